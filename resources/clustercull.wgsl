@@ -0,0 +1,119 @@
+/**
+ * Culling of the meshlets of batches with few instances, see ClusterCuller. Each workgroup
+ * tests one meshlet of a batch, each invocation against one instance of the batch, and copies
+ * the indices of the meshlet to the compacted indices of the batch when any instance may see it.
+ */
+
+struct ClusterUniforms {
+    // Inside when dot(xyz, position) + w >= 0
+    planes: array<vec4f, 6>,
+    cameraPosition: vec4f,
+    workgroupCount: u32,
+    isEnabled: u32,
+};
+
+// Layout of Scene::InstanceData
+struct InstanceData {
+    modelMatrix: mat4x4f,
+};
+
+// Layout of MeshMeshlet
+struct Meshlet {
+    // Center in xyz and radius in w
+    boundingSphere: vec4f,
+    // Axis in xyz and cutoff in w
+    normalCone: vec4f,
+    firstIndex: u32,
+    triangleCount: u32,
+};
+
+// Layout of ClusterCuller::BatchData
+struct ClusterBatch {
+    firstMeshlet: u32,
+    firstWorkgroup: u32,
+    firstInstance: u32,
+    instanceCount: u32,
+    firstIndex: u32,
+};
+
+@group(0) @binding(0) var<uniform> uCluster: ClusterUniforms;
+@group(0) @binding(1) var<storage, read> instances: array<InstanceData>;
+@group(0) @binding(2) var<storage, read> meshlets: array<Meshlet>;
+@group(0) @binding(3) var<storage, read> sourceIndices: array<u32>;
+@group(0) @binding(4) var<storage, read> batches: array<ClusterBatch>;
+// Batch of each workgroup
+@group(0) @binding(5) var<storage, read> workgroupBatches: array<u32>;
+@group(0) @binding(6) var<storage, read_write> indices: array<u32>;
+// Number of compacted indices of each batch, the index count of its draws
+@group(0) @binding(7) var<storage, read_write> indexCounts: array<atomic<u32>>;
+
+// Must match ClusterCuller::kMaxInstanceCount
+const kWorkgroupSize = 64u;
+
+// Whether any instance may see the meshlet
+var<workgroup> isMeshletVisible: atomic<u32>;
+// First compacted index of the meshlet plus one, zero when it is culled
+var<workgroup> meshletOutput: u32;
+
+fn isVisible(meshlet: Meshlet, instance: u32) -> bool {
+    let modelMatrix = instances[instance].modelMatrix;
+    let center = (modelMatrix * vec4f(meshlet.boundingSphere.xyz, 1.0)).xyz;
+    let scales = vec3f(dot(modelMatrix[0].xyz, modelMatrix[0].xyz),
+                       dot(modelMatrix[1].xyz, modelMatrix[1].xyz),
+                       dot(modelMatrix[2].xyz, modelMatrix[2].xyz));
+    let maxScale = max(max(scales.x, scales.y), scales.z);
+    let radius = meshlet.boundingSphere.w * sqrt(maxScale);
+
+    for (var i = 0u; i < 6u; i++) {
+        let plane = uCluster.planes[i];
+        if (dot(plane.xyz, center) + plane.w < -radius) {
+            return false;
+        }
+    }
+
+    // The cone only keeps its angle under uniform scales
+    let cone = meshlet.normalCone;
+    let minScale = min(min(scales.x, scales.y), scales.z);
+    if (cone.w < 1.0 && maxScale <= minScale * 1.001) {
+        let axis = normalize((modelMatrix * vec4f(cone.xyz, 0.0)).xyz);
+        let offset = center - uCluster.cameraPosition.xyz;
+        if (dot(offset, axis) >= cone.w * length(offset) + radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+@compute @workgroup_size(kWorkgroupSize)
+fn cs_main(@builtin(workgroup_id) workgroupId: vec3u,
+           @builtin(num_workgroups) workgroupCounts: vec3u,
+           @builtin(local_invocation_index) localIndex: u32) {
+    // Workgroups wrap along y past the limit of a dimension
+    let workgroup = workgroupId.y * workgroupCounts.x + workgroupId.x;
+    if (workgroup >= uCluster.workgroupCount) {
+        return;
+    }
+
+    let batchIndex = workgroupBatches[workgroup];
+    let batch = batches[batchIndex];
+    let meshlet = meshlets[batch.firstMeshlet + workgroup - batch.firstWorkgroup];
+    if (localIndex < batch.instanceCount
+        && (uCluster.isEnabled == 0u || isVisible(meshlet, batch.firstInstance + localIndex))) {
+        atomicOr(&isMeshletVisible, 1u);
+    }
+    workgroupBarrier();
+
+    let indexCount = 3u * meshlet.triangleCount;
+    if (localIndex == 0u && atomicLoad(&isMeshletVisible) != 0u) {
+        // Meshlets of a batch land in any order, which only matters for blending
+        meshletOutput = batch.firstIndex + atomicAdd(&indexCounts[batchIndex], indexCount) + 1u;
+    }
+    let output = workgroupUniformLoad(&meshletOutput);
+    if (output == 0u) {
+        return;
+    }
+
+    for (var i = localIndex; i < indexCount; i += kWorkgroupSize) {
+        indices[output - 1u + i] = sourceIndices[meshlet.firstIndex + i];
+    }
+}
@@ -0,0 +1,208 @@
+/**
+ * Frustum and occlusion culling of scene instances, see GpuCuller. Each invocation tests the
+ * bounding sphere of one instance and appends the visible ones to the range of their batch in
+ * visibleInstances, counting them in the arguments of the indirect draw of the batch.
+ *
+ * With occlusion culling, cs_early only keeps the instances visible last frame, which are drawn
+ * and reduced into the depth pyramid. cs_late then tests every instance against the pyramid,
+ * records its visibility for the next frame, and keeps the visible ones cs_early missed.
+ *
+ * Each batch has one draw per level of detail of its mesh, visible instances being appended
+ * to the draw of the coarsest level whose error projects to at most lodThreshold pixels.
+ */
+
+struct CullUniforms {
+    // Inside when dot(xyz, position) + w >= 0
+    planes: array<vec4f, 6>,
+    viewMatrix: mat4x4f,
+    // Elements [0][0], [1][1], [2][2] and [3][2] of the projection matrix
+    projection: vec4f,
+    instanceCount: u32,
+    // Draws of each phase, those of cs_late following those of cs_early
+    drawCount: u32,
+    isEnabled: u32,
+    isOcclusionEnabled: u32,
+    depthSize: vec2u,
+    // Negative to always draw the finest level
+    lodThreshold: f32,
+};
+
+// Must match kMaxMeshLodCount
+const kMaxLodCount = 6u;
+
+// Layout of GpuCuller::BatchData
+struct CullBatch {
+    // Bounding sphere of the mesh, center in xyz and radius in w
+    boundingSphere: vec4f,
+    // Draw of the finest level, followed by the others
+    firstDraw: u32,
+    lodCount: u32,
+    // Bound on the error of each level, in the space of the mesh
+    lodErrors: array<f32, kMaxLodCount>,
+};
+
+// Layout of Scene::InstanceData
+struct InstanceData {
+    modelMatrix: mat4x4f,
+};
+
+// Layout of the arguments of drawIndexedIndirect
+struct DrawArgs {
+    indexCount: u32,
+    instanceCount: atomic<u32>,
+    firstIndex: u32,
+    baseVertex: i32,
+    firstInstance: u32,
+};
+
+@group(0) @binding(0) var<uniform> uCull: CullUniforms;
+@group(0) @binding(1) var<storage, read> instances: array<InstanceData>;
+// Batch of each instance
+@group(0) @binding(2) var<storage, read> instanceBatches: array<u32>;
+@group(0) @binding(3) var<storage, read> batches: array<CullBatch>;
+// The draws of cs_early, followed by those of cs_late
+@group(0) @binding(4) var<storage, read_write> drawArgs: array<DrawArgs>;
+@group(0) @binding(5) var<storage, read_write> visibleInstances: array<u32>;
+// Whether each instance was visible last frame
+@group(0) @binding(6) var<storage, read_write> instanceVisibility: array<u32>;
+// Instances of each batch inside the frustum, for statistics
+@group(0) @binding(7) var<storage, read_write> frustumCounts: array<atomic<u32>>;
+@group(0) @binding(8) var depthPyramid: texture_2d<f32>;
+
+struct Sphere {
+    center: vec3f,
+    radius: f32,
+    // Largest axis scale of the instance
+    scale: f32,
+};
+
+fn getWorldSphere(instance: u32, batch: u32) -> Sphere {
+    let modelMatrix = instances[instance].modelMatrix;
+    let sphere = batches[batch].boundingSphere;
+    let center = (modelMatrix * vec4f(sphere.xyz, 1.0)).xyz;
+    // The largest axis scale keeps the sphere conservative under non-uniform scales, as on the CPU
+    let scale = sqrt(max(max(dot(modelMatrix[0].xyz, modelMatrix[0].xyz),
+                             dot(modelMatrix[1].xyz, modelMatrix[1].xyz)),
+                         dot(modelMatrix[2].xyz, modelMatrix[2].xyz)));
+    return Sphere(center, sphere.w * scale, scale);
+}
+
+fn isInFrustum(sphere: Sphere) -> bool {
+    for (var i = 0u; i < 6u; i++) {
+        let plane = uCull.planes[i];
+        if (dot(plane.xyz, sphere.center) + plane.w < -sphere.radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Range of screen coordinates a tangent line of a view space circle projects to, along x or y
+ * (a) with depth z. The tangent directions are the direction of the center rotated by the half
+ * angle of the circle, which is well defined while the circle lies in front of the camera.
+ */
+fn projectCircle(a: f32, z: f32, radius: f32, scale: f32) -> vec2f {
+    let tangent = sqrt(a * a + z * z - radius * radius);
+    let minimum = (tangent * a - radius * z) / (tangent * z + radius * a);
+    let maximum = (tangent * a + radius * z) / (tangent * z - radius * a);
+    return vec2f(minimum, maximum) * scale;
+}
+
+fn isOccluded(sphere: Sphere) -> bool {
+    let center = (uCull.viewMatrix * vec4f(sphere.center, 1.0)).xyz;
+    let radius = sphere.radius;
+    // Spheres crossing the near plane cover too much of the screen to be worth testing
+    let near = -uCull.projection.w / uCull.projection.z;
+    if (center.z - radius < near) {
+        return false;
+    }
+
+    // Bounds in normalized device coordinates, then in depth texels, y pointing down
+    let rangeX = projectCircle(center.x, center.z, radius, uCull.projection.x);
+    let rangeY = projectCircle(center.y, center.z, radius, uCull.projection.y);
+    let uvMin = clamp(vec2f(rangeX.x, -rangeY.y) * 0.5 + 0.5, vec2f(0.0), vec2f(1.0));
+    let uvMax = clamp(vec2f(rangeX.y, -rangeY.x) * 0.5 + 0.5, vec2f(0.0), vec2f(1.0));
+    let texelMin = min(vec2u(uvMin * vec2f(uCull.depthSize)), uCull.depthSize - 1u);
+    let texelMax = min(vec2u(uvMax * vec2f(uCull.depthSize)), uCull.depthSize - 1u);
+
+    // The level where the footprint spans at most 2x2 texels, see DepthPyramid
+    let span = max(texelMax.x - texelMin.x, texelMax.y - texelMin.y) + 1u;
+    let levelCount = textureNumLevels(depthPyramid);
+    let level = min(select(0u, firstLeadingBit(span - 1u), span > 1u), levelCount - 1u);
+    let levelSize = textureDimensions(depthPyramid, level);
+    let first = min(texelMin >> vec2u(level + 1u), levelSize - 1u);
+    let last = min(texelMax >> vec2u(level + 1u), levelSize - 1u);
+    let depth = max(max(textureLoad(depthPyramid, first, level).r,
+                        textureLoad(depthPyramid, vec2u(last.x, first.y), level).r),
+                    max(textureLoad(depthPyramid, vec2u(first.x, last.y), level).r,
+                        textureLoad(depthPyramid, last, level).r));
+
+    // Depth of the nearest point of the sphere
+    let sphereDepth = uCull.projection.z + uCull.projection.w / (center.z - radius);
+    return sphereDepth > depth;
+}
+
+/**
+ * Draw of the coarsest level of detail of a batch whose error projects to at most
+ * lodThreshold pixels at the nearest point of the sphere, or of the finest inside it
+ */
+fn selectDraw(sphere: Sphere, batch: u32) -> u32 {
+    let firstDraw = batches[batch].firstDraw;
+    let nearest = length((uCull.viewMatrix * vec4f(sphere.center, 1.0)).xyz) - sphere.radius;
+    if (nearest <= 0.0) {
+        return firstDraw;
+    }
+
+    // Pixels covered by a unit of the space of the mesh at that distance
+    let pixelsPerUnit = sphere.scale * uCull.projection.y * 0.5 * f32(uCull.depthSize.y) / nearest;
+    var lod = 0u;
+    while (lod + 1u < batches[batch].lodCount
+           && batches[batch].lodErrors[lod + 1u] * pixelsPerUnit <= uCull.lodThreshold) {
+        lod++;
+    }
+    return firstDraw + lod;
+}
+
+fn appendVisible(instance: u32, drawIndex: u32) {
+    // Instances of a batch land in any order, which only matters for blending
+    let index = atomicAdd(&drawArgs[drawIndex].instanceCount, 1u);
+    visibleInstances[drawArgs[drawIndex].firstInstance + index] = instance;
+}
+
+@compute @workgroup_size(64)
+fn cs_early(@builtin(global_invocation_id) id: vec3u) {
+    let instance = id.x;
+    if (instance >= uCull.instanceCount) {
+        return;
+    }
+
+    let batch = instanceBatches[instance];
+    let sphere = getWorldSphere(instance, batch);
+    if (uCull.isEnabled != 0u && !isInFrustum(sphere)) {
+        return;
+    }
+    atomicAdd(&frustumCounts[batch], 1u);
+
+    if (uCull.isOcclusionEnabled == 0u || instanceVisibility[instance] != 0u) {
+        appendVisible(instance, selectDraw(sphere, batch));
+    }
+}
+
+@compute @workgroup_size(64)
+fn cs_late(@builtin(global_invocation_id) id: vec3u) {
+    let instance = id.x;
+    if (instance >= uCull.instanceCount) {
+        return;
+    }
+
+    let batch = instanceBatches[instance];
+    let sphere = getWorldSphere(instance, batch);
+    let isVisible = isInFrustum(sphere) && !isOccluded(sphere);
+    let wasVisible = instanceVisibility[instance] != 0u;
+    instanceVisibility[instance] = select(0u, 1u, isVisible);
+
+    if (isVisible && !wasVisible) {
+        appendVisible(instance, uCull.drawCount + selectDraw(sphere, batch));
+    }
+}
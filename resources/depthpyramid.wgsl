@@ -0,0 +1,55 @@
+/**
+ * Reduce the depth buffer into a pyramid of farthest depths, see DepthPyramid. Each texel holds
+ * the maximum of the 2x2 texels it covers in the level below, level 0 covering the depth
+ * buffer. Mip sizes round down, so the last texel along an axis also covers the texel left
+ * over by an odd size, and any depth texel x is covered by texel min(x >> (level + 1), size - 1)
+ * of every level.
+ */
+
+@group(0) @binding(0) var depthTexture: texture_depth_2d;
+@group(0) @binding(1) var previousLevel: texture_2d<f32>;
+@group(0) @binding(2) var nextLevel: texture_storage_2d<r32float, write>;
+
+// Must match kWorkgroupSize in DepthPyramid.cpp
+const kWorkgroupSize = 8u;
+
+// Texels of the level below covered by texel id of a level of size nextSize
+fn getLastTexel(id: vec2u, nextSize: vec2u, size: vec2u) -> vec2u {
+    return select(min(2u * id + 1u, size - 1u), size - 1u, id == nextSize - 1u);
+}
+
+@compute @workgroup_size(kWorkgroupSize, kWorkgroupSize)
+fn cs_first(@builtin(global_invocation_id) id: vec3u) {
+    let nextSize = textureDimensions(nextLevel);
+    if (any(id.xy >= nextSize)) {
+        return;
+    }
+
+    let size = textureDimensions(depthTexture);
+    let last = getLastTexel(id.xy, nextSize, size);
+    var depth = 0.0;
+    for (var y = 2u * id.y; y <= last.y; y++) {
+        for (var x = 2u * id.x; x <= last.x; x++) {
+            depth = max(depth, textureLoad(depthTexture, vec2u(x, y), 0));
+        }
+    }
+    textureStore(nextLevel, id.xy, vec4f(depth, 0.0, 0.0, 1.0));
+}
+
+@compute @workgroup_size(kWorkgroupSize, kWorkgroupSize)
+fn cs_next(@builtin(global_invocation_id) id: vec3u) {
+    let nextSize = textureDimensions(nextLevel);
+    if (any(id.xy >= nextSize)) {
+        return;
+    }
+
+    let size = textureDimensions(previousLevel);
+    let last = getLastTexel(id.xy, nextSize, size);
+    var depth = 0.0;
+    for (var y = 2u * id.y; y <= last.y; y++) {
+        for (var x = 2u * id.x; x <= last.x; x++) {
+            depth = max(depth, textureLoad(previousLevel, vec2u(x, y), 0).r);
+        }
+    }
+    textureStore(nextLevel, id.xy, vec4f(depth, 0.0, 0.0, 1.0));
+}
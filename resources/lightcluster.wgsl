@@ -0,0 +1,91 @@
+/**
+ * Binning of the lights into the clusters of the view frustum, see LightClusterer. Each
+ * invocation lists the lights reaching one cluster, the lights being loaded by the workgroup in
+ * turn and transformed to view space once for all of its clusters.
+ */
+
+// Layout of LightClusterer::ClusterUniforms
+struct ClusterUniforms {
+    viewMatrix: mat4x4f,
+    // Clusters per pixel in xy, the slice of a view depth being log(depth) * z + w
+    clusterScale: vec4f,
+    // View space xy per unit of depth at the edges of the screen, and the near and far planes
+    projectionScale: vec4f,
+    // Clusters along each axis, and the light count in w
+    clusterCounts: vec4u,
+};
+
+// Layout of LightClusterer::Light
+struct Light {
+    positionRange: vec4f,
+    colorSpotScale: vec4f,
+    directionSpotOffset: vec4f,
+};
+
+@group(0) @binding(0) var<uniform> uCluster: ClusterUniforms;
+@group(0) @binding(1) var<storage, read> lights: array<Light>;
+// Light count of each cluster followed by the indices of its lights
+@group(0) @binding(2) var<storage, read_write> clusterLights: array<u32>;
+
+// Must match LightClusterer::kMaxLightsPerCluster
+const kMaxLightsPerCluster = 63u;
+const kWorkgroupSize = 64u;
+
+// Lights of the current chunk, their view space center in xyz and their range in w
+var<workgroup> chunkLights: array<vec4f, kWorkgroupSize>;
+
+fn getSliceDepth(slice: u32) -> f32 {
+    let nearPlane = uCluster.projectionScale.z;
+    let farPlane = uCluster.projectionScale.w;
+    return nearPlane * pow(farPlane / nearPlane, f32(slice) / f32(uCluster.clusterCounts.z));
+}
+
+@compute @workgroup_size(kWorkgroupSize)
+fn cs_main(@builtin(global_invocation_id) invocationId: vec3u,
+           @builtin(local_invocation_index) localIndex: u32) {
+    let counts = uCluster.clusterCounts;
+    let cluster = invocationId.x;
+    let isCluster = cluster < counts.x * counts.y * counts.z;
+
+    // Bounding box of the cluster in view space, rows of tiles going down the screen
+    let tile = vec3u(cluster % counts.x,
+                     (cluster / counts.x) % counts.y,
+                     cluster / (counts.x * counts.y));
+    let ndcMin = vec2f(2.0 * f32(tile.x) / f32(counts.x) - 1.0,
+                       1.0 - 2.0 * f32(tile.y + 1u) / f32(counts.y));
+    let ndcMax = vec2f(2.0 * f32(tile.x + 1u) / f32(counts.x) - 1.0,
+                       1.0 - 2.0 * f32(tile.y) / f32(counts.y));
+    let nearDepth = getSliceDepth(tile.z);
+    let farDepth = getSliceDepth(tile.z + 1u);
+    let scale = uCluster.projectionScale.xy;
+    let boxMin = vec3f(min(ndcMin * nearDepth, ndcMin * farDepth) * scale, nearDepth);
+    let boxMax = vec3f(max(ndcMax * nearDepth, ndcMax * farDepth) * scale, farDepth);
+
+    let output = cluster * (kMaxLightsPerCluster + 1u);
+    var count = 0u;
+    for (var firstLight = 0u; firstLight < counts.w; firstLight += kWorkgroupSize) {
+        let index = firstLight + localIndex;
+        if (index < counts.w) {
+            let light = lights[index].positionRange;
+            let center = uCluster.viewMatrix * vec4f(light.xyz, 1.0);
+            chunkLights[localIndex] = vec4f(center.xyz, light.w);
+        }
+        workgroupBarrier();
+
+        let chunkSize = min(counts.w - firstLight, kWorkgroupSize);
+        for (var i = 0u; isCluster && i < chunkSize && count < kMaxLightsPerCluster; i++) {
+            // Distance from the center of the light to the closest point of the box
+            let sphere = chunkLights[i];
+            let offset = clamp(sphere.xyz, boxMin, boxMax) - sphere.xyz;
+            if (dot(offset, offset) <= sphere.w * sphere.w) {
+                clusterLights[output + 1u + count] = firstLight + i;
+                count++;
+            }
+        }
+        workgroupBarrier();
+    }
+
+    if (isCluster) {
+        clusterLights[output] = count;
+    }
+}
@@ -0,0 +1,75 @@
+/**
+ * Downsample one mip level of an RGBA8 texture into the next one, with the same filter as
+ * MipMapGenerator on the CPU: a 2x2 box along even axes, and 3 weighted taps along odd axes
+ * so that every source texel contributes equally.
+ */
+
+// Average colors in linear space, for textures holding sRGB encoded colors
+override isSrgb: bool = false;
+
+@group(0) @binding(0) var previousLevel: texture_2d<f32>;
+@group(0) @binding(1) var nextLevel: texture_storage_2d<rgba8unorm, write>;
+
+/**
+ * Source texels first, first + 1 and first + 2 contributing to destination texel i along an
+ * axis, and their weights
+ */
+struct FilterTaps {
+    first: u32,
+    weights: vec3f,
+};
+
+fn computeFilterTaps(sourceSize: u32, i: u32) -> FilterTaps {
+    if (sourceSize == 1u) {
+        return FilterTaps(0u, vec3f(1.0, 0.0, 0.0));
+    }
+    if (sourceSize % 2u == 0u) {
+        return FilterTaps(2u * i, vec3f(0.5, 0.5, 0.0));
+    }
+    let n = f32(sourceSize / 2u);
+    return FilterTaps(2u * i, vec3f(n - f32(i), n, f32(i) + 1.0) / f32(sourceSize));
+}
+
+fn srgbToLinear(c: vec3f) -> vec3f {
+    return select(pow((c + 0.055) / 1.055, vec3f(2.4)), c / 12.92, c <= vec3f(0.04045));
+}
+
+fn linearToSrgb(c: vec3f) -> vec3f {
+    return select(1.055 * pow(c, vec3f(1.0 / 2.4)) - 0.055, c * 12.92, c <= vec3f(0.0031308));
+}
+
+fn loadTexel(coord: vec2u) -> vec4f {
+    let texel = textureLoad(previousLevel, coord, 0);
+    if (isSrgb) {
+        return vec4f(srgbToLinear(texel.rgb), texel.a);
+    }
+    return texel;
+}
+
+@compute @workgroup_size(8, 8)
+fn cs_main(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(nextLevel);
+    if (any(id.xy >= size)) {
+        return;
+    }
+
+    let sourceSize = textureDimensions(previousLevel);
+    let tapsX = computeFilterTaps(sourceSize.x, id.x);
+    let tapsY = computeFilterTaps(sourceSize.y, id.y);
+
+    var color = vec4f(0.0);
+    for (var y = 0u; y < 3u; y++) {
+        for (var x = 0u; x < 3u; x++) {
+            let weight = tapsX.weights[x] * tapsY.weights[y];
+            // Taps with a zero weight may lie outside of the source level
+            if (weight > 0.0) {
+                color += weight * loadTexel(vec2u(tapsX.first + x, tapsY.first + y));
+            }
+        }
+    }
+
+    if (isSrgb) {
+        color = vec4f(linearToSrgb(color.rgb), color.a);
+    }
+    textureStore(nextLevel, id.xy, color);
+}
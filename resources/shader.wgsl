@@ -1,3 +1,13 @@
+// Variants are expanded by the shadercompiler tool, see ShaderVariants.h: half precision
+// shading is selected by the F16 define, the other features by the override constants below
+#if F16
+enable f16;
+alias real = f16;
+#else
+alias real = f32;
+#endif
+
+// Positions come from their own vertex buffer, the other attributes from a second one
 struct VertexInput {
     @location(0) position: vec3f,
     @location(1) tangent: vec3f,
@@ -7,23 +17,41 @@ struct VertexInput {
     @location(5) uv: vec2f,
 };
 
+// Layout of PackedVertexAttributes
+struct PackedVertexInput {
+    @location(0) position: vec4f,
+    @location(1) normal: vec2f,
+    @location(2) tangent: vec2f,
+    @location(3) color: vec4f,
+    @location(4) uv: vec2f,
+};
+
 struct VertexOutput {
-    @builtin(position) position: vec4f,
+    // Invariant so that the shading after a depth prepass passes its equal depth test
+    @invariant @builtin(position) position: vec4f,
     @location(0) color: vec3f,
     @location(1) tangent: vec3f,
     @location(2) bitangent: vec3f,
     @location(3) normal: vec3f,
     @location(4) uv: vec2f,
     @location(5) viewDirection: vec3f,
+    // Distance along the view axis, which selects the slice of the light clusters
+    @location(6) viewDepth: f32,
 };
 
 struct MyUniforms {
     projectionMatrix: mat4x4f,
     viewMatrix: mat4x4f,
-    modelMatrix: mat4x4f,
     color: vec4f,
     cameraWorldPosition: vec3f,
     time: f32,
+    positionScale: vec4f,
+    positionOffset: vec4f,
+};
+
+// Layout of Scene::InstanceData
+struct InstanceData {
+    modelMatrix: mat4x4f,
 };
 
 struct LightingUniforms {
@@ -34,70 +62,183 @@ struct LightingUniforms {
     ks: f32,
 };
 
+// Layout of LightClusterer::ClusterUniforms
+struct ClusterUniforms {
+    viewMatrix: mat4x4f,
+    // Clusters per pixel in xy, the slice of a view depth being log(depth) * z + w
+    clusterScale: vec4f,
+    projectionScale: vec4f,
+    // Clusters along each axis, and the light count in w
+    clusterCounts: vec4u,
+};
+
+// Layout of LightClusterer::Light
+struct Light {
+    positionRange: vec4f,
+    colorSpotScale: vec4f,
+    directionSpotOffset: vec4f,
+};
+
 @group(0) @binding(0) var<uniform> uMyUniforms: MyUniforms;
 @group(0) @binding(1) var baseColorTexture: texture_2d<f32>;
 @group(0) @binding(2) var normalTexture: texture_2d<f32>;
 @group(0) @binding(3) var textureSampler: sampler;
 @group(0) @binding(4) var<uniform> uLighting: LightingUniforms;
+@group(0) @binding(5) var<storage, read> instances: array<InstanceData>;
+// Instances left by the culling passes, each early and late draw listing its visible ones from
+// its first instance
+@group(0) @binding(6) var<storage, read> visibleInstances: array<u32>;
+// Point and spot lights, and the lights reaching each cluster listed by lightcluster.wgsl
+@group(0) @binding(7) var<storage, read> lights: array<Light>;
+@group(0) @binding(8) var<storage, read> clusterLights: array<u32>;
+@group(0) @binding(9) var<uniform> uClusters: ClusterUniforms;
 
 const PI = 3.14159265359;
 
-@vertex
-fn vs_main(in: VertexInput) -> VertexOutput {
+// Number of directional lights shaded, at most the size of the LightingUniforms arrays
+override kLightCount: u32 = 2;
+// Must match LightClusterer::kMaxLightsPerCluster
+const kMaxLightsPerCluster = 63u;
+// Without normal mapping the normal texture is not sampled
+override kNormalMapping: bool = true;
+
+fn getModelMatrix(instanceIndex: u32) -> mat4x4f {
+    // instance_index starts at the first instance of the batch, see cull.wgsl
+    return instances[visibleInstances[instanceIndex]].modelMatrix;
+}
+
+// Shared by the depth and shading entry points, which must compute the same clip positions
+fn getClipPosition(worldPosition: vec4f) -> vec4f {
+    return uMyUniforms.projectionMatrix * uMyUniforms.viewMatrix * worldPosition;
+}
+
+fn decodePosition(position: vec4f) -> vec3f {
+    return position.xyz * uMyUniforms.positionScale.xyz + uMyUniforms.positionOffset.xyz;
+}
+
+fn transformVertex(instanceIndex: u32, position: vec3f, tangent: vec3f, bitangent: vec3f, normal: vec3f, color: vec3f, uv: vec2f) -> VertexOutput {
     var out: VertexOutput;
 
-    let worldPosition = uMyUniforms.modelMatrix * vec4f(in.position, 1.0);
-    out.position = uMyUniforms.projectionMatrix * uMyUniforms.viewMatrix * worldPosition;
+    let modelMatrix = getModelMatrix(instanceIndex);
+    let worldPosition = modelMatrix * vec4f(position, 1.0);
+    out.position = getClipPosition(worldPosition);
+    out.viewDepth = out.position.w;
     
-    out.color = in.color;
-    out.tangent = (uMyUniforms.modelMatrix * vec4f(in.tangent, 0.0)).xyz;
-    out.bitangent = (uMyUniforms.modelMatrix * vec4f(in.bitangent, 0.0)).xyz;
-    out.normal = (uMyUniforms.modelMatrix * vec4f(in.normal, 0.0)).xyz;
-    out.uv = in.uv;
+    out.color = color;
+    out.tangent = (modelMatrix * vec4f(tangent, 0.0)).xyz;
+    out.bitangent = (modelMatrix * vec4f(bitangent, 0.0)).xyz;
+    out.normal = (modelMatrix * vec4f(normal, 0.0)).xyz;
+    out.uv = uv;
 
     let cameraWorldPosition = uMyUniforms.cameraWorldPosition;
     out.viewDirection = cameraWorldPosition - worldPosition.xyz;
     return out;
 }
 
-@fragment
-fn fs_main(in: VertexOutput) -> @location(0) vec4f {
-    // Sample normal
-    let normalMapStrength = 1.0;
-    let encodedN = textureSample(normalTexture, textureSampler, in.uv).rgb;
-    let localN = encodedN * 2.0 - 1.0;
-    // The TBN matrix converts directions from the local space to the world space
-    let localToWorld = mat3x3f(
-        normalize(in.tangent),
-        normalize(in.bitangent),
-        normalize(in.normal),
-    );
-    let worldN = localToWorld * localN;
-    let N = mix(in.normal, worldN, normalMapStrength);
-
-    let V = normalize(in.viewDirection);
+// Inverse of the octahedral mapping done on the CPU
+fn decodeOctahedral(e: vec2f) -> vec3f {
+    var n = vec3f(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+    let t = max(-n.z, 0.0);
+    n.x += select(t, -t, n.x >= 0.0);
+    n.y += select(t, -t, n.y >= 0.0);
+    return normalize(n);
+}
 
-    // Sample texture
-    let baseColor = textureSample(baseColorTexture, textureSampler, in.uv).rgb;
-    let kd = uLighting.kd; // strength of the diffuse effect
-    let ks = uLighting.ks; // strength of the specular effect
-    let hardness = uLighting.hardness;
+@vertex
+fn vs_main(in: VertexInput, @builtin(instance_index) instanceIndex: u32) -> VertexOutput {
+    return transformVertex(instanceIndex, in.position, in.tangent, in.bitangent, in.normal, in.color, in.uv);
+}
+
+@vertex
+fn vs_main_packed(in: PackedVertexInput, @builtin(instance_index) instanceIndex: u32) -> VertexOutput {
+    let position = decodePosition(in.position);
+    let normal = decodeOctahedral(in.normal);
+    let tangent = decodeOctahedral(in.tangent);
+    let bitangent = cross(normal, tangent);
+    return transformVertex(instanceIndex, position, tangent, bitangent, normal, in.color.rgb, in.uv);
+}
+
+// Depth prepass, which only fetches the position buffer
+@vertex
+fn vs_depth(@location(0) position: vec3f, @builtin(instance_index) instanceIndex: u32) -> @invariant @builtin(position) vec4f {
+    return getClipPosition(getModelMatrix(instanceIndex) * vec4f(position, 1.0));
+}
+
+@vertex
+fn vs_depth_packed(@location(0) position: vec4f, @builtin(instance_index) instanceIndex: u32) -> @invariant @builtin(position) vec4f {
+    return getClipPosition(getModelMatrix(instanceIndex) * vec4f(decodePosition(position), 1.0));
+}
+
+// Phong shading of a light coming from the direction L
+fn shade(L: vec3<real>, N: vec3<real>, V: vec3<real>, lightColor: vec3<real>, baseColor: vec3<real>, kd: real, ks: real, hardness: real) -> vec3<real> {
+    let R = reflect(-L, N); // equivalent to 2.0 * dot(N, L) * N - L
 
-    var color = vec3f(0.0);
-    for (var i: i32 = 0; i < 2; i++) {
-        let lightColor = uLighting.colors[i].rgb;
+    let diffuse = max(real(0.0), dot(L, N)) * lightColor;
 
-        let L = normalize(uLighting.directions[i].xyz);
-        let R = reflect(-L, N); // equivalent to 2.0 * dot(N, L) * N - L
+    // We clamp the dot product to 0 when it is negative
+    let RoV = max(real(0.0), dot(R, V));
+    let specular = pow(RoV, hardness) * lightColor;
 
-        let diffuse = max(0.0, dot(L, N)) * lightColor;
+    return baseColor * kd * diffuse + ks * specular;
+}
 
-        // We clamp the dot product to 0 when it is negative
-        let RoV = max(0.0, dot(R, V));
-        let specular = pow(RoV, hardness);
+@fragment
+fn fs_main(in: VertexOutput) -> @location(0) vec4f {
+    var N = normalize(in.normal);
+    if (kNormalMapping) {
+        // Only X and Y are stored (BC5), Z is rebuilt knowing the normal has unit length
+        let encodedN = textureSample(normalTexture, textureSampler, in.uv).rg;
+        let localXY = encodedN * 2.0 - 1.0;
+        let localN = vec3f(localXY, sqrt(max(0.0, 1.0 - dot(localXY, localXY))));
+        // The TBN matrix converts directions from the local space to the world space
+        let localToWorld = mat3x3f(
+            normalize(in.tangent),
+            normalize(in.bitangent),
+            normalize(in.normal),
+        );
+        N = localToWorld * localN;
+    }
+
+    let V = vec3<real>(normalize(in.viewDirection));
+
+    // Sample texture
+    let baseColor = vec3<real>(textureSample(baseColorTexture, textureSampler, in.uv).rgb);
+    let kd = real(uLighting.kd); // strength of the diffuse effect
+    let ks = real(uLighting.ks); // strength of the specular effect
+    let hardness = real(uLighting.hardness);
+
+    var color = vec3<real>(0.0);
+    for (var i = 0u; i < kLightCount; i++) {
+        let lightColor = vec3<real>(uLighting.colors[i].rgb);
+        let L = vec3<real>(normalize(uLighting.directions[i].xyz));
+        color += shade(L, vec3<real>(N), V, lightColor, baseColor, kd, ks, hardness);
+    }
 
-        color += baseColor * kd * diffuse + ks * specular;
+    // Point and spot lights of the cluster of the fragment
+    let counts = uClusters.clusterCounts;
+    let scale = uClusters.clusterScale;
+    let tile = min(vec2u(in.position.xy * scale.xy), counts.xy - 1u);
+    let slice = min(u32(max(log(in.viewDepth) * scale.z + scale.w, 0.0)), counts.z - 1u);
+    let cluster = (slice * counts.y + tile.y) * counts.x + tile.x;
+    let clusterStart = cluster * (kMaxLightsPerCluster + 1u);
+    let worldPosition = uMyUniforms.cameraWorldPosition - in.viewDirection;
+    for (var i = 0u; i < clusterLights[clusterStart]; i++) {
+        let light = lights[clusterLights[clusterStart + 1u + i]];
+        let toLight = light.positionRange.xyz - worldPosition;
+        let distance2 = dot(toLight, toLight);
+        let L = toLight * inverseSqrt(distance2);
+
+        // Inverse square falloff kept finite near the light, windowed to reach zero at its range
+        let ratio2 = distance2 / (light.positionRange.w * light.positionRange.w);
+        let window = saturate(1.0 - ratio2 * ratio2);
+        var attenuation = window * window / (1.0 + distance2);
+        let cone = saturate(dot(-L, light.directionSpotOffset.xyz) * light.colorSpotScale.w
+                            + light.directionSpotOffset.w);
+        attenuation *= cone * cone;
+
+        let lightColor = vec3<real>(light.colorSpotScale.rgb * attenuation);
+        color += shade(vec3<real>(L), vec3<real>(N), V, lightColor, baseColor, kd, ks, hardness);
     }
 
-    return vec4f(color, 1.0);
+    return vec4f(vec3f(color), 1.0);
 }
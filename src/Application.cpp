@@ -1,5 +1,15 @@
 #include "Application.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <glm/gtx/color_space.hpp>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <span>
 #include <vector>
 
 #include <imgui.h>
@@ -11,12 +21,42 @@
     #include <emscripten/html5.h>
 #endif
 
+#include "MemoryUsage.h"
+#include "MeshCache.h"
 #include "ResourceManager.h"
+#include "ShaderVariants.h"
+#include "VertexLayout.h"
 #include "WebGPUUtils.h"
 #include "sdl3webgpu.h"
 
 constexpr float PI = 3.14159265358979323846f;
 
+// Directory and size budget of the compiled shader and pipeline cache
+constexpr const char* kPipelineCacheDirectory = "pipeline_cache";
+constexpr uint64_t kPipelineCacheMaxSize      = 64 * 1024 * 1024;
+
+// Shader of the render pipeline, reloaded from the source tree when it is edited
+constexpr const char* kShaderName       = "shader";
+constexpr const char* kShaderSourceName = "shader.wgsl";
+constexpr std::chrono::milliseconds kShaderWatchInterval(250);
+
+// Blocks of the uniform ring, in binding order
+constexpr UniformRing::Block kUniformsBlock = 0;
+constexpr UniformRing::Block kLightingBlock = 1;
+// Slices of the uniform ring, each needing render bundles of its own, see UniformRing
+constexpr uint32_t kFramesInFlight = 3;
+
+// Size of the buffers the meshes are suballocated from, larger meshes get a buffer of their own
+constexpr uint64_t kVertexSlabSize = 32 * 1024 * 1024;
+constexpr uint64_t kIndexSlabSize  = 16 * 1024 * 1024;
+// Fragmentation of a pool above which its ranges are repacked, see BufferPool::Stats
+constexpr float kMaxPoolFragmentation = 0.25f;
+
+constexpr const char* kCullShaderName         = "cull.wgsl";
+constexpr const char* kDepthPyramidShaderName = "depthpyramid.wgsl";
+constexpr const char* kClusterCullShaderName  = "clustercull.wgsl";
+constexpr const char* kLightClusterShaderName = "lightcluster.wgsl";
+
 namespace ImGui
 {
     bool DragDirection(const char* label, glm::vec4& direction)
@@ -30,9 +70,14 @@ namespace ImGui
 
 bool Application::Initialize()
 {
+    // Assets come from the pack built next to the executable, or else from loose files
+    assetPack.Open("resources.pak", "resources");
+
+    // The textures and the lights are known before the pipeline, to select its shader variant
     return InitializeWindowAndDevice() && InitializeDepthBuffer() && InitializeBindGroupLayout()
-           && InitializePipeline() && InitializeTexture() && InitializeGeometry()
-           && InitializeUniforms() && InitializeLightingUniforms() && InitializeBindGroups()
+           && InitializeTexture() && InitializeLightingUniforms() && InitializePipeline()
+           && InitializeGeometry() && InitializeScene() && InitializeCulling()
+           && InitializeUniforms() && InitializeLights() && InitializeBindGroups()
            && InitializeGUI();
 }
 
@@ -41,6 +86,16 @@ void Application::Terminate()
     // Terminate GUI
     TerminateGUI();
 
+#ifndef __EMSCRIPTEN__
+    PipelineCache::Statistics cacheStatistics = pipelineCache.GetStatistics();
+    SDL_Log("Pipeline cache: %u hits, %u misses, %u stores, %u evictions, %.1f MB",
+            cacheStatistics.hits,
+            cacheStatistics.misses,
+            cacheStatistics.stores,
+            cacheStatistics.evictions,
+            cacheStatistics.size / (1024.0 * 1024.0));
+#endif
+
     // Terminate SDL
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -102,14 +157,37 @@ void Application::MainLoop()
     deltaTime   = std::min(delta, 0.05f);
     tickCount   = SDL_GetTicks();
 
+    // CPU time of the frame, from here to its submission
+    Uint64 frameStartTime = SDL_GetTicksNS();
+
     // Update uniform buffer
     UpdateLightingUniforms();
 
     uniforms.time = tickCount / 1000.0f;
-    queue.WriteBuffer(uniformBuffer,
-                      offsetof(MyUniforms, time),
-                      &uniforms.time,
-                      sizeof(MyUniforms::time));
+    uniformRing.Write(kUniformsBlock, &uniforms, sizeof(MyUniforms));
+
+    // Upload all the uniforms changed since the last frame with a single write
+    uniformRing.Flush(queue);
+
+    // Bind texture levels uploaded since the last frame, the culling buffers of new batches and
+    // the light buffer once it grows
+    bool bindingsChanged = textureStreamer.Update();
+    bindingsChanged      = UpdateLights() || bindingsChanged;
+    if (scene.Update(queue))
+    {
+        UpdateDrawBatches();
+        bindingsChanged = true;
+    }
+    if (bindingsChanged)
+    {
+        InitializeBindGroups();
+    }
+
+    // Recompile the pipelines when their shaders are edited
+    for (const std::filesystem::path& path : shaderWatcher.Poll())
+    {
+        ReloadShader(path);
+    }
 
     // Get the next target texture view
     wgpu::TextureView targetView = GetNextSurfaceTextureView();
@@ -123,6 +201,28 @@ void Application::MainLoop()
     encoderDesc.nextInChain                    = nullptr;
     encoderDesc.label                          = WebGPUUtils::GenerateString("My command encoder");
     wgpu::CommandEncoder encoder               = device.CreateCommandEncoder(&encoderDesc);
+    gpuTimer.Begin(encoder);
+
+    // Only the instance counts of the batches depend on the camera, the CPU never visits instances
+    bool isCulling          = isIndirectDrawSupported && isCullingEnabled;
+    bool isOcclusionCulling = isCulling && isOcclusionCullingEnabled;
+    culler.Cull(encoder,
+                uniforms.projectionMatrix,
+                uniforms.viewMatrix,
+                isCulling,
+                isOcclusionCulling,
+                isLodEnabled && isIndirectDrawSupported ? lodErrorThreshold : -1.0f);
+    clusterCuller.Cull(encoder,
+                       uniforms.projectionMatrix,
+                       uniforms.viewMatrix,
+                       isCulling && isClusterCullingEnabled,
+                       culler);
+    // The lights reaching each cluster of the view, read by the shading
+    lightClusterer.Build(encoder,
+                         uniforms.projectionMatrix,
+                         uniforms.viewMatrix,
+                         depthTexture.GetWidth(),
+                         depthTexture.GetHeight());
 
     // Create the render pass that clears the screen with our color
     wgpu::RenderPassDescriptor renderPassDesc = {};
@@ -156,18 +256,50 @@ void Application::MainLoop()
 
     renderPassDesc.timestampWrites = nullptr;
 
-    // Create the render pass and end it immediately (we only clear the screen but do not draw anything)
+    // With the depth prepass the phases only draw positions, whose visible fragments are shaded
+    // by a last pass, once per pixel
+    ScenePass phasePass = isDepthPrepassEnabled ? ScenePass::DepthPrepass : ScenePass::Shaded;
+
+    renderPassDesc.colorAttachmentCount = isDepthPrepassEnabled ? 0 : 1;
+
+    // The early phase draws the instances visible last frame, see GpuCuller
+    frameEncodeTime                    = 0;
     wgpu::RenderPassEncoder renderPass = encoder.BeginRenderPass(&renderPassDesc);
+    DrawScene(renderPass, phasePass, GpuCuller::Phase::Early);
+
+    // Then the late phase draws the newly visible instances, tested against the early depth
+    if (isOcclusionCulling)
+    {
+        renderPass.End();
+        depthPyramid.Build(encoder);
+        culler.CullLate(encoder);
+
+        renderPassColorAttachment.loadOp   = wgpu::LoadOp::Load;
+        depthStencilAttachment.depthLoadOp = wgpu::LoadOp::Load;
+        renderPass                         = encoder.BeginRenderPass(&renderPassDesc);
+        DrawScene(renderPass, phasePass, GpuCuller::Phase::Late);
+    }
 
-    // set pipeline to renderpass and draw
-    renderPass.SetPipeline(pipeline);
-    renderPass.SetVertexBuffer(0, pointBuffer, 0, pointBuffer.GetSize());
-    renderPass.SetBindGroup(0, bindGroup, 0, nullptr);
-    renderPass.Draw(indexCount, 1, 0, 0);
+    // The draws of both phases again, each passing the equal depth test where it is in front
+    if (isDepthPrepassEnabled)
+    {
+        renderPass.End();
+        renderPassDesc.colorAttachmentCount = 1;
+        renderPassColorAttachment.loadOp    = wgpu::LoadOp::Clear;
+        depthStencilAttachment.depthLoadOp  = wgpu::LoadOp::Load;
+        renderPass                          = encoder.BeginRenderPass(&renderPassDesc);
+        DrawScene(renderPass, ScenePass::ShadedAfterPrepass, GpuCuller::Phase::Early);
+        if (isOcclusionCulling)
+        {
+            DrawScene(renderPass, ScenePass::ShadedAfterPrepass, GpuCuller::Phase::Late);
+        }
+    }
+    sceneEncodeTime = 0.95 * sceneEncodeTime + 0.05 * frameEncodeTime / 1000000.0;
 
     UpdateGUI(renderPass);
 
     renderPass.End();
+    gpuTimer.End(encoder);
 
     // Finally encode and submit the render pass
     wgpu::CommandBufferDescriptor cmdBufferDescriptor;
@@ -177,6 +309,36 @@ void Application::MainLoop()
     wgpu::CommandBuffer command = encoder.Finish(&cmdBufferDescriptor);
 
     queue.Submit(1, &command);
+    gpuTimer.Read();
+    frameCpuTime = SDL_GetTicksNS() - frameStartTime;
+    frameBenchmark.AddFrame();
+
+    // The stats lag the frame by the read back latency, no read starting while one is pending.
+    // The scene and the camera do not change before the counts of this frame are read back.
+    std::vector<uint32_t> cpuCounts;
+    if (isCullingCheckRequested)
+    {
+        glm::mat4x4 viewProjection = uniforms.projectionMatrix * uniforms.viewMatrix;
+        cpuCounts = culler.CountVisible(scene.GetInstanceData(), viewProjection);
+    }
+    bool isReading = culler.ReadStats(
+        [this, cpuCounts](const GpuCuller::Stats& stats)
+        {
+            cullingStats = stats;
+            for (uint32_t batch = 0; batch < cpuCounts.size(); ++batch)
+            {
+                uint32_t gpuCount = stats.frustumCounts[batch];
+                SDL_Log("Batch %u: %u instances in the frustum on the GPU, %u on the CPU%s",
+                        batch,
+                        gpuCount,
+                        cpuCounts[batch],
+                        gpuCount != cpuCounts[batch] ? " (mismatch)" : "");
+            }
+        });
+    if (isReading)
+    {
+        isCullingCheckRequested = false;
+    }
 
 #ifndef __EMSCRIPTEN__
     surface.Present();
@@ -237,7 +399,31 @@ bool Application::InitializeWindowAndDevice()
     wgpu::DeviceDescriptor deviceDesc = {};
     deviceDesc.nextInChain            = nullptr;
     deviceDesc.label                  = WebGPUUtils::GenerateString("My Device");
-    deviceDesc.requiredFeatureCount   = 0;
+
+    // Block compressed textures are used when available, RGBA8 otherwise
+    std::vector<wgpu::FeatureName> requiredFeatures;
+    if (adapter.HasFeature(wgpu::FeatureName::TextureCompressionBC))
+    {
+        requiredFeatures.push_back(wgpu::FeatureName::TextureCompressionBC);
+    }
+    // Enables the half precision shader variants
+    if (adapter.HasFeature(wgpu::FeatureName::ShaderF16))
+    {
+        requiredFeatures.push_back(wgpu::FeatureName::ShaderF16);
+    }
+    // Enables drawing the culled batches indirectly, each starting at its first instance
+    isIndirectDrawSupported = adapter.HasFeature(wgpu::FeatureName::IndirectFirstInstance);
+    if (isIndirectDrawSupported)
+    {
+        requiredFeatures.push_back(wgpu::FeatureName::IndirectFirstInstance);
+    }
+    // Enables measuring the GPU time of the frames
+    if (adapter.HasFeature(wgpu::FeatureName::TimestampQuery))
+    {
+        requiredFeatures.push_back(wgpu::FeatureName::TimestampQuery);
+    }
+    deviceDesc.requiredFeatureCount = requiredFeatures.size();
+    deviceDesc.requiredFeatures     = requiredFeatures.data();
 
     wgpu::Limits requiredLimits         = GetRequiredLimits(adapter);
     deviceDesc.requiredLimits           = &requiredLimits;
@@ -268,11 +454,25 @@ bool Application::InitializeWindowAndDevice()
 
     deviceDesc.SetUncapturedErrorCallback(uncapturedErrorCallback);
 
+#ifndef __EMSCRIPTEN__
+    // Keep compiled shaders and pipelines across launches
+    wgpu::DawnCacheDeviceDescriptor cacheDesc;
+    cacheDesc.nextInChain  = nullptr;
+    cacheDesc.sType        = wgpu::SType::DawnCacheDeviceDescriptor;
+    cacheDesc.isolationKey = WebGPUUtils::GenerateString("Dawn Sample");
+    if (pipelineCache.Initialize(kPipelineCacheDirectory, kPipelineCacheMaxSize))
+    {
+        pipelineCache.Attach(cacheDesc);
+        deviceDesc.nextInChain = &cacheDesc;
+    }
+#endif
+
     device = WebGPUUtils::RequestDeviceSync(instance, adapter, &deviceDesc);
 
     WebGPUUtils::InspectDevice(device);
 
     queue = device.GetQueue();
+    gpuTimer.Initialize(device);
 
     surfaceFormat = WebGPUUtils::GetTextureFormat(surface, adapter);
 
@@ -303,7 +503,9 @@ bool Application::InitializeDepthBuffer()
     depthTextureDesc.mipLevelCount   = 1;
     depthTextureDesc.sampleCount     = 1;
     depthTextureDesc.size            = {1024, 768, 1};
-    depthTextureDesc.usage           = wgpu::TextureUsage::RenderAttachment;
+    // Also read by the depth pyramid
+    depthTextureDesc.usage           = wgpu::TextureUsage::RenderAttachment
+                                     | wgpu::TextureUsage::TextureBinding;
     depthTextureDesc.viewFormatCount = 1;
     depthTextureDesc.viewFormats     = (wgpu::TextureFormat*)&depthTextureFormat;
     depthTexture                     = device.CreateTexture(&depthTextureDesc);
@@ -326,15 +528,16 @@ bool Application::InitializeDepthBuffer()
 
 bool Application::InitializeBindGroupLayout()
 {
-    std::vector<wgpu::BindGroupLayoutEntry> bindingLayoutEntries(5);
+    std::vector<wgpu::BindGroupLayoutEntry> bindingLayoutEntries(10);
 
     // The uniform buffer binding
     wgpu::BindGroupLayoutEntry& bindingLayout = bindingLayoutEntries[0];
     SetDefaultBindGroupLayout(bindingLayout);
-    bindingLayout.binding               = 0;
-    bindingLayout.visibility            = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment;
-    bindingLayout.buffer.type           = wgpu::BufferBindingType::Uniform;
-    bindingLayout.buffer.minBindingSize = sizeof(MyUniforms);
+    bindingLayout.binding                 = 0;
+    bindingLayout.visibility              = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment;
+    bindingLayout.buffer.type             = wgpu::BufferBindingType::Uniform;
+    bindingLayout.buffer.hasDynamicOffset = true;
+    bindingLayout.buffer.minBindingSize   = sizeof(MyUniforms);
 
     // The texture binding
     wgpu::BindGroupLayoutEntry& textureBindingLayout = bindingLayoutEntries[1];
@@ -362,10 +565,51 @@ bool Application::InitializeBindGroupLayout()
     // The lighting uniform buffer binding
     wgpu::BindGroupLayoutEntry& lightingUniformLayout = bindingLayoutEntries[4];
     SetDefaultBindGroupLayout(lightingUniformLayout);
-    lightingUniformLayout.binding               = 4;
-    lightingUniformLayout.visibility            = wgpu::ShaderStage::Fragment;
-    lightingUniformLayout.buffer.type           = wgpu::BufferBindingType::Uniform;
-    lightingUniformLayout.buffer.minBindingSize = sizeof(LightingUniforms);
+    lightingUniformLayout.binding                 = 4;
+    lightingUniformLayout.visibility              = wgpu::ShaderStage::Fragment;
+    lightingUniformLayout.buffer.type             = wgpu::BufferBindingType::Uniform;
+    lightingUniformLayout.buffer.hasDynamicOffset = true;
+    lightingUniformLayout.buffer.minBindingSize   = sizeof(LightingUniforms);
+
+    // The instance data binding
+    wgpu::BindGroupLayoutEntry& instanceLayout = bindingLayoutEntries[5];
+    SetDefaultBindGroupLayout(instanceLayout);
+    instanceLayout.binding               = 5;
+    instanceLayout.visibility            = wgpu::ShaderStage::Vertex;
+    instanceLayout.buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    instanceLayout.buffer.minBindingSize = sizeof(Scene::InstanceData);
+
+    // The visible instance binding, written by the culling pass
+    wgpu::BindGroupLayoutEntry& visibleInstanceLayout = bindingLayoutEntries[6];
+    SetDefaultBindGroupLayout(visibleInstanceLayout);
+    visibleInstanceLayout.binding               = 6;
+    visibleInstanceLayout.visibility            = wgpu::ShaderStage::Vertex;
+    visibleInstanceLayout.buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    visibleInstanceLayout.buffer.minBindingSize = sizeof(uint32_t);
+
+    // The point and spot lights binding
+    wgpu::BindGroupLayoutEntry& lightLayout = bindingLayoutEntries[7];
+    SetDefaultBindGroupLayout(lightLayout);
+    lightLayout.binding               = 7;
+    lightLayout.visibility            = wgpu::ShaderStage::Fragment;
+    lightLayout.buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    lightLayout.buffer.minBindingSize = sizeof(LightClusterer::Light);
+
+    // The lights of each cluster binding, written by the light cluster pass
+    wgpu::BindGroupLayoutEntry& clusterLightLayout = bindingLayoutEntries[8];
+    SetDefaultBindGroupLayout(clusterLightLayout);
+    clusterLightLayout.binding               = 8;
+    clusterLightLayout.visibility            = wgpu::ShaderStage::Fragment;
+    clusterLightLayout.buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    clusterLightLayout.buffer.minBindingSize = sizeof(uint32_t);
+
+    // The light cluster uniform buffer binding
+    wgpu::BindGroupLayoutEntry& clusterUniformLayout = bindingLayoutEntries[9];
+    SetDefaultBindGroupLayout(clusterUniformLayout);
+    clusterUniformLayout.binding               = 9;
+    clusterUniformLayout.visibility            = wgpu::ShaderStage::Fragment;
+    clusterUniformLayout.buffer.type           = wgpu::BufferBindingType::Uniform;
+    clusterUniformLayout.buffer.minBindingSize = sizeof(LightClusterer::ClusterUniforms);
 
     // Create a bind group layout
     wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
@@ -388,12 +632,14 @@ wgpu::Limits Application::GetRequiredLimits(wgpu::Adapter adapter) const
 
     requiredLimits.maxVertexAttributes        = 6;
     requiredLimits.maxVertexBuffers           = 2;
-    requiredLimits.maxBufferSize              = 150000 * sizeof(VertexAttributes);
+    requiredLimits.maxBufferSize              = supportedLimits.maxBufferSize;
     requiredLimits.maxVertexBufferArrayStride = sizeof(VertexAttributes);
 
     requiredLimits.maxBindGroups                   = 2;
-    requiredLimits.maxUniformBuffersPerShaderStage = 2;
+    requiredLimits.maxUniformBuffersPerShaderStage = 3;
     requiredLimits.maxUniformBufferBindingSize     = 16 * 4 * sizeof(float);
+    // Both uniform blocks live in the uniform ring
+    requiredLimits.maxDynamicUniformBuffersPerPipelineLayout = 2;
 
     requiredLimits.maxStorageBufferBindingSize = supportedLimits.maxStorageBufferBindingSize;
 
@@ -414,52 +660,136 @@ wgpu::Limits Application::GetRequiredLimits(wgpu::Adapter adapter) const
 
 bool Application::InitializePipeline()
 {
-    // Load the shader module
-    wgpu::ShaderModule shaderModule =
-        ResourceManager::LoadShaderModule("resources/shader.wgsl", device);
+    // Variants are precompiled into the pack by shadercompiler, or else expanded from the source
+    AssetPack::Asset manifestAsset;
+    AssetPack::Asset shaderAsset;
+    if (assetPack.Load(ShaderVariants::GetManifestName(kShaderName), manifestAsset))
+    {
+        std::string_view manifest(reinterpret_cast<const char*>(manifestAsset.data.data()),
+                                  manifestAsset.data.size());
+        ShaderVariants::ReadManifest(manifest, shaderVariants);
+    }
+    if (shaderVariants.empty() && assetPack.Load(kShaderSourceName, shaderAsset))
+    {
+        shaderVariants = ShaderVariants::Enumerate(kShaderName);
+        shaderSource.assign(reinterpret_cast<const char*>(shaderAsset.data.data()),
+                            shaderAsset.data.size());
+    }
 
-    if (shaderModule == nullptr)
+    // Describe pipeline layout
+    wgpu::PipelineLayoutDescriptor layoutDesc {};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts     = (wgpu::BindGroupLayout*)&bindGroupLayout;
+    layout                          = device.CreatePipelineLayout(&layoutDesc);
+
+    // Compiles while the textures stream and the geometry loads, the mesh is drawn once ready
+    UpdateShaderVariant();
+    if (shaderVariant == nullptr)
     {
         SDL_Log("Could not load shader!");
         exit(EXIT_FAILURE);
     }
 
+#ifdef RESOURCE_SOURCE_DIR
+    shaderWatcher.Watch(RESOURCE_SOURCE_DIR, ".wgsl", kShaderWatchInterval);
+#endif
+
+    return layout != nullptr;
+}
+
+void Application::UpdateShaderVariant()
+{
+    // Lights after the last one with a color do not contribute
+    ShaderVariants::Features required;
+    required.lightCount = 0;
+    for (uint32_t i = 0; i < ShaderVariants::kMaxLightCount; ++i)
+    {
+        if (glm::vec3(lightingUniforms.colors[i]) != glm::vec3(0.0f))
+        {
+            required.lightCount = i + 1;
+        }
+    }
+    // One variant draws every material, with normal mapping when any has a normal map. The others
+    // then sample flatNormalTexture, which leaves their interpolated normals unchanged.
+    required.normalMapping = std::any_of(materials.begin(),
+                                         materials.end(),
+                                         [](const Material& material)
+                                         {
+                                             return material.normalTexture
+                                                    != TextureStreamer::kInvalidHandle;
+                                         });
+    required.vertexFormat  = vertexFormat;
+    required.f16           = device.HasFeature(wgpu::FeatureName::ShaderF16);
+
+    const ShaderVariants::Variant* variant = ShaderVariants::Select(shaderVariants, required);
+    if (variant == nullptr || variant == shaderVariant)
+    {
+        return;
+    }
+
+    wgpu::ShaderModule shaderModule = LoadShaderVariant(*variant);
+    if (shaderModule == nullptr)
+    {
+        SDL_Log("Could not load shader %s", variant->sourceName.c_str());
+        return;
+    }
+
+    SDL_Log("Shader variant: %u lights, normal mapping %s, %s precision",
+            variant->features.lightCount,
+            variant->features.normalMapping ? "on" : "off",
+            variant->features.f16 ? "half" : "full");
+    shaderVariant = variant;
+    CreatePipeline(*variant, shaderModule);
+}
+
+wgpu::ShaderModule Application::LoadShaderVariant(const ShaderVariants::Variant& variant)
+{
+    std::span<const unsigned char> source;
+    AssetPack::Asset shaderAsset;
+    std::string preprocessedSource;
+    if (!shaderSource.empty())
+    {
+        if (!ShaderVariants::Preprocess(shaderSource, variant.defines, preprocessedSource))
+        {
+            return nullptr;
+        }
+        source = {reinterpret_cast<const unsigned char*>(preprocessedSource.data()),
+                  preprocessedSource.size()};
+    }
+    else if (assetPack.Load(variant.sourceName, shaderAsset))
+    {
+        source = shaderAsset.data;
+    }
+
+    wgpu::ShaderModule shaderModule = nullptr;
+    if (!source.empty())
+    {
+        shaderModule = ResourceManager::LoadShaderModule(source, device);
+        WebGPUUtils::LogCompilationMessages(shaderModule, variant.sourceName.c_str());
+    }
+    return shaderModule;
+}
+
+void Application::CreatePipeline(const ShaderVariants::Variant& variant,
+                                 wgpu::ShaderModule shaderModule)
+{
+    Uint64 startTime = SDL_GetTicksNS();
+
     // Create the render pipeline
     wgpu::RenderPipelineDescriptor pipelineDesc = {};
     pipelineDesc.nextInChain                    = nullptr;
 
-    // Describe vertex pipeline
-    wgpu::VertexBufferLayout vertexBufferLayout {};
-    std::vector<wgpu::VertexAttribute> vertexAttribs(6);
-    vertexAttribs[0].shaderLocation = 0;  // @location(0) position attribute
-    vertexAttribs[0].format         = wgpu::VertexFormat::Float32x3;
-    vertexAttribs[0].offset         = offsetof(VertexAttributes, position);
-    vertexAttribs[1].shaderLocation = 1;  // @location(1) tangent attribute
-    vertexAttribs[1].format         = wgpu::VertexFormat::Float32x3;
-    vertexAttribs[1].offset         = offsetof(VertexAttributes, position);
-    vertexAttribs[2].shaderLocation = 2;  // @location(2) bitangent attribute
-    vertexAttribs[2].format         = wgpu::VertexFormat::Float32x3;
-    vertexAttribs[2].offset         = offsetof(VertexAttributes, position);
-    vertexAttribs[3].shaderLocation = 3;  // @location(3) normal attribute
-    vertexAttribs[3].format         = wgpu::VertexFormat::Float32x3;
-    vertexAttribs[3].offset         = offsetof(VertexAttributes, normal);
-    vertexAttribs[4].shaderLocation = 4;  // @location(4) color attribute
-    vertexAttribs[4].format         = wgpu::VertexFormat::Float32x3;
-    vertexAttribs[4].offset         = offsetof(VertexAttributes, color);
-    vertexAttribs[5].shaderLocation = 5;  // @location(5) uv attribute
-    vertexAttribs[5].format         = wgpu::VertexFormat::Float32x2;
-    vertexAttribs[5].offset         = offsetof(VertexAttributes, uv);
-
-    vertexBufferLayout.attributeCount = static_cast<uint32_t>(vertexAttribs.size());
-    vertexBufferLayout.attributes     = vertexAttribs.data();
-    vertexBufferLayout.arrayStride    = sizeof(VertexAttributes);
-    vertexBufferLayout.stepMode       = wgpu::VertexStepMode::Vertex;
-
-    pipelineDesc.vertex.bufferCount = 1;
-    pipelineDesc.vertex.buffers     = &vertexBufferLayout;
+    // Describe vertex pipeline, reading positions and the other attributes from two buffers
+    std::vector<wgpu::VertexAttribute> vertexAttribs;
+    std::array<wgpu::VertexBufferLayout, 2> vertexBufferLayouts =
+        GetVertexBufferLayouts(variant.features.vertexFormat, vertexAttribs);
+
+    pipelineDesc.vertex.bufferCount = vertexBufferLayouts.size();
+    pipelineDesc.vertex.buffers     = vertexBufferLayouts.data();
 
     pipelineDesc.vertex.module        = shaderModule;
-    pipelineDesc.vertex.entryPoint    = WebGPUUtils::GenerateString("vs_main");
+    pipelineDesc.vertex.entryPoint    = {variant.vertexEntryPoint.data(),
+                                         variant.vertexEntryPoint.size()};
     pipelineDesc.vertex.constantCount = 0;
     pipelineDesc.vertex.constants     = nullptr;
 
@@ -469,12 +799,20 @@ bool Application::InitializePipeline()
     pipelineDesc.primitive.frontFace        = wgpu::FrontFace::CCW;
     pipelineDesc.primitive.cullMode         = wgpu::CullMode::None;
 
-    // Describe fragment pipeline
+    // Describe fragment pipeline, specialized by the pipeline-overridable constants
+    std::vector<wgpu::ConstantEntry> constants(variant.constants.size());
+    for (size_t i = 0; i < constants.size(); ++i)
+    {
+        constants[i].key   = {variant.constants[i].first.data(), variant.constants[i].first.size()};
+        constants[i].value = variant.constants[i].second;
+    }
+
     wgpu::FragmentState fragmentState {};
     fragmentState.module        = shaderModule;
-    fragmentState.entryPoint    = WebGPUUtils::GenerateString("fs_main");
-    fragmentState.constantCount = 0;
-    fragmentState.constants     = nullptr;
+    fragmentState.entryPoint    = {variant.fragmentEntryPoint.data(),
+                                   variant.fragmentEntryPoint.size()};
+    fragmentState.constantCount = constants.size();
+    fragmentState.constants     = constants.data();
 
     // blend settings
     wgpu::BlendState blendState {};
@@ -509,17 +847,111 @@ bool Application::InitializePipeline()
     pipelineDesc.multisample.mask                   = ~0u;
     pipelineDesc.multisample.alphaToCoverageEnabled = false;
 
-    // Describe pipeline layout
-    wgpu::PipelineLayoutDescriptor layoutDesc {};
-    layoutDesc.bindGroupLayoutCount = 1;
-    layoutDesc.bindGroupLayouts     = (wgpu::BindGroupLayout*)&bindGroupLayout;
-    layout                          = device.CreatePipelineLayout(&layoutDesc);
-
     pipelineDesc.layout = layout;
 
-    pipeline = device.CreateRenderPipeline(&pipelineDesc);
+    // The current pipelines keep drawing until the new ones are swapped in between two frames,
+    // all at once since the prepass and the shading after it must share their vertex shader.
+    // Only the latest request may complete, so that a slow compilation never wins over an edit.
+    uint32_t generation = ++pipelineGeneration;
+    auto newPipelines   = std::make_shared<std::array<wgpu::RenderPipeline, kScenePassCount>>();
+
+    // The prepass only writes the depth of positions, which the shading after it tests equal
+    const char* depthEntryPoint = ShaderVariants::GetDepthEntryPoint(variant.features.vertexFormat);
+
+    wgpu::RenderPipelineDescriptor depthPipelineDesc = pipelineDesc;
+    depthPipelineDesc.vertex.entryPoint              = WebGPUUtils::GenerateString(depthEntryPoint);
+    depthPipelineDesc.vertex.bufferCount             = 1;
+    depthPipelineDesc.fragment                       = nullptr;
+
+    wgpu::DepthStencilState equalDepthState = depthStencilState;
+    equalDepthState.depthCompare            = wgpu::CompareFunction::Equal;
+    equalDepthState.depthWriteEnabled       = false;
+
+    wgpu::RenderPipelineDescriptor equalPipelineDesc = pipelineDesc;
+    equalPipelineDesc.depthStencil                   = &equalDepthState;
+
+    // Indexed by ScenePass
+    const wgpu::RenderPipelineDescriptor* pipelineDescs[] = {&pipelineDesc,
+                                                             &depthPipelineDesc,
+                                                             &equalPipelineDesc};
+    for (uint32_t pass = 0; pass < kScenePassCount; ++pass)
+    {
+        auto callback = [this, generation, startTime, newPipelines, pass](
+                            wgpu::CreatePipelineAsyncStatus status,
+                            wgpu::RenderPipeline newPipeline,
+                            wgpu::StringView message)
+        {
+            if (status != wgpu::CreatePipelineAsyncStatus::Success)
+            {
+                SDL_Log("Could not create render pipeline: %.*s",
+                        static_cast<int>(message.length),
+                        message.data);
+                return;
+            }
+            if (generation != pipelineGeneration)
+            {
+                return;
+            }
+
+            (*newPipelines)[pass] = std::move(newPipeline);
+            if (std::all_of(newPipelines->begin(),
+                            newPipelines->end(),
+                            [](const wgpu::RenderPipeline& pipeline)
+                            { return pipeline != nullptr; }))
+            {
+                pipelines = *newPipelines;
+                InvalidateSceneBundles();
+                SDL_Log("Created render pipelines in %.1f ms",
+                        (SDL_GetTicksNS() - startTime) / 1000000.0);
+            }
+        };
+
+        device.CreateRenderPipelineAsync(pipelineDescs[pass], WebGPUUtils::kCallbackMode, callback);
+    }
+}
+
+void Application::ReloadShader(const std::filesystem::path& path)
+{
+    SDL_Log("Reloading %s", path.string().c_str());
+    std::ifstream file(path, std::ios::binary);
+    std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!file.is_open() || source.empty())
+    {
+        SDL_Log("Could not load shader %s", path.string().c_str());
+        return;
+    }
 
-    return pipeline != nullptr;
+    // An invalid shader fails the pipeline creation, and the previous pipelines stay in use
+    std::span<const unsigned char> sourceData(reinterpret_cast<const unsigned char*>(source.data()),
+                                              source.size());
+    std::filesystem::path name = path.filename();
+    if (name == kShaderSourceName)
+    {
+        // Variants are expanded from the edited source from now on
+        shaderSource  = std::move(source);
+        shaderVariant = nullptr;
+        UpdateShaderVariant();
+    }
+    else if (name == kCullShaderName)
+    {
+        culler.ReloadShader(sourceData);
+    }
+    else if (name == kDepthPyramidShaderName)
+    {
+        depthPyramid.ReloadShader(sourceData);
+    }
+    else if (name == kClusterCullShaderName)
+    {
+        clusterCuller.ReloadShader(sourceData);
+    }
+    else if (name == kLightClusterShaderName)
+    {
+        lightClusterer.ReloadShader(sourceData);
+    }
+    else
+    {
+        SDL_Log("No pipeline uses %s", path.string().c_str());
+    }
 }
 
 bool Application::InitializeTexture()
@@ -538,29 +970,44 @@ bool Application::InitializeTexture()
     samplerDesc.maxAnisotropy = 1;
     sampler                   = device.CreateSampler(&samplerDesc);
 
-    // Create a texture
-    baseColorTexture = ResourceManager::LoadTexture("resources/fourareen2K_albedo.jpg",
-                                                    device,
-                                                    &baseColorTextureView);
-
-    normalTexture = ResourceManager::LoadTexture("resources/fourareen2K_normals.png",
-                                                 device,
-                                                 &normalTextureView);
-
-    if (!baseColorTexture || !normalTexture)
+    // Load textures in the background, a flat color and a flat normal are shown meanwhile
+    textureStreamer.Initialize(device);
+    flatNormalTexture = textureStreamer.CreateSolid({128, 128, 255, 255});
+    AssetPack::Asset baseColorAsset;
+    AssetPack::Asset normalAsset;
+    if (!assetPack.Load("fourareen2K_albedo.jpg", baseColorAsset)
+        || !assetPack.Load("fourareen2K_normals.png", normalAsset))
     {
-        SDL_Log("Could not load texture!");
-        return false;
+        SDL_Log("Could not load textures!");
+        exit(EXIT_FAILURE);
     }
+    Material& material        = materials.emplace_back();
+    material.baseColorTexture = textureStreamer.Load("resources/fourareen2K_albedo.jpg",
+                                                     baseColorAsset.data,
+                                                     baseColorAsset.stamp,
+                                                     TextureStreamer::TextureType::Color,
+                                                     {128, 128, 128, 255});
+    material.normalTexture    = textureStreamer.Load("resources/fourareen2K_normals.png",
+                                                  normalAsset.data,
+                                                  normalAsset.stamp,
+                                                  TextureStreamer::TextureType::NormalMap,
+                                                  {128, 128, 255, 255});
     return true;
 }
 
 bool Application::InitializeGeometry()
 {
-    // Load mesh data from OBJ file
-    std::vector<VertexAttributes> vertexData;
-
-    bool success = ResourceManager::LoadGeometryFromObj("resources/fourareen.obj", vertexData);
+    // Load mesh data from its binary cache or from the OBJ file
+    Uint64 startTime = SDL_GetTicksNS();
+    MeshCache meshCache;
+
+    AssetPack::Asset meshAsset;
+    bool success = assetPack.Load("fourareen.obj", meshAsset)
+                   && ResourceManager::LoadMesh(meshAsset.data,
+                                                meshAsset.stamp,
+                                                "resources/fourareen.meshcache",
+                                                vertexFormat,
+                                                meshCache);
 
     if (!success)
     {
@@ -568,73 +1015,183 @@ bool Application::InitializeGeometry()
         exit(EXIT_FAILURE);
     }
 
-    // Create vertex buffer
-    wgpu::BufferDescriptor bufferDesc {};
-    bufferDesc.nextInChain      = nullptr;
-    bufferDesc.size             = vertexData.size() * sizeof(VertexAttributes);
-    bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Vertex;
-    bufferDesc.mappedAtCreation = false;
-    pointBuffer                 = device.CreateBuffer(&bufferDesc);
+    SDL_Log("Loaded mesh in %.1f ms", (SDL_GetTicksNS() - startTime) / 1000000.0);
+
+    std::span<const unsigned char> vertexData = meshCache.GetVertexData();
+    std::span<const uint32_t> indexData       = meshCache.GetIndexData();
+    uniforms.positionScale                    = glm::vec4(meshCache.GetPositionScale(), 0.0f);
+    uniforms.positionOffset                   = glm::vec4(meshCache.GetPositionOffset(), 0.0f);
+
+    // Suballocate the mesh from the vertex and index pools, the positions of the vertices being
+    // stored apart from their other attributes for the depth prepass
+    uint32_t positionSize                     = GetPositionSize(vertexFormat);
+    uint32_t vertexStride                     = meshCache.GetVertexStride();
+    std::array<uint32_t, 2> vertexStreamSizes = {positionSize, vertexStride - positionSize};
+    vertexPool.Initialize(device,
+                          "Vertex pool",
+                          wgpu::BufferUsage::Vertex,
+                          vertexStride,
+                          kVertexSlabSize,
+                          vertexStreamSizes);
+    indexPool.Initialize(device,
+                         "Index pool",
+                         wgpu::BufferUsage::Index,
+                         sizeof(uint32_t),
+                         kIndexSlabSize);
+
+    // Every level of detail indexes the same vertices, their indices following each other
+    std::span<const MeshLod> lods = meshCache.GetLods();
+    Mesh& mesh                    = meshes.emplace_back();
+    mesh.vertices                 = vertexPool.Allocate(meshCache.GetVertexCount());
+    mesh.indices                  = indexPool.Allocate(static_cast<uint32_t>(indexData.size()));
+    mesh.lods.assign(lods.begin(), lods.end());
+    mesh.boundsMin = meshCache.GetBoundsMin();
+    mesh.boundsMax = meshCache.GetBoundsMax();
+    if (mesh.vertices == BufferPool::kInvalidHandle || mesh.indices == BufferPool::kInvalidHandle)
+    {
+        return false;
+    }
+
+    std::vector<unsigned char> vertexStreamData = SplitVertexStreams(vertexFormat, vertexData);
+    vertexPool.Write(mesh.vertices, vertexStreamData.data(), vertexStreamData.size());
+    indexPool.Write(mesh.indices, indexData.data(), indexData.size_bytes());
+    vertexPool.Flush();
+    indexPool.Flush();
+    mesh.clusterMesh = clusterCuller.AddMesh(meshCache.GetMeshlets(),
+                                             indexData.first(lods[0].indexCount));
+
+    SDL_Log("Loaded geometry: %u unique vertices (%zu bytes), %u indices in %zu levels of detail",
+            meshCache.GetVertexCount(),
+            vertexData.size(),
+            static_cast<uint32_t>(indexData.size()),
+            lods.size());
+    vertexPool.LogStats();
+    indexPool.LogStats();
+    MemoryUsage::LogPeakResidentSize("loading the geometry");
+
+    return true;
+}
+
+bool Application::InitializeScene()
+{
+    scene.Initialize(device);
+    scene.SetMaxBatchSize(static_cast<uint32_t>(maxBatchSize));
+    PopulateScene();
+    scene.Update(queue);
 
-    queue.WriteBuffer(pointBuffer, 0, vertexData.data(), bufferDesc.size);
+    return scene.GetInstanceBuffer() != nullptr;
+}
 
-    indexCount = static_cast<int>(vertexData.size());
+bool Application::InitializeCulling()
+{
+    AssetPack::Asset shaderAsset;
+    AssetPack::Asset pyramidShaderAsset;
+    AssetPack::Asset clusterShaderAsset;
+    if (!assetPack.Load(kCullShaderName, shaderAsset)
+        || !culler.Initialize(device, shaderAsset.data)
+        || !assetPack.Load(kDepthPyramidShaderName, pyramidShaderAsset)
+        || !depthPyramid.Initialize(device, pyramidShaderAsset.data)
+        || !assetPack.Load(kClusterCullShaderName, clusterShaderAsset)
+        || !clusterCuller.Initialize(device, clusterShaderAsset.data))
+    {
+        SDL_Log("Could not initialize culling!");
+        return false;
+    }
+    if (!isIndirectDrawSupported)
+    {
+        SDL_Log("IndirectFirstInstance is not supported, culling is disabled");
+    }
 
-    return pointBuffer != nullptr;
+    depthPyramid.SetDepthTexture(depthTextureView,
+                                 depthTexture.GetWidth(),
+                                 depthTexture.GetHeight());
+    culler.SetDepthPyramid(depthPyramid);
+    UpdateDrawBatches();
+    return true;
 }
 
 bool Application::InitializeUniforms()
 {
-    // Create uniform buffer
-    wgpu::BufferDescriptor bufferDesc {};
-    bufferDesc.size             = sizeof(MyUniforms);
-    bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
-    bufferDesc.mappedAtCreation = false;
-    uniformBuffer               = device.CreateBuffer(&bufferDesc);
+    // Create the uniform ring, holding the uniforms and the lighting uniforms of every frame
+    const std::array<uint64_t, 2> blockSizes = {sizeof(MyUniforms), sizeof(LightingUniforms)};
+    bool success = uniformRing.Initialize(device, blockSizes, kFramesInFlight);
 
-    // Upload the initial value of the uniforms
-    uniforms.modelMatrix = glm::mat4x4(1.0);
+    // Initial value of the uniforms, uploaded with the first frame
     uniforms.viewMatrix =
         glm::lookAt(glm::vec3(-2.0f, -3.0f, 2.0f), glm::vec3(0.0f), glm::vec3(0, 0, 1));
     uniforms.projectionMatrix = glm::perspective(45 * PI / 180, 640.0f / 480.0f, 0.01f, 100.0f);
     uniforms.time             = 1.0f;
     uniforms.color            = {0.0f, 1.0f, 0.4f, 1.0f};
-    queue.WriteBuffer(uniformBuffer, 0, &uniforms, sizeof(MyUniforms));
 
-    return uniformBuffer != nullptr;
+    return success;
 }
 
 bool Application::InitializeBindGroups()
 {
     // Create a binding
-    std::vector<wgpu::BindGroupEntry> bindings(5);
+    std::vector<wgpu::BindGroupEntry> bindings(10);
     bindings[0].binding = 0;
-    bindings[0].buffer  = uniformBuffer;
+    bindings[0].buffer  = uniformRing.GetBuffer();
     bindings[0].offset  = 0;
-    bindings[0].size    = sizeof(MyUniforms);
-
-    bindings[1].binding     = 1;
-    bindings[1].textureView = baseColorTextureView;
+    bindings[0].size    = uniformRing.GetBlockSize(kUniformsBlock);
 
-    bindings[2].binding     = 2;
-    bindings[2].textureView = normalTextureView;
+    bindings[1].binding = 1;
+    bindings[2].binding = 2;
 
     bindings[3].binding = 3;
     bindings[3].sampler = sampler;
 
     bindings[4].binding = 4;
-    bindings[4].buffer  = lightingUniformBuffer;
+    bindings[4].buffer  = uniformRing.GetBuffer();
     bindings[4].offset  = 0;
-    bindings[4].size    = sizeof(LightingUniforms);
-
-    // A bind group contains one or multiple bindings
-    wgpu::BindGroupDescriptor bindGroupDesc {};
-    bindGroupDesc.layout     = bindGroupLayout;
-    bindGroupDesc.entryCount = static_cast<uint32_t>(bindings.size());
-    bindGroupDesc.entries    = bindings.data();
-    bindGroup                = device.CreateBindGroup(&bindGroupDesc);
+    bindings[4].size    = uniformRing.GetBlockSize(kLightingBlock);
+
+    bindings[5].binding = 5;
+    bindings[5].buffer  = scene.GetInstanceBuffer();
+    bindings[5].offset  = 0;
+    bindings[5].size    = scene.GetInstanceBuffer().GetSize();
+
+    bindings[6].binding = 6;
+    bindings[6].buffer  = culler.GetVisibleInstanceBuffer();
+    bindings[6].offset  = 0;
+    bindings[6].size    = culler.GetVisibleInstanceBuffer().GetSize();
+
+    bindings[7].binding = 7;
+    bindings[7].buffer  = lightClusterer.GetLightBuffer();
+    bindings[7].offset  = 0;
+    bindings[7].size    = lightClusterer.GetLightBuffer().GetSize();
+
+    bindings[8].binding = 8;
+    bindings[8].buffer  = lightClusterer.GetClusterLightBuffer();
+    bindings[8].offset  = 0;
+    bindings[8].size    = lightClusterer.GetClusterLightBuffer().GetSize();
+
+    bindings[9].binding = 9;
+    bindings[9].buffer  = lightClusterer.GetUniformBuffer();
+    bindings[9].offset  = 0;
+    bindings[9].size    = lightClusterer.GetUniformBuffer().GetSize();
+
+    // A bind group contains one or multiple bindings, one per material here
+    for (Material& material : materials)
+    {
+        bindings[1].textureView = textureStreamer.GetTextureView(material.baseColorTexture);
+        bindings[2].textureView = textureStreamer.GetTextureView(
+            material.normalTexture != TextureStreamer::kInvalidHandle ? material.normalTexture
+                                                                      : flatNormalTexture);
+
+        wgpu::BindGroupDescriptor bindGroupDesc {};
+        bindGroupDesc.layout     = bindGroupLayout;
+        bindGroupDesc.entryCount = static_cast<uint32_t>(bindings.size());
+        bindGroupDesc.entries    = bindings.data();
+        material.bindGroup       = device.CreateBindGroup(&bindGroupDesc);
+        if (material.bindGroup == nullptr)
+        {
+            return false;
+        }
+    }
 
-    return bindGroup != nullptr;
+    InvalidateSceneBundles();
+    return true;
 }
 
 bool Application::InitializeGUI()
@@ -694,10 +1251,79 @@ void Application::UpdateGUI(wgpu::RenderPassEncoder renderPass)
             ImGui::SliderFloat("Hardness", &lightingUniforms.hardness, 1.0f, 100.0f) || changed;
         changed = ImGui::SliderFloat("K Diffuse", &lightingUniforms.kd, 0.0f, 1.0f) || changed;
         changed = ImGui::SliderFloat("K Specular", &lightingUniforms.ks, 0.0f, 1.0f) || changed;
+        if (ImGui::SliderInt("Point and spot lights", &clusteredLightCount, 0, 1024))
+        {
+            SpawnLights();
+        }
+        if (!frameBenchmark.IsRunning() && ImGui::Button("Benchmark lights"))
+        {
+            StartLightBenchmark();
+        }
+        ImGui::Checkbox("Animate lights", &isLightAnimationEnabled);
         ImGui::End();
         lightingUniformsChanged = changed;
     }
 
+    {
+        ImGui::Begin("Scene");
+        if (ImGui::SliderInt("Grid size", &instanceGridSize, 1, 200))
+        {
+            PopulateScene();
+            lightsChanged = true;
+        }
+        if (ImGui::SliderInt("Max instances per draw",
+                             &maxBatchSize,
+                             1,
+                             65536,
+                             "%d",
+                             ImGuiSliderFlags_Logarithmic))
+        {
+            scene.SetMaxBatchSize(static_cast<uint32_t>(maxBatchSize));
+        }
+        ImGui::Text("%u instances in %zu draws",
+                    scene.GetInstanceCount(),
+                    scene.GetBatches().size());
+        ImGui::Checkbox("Render bundles", &isRenderBundleEnabled);
+        ImGui::Checkbox("Depth prepass", &isDepthPrepassEnabled);
+        ImGui::Text("Scene draws encoded in %.3f ms", sceneEncodeTime);
+        if (gpuTimer.IsSupported())
+        {
+            ImGui::Text("Frame drawn by the GPU in %.3f ms", gpuTimer.GetTime());
+        }
+        if (!frameBenchmark.IsRunning() && ImGui::Button("Benchmark encoding"))
+        {
+            StartEncodeBenchmark();
+        }
+        ImGui::Text("%llu triangles, %llu drawn",
+                    static_cast<unsigned long long>(cullingStats.triangleCount),
+                    static_cast<unsigned long long>(cullingStats.drawnTriangleCount));
+        ImGui::Text("%llu outside the frustum, %llu occluded",
+                    static_cast<unsigned long long>(cullingStats.frustumCulledTriangleCount),
+                    static_cast<unsigned long long>(cullingStats.occludedTriangleCount));
+        ImGui::Text("%llu in culled meshlets, %llu left out by levels of detail",
+                    static_cast<unsigned long long>(cullingStats.clusterCulledTriangleCount),
+                    static_cast<unsigned long long>(cullingStats.lodReducedTriangleCount));
+        if (isIndirectDrawSupported)
+        {
+            ImGui::Checkbox("Levels of detail", &isLodEnabled);
+            if (isLodEnabled)
+            {
+                ImGui::SliderFloat("Max error (pixels)", &lodErrorThreshold, 0.25f, 8.0f);
+            }
+            ImGui::Checkbox("GPU culling", &isCullingEnabled);
+            if (isCullingEnabled)
+            {
+                ImGui::Checkbox("Occlusion culling", &isOcclusionCullingEnabled);
+                ImGui::Checkbox("Cluster culling", &isClusterCullingEnabled);
+                if (ImGui::Button("Compare with CPU culling"))
+                {
+                    isCullingCheckRequested = true;
+                }
+            }
+        }
+        ImGui::End();
+    }
+
     // Draw UI
     ImGui::EndFrame();
     ImGui::Render();
@@ -785,16 +1411,9 @@ void Application::UpdateViewMatrix()
     float sy            = std::sin(cameraState.angles.y);
     glm::vec3 position  = glm::vec3(cx * cy, sx * cy, sy) * std::exp(-cameraState.zoom);
     uniforms.viewMatrix = glm::lookAt(position, glm::vec3(0.0f), glm::vec3(0, 0, 1));
-    queue.WriteBuffer(uniformBuffer,
-                      offsetof(MyUniforms, viewMatrix),
-                      &uniforms.viewMatrix,
-                      sizeof(MyUniforms::viewMatrix));
 
+    // Uploaded with the other uniforms at the next frame
     uniforms.cameraWorldPosition = position;
-    queue.WriteBuffer(uniformBuffer,
-                      offsetof(MyUniforms, cameraWorldPosition),
-                      &uniforms.cameraWorldPosition,
-                      sizeof(MyUniforms::cameraWorldPosition));
 }
 
 void Application::OnMouseMove()
@@ -860,31 +1479,421 @@ void Application::OnScroll(SDL_Event& event)
 
 bool Application::InitializeLightingUniforms()
 {
-    // Create uniform buffer
-    wgpu::BufferDescriptor bufferDesc;
-    bufferDesc.size             = sizeof(LightingUniforms);
-    bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
-    bufferDesc.mappedAtCreation = false;
-    lightingUniformBuffer       = device.CreateBuffer(&bufferDesc);
-
-    // Initialize values
+    // Initialize values, uploaded through the uniform ring with the first frame
     lightingUniforms.directions[0] = {0.5f, -0.9f, 0.1f, 0.0f};
     lightingUniforms.directions[1] = {0.2f, 0.4f, 0.3f, 0.0f};
     lightingUniforms.colors[0]     = {1.0f, 0.9f, 0.6f, 1.0f};
     lightingUniforms.colors[1]     = {0.6f, 0.9f, 1.0f, 1.0f};
+    lightingUniformsChanged        = true;
 
-    UpdateLightingUniforms();
-
-    return lightingUniformBuffer != nullptr;
+    return true;
 }
 
 void Application::UpdateLightingUniforms()
 {
     if (lightingUniformsChanged)
     {
-        queue.WriteBuffer(lightingUniformBuffer, 0, &lightingUniforms, sizeof(LightingUniforms));
+        uniformRing.Write(kLightingBlock, &lightingUniforms, sizeof(LightingUniforms));
         lightingUniformsChanged = false;
+
+        // Switching a light off or on may allow a cheaper shader variant or need another one
+        UpdateShaderVariant();
+    }
+}
+
+bool Application::InitializeLights()
+{
+    AssetPack::Asset shaderAsset;
+    if (!assetPack.Load(kLightClusterShaderName, shaderAsset)
+        || !lightClusterer.Initialize(device, shaderAsset.data))
+    {
+        SDL_Log("Could not initialize light clustering!");
+        return false;
+    }
+
+    SpawnLights();
+    UpdateLights();
+    return true;
+}
+
+void Application::StartLightBenchmark()
+{
+    std::vector<FrameBenchmark::Step> steps;
+    for (int lightCount : {0, 64, 256, 1024})
+    {
+        char label[64];
+        snprintf(label, sizeof(label), "%d point and spot lights", lightCount);
+        steps.push_back({label,
+                         [this, lightCount]()
+                         {
+                             clusteredLightCount = lightCount;
+                             SpawnLights();
+                         }});
+    }
+
+    // The GPU time lags by a few frames, which the frames left to each step cover
+    std::vector<FrameBenchmark::Metric> metrics = {{"CPU frame",
+                                                    [this]()
+                                                    {
+                                                        return frameCpuTime / 1000000.0;
+                                                    }}};
+    if (gpuTimer.IsSupported())
+    {
+        metrics.push_back({"GPU frame",
+                           [this]()
+                           {
+                               return gpuTimer.GetTime();
+                           }});
+    }
+    frameBenchmark.Start("Lights",
+                         std::move(metrics),
+                         std::move(steps),
+                         [this, lightCount = clusteredLightCount]()
+                         {
+                             clusteredLightCount = lightCount;
+                             SpawnLights();
+                         });
+}
+
+void Application::SpawnLights()
+{
+    // Seeded alike every time, so that changing the count keeps the lights already there
+    std::mt19937 random;
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    lights.resize(clusteredLightCount);
+    lightMotions.resize(clusteredLightCount);
+    for (int i = 0; i < clusteredLightCount; ++i)
+    {
+        // Spread evenly over the disk of the grid, turning either way
+        LightMotion& motion = lightMotions[i];
+        motion.radius       = std::sqrt(unit(random));
+        motion.angle        = 2.0f * PI * unit(random);
+        motion.speed        = (0.2f + 0.3f * unit(random)) * (unit(random) < 0.5f ? -1.0f : 1.0f);
+        motion.height       = 0.1f + 0.5f * unit(random);
+        motion.range        = 0.5f + 0.5f * unit(random);
+
+        // One light in four is a spot light pointing down
+        LightClusterer::Light& light = lights[i];
+        light                        = {};
+        light.color                  = glm::rgbColor(glm::vec3(360.0f * unit(random), 1.0f, 1.0f));
+        if (i % 4 == 3)
+        {
+            LightClusterer::SetSpotCone(light, 0.3f, 0.5f);
+        }
+    }
+    lightsChanged = true;
+}
+
+bool Application::UpdateLights()
+{
+    bool isAnimating = isLightAnimationEnabled && !lights.empty();
+    if (!lightsChanged && !isAnimating)
+    {
+        return false;
+    }
+
+    // The lights cover the grid whatever its size
+    float spacing    = GetInstanceSpacing();
+    float gridRadius = 0.5f * spacing * instanceGridSize;
+    for (size_t i = 0; i < lights.size(); ++i)
+    {
+        LightMotion& motion = lightMotions[i];
+        if (isAnimating)
+        {
+            motion.angle = std::fmod(motion.angle + motion.speed * deltaTime, 2.0f * PI);
+        }
+
+        float distance     = motion.radius * gridRadius;
+        lights[i].position = {distance * std::cos(motion.angle),
+                              distance * std::sin(motion.angle),
+                              motion.height * spacing};
+        lights[i].range    = motion.range * spacing;
+    }
+    lightsChanged = false;
+
+    return lightClusterer.SetLights(lights);
+}
+
+void Application::DrawScene(wgpu::RenderPassEncoder renderPass,
+                            ScenePass pass,
+                            GpuCuller::Phase phase)
+{
+    // Draw once the asynchronous creation of the pipelines completed
+    if (!pipelines[static_cast<uint32_t>(pass)])
+    {
+        return;
     }
+
+    // The draws only change with the scene or the resources, and the bundles with them
+    Uint64 startTime = SDL_GetTicksNS();
+    if (isRenderBundleEnabled)
+    {
+        wgpu::RenderBundle bundle = GetSceneBundle(pass, phase);
+        renderPass.ExecuteBundles(1, &bundle);
+    }
+    else
+    {
+        EncodeScene(renderPass, pass, phase);
+    }
+    frameEncodeTime += SDL_GetTicksNS() - startTime;
+}
+
+template <typename Encoder>
+void Application::EncodeScene(Encoder encoder, ScenePass pass, GpuCuller::Phase phase)
+{
+    encoder.SetPipeline(pipelines[static_cast<uint32_t>(pass)]);
+
+    // One instanced draw per level of detail of each batch, of the instances left there by the
+    // culling pass. Whole slabs are bound, so that meshes sharing them only differ by their
+    // draw ranges and bindings only change with the material or the slab.
+    std::span<const uint32_t> dynamicOffsets = uniformRing.GetDynamicOffsets();
+    wgpu::Buffer boundVertexBuffer           = nullptr;
+    wgpu::Buffer boundIndexBuffer            = nullptr;
+    Scene::MaterialId boundMaterial          = UINT32_MAX;
+    std::span<const Scene::Batch> batches    = scene.GetBatches();
+    for (uint32_t batchIndex = 0; batchIndex < batches.size(); ++batchIndex)
+    {
+        const Scene::Batch& batch = batches[batchIndex];
+        const Mesh& mesh          = meshes[batch.mesh];
+        wgpu::Buffer vertexBuffer = vertexPool.GetBuffer(mesh.vertices);
+        if (vertexBuffer.Get() != boundVertexBuffer.Get())
+        {
+            // The positions, then the other attributes unless only the depth is drawn
+            uint32_t streamCount = pass == ScenePass::DepthPrepass ? 1 : 2;
+            for (uint32_t stream = 0; stream < streamCount; ++stream)
+            {
+                encoder.SetVertexBuffer(stream,
+                                        vertexBuffer,
+                                        vertexPool.GetStreamOffset(mesh.vertices, stream),
+                                        vertexPool.GetStreamSize(mesh.vertices, stream));
+            }
+            boundVertexBuffer = vertexBuffer;
+        }
+        if (batch.material != boundMaterial)
+        {
+            encoder.SetBindGroup(0,
+                                 materials[batch.material].bindGroup,
+                                 dynamicOffsets.size(),
+                                 dynamicOffsets.data());
+            boundMaterial = batch.material;
+        }
+
+        // Without indirect draws the finest level is drawn, for lack of per-instance counts, and
+        // the culler leaves every instance in its list
+        size_t lodCount = isIndirectDrawSupported ? mesh.lods.size() : 1;
+        for (uint32_t lod = 0; lod < lodCount; ++lod)
+        {
+            wgpu::Buffer indexBuffer = lod == 0 && IsClusterCulled(batch)
+                                           ? clusterCuller.GetIndexBuffer()
+                                           : indexPool.GetBuffer(mesh.indices);
+            if (indexBuffer.Get() != boundIndexBuffer.Get())
+            {
+                encoder.SetIndexBuffer(indexBuffer,
+                                       wgpu::IndexFormat::Uint32,
+                                       0,
+                                       indexBuffer.GetSize());
+                boundIndexBuffer = indexBuffer;
+            }
+
+            if (isIndirectDrawSupported)
+            {
+                uint64_t offset = culler.GetDrawArgsOffset(batchIndex, lod, phase);
+                encoder.DrawIndexedIndirect(culler.GetDrawArgsBuffer(), offset);
+            }
+            else if (phase == GpuCuller::Phase::Early)
+            {
+                uint32_t firstVertex = vertexPool.GetFirstElement(mesh.vertices);
+                encoder.DrawIndexed(mesh.lods[0].indexCount,
+                                    batch.instanceCount,
+                                    indexPool.GetFirstElement(mesh.indices),
+                                    static_cast<int32_t>(firstVertex),
+                                    culler.GetFirstVisibleInstance(batchIndex));
+            }
+        }
+    }
+}
+
+wgpu::RenderBundle Application::GetSceneBundle(ScenePass pass, GpuCuller::Phase phase)
+{
+    // One bundle per pass, phase and slice of the uniform ring
+    uint32_t sliceCount = uniformRing.GetSliceCount();
+    uint32_t list       = static_cast<uint32_t>(pass) * 2 + static_cast<uint32_t>(phase);
+    sceneBundles.resize(kScenePassCount * 2 * sliceCount);
+    wgpu::RenderBundle& bundle = sceneBundles[list * sliceCount + uniformRing.GetSliceIndex()];
+    if (bundle)
+    {
+        return bundle;
+    }
+
+    // The formats must match those of the render pass, which has no color for the prepass
+    wgpu::RenderBundleEncoderDescriptor bundleEncoderDesc {};
+    bundleEncoderDesc.label              = WebGPUUtils::GenerateString("Scene bundle encoder");
+    bundleEncoderDesc.colorFormatCount   = pass == ScenePass::DepthPrepass ? 0 : 1;
+    bundleEncoderDesc.colorFormats       = &surfaceFormat;
+    bundleEncoderDesc.depthStencilFormat = depthTextureFormat;
+    bundleEncoderDesc.sampleCount        = 1;
+    bundleEncoderDesc.depthReadOnly      = false;
+    bundleEncoderDesc.stencilReadOnly    = true;
+
+    wgpu::RenderBundleEncoder bundleEncoder = device.CreateRenderBundleEncoder(&bundleEncoderDesc);
+    EncodeScene(bundleEncoder, pass, phase);
+
+    wgpu::RenderBundleDescriptor bundleDesc {};
+    bundleDesc.label = WebGPUUtils::GenerateString("Scene bundle");
+    bundle           = bundleEncoder.Finish(&bundleDesc);
+    return bundle;
+}
+
+void Application::InvalidateSceneBundles()
+{
+    sceneBundles.clear();
+}
+
+void Application::PopulateScene()
+{
+    // Copies of the mesh side by side, centered on the origin
+    float spacing    = GetInstanceSpacing();
+    float gridOrigin = -0.5f * spacing * (instanceGridSize - 1);
+
+    scene.Clear();
+    for (int y = 0; y < instanceGridSize; ++y)
+    {
+        for (int x = 0; x < instanceGridSize; ++x)
+        {
+            glm::vec3 position(gridOrigin + spacing * x, gridOrigin + spacing * y, 0.0f);
+            scene.AddInstance(0, 0, glm::translate(glm::mat4x4(1.0f), position));
+        }
+    }
+}
+
+float Application::GetInstanceSpacing() const
+{
+    glm::vec3 extent = meshes[0].boundsMax - meshes[0].boundsMin;
+    return 1.25f * std::max(extent.x, extent.y);
+}
+
+bool Application::IsClusterCulled(const Scene::Batch& batch) const
+{
+    return isIndirectDrawSupported && batch.instanceCount <= ClusterCuller::kMaxInstanceCount;
+}
+
+void Application::UpdateDrawBatches()
+{
+    // Repack the pools once their free space is scattered, the draws below then reading the
+    // moved ranges from the handles of the meshes
+    for (BufferPool* pool : {&vertexPool, &indexPool})
+    {
+        if (pool->GetStats().fragmentation > kMaxPoolFragmentation)
+        {
+            pool->Defragment();
+            pool->Flush();
+            pool->LogStats();
+        }
+    }
+
+    std::span<const Scene::Batch> batches = scene.GetBatches();
+
+    // Batches of few instances also cull the meshlets of their mesh
+    std::vector<ClusterCuller::Batch> clusterBatches;
+    for (uint32_t batchIndex = 0; batchIndex < batches.size(); ++batchIndex)
+    {
+        const Scene::Batch& batch = batches[batchIndex];
+        if (IsClusterCulled(batch))
+        {
+            clusterBatches.push_back({meshes[batch.mesh].clusterMesh,
+                                      batch.firstInstance,
+                                      batch.instanceCount,
+                                      batchIndex});
+        }
+    }
+    clusterCuller.SetBatches(clusterBatches, scene.GetInstanceBuffer());
+
+    // Bounding spheres around the bounding boxes of the meshes
+    std::vector<GpuCuller::DrawBatch> drawBatches;
+    uint32_t clusterBatch = 0;
+    for (const Scene::Batch& batch : batches)
+    {
+        const Mesh& mesh = meshes[batch.mesh];
+        glm::vec3 center = 0.5f * (mesh.boundsMin + mesh.boundsMax);
+        float radius     = 0.5f * glm::length(mesh.boundsMax - mesh.boundsMin);
+
+        GpuCuller::DrawBatch& drawBatch = drawBatches.emplace_back();
+        drawBatch.baseVertex     = static_cast<int32_t>(vertexPool.GetFirstElement(mesh.vertices));
+        drawBatch.firstInstance  = batch.firstInstance;
+        drawBatch.instanceCount  = batch.instanceCount;
+        drawBatch.boundingSphere = glm::vec4(center, radius);
+
+        // The finest level of a cluster culled batch is drawn from the compacted indices
+        uint32_t firstIndex = indexPool.GetFirstElement(mesh.indices);
+        for (const MeshLod& lod : mesh.lods)
+        {
+            drawBatch.lods.push_back({lod.indexCount, firstIndex + lod.firstIndex, lod.error});
+        }
+        if (IsClusterCulled(batch))
+        {
+            drawBatch.lods[0].firstIndex = clusterCuller.GetFirstIndex(clusterBatch++);
+        }
+    }
+    culler.SetBatches(drawBatches, scene.GetInstanceBuffer());
+    InvalidateSceneBundles();
+}
+
+void Application::StartEncodeBenchmark()
+{
+    auto configure = [this](int gridSize, int batchSize, bool isBundled)
+    {
+        if (instanceGridSize != gridSize)
+        {
+            instanceGridSize = gridSize;
+            PopulateScene();
+            lightsChanged = true;
+        }
+        maxBatchSize = batchSize;
+        scene.SetMaxBatchSize(static_cast<uint32_t>(maxBatchSize));
+        isRenderBundleEnabled = isBundled;
+    };
+
+    // From one draw per instance to one per batch, each encoded directly then from bundles
+    std::vector<FrameBenchmark::Step> steps;
+    for (int gridSize : {50, 100, 200})
+    {
+        for (int batchSize : {1, 16, 256, 65536})
+        {
+            for (bool isBundled : {false, true})
+            {
+                char label[96];
+                snprintf(label,
+                         sizeof(label),
+                         "%dx%d grid, %d instances per draw, %s",
+                         gridSize,
+                         gridSize,
+                         batchSize,
+                         isBundled ? "render bundles" : "direct");
+                steps.push_back({label,
+                                 [configure, gridSize, batchSize, isBundled]()
+                                 {
+                                     configure(gridSize, batchSize, isBundled);
+                                 }});
+            }
+        }
+    }
+
+    std::vector<FrameBenchmark::Metric> metrics = {{"scene encoding",
+                                                    [this]()
+                                                    {
+                                                        return frameEncodeTime / 1000000.0;
+                                                    }}};
+    frameBenchmark.Start("Encoding",
+                         std::move(metrics),
+                         std::move(steps),
+                         [configure,
+                          gridSize  = instanceGridSize,
+                          batchSize = maxBatchSize,
+                          isBundled = isRenderBundleEnabled]()
+                         {
+                             configure(gridSize, batchSize, isBundled);
+                         });
 }
 
 void Application::SetDefaultLimits(wgpu::Limits& limits) const
@@ -4,6 +4,9 @@
 #include <webgpu/webgpu_cpp.h>
 #include <array>
 #include <cassert>
+#include <filesystem>
+#include <string>
+#include <vector>
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_FORCE_LEFT_HANDED
@@ -12,18 +15,21 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/polar_coordinates.hpp>
 
-struct VertexAttributes
-{
-    glm::vec3 position;
-    // Texture mapping attributes represent the local frame in which
-    // normals sampled from the normal map are expressed.
-    glm::vec3 tangent;    // T = local X axis
-    glm::vec3 bitangent;  // B = local Y axis
-    glm::vec3 normal;     // N = local Z axis
-
-    glm::vec3 color;
-    glm::vec2 uv;
-};
+#include "AssetPack.h"
+#include "BufferPool.h"
+#include "ClusterCuller.h"
+#include "DepthPyramid.h"
+#include "FileWatcher.h"
+#include "FrameBenchmark.h"
+#include "GpuCuller.h"
+#include "GpuTimer.h"
+#include "LightClusterer.h"
+#include "PipelineCache.h"
+#include "Scene.h"
+#include "ShaderVariants.h"
+#include "TextureStreamer.h"
+#include "UniformRing.h"
+#include "VertexFormat.h"
 
 class Application
 {
@@ -41,6 +47,19 @@ public:
     bool IsRunning();
 
 private:
+    // Ways of drawing the scene, each with its own pipeline
+    enum class ScenePass
+    {
+        // Shading with depth test and writes
+        Shaded,
+        // Positions alone, filling the depth buffer before shading
+        DepthPrepass,
+        // Shading of the fragments left by the depth prepass, with an equal depth test
+        ShadedAfterPrepass,
+    };
+
+    static constexpr uint32_t kScenePassCount = 3;
+
     bool InitializeWindowAndDevice();
 
     bool InitializeDepthBuffer();
@@ -49,14 +68,31 @@ private:
 
     bool InitializePipeline();
 
+    // Select the cheapest shader variant for the material and the lights, and switch to it
+    void UpdateShaderVariant();
+
+    wgpu::ShaderModule LoadShaderVariant(const ShaderVariants::Variant& variant);
+
+    // Start compiling the render pipelines, which replace the current ones once all are ready
+    void CreatePipeline(const ShaderVariants::Variant& variant, wgpu::ShaderModule shaderModule);
+
+    // Recompile the pipelines of an edited shader, keeping the current ones on errors
+    void ReloadShader(const std::filesystem::path& path);
+
     bool InitializeTexture();
 
     bool InitializeGeometry();
 
+    bool InitializeScene();
+
+    bool InitializeCulling();
+
     bool InitializeUniforms();
 
     bool InitializeLightingUniforms();
 
+    bool InitializeLights();
+
     bool InitializeBindGroups();
 
     bool InitializeGUI();
@@ -80,6 +116,34 @@ private:
 
     // Lighting
     void UpdateLightingUniforms();
+    // Scatter clusteredLightCount point and spot lights over the scene
+    void SpawnLights();
+    // Move the clustered lights and upload them, returning true when their buffer was recreated
+    bool UpdateLights();
+    // Log the CPU and GPU time of the frames for several counts of clustered lights
+    void StartLightBenchmark();
+
+    // Scene
+    void PopulateScene();
+    // Distance between the copies of the mesh in the grid
+    float GetInstanceSpacing() const;
+    // Draw the batches of the scene with the arguments of a culling phase
+    void DrawScene(wgpu::RenderPassEncoder renderPass, ScenePass pass, GpuCuller::Phase phase);
+    // Record the draws of DrawScene into a render pass or a render bundle
+    template <typename Encoder>
+    void EncodeScene(Encoder encoder, ScenePass pass, GpuCuller::Phase phase);
+    // Render bundle of the draws of a pass, recorded on first use after InvalidateSceneBundles
+    wgpu::RenderBundle GetSceneBundle(ScenePass pass, GpuCuller::Phase phase);
+    // Drop the recorded draws, after the pipelines, the bindings or the batches changed
+    void InvalidateSceneBundles();
+    // Whether a batch is drawn from the indices compacted by the ClusterCuller
+    bool IsClusterCulled(const Scene::Batch& batch) const;
+    // Hand the batches of the scene to the culler, after they or the instance buffer changed,
+    // defragmenting the vertex and index pools first when needed
+    void UpdateDrawBatches();
+    // Log the encoding time of the scene over grid sizes and batch limits, with and without
+    // render bundles
+    void StartEncodeBenchmark();
 
     // GUI
     void TerminateGUI();
@@ -89,10 +153,12 @@ private:
     {
         glm::mat4x4 projectionMatrix;
         glm::mat4x4 viewMatrix;
-        glm::mat4x4 modelMatrix;
         glm::vec4 color;
         glm::vec3 cameraWorldPosition;
         float time;
+        // Dequantization of packed vertex positions: position * scale + offset
+        glm::vec4 positionScale;
+        glm::vec4 positionOffset;
     };
 
     static_assert(sizeof(MyUniforms) % 16 == 0);
@@ -109,6 +175,41 @@ private:
 
     static_assert(sizeof(LightingUniforms) % 16 == 0);
 
+    // Geometry of a mesh, suballocated from the vertex and index pools
+    struct Mesh
+    {
+        BufferPool::Handle vertices = BufferPool::kInvalidHandle;
+        BufferPool::Handle indices  = BufferPool::kInvalidHandle;
+        // From the finest, their first index being relative to indices
+        std::vector<MeshLod> lods;
+        // Id of the mesh in the ClusterCuller
+        uint32_t clusterMesh = 0;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
+
+    // Textures of a material, and the bind group drawing with them
+    struct Material
+    {
+        TextureStreamer::Handle baseColorTexture = TextureStreamer::kInvalidHandle;
+        // kInvalidHandle without a normal map, flatNormalTexture being bound instead
+        TextureStreamer::Handle normalTexture = TextureStreamer::kInvalidHandle;
+        wgpu::BindGroup bindGroup             = nullptr;
+    };
+
+    // Orbit of a clustered light around the vertical axis through the center of the grid
+    struct LightMotion
+    {
+        // Distance to the axis, relative to half the size of the grid
+        float radius;
+        float angle;
+        // In radians per second
+        float speed;
+        // Height and range, relative to the spacing of the instances
+        float height;
+        float range;
+    };
+
     struct CameraState
     {
         // angles.x is the rotation of the camera around the global vertical axis, affected by mouse.x
@@ -137,32 +238,98 @@ private:
         float intertia = 0.9f;
     };
 
+    // Declared first to outlive the device, which may store blobs until it is released
+    PipelineCache pipelineCache;
+
     SDL_Window* window                     = nullptr;
     wgpu::Device device                    = nullptr;
     wgpu::Queue queue                      = nullptr;
     wgpu::Surface surface                  = nullptr;
-    wgpu::RenderPipeline pipeline          = nullptr;
     wgpu::TextureFormat surfaceFormat      = wgpu::TextureFormat::Undefined;
-    wgpu::Buffer pointBuffer               = nullptr;
-    uint32_t indexCount                    = 0;
-    wgpu::Buffer uniformBuffer             = nullptr;
-    wgpu::Buffer lightingUniformBuffer     = nullptr;
+    VertexFormat vertexFormat              = VertexFormat::Packed;
     wgpu::PipelineLayout layout            = nullptr;
     wgpu::BindGroupLayout bindGroupLayout  = nullptr;
-    wgpu::BindGroup bindGroup              = nullptr;
     wgpu::TextureFormat depthTextureFormat = wgpu::TextureFormat::Depth24Plus;
     wgpu::Texture depthTexture             = nullptr;
     wgpu::TextureView depthTextureView     = nullptr;
-    wgpu::Texture baseColorTexture         = nullptr;
-    wgpu::TextureView baseColorTextureView = nullptr;
-    wgpu::Texture normalTexture            = nullptr;
-    wgpu::TextureView normalTextureView    = nullptr;
     wgpu::Sampler sampler                  = nullptr;
 
+    BufferPool vertexPool;
+    BufferPool indexPool;
+    // Indexed by Scene::MeshId and Scene::MaterialId
+    std::vector<Mesh> meshes;
+    std::vector<Material> materials;
+
+    Scene scene;
+    // The scene is a square grid of copies of the mesh
+    int instanceGridSize = 1;
+
+    GpuCuller culler;
+    // Reduction of the depth of the early draws, for occlusion culling
+    DepthPyramid depthPyramid;
+    ClusterCuller clusterCuller;
+    // Culled batches are drawn indirectly, which needs IndirectFirstInstance
+    bool isIndirectDrawSupported   = false;
+    bool isCullingEnabled          = true;
+    bool isOcclusionCullingEnabled = true;
+    bool isClusterCullingEnabled   = true;
+    bool isLodEnabled              = true;
+    // Largest error of the levels of detail drawn, in pixels
+    float lodErrorThreshold = 1.0f;
+    // Outcome of the last culling read back, shown in the GUI
+    GpuCuller::Stats cullingStats {};
+    // Set from the GUI to check the GPU visible counts against the CPU after the next frame
+    bool isCullingCheckRequested = false;
+
+    // Draws of the scene for each pass, phase and slice of the uniform ring, whose dynamic
+    // offsets they bind, replayed instead of being encoded every frame
+    std::vector<wgpu::RenderBundle> sceneBundles;
+    bool isRenderBundleEnabled = true;
+    // Fill the depth buffer from the positions first, so that each pixel is shaded once
+    bool isDepthPrepassEnabled = false;
+    // Limit of the instances of a draw, splitting batches to benchmark many draws
+    int maxBatchSize = 65536;
+    // CPU time spent encoding or replaying the draws of the scene, averaged over frames
+    double sceneEncodeTime = 0.0;
+    Uint64 frameEncodeTime = 0;
+    // CPU time of the last frame, without the wait for the next one
+    Uint64 frameCpuTime = 0;
+    GpuTimer gpuTimer;
+    // Sweep started from the GUI, measuring the frames until it is done
+    FrameBenchmark frameBenchmark;
+
+    // Declared before the streamer, which reads texture data from it
+    AssetPack assetPack;
+
+    TextureStreamer textureStreamer;
+    // Normal along the surface normal, for the materials without a normal map
+    TextureStreamer::Handle flatNormalTexture = TextureStreamer::kInvalidHandle;
+
+    // Variants of the render shader, preprocessed at runtime from shaderSource unless it is
+    // empty, in which case they are precompiled in the asset pack
+    std::vector<ShaderVariants::Variant> shaderVariants;
+    const ShaderVariants::Variant* shaderVariant = nullptr;
+    std::string shaderSource;
+
+    FileWatcher shaderWatcher;
+    // Indexed by ScenePass
+    std::array<wgpu::RenderPipeline, kScenePassCount> pipelines;
+    // Incremented by each pipeline creation, only the latest one may replace the pipelines
+    uint32_t pipelineGeneration = 0;
+
+    UniformRing uniformRing;
     MyUniforms uniforms;
     LightingUniforms lightingUniforms;
     bool lightingUniformsChanged = true;
 
+    // Point and spot lights, binned into the clusters of the view every frame
+    LightClusterer lightClusterer;
+    std::vector<LightClusterer::Light> lights;
+    std::vector<LightMotion> lightMotions;
+    int clusteredLightCount      = 32;
+    bool isLightAnimationEnabled = true;
+    bool lightsChanged           = true;
+
     CameraState cameraState;
     DragState dragState;
 
@@ -0,0 +1,275 @@
+#include "AssetPack.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+namespace
+{
+    constexpr uint32_t kAssetPackMagic = 0x4B415054;  // "TPAK"
+    // Bump whenever the layout of the pack changes
+    constexpr uint32_t kAssetPackVersion = 1;
+    // Alignment of the table of contents and of every entry in the file
+    constexpr uint64_t kSectionAlignment = 16;
+    // zlib compression level of Deflate entries
+    constexpr int kCompressionQuality = 8;
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}  // namespace
+
+struct AssetPack::Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    // Size of the names, which directly follow the entries
+    uint32_t namesSize;
+};
+
+// The entries directly follow the header, sorted by name
+struct AssetPack::Entry
+{
+    // Location of the stored data from the beginning of the file
+    uint64_t offset;
+    uint64_t size;
+
+    // Size and hash of the data once inflated, see AssetSource::Stamp
+    uint64_t uncompressedSize;
+    uint64_t hash;
+
+    // Location of the name from the beginning of the names
+    uint32_t nameOffset;
+    uint32_t nameSize;
+    uint32_t compression;
+    uint32_t _pad;
+};
+
+bool AssetPack::Open(const std::filesystem::path& packPath,
+                     const std::filesystem::path& looseDirectory)
+{
+    this->looseDirectory = looseDirectory;
+    loadedAssets.clear();
+    if (!file.Open(packPath))
+    {
+        SDL_Log("No asset pack, loading assets from %s", looseDirectory.string().c_str());
+        return false;
+    }
+
+    if (!Validate())
+    {
+        SDL_Log("Ignoring invalid asset pack %s", packPath.string().c_str());
+        file.Close();
+        return false;
+    }
+    return true;
+}
+
+bool AssetPack::Load(std::string_view name, Asset& asset)
+{
+    const Entry* entry = IsPacked() ? FindEntry(name) : nullptr;
+    if (entry && entry->compression == static_cast<uint32_t>(Compression::None))
+    {
+        // Served straight from the mapping
+        asset.data  = {file.GetData() + entry->offset, entry->size};
+        asset.stamp = {entry->uncompressedSize, 0, entry->hash};
+        return true;
+    }
+    if (IsPacked() && !entry)
+    {
+        return false;
+    }
+
+    auto it = loadedAssets.find(std::string(name));
+    if (it == loadedAssets.end())
+    {
+        LoadedAsset loadedAsset;
+        if (entry ? !LoadEntry(*entry, loadedAsset) : !LoadLooseFile(name, loadedAsset))
+        {
+            return false;
+        }
+        it = loadedAssets.emplace(std::string(name), std::move(loadedAsset)).first;
+    }
+    asset = it->second.asset;
+    return true;
+}
+
+bool AssetPack::Write(const std::filesystem::path& packPath, std::vector<SourceEntry> entries)
+{
+    std::sort(entries.begin(),
+              entries.end(),
+              [](const SourceEntry& a, const SourceEntry& b) { return a.name < b.name; });
+
+    std::vector<Entry> packEntries(entries.size());
+    std::string names;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        SourceEntry& source = entries[i];
+        if (source.data.size() > INT_MAX)
+        {
+            SDL_Log("Asset %s is too large to be packed", source.name.c_str());
+            return false;
+        }
+
+        Entry& entry           = packEntries[i];
+        entry.uncompressedSize = source.data.size();
+        entry.hash             = AssetSource::HashBytes(source.data.data(), source.data.size());
+        entry.nameOffset       = static_cast<uint32_t>(names.size());
+        entry.nameSize         = static_cast<uint32_t>(source.name.size());
+        entry.compression      = static_cast<uint32_t>(Compression::None);
+        names                 += source.name;
+
+        if (source.compression == Compression::Deflate)
+        {
+            int compressedSize = 0;
+            unsigned char* compressedData =
+                stbi_zlib_compress(source.data.data(),
+                                   static_cast<int>(source.data.size()),
+                                   &compressedSize,
+                                   kCompressionQuality);
+            if (compressedData && size_t(compressedSize) < source.data.size())
+            {
+                source.data.assign(compressedData, compressedData + compressedSize);
+                entry.compression = static_cast<uint32_t>(Compression::Deflate);
+            }
+            free(compressedData);
+        }
+        entry.size = source.data.size();
+    }
+
+    Header header {};
+    header.magic      = kAssetPackMagic;
+    header.version    = kAssetPackVersion;
+    header.entryCount = static_cast<uint32_t>(entries.size());
+    header.namesSize  = static_cast<uint32_t>(names.size());
+
+    uint64_t namesOffset = sizeof(Header) + packEntries.size() * sizeof(Entry);
+    uint64_t offset      = AlignUp(namesOffset + names.size(), kSectionAlignment);
+    for (Entry& entry : packEntries)
+    {
+        entry.offset = offset;
+        offset       = AlignUp(offset + entry.size, kSectionAlignment);
+    }
+
+    std::vector<unsigned char> packData(offset, 0);
+    memcpy(packData.data(), &header, sizeof(Header));
+    memcpy(packData.data() + sizeof(Header),
+           packEntries.data(),
+           packEntries.size() * sizeof(Entry));
+    memcpy(packData.data() + namesOffset, names.data(), names.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        memcpy(packData.data() + packEntries[i].offset,
+               entries[i].data.data(),
+               entries[i].data.size());
+    }
+    return AssetSource::WriteCacheFile(packPath, packData);
+}
+
+const AssetPack::Header* AssetPack::GetHeader() const
+{
+    return reinterpret_cast<const Header*>(file.GetData());
+}
+
+const AssetPack::Entry* AssetPack::GetEntries() const
+{
+    return reinterpret_cast<const Entry*>(file.GetData() + sizeof(Header));
+}
+
+std::string_view AssetPack::GetName(const Entry& entry) const
+{
+    const char* names = reinterpret_cast<const char*>(GetEntries() + GetHeader()->entryCount);
+    return {names + entry.nameOffset, entry.nameSize};
+}
+
+const AssetPack::Entry* AssetPack::FindEntry(std::string_view name) const
+{
+    const Entry* first = GetEntries();
+    const Entry* last  = first + GetHeader()->entryCount;
+    const Entry* entry = std::lower_bound(first,
+                                          last,
+                                          name,
+                                          [this](const Entry& entry, std::string_view name)
+                                          { return GetName(entry) < name; });
+    return entry != last && GetName(*entry) == name ? entry : nullptr;
+}
+
+bool AssetPack::Validate() const
+{
+    size_t size = file.GetSize();
+    if (size < sizeof(Header))
+    {
+        return false;
+    }
+
+    const Header* header = GetHeader();
+    if (header->magic != kAssetPackMagic || header->version != kAssetPackVersion
+        || header->entryCount > (size - sizeof(Header)) / sizeof(Entry)
+        || header->namesSize > size - sizeof(Header) - header->entryCount * sizeof(Entry))
+    {
+        return false;
+    }
+
+    const Entry* entries = GetEntries();
+    for (uint32_t i = 0; i < header->entryCount; ++i)
+    {
+        const Entry& entry = entries[i];
+        if (entry.offset % kSectionAlignment != 0 || entry.offset > size
+            || entry.size > size - entry.offset || entry.nameOffset > header->namesSize
+            || entry.nameSize > header->namesSize - entry.nameOffset
+            || entry.compression > static_cast<uint32_t>(Compression::Deflate))
+        {
+            return false;
+        }
+        // Lookups rely on the entries being sorted by name
+        if (i > 0 && !(GetName(entries[i - 1]) < GetName(entry)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AssetPack::LoadEntry(const Entry& entry, LoadedAsset& loadedAsset) const
+{
+    if (entry.uncompressedSize > INT_MAX || entry.size > INT_MAX)
+    {
+        return false;
+    }
+
+    loadedAsset.inflatedData.resize(entry.uncompressedSize);
+    int inflatedSize =
+        stbi_zlib_decode_buffer(reinterpret_cast<char*>(loadedAsset.inflatedData.data()),
+                                static_cast<int>(entry.uncompressedSize),
+                                reinterpret_cast<const char*>(file.GetData() + entry.offset),
+                                static_cast<int>(entry.size));
+    if (inflatedSize != static_cast<int>(entry.uncompressedSize)
+        || AssetSource::HashBytes(loadedAsset.inflatedData.data(), inflatedSize) != entry.hash)
+    {
+        SDL_Log("Corrupted asset %.*s", static_cast<int>(entry.nameSize), GetName(entry).data());
+        return false;
+    }
+
+    loadedAsset.asset.data  = loadedAsset.inflatedData;
+    loadedAsset.asset.stamp = {entry.uncompressedSize, 0, entry.hash};
+    return true;
+}
+
+bool AssetPack::LoadLooseFile(std::string_view name, LoadedAsset& loadedAsset) const
+{
+    std::filesystem::path path = looseDirectory / name;
+    if (!loadedAsset.looseFile.Open(path) || !AssetSource::GetStamp(path, loadedAsset.asset.stamp))
+    {
+        return false;
+    }
+    loadedAsset.asset.data = {loadedAsset.looseFile.GetData(), loadedAsset.looseFile.GetSize()};
+    return true;
+}
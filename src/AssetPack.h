@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "AssetSource.h"
+#include "MappedFile.h"
+
+/**
+ * Read-only archive of the application assets, memory-mapped as a single file. Entries are
+ * looked up by name in a sorted table of contents and returned as spans into the mapping,
+ * except for compressed entries which are inflated once on first access. When there is no
+ * pack, assets are read as loose files from a fallback directory instead.
+ */
+class AssetPack
+{
+public:
+    enum class Compression : uint32_t
+    {
+        None,
+        // zlib stream
+        Deflate,
+    };
+
+    struct Asset
+    {
+        std::span<const unsigned char> data;
+        // Identity of the content, for caches built from the asset
+        AssetSource::Stamp stamp;
+    };
+
+    // Asset to be stored by Write
+    struct SourceEntry
+    {
+        std::string name;
+        std::vector<unsigned char> data;
+        Compression compression = Compression::None;
+    };
+
+    AssetPack() = default;
+
+    AssetPack(const AssetPack&)            = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    /**
+     * Map the pack at packPath. Return false if it is missing or corrupted, in which case
+     * assets are read from looseDirectory.
+     */
+    bool Open(const std::filesystem::path& packPath,
+              const std::filesystem::path& looseDirectory);
+
+    bool IsPacked() const
+    {
+        return file.IsOpen();
+    }
+
+    /**
+     * Get the content of an asset from its name, a path relative to the root of the pack.
+     * The data stays valid as long as the pack is alive. Not thread safe.
+     */
+    bool Load(std::string_view name, Asset& asset);
+
+    /**
+     * Write a pack holding the given entries. Entries are stored uncompressed when
+     * compression would not make them smaller.
+     */
+    static bool Write(const std::filesystem::path& packPath, std::vector<SourceEntry> entries);
+
+private:
+    struct Header;
+    struct Entry;
+
+    // Storage of the assets that cannot be returned straight from the mapping
+    struct LoadedAsset
+    {
+        Asset asset;
+        std::vector<unsigned char> inflatedData;
+        MappedFile looseFile;
+    };
+
+    const Header* GetHeader() const;
+    const Entry* GetEntries() const;
+    std::string_view GetName(const Entry& entry) const;
+    const Entry* FindEntry(std::string_view name) const;
+
+    // Check that the table of contents describes ranges lying within the file
+    bool Validate() const;
+
+    bool LoadEntry(const Entry& entry, LoadedAsset& loadedAsset) const;
+    bool LoadLooseFile(std::string_view name, LoadedAsset& loadedAsset) const;
+
+    MappedFile file;
+    std::filesystem::path looseDirectory;
+    std::unordered_map<std::string, LoadedAsset> loadedAssets;
+};
@@ -0,0 +1,127 @@
+#include "AssetSource.h"
+
+#include <SDL3/SDL_log.h>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+#include "MappedFile.h"
+
+namespace
+{
+    struct SourceInfo
+    {
+        bool exists       = false;
+        uint64_t size     = 0;
+        int64_t writeTime = 0;
+    };
+
+    SourceInfo GetSourceInfo(const std::filesystem::path& sourcePath)
+    {
+        SourceInfo info;
+        std::error_code error;
+        info.size = std::filesystem::file_size(sourcePath, error);
+        if (error)
+        {
+            return info;
+        }
+        auto writeTime = std::filesystem::last_write_time(sourcePath, error);
+        if (error)
+        {
+            return info;
+        }
+        info.writeTime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+        info.exists    = true;
+        return info;
+    }
+
+    bool HashSource(const std::filesystem::path& sourcePath, uint64_t& hash)
+    {
+        MappedFile source;
+        if (!source.Open(sourcePath))
+        {
+            return false;
+        }
+        hash = AssetSource::HashBytes(source.GetData(), source.GetSize());
+        return true;
+    }
+}  // namespace
+
+namespace AssetSource
+{
+    uint64_t HashBytes(const unsigned char* bytes, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull ^ size;
+        size_t i      = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, bytes + i, sizeof(word));
+            hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+            hash ^= hash >> 29;
+        }
+        for (; i < size; ++i)
+        {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool GetStamp(const std::filesystem::path& sourcePath, Stamp& stamp)
+    {
+        SourceInfo source = GetSourceInfo(sourcePath);
+        stamp.size        = source.size;
+        stamp.writeTime   = source.writeTime;
+        return source.exists && HashSource(sourcePath, stamp.hash);
+    }
+
+    bool Matches(const std::filesystem::path& sourcePath, const Stamp& stamp)
+    {
+        SourceInfo source = GetSourceInfo(sourcePath);
+        if (!source.exists || stamp.writeTime == source.writeTime)
+        {
+            return true;
+        }
+        uint64_t sourceHash = 0;
+        return stamp.size == source.size && HashSource(sourcePath, sourceHash)
+               && stamp.hash == sourceHash;
+    }
+
+    bool Matches(const Stamp& source, const Stamp& stamp)
+    {
+        return source.size == stamp.size && source.hash == stamp.hash;
+    }
+
+    bool WriteCacheFile(const std::filesystem::path& cachePath,
+                        std::span<const unsigned char> data)
+    {
+        std::error_code error;
+        if (cachePath.has_parent_path())
+        {
+            std::filesystem::create_directories(cachePath.parent_path(), error);
+        }
+
+        std::filesystem::path temporaryPath = cachePath;
+        temporaryPath += ".tmp";
+        {
+            std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+            output.write(reinterpret_cast<const char*>(data.data()), data.size());
+            if (!output)
+            {
+                SDL_Log("Could not write cache %s", cachePath.string().c_str());
+                return false;
+            }
+        }
+        std::filesystem::rename(temporaryPath, cachePath, error);
+        if (error)
+        {
+            SDL_Log("Could not write cache %s: %s",
+                    cachePath.string().c_str(),
+                    error.message().c_str());
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+        return true;
+    }
+
+}  // namespace AssetSource
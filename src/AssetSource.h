@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+namespace AssetSource
+{
+    // Identity of the source asset a cache was built from
+    struct Stamp
+    {
+        uint64_t size     = 0;
+        int64_t writeTime = 0;
+        uint64_t hash     = 0;
+    };
+
+    // 64-bit hash over 8-byte words, with FNV-1a over the remaining tail
+    uint64_t HashBytes(const unsigned char* bytes, size_t size);
+
+    // Stamp the asset at sourcePath, return false if it cannot be read
+    bool GetStamp(const std::filesystem::path& sourcePath, Stamp& stamp);
+
+    /**
+     * Whether the asset at sourcePath still matches a stamp, compared by size and modification
+     * time, then by content hash when only the time differs. A missing source matches, so
+     * that caches can be shipped without their sources.
+     */
+    bool Matches(const std::filesystem::path& sourcePath, const Stamp& stamp);
+
+    // Whether two stamps describe the same content, compared by size and hash only
+    bool Matches(const Stamp& source, const Stamp& stamp);
+
+    /**
+     * Write a cache through a temporary file renamed in place, so that a reader never sees
+     * a partial cache. Missing parent directories are created. Failures are logged.
+     */
+    bool WriteCacheFile(const std::filesystem::path& cachePath,
+                        std::span<const unsigned char> data);
+
+}  // namespace AssetSource
@@ -0,0 +1,374 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+
+#include "ThreadPool.h"
+
+namespace
+{
+    // Block rows handled by one task of the thread pool
+    constexpr size_t kBlockRowsPerTask = 4;
+    // Interpolation weights of 4-bit BC7 indices, out of 64
+    constexpr int kBC7Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    using Block = unsigned char[16][4];
+
+    // Gather the texels of a block, repeating the edge texels past the image border
+    void LoadBlock(const unsigned char* pixels,
+                   uint32_t width,
+                   uint32_t height,
+                   uint32_t blockX,
+                   uint32_t blockY,
+                   Block& block)
+    {
+        for (uint32_t y = 0; y < 4; ++y)
+        {
+            uint32_t row = std::min(blockY * 4 + y, height - 1);
+            for (uint32_t x = 0; x < 4; ++x)
+            {
+                uint32_t column          = std::min(blockX * 4 + x, width - 1);
+                const unsigned char* src = pixels + 4 * (size_t(row) * width + column);
+                std::copy(src, src + 4, block[4 * y + x]);
+            }
+        }
+    }
+
+    // Append bits to a 128-bit block, least significant first
+    struct BitWriter
+    {
+        unsigned char* bytes;
+        uint32_t position = 0;
+
+        void Write(uint32_t value, uint32_t bitCount)
+        {
+            for (uint32_t i = 0; i < bitCount; ++i, ++position)
+            {
+                if (value >> i & 1)
+                {
+                    bytes[position / 8] |= static_cast<unsigned char>(1 << position % 8);
+                }
+            }
+        }
+    };
+
+    // BC7 mode 6 endpoint: 7 bits per channel and a shared p-bit appended as LSB
+    struct BC7Endpoint
+    {
+        int value[4];
+        int pBit;
+
+        int Expand(int channel) const
+        {
+            return value[channel] << 1 | pBit;
+        }
+    };
+
+    BC7Endpoint QuantizeBC7Endpoint(const float color[4])
+    {
+        BC7Endpoint best {};
+        float bestError = INFINITY;
+        for (int pBit = 0; pBit < 2; ++pBit)
+        {
+            BC7Endpoint endpoint {{}, pBit};
+            float error = 0.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+                float quantized   = std::round((color[c] - pBit) / 2.0f);
+                endpoint.value[c] = static_cast<int>(std::clamp(quantized, 0.0f, 127.0f));
+                float difference  = static_cast<float>(endpoint.Expand(c)) - color[c];
+                error            += difference * difference;
+            }
+            if (error < bestError)
+            {
+                best      = endpoint;
+                bestError = error;
+            }
+        }
+        return best;
+    }
+
+    // Pick the closest palette entry for each texel, return the total squared error
+    int AssignBC7Indices(const Block& block,
+                         const BC7Endpoint& e0,
+                         const BC7Endpoint& e1,
+                         int indices[16])
+    {
+        int palette[16][4];
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                palette[i][c] =
+                    ((64 - kBC7Weights[i]) * e0.Expand(c) + kBC7Weights[i] * e1.Expand(c) + 32)
+                    >> 6;
+            }
+        }
+
+        int totalError = 0;
+        for (int t = 0; t < 16; ++t)
+        {
+            int bestError = INT32_MAX;
+            for (int i = 0; i < 16; ++i)
+            {
+                int error = 0;
+                for (int c = 0; c < 4; ++c)
+                {
+                    int difference = palette[i][c] - block[t][c];
+                    error         += difference * difference;
+                }
+                if (error < bestError)
+                {
+                    bestError  = error;
+                    indices[t] = i;
+                }
+            }
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    /**
+     * Least squares endpoints for the given indices, solving for each channel
+     * x = (1 - w) * e0 + w * e1 over the 16 texels. Return false if the system is singular.
+     */
+    bool FitBC7Endpoints(const Block& block, const int indices[16], float e0[4], float e1[4])
+    {
+        float a = 0.0f, b = 0.0f, c = 0.0f;
+        float d0[4] = {}, d1[4] = {};
+        for (int t = 0; t < 16; ++t)
+        {
+            float w = kBC7Weights[indices[t]] / 64.0f;
+            a      += (1.0f - w) * (1.0f - w);
+            b      += (1.0f - w) * w;
+            c      += w * w;
+            for (int k = 0; k < 4; ++k)
+            {
+                d0[k] += (1.0f - w) * block[t][k];
+                d1[k] += w * block[t][k];
+            }
+        }
+        float determinant = a * c - b * b;
+        if (std::abs(determinant) < 1e-6f)
+        {
+            return false;
+        }
+        for (int k = 0; k < 4; ++k)
+        {
+            e0[k] = std::clamp((c * d0[k] - b * d1[k]) / determinant, 0.0f, 255.0f);
+            e1[k] = std::clamp((a * d1[k] - b * d0[k]) / determinant, 0.0f, 255.0f);
+        }
+        return true;
+    }
+
+    void EncodeBC7Block(const Block& block, unsigned char* output)
+    {
+        // Principal axis of the texels by power iteration on their covariance
+        float mean[4] = {};
+        for (int t = 0; t < 16; ++t)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                mean[c] += block[t][c] / 16.0f;
+            }
+        }
+        float covariance[4][4] = {};
+        for (int t = 0; t < 16; ++t)
+        {
+            float d[4];
+            for (int c = 0; c < 4; ++c)
+            {
+                d[c] = block[t][c] - mean[c];
+            }
+            for (int i = 0; i < 4; ++i)
+            {
+                for (int j = 0; j < 4; ++j)
+                {
+                    covariance[i][j] += d[i] * d[j];
+                }
+            }
+        }
+        float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+            float next[4] = {};
+            float length  = 0.0f;
+            for (int i = 0; i < 4; ++i)
+            {
+                for (int j = 0; j < 4; ++j)
+                {
+                    next[i] += covariance[i][j] * axis[j];
+                }
+                length += next[i] * next[i];
+            }
+            if (length < 1e-12f)
+            {
+                break;
+            }
+            for (int i = 0; i < 4; ++i)
+            {
+                axis[i] = next[i] / std::sqrt(length);
+            }
+        }
+
+        // Initial endpoints at the extent of the texels along the axis
+        float minProjection = INFINITY, maxProjection = -INFINITY;
+        for (int t = 0; t < 16; ++t)
+        {
+            float projection = 0.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+                projection += (block[t][c] - mean[c]) * axis[c];
+            }
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+        float color0[4], color1[4];
+        for (int c = 0; c < 4; ++c)
+        {
+            color0[c] = std::clamp(mean[c] + minProjection * axis[c], 0.0f, 255.0f);
+            color1[c] = std::clamp(mean[c] + maxProjection * axis[c], 0.0f, 255.0f);
+        }
+
+        BC7Endpoint e0 = QuantizeBC7Endpoint(color0);
+        BC7Endpoint e1 = QuantizeBC7Endpoint(color1);
+        int indices[16];
+        int error = AssignBC7Indices(block, e0, e1, indices);
+
+        // One refinement pass, kept only if it lowers the error
+        if (error > 0 && FitBC7Endpoints(block, indices, color0, color1))
+        {
+            BC7Endpoint refined0 = QuantizeBC7Endpoint(color0);
+            BC7Endpoint refined1 = QuantizeBC7Endpoint(color1);
+            int refinedIndices[16];
+            if (AssignBC7Indices(block, refined0, refined1, refinedIndices) < error)
+            {
+                e0 = refined0;
+                e1 = refined1;
+                std::copy(refinedIndices, refinedIndices + 16, indices);
+            }
+        }
+
+        // The most significant bit of the first index is implicitly 0
+        if (indices[0] & 8)
+        {
+            std::swap(e0, e1);
+            for (int& index : indices)
+            {
+                index = 15 - index;
+            }
+        }
+
+        std::fill(output, output + BlockCompression::kBytesPerBlock, 0);
+        BitWriter writer {output};
+        writer.Write(1 << 6, 7);  // Mode 6
+        for (int c = 0; c < 4; ++c)
+        {
+            writer.Write(e0.value[c], 7);
+            writer.Write(e1.value[c], 7);
+        }
+        writer.Write(e0.pBit, 1);
+        writer.Write(e1.pBit, 1);
+        writer.Write(indices[0], 3);
+        for (int t = 1; t < 16; ++t)
+        {
+            writer.Write(indices[t], 4);
+        }
+    }
+
+    // One channel of a block in the BC4 format, using the 8 value palette
+    void EncodeBC4Block(const Block& block, int channel, unsigned char* output)
+    {
+        int e0 = 0, e1 = 255;
+        for (int t = 0; t < 16; ++t)
+        {
+            e0 = std::max<int>(e0, block[t][channel]);
+            e1 = std::min<int>(e1, block[t][channel]);
+        }
+
+        int palette[8] = {e0, e1};
+        for (int i = 2; i < 8; ++i)
+        {
+            palette[i] = ((8 - i) * e0 + (i - 1) * e1 + 3) / 7;
+        }
+
+        std::fill(output, output + 8, 0);
+        output[0] = static_cast<unsigned char>(e0);
+        output[1] = static_cast<unsigned char>(e1);
+        BitWriter writer {output, 16};
+        for (int t = 0; t < 16; ++t)
+        {
+            int bestIndex = 0;
+            for (int i = 1; i < 8 && e0 > e1; ++i)
+            {
+                if (std::abs(palette[i] - block[t][channel])
+                    < std::abs(palette[bestIndex] - block[t][channel]))
+                {
+                    bestIndex = i;
+                }
+            }
+            writer.Write(bestIndex, 3);
+        }
+    }
+
+    void CompressBlocks(const unsigned char* pixels,
+                        uint32_t width,
+                        uint32_t height,
+                        unsigned char* blocks,
+                        const std::function<void(const Block&, unsigned char*)>& encodeBlock)
+    {
+        uint32_t blocksWide = (width + 3) / 4;
+        uint32_t blocksHigh = (height + 3) / 4;
+        ThreadPool::GetInstance().ParallelFor(
+            blocksHigh,
+            kBlockRowsPerTask,
+            [&](size_t first, size_t last)
+            {
+                Block block;
+                for (size_t y = first; y < last; ++y)
+                {
+                    for (uint32_t x = 0; x < blocksWide; ++x)
+                    {
+                        LoadBlock(pixels, width, height, x, static_cast<uint32_t>(y), block);
+                        size_t blockIndex = y * blocksWide + x;
+                        encodeBlock(block, blocks + blockIndex * BlockCompression::kBytesPerBlock);
+                    }
+                }
+            });
+    }
+}  // namespace
+
+namespace BlockCompression
+{
+    size_t GetCompressedSize(uint32_t width, uint32_t height)
+    {
+        return size_t((width + 3) / 4) * ((height + 3) / 4) * kBytesPerBlock;
+    }
+
+    void CompressBC7(const unsigned char* pixels,
+                     uint32_t width,
+                     uint32_t height,
+                     unsigned char* blocks)
+    {
+        CompressBlocks(pixels, width, height, blocks, EncodeBC7Block);
+    }
+
+    void CompressBC5(const unsigned char* pixels,
+                     uint32_t width,
+                     uint32_t height,
+                     unsigned char* blocks)
+    {
+        CompressBlocks(pixels,
+                       width,
+                       height,
+                       blocks,
+                       [](const Block& block, unsigned char* output)
+                       {
+                           EncodeBC4Block(block, 0, output);
+                           EncodeBC4Block(block, 1, output + 8);
+                       });
+    }
+
+}  // namespace BlockCompression
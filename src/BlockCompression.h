@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace BlockCompression
+{
+    // Size of a block in texels along each axis, and in bytes for both BC5 and BC7
+    constexpr uint32_t kBlockDimension = 4;
+    constexpr uint32_t kBytesPerBlock  = 16;
+
+    // Bytes of an image of the given size once compressed
+    size_t GetCompressedSize(uint32_t width, uint32_t height);
+
+    /**
+     * Compress an RGBA8 image into BC7 blocks. Every block is encoded in mode 6 (one subset,
+     * RGBA endpoints and 4-bit indices) from its principal axis, refined by least squares.
+     * Blocks crossing the image border repeat the edge texels.
+     */
+    void CompressBC7(const unsigned char* pixels,
+                     uint32_t width,
+                     uint32_t height,
+                     unsigned char* blocks);
+
+    /**
+     * Compress the red and green channels of an RGBA8 image into BC5 blocks, e.g. the X and
+     * Y components of a tangent space normal map
+     */
+    void CompressBC5(const unsigned char* pixels,
+                     uint32_t width,
+                     uint32_t height,
+                     unsigned char* blocks);
+
+}  // namespace BlockCompression
@@ -0,0 +1,294 @@
+#include "BufferPool.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "WebGPUUtils.h"
+
+void BufferPool::Initialize(wgpu::Device device,
+                            const char* label,
+                            wgpu::BufferUsage usage,
+                            uint32_t elementSize,
+                            uint64_t slabSize,
+                            std::span<const uint32_t> streamSizes)
+{
+    assert(elementSize % 4 == 0);
+
+    wgpu::Limits limits {};
+    device.GetLimits(&limits);
+
+    this->device      = device;
+    this->label       = label;
+    this->usage       = usage | wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::CopySrc;
+    this->elementSize = elementSize;
+    maxBufferSize     = limits.maxBufferSize;
+    slabElements      = static_cast<uint32_t>(std::min(slabSize, maxBufferSize) / elementSize);
+
+    this->streamSizes.assign(streamSizes.begin(), streamSizes.end());
+    if (this->streamSizes.empty())
+    {
+        this->streamSizes.push_back(elementSize);
+    }
+    streamStarts.clear();
+    uint32_t streamStart = 0;
+    for (uint32_t streamSize : this->streamSizes)
+    {
+        assert(streamSize % 4 == 0);
+        streamStarts.push_back(streamStart);
+        streamStart += streamSize;
+    }
+    assert(streamStart == elementSize);
+}
+
+BufferPool::Handle BufferPool::Allocate(uint32_t elementCount)
+{
+    Range range {0, elementCount, {}};
+    for (; range.slab < slabs.size(); ++range.slab)
+    {
+        range.allocation = slabs[range.slab].allocator.Allocate(elementCount);
+        if (range.allocation.offset != OffsetAllocator::kInvalid)
+        {
+            break;
+        }
+    }
+
+    if (range.slab == slabs.size())
+    {
+        uint32_t slabSize = std::max(slabElements, elementCount);
+        if (uint64_t(slabSize) * elementSize > maxBufferSize)
+        {
+            SDL_Log("%s: %u elements do not fit in a buffer", label, elementCount);
+            return kInvalidHandle;
+        }
+
+        Slab& slab  = slabs.emplace_back();
+        slab.buffer = CreateSlabBuffer(slabSize);
+        slab.allocator.Reset(slabSize);
+        range.allocation = slab.allocator.Allocate(elementCount);
+    }
+
+    Handle handle;
+    if (freeHandles.empty())
+    {
+        handle = static_cast<Handle>(ranges.size());
+        ranges.push_back(range);
+    }
+    else
+    {
+        handle = freeHandles.back();
+        freeHandles.pop_back();
+        ranges[handle] = range;
+    }
+    return handle;
+}
+
+void BufferPool::Free(Handle handle)
+{
+    if (handle == kInvalidHandle)
+    {
+        return;
+    }
+
+    Range& range = ranges[handle];
+    slabs[range.slab].allocator.Free(range.allocation);
+    range.allocation = {};
+    freeHandles.push_back(handle);
+}
+
+void BufferPool::Write(Handle handle, const void* data, uint64_t size)
+{
+    assert(size <= GetSize(handle));
+
+    wgpu::Buffer stagingBuffer =
+        WebGPUUtils::CreateMappedBuffer(device,
+                                        "Buffer pool staging buffer",
+                                        wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::CopySrc,
+                                        size);
+    memcpy(stagingBuffer.GetMappedRange(), data, size);
+    stagingBuffer.Unmap();
+
+    // The staging size is rounded up to 4 bytes, which the range always covers
+    const Range& range    = ranges[handle];
+    uint32_t slabSize     = slabs[range.slab].allocator.GetSize();
+    uint64_t sourceOffset = 0;
+    for (uint32_t stream = 0; stream < streamSizes.size() && sourceOffset < size; ++stream)
+    {
+        uint64_t streamSize = std::min(uint64_t(range.elementCount) * streamSizes[stream],
+                                       stagingBuffer.GetSize() - sourceOffset);
+        GetEncoder().CopyBufferToBuffer(stagingBuffer,
+                                        sourceOffset,
+                                        GetBuffer(handle),
+                                        GetElementOffset(slabSize, range.allocation.offset, stream),
+                                        streamSize);
+        sourceOffset += streamSize;
+    }
+}
+
+uint64_t BufferPool::Defragment()
+{
+    std::vector<Handle> handles;
+    for (Handle handle = 0; handle < ranges.size(); ++handle)
+    {
+        if (ranges[handle].allocation.node != OffsetAllocator::kInvalid)
+        {
+            handles.push_back(handle);
+        }
+    }
+    std::sort(handles.begin(),
+              handles.end(),
+              [this](Handle a, Handle b)
+              {
+                  const Range& rangeA = ranges[a];
+                  const Range& rangeB = ranges[b];
+                  return rangeA.slab != rangeB.slab
+                             ? rangeA.slab < rangeB.slab
+                             : rangeA.allocation.offset < rangeB.allocation.offset;
+              });
+
+    // Fresh allocators hand out consecutive ranges from their start
+    std::vector<Slab> packedSlabs;
+    uint64_t movedSize = 0;
+    for (Handle handle : handles)
+    {
+        Range& range                       = ranges[handle];
+        const Slab& sourceSlab             = slabs[range.slab];
+        uint32_t sourceElement             = range.allocation.offset;
+        uint32_t sourceSize                = sourceSlab.allocator.GetSize();
+        OffsetAllocator::Allocation packed = {};
+        if (!packedSlabs.empty())
+        {
+            packed = packedSlabs.back().allocator.Allocate(range.elementCount);
+        }
+        if (packed.offset == OffsetAllocator::kInvalid)
+        {
+            uint32_t slabSize = std::max(slabElements, range.elementCount);
+            Slab& slab        = packedSlabs.emplace_back();
+            slab.buffer       = CreateSlabBuffer(slabSize);
+            slab.allocator.Reset(slabSize);
+            packed = slab.allocator.Allocate(range.elementCount);
+        }
+
+        range.slab          = static_cast<uint32_t>(packedSlabs.size() - 1);
+        range.allocation    = packed;
+        uint32_t packedSize = packedSlabs.back().allocator.GetSize();
+        for (uint32_t stream = 0; stream < streamSizes.size(); ++stream)
+        {
+            uint64_t size = uint64_t(range.elementCount) * streamSizes[stream];
+            GetEncoder().CopyBufferToBuffer(sourceSlab.buffer,
+                                            GetElementOffset(sourceSize, sourceElement, stream),
+                                            packedSlabs.back().buffer,
+                                            GetElementOffset(packedSize, packed.offset, stream),
+                                            size);
+        }
+        movedSize += uint64_t(range.elementCount) * elementSize;
+    }
+    slabs = std::move(packedSlabs);
+    return movedSize;
+}
+
+void BufferPool::Flush()
+{
+    if (encoder == nullptr)
+    {
+        return;
+    }
+
+    wgpu::CommandBuffer commands = encoder.Finish();
+    device.GetQueue().Submit(1, &commands);
+    encoder = nullptr;
+}
+
+wgpu::Buffer BufferPool::GetBuffer(Handle handle) const
+{
+    return slabs[ranges[handle].slab].buffer;
+}
+
+uint32_t BufferPool::GetFirstElement(Handle handle) const
+{
+    return ranges[handle].allocation.offset;
+}
+
+uint64_t BufferPool::GetOffset(Handle handle) const
+{
+    const Range& range = ranges[handle];
+    return GetElementOffset(slabs[range.slab].allocator.GetSize(), range.allocation.offset, 0);
+}
+
+uint64_t BufferPool::GetSize(Handle handle) const
+{
+    return uint64_t(ranges[handle].elementCount) * elementSize;
+}
+
+uint64_t BufferPool::GetStreamOffset(Handle handle, uint32_t stream) const
+{
+    return uint64_t(slabs[ranges[handle].slab].allocator.GetSize()) * streamStarts[stream];
+}
+
+uint64_t BufferPool::GetStreamSize(Handle handle, uint32_t stream) const
+{
+    return uint64_t(slabs[ranges[handle].slab].allocator.GetSize()) * streamSizes[stream];
+}
+
+BufferPool::Stats BufferPool::GetStats() const
+{
+    Stats stats {static_cast<uint32_t>(slabs.size()), 0, 0, 0, 0.0f};
+    uint64_t freeSize = 0;
+    // Sum of the largest free range of each slab
+    uint64_t contiguousFreeSize = 0;
+    for (const Slab& slab : slabs)
+    {
+        OffsetAllocator::Stats slabStats = slab.allocator.GetStats();
+        uint64_t slabSize                = uint64_t(slab.allocator.GetSize()) * elementSize;
+        uint64_t slabFreeSize            = uint64_t(slabStats.freeSize) * elementSize;
+        uint64_t largestFreeRange        = uint64_t(slabStats.largestFreeRange) * elementSize;
+
+        stats.capacity         += slabSize;
+        stats.usedSize         += slabSize - slabFreeSize;
+        stats.largestFreeRange  = std::max(stats.largestFreeRange, largestFreeRange);
+        freeSize               += slabFreeSize;
+        contiguousFreeSize     += largestFreeRange;
+    }
+    if (freeSize > 0)
+    {
+        stats.fragmentation = 1.0f - float(contiguousFreeSize) / float(freeSize);
+    }
+    return stats;
+}
+
+void BufferPool::LogStats() const
+{
+    Stats stats = GetStats();
+    SDL_Log("%s: %u slabs, %.1f of %.1f MB used, largest free range %.1f MB, fragmentation %.0f%%",
+            label,
+            stats.slabCount,
+            stats.usedSize / (1024.0 * 1024.0),
+            stats.capacity / (1024.0 * 1024.0),
+            stats.largestFreeRange / (1024.0 * 1024.0),
+            stats.fragmentation * 100.0f);
+}
+
+wgpu::Buffer BufferPool::CreateSlabBuffer(uint32_t elementCount) const
+{
+    wgpu::BufferDescriptor bufferDesc {};
+    bufferDesc.label            = WebGPUUtils::GenerateString(label);
+    bufferDesc.size             = uint64_t(elementCount) * elementSize;
+    bufferDesc.usage            = usage;
+    bufferDesc.mappedAtCreation = false;
+    return device.CreateBuffer(&bufferDesc);
+}
+
+uint64_t BufferPool::GetElementOffset(uint32_t slabSize, uint32_t element, uint32_t stream) const
+{
+    return uint64_t(slabSize) * streamStarts[stream] + uint64_t(element) * streamSizes[stream];
+}
+
+wgpu::CommandEncoder BufferPool::GetEncoder()
+{
+    if (encoder == nullptr)
+    {
+        encoder = device.CreateCommandEncoder();
+    }
+    return encoder;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "OffsetAllocator.h"
+
+/**
+ * Suballocator of GPU buffers of one usage class, e.g. vertices or indices. Large slabs are
+ * created on demand and ranges handed out with an OffsetAllocator, so that many meshes share
+ * a few buffers and draws can reuse the same binding.
+ *
+ * Ranges are counted in elements of a fixed size, so that an offset is also a valid first
+ * index or base vertex. Handles stay valid across Defragment, which moves ranges, so the
+ * buffer and offset of a handle must be queried again after it.
+ *
+ * Elements may be split into streams, e.g. the positions and the other attributes of vertices.
+ * Each slab stores its streams one after the other, an element having the same index in all of
+ * them, so that a base vertex applies to every stream bound from the slab.
+ */
+class BufferPool
+{
+public:
+    using Handle = uint32_t;
+
+    static constexpr Handle kInvalidHandle = UINT32_MAX;
+
+    struct Stats
+    {
+        uint32_t slabCount;
+        uint64_t capacity;
+        uint64_t usedSize;
+        uint64_t largestFreeRange;
+        // 0 when the free space of each slab is a single range, close to 1 when it is scattered
+        float fragmentation;
+    };
+
+    /**
+     * elementSize must be a multiple of 4, as required by buffer copies and vertex buffer
+     * offsets. A range larger than slabSize gets a slab of its own. streamSizes splits the
+     * elements into streams of these sizes, multiples of 4 summing to elementSize, and is
+     * empty for a single stream.
+     */
+    void Initialize(wgpu::Device device,
+                    const char* label,
+                    wgpu::BufferUsage usage,
+                    uint32_t elementSize,
+                    uint64_t slabSize,
+                    std::span<const uint32_t> streamSizes = {});
+
+    // Return kInvalidHandle if the range does not fit in a buffer of the device
+    Handle Allocate(uint32_t elementCount);
+    void Free(Handle handle);
+
+    /**
+     * Copy data to the start of a range through a staging buffer mapped at creation, the
+     * elements of each stream following those of the previous one. The copies are submitted
+     * by the next Flush.
+     */
+    void Write(Handle handle, const void* data, uint64_t size);
+
+    /**
+     * Repack all ranges, in order, into as few new slabs as possible, the copies happening on
+     * the GPU, and release the old slabs. Return the number of bytes moved. The copies are
+     * submitted by the next Flush. Meant to be called when GetStats shows fragmentation.
+     */
+    uint64_t Defragment();
+
+    // Submit the pending copies, if any
+    void Flush();
+
+    wgpu::Buffer GetBuffer(Handle handle) const;
+    // First element of the range, e.g. its first index or base vertex
+    uint32_t GetFirstElement(Handle handle) const;
+    // Offset of the range in its first stream, and size of the range in all streams
+    uint64_t GetOffset(Handle handle) const;
+    uint64_t GetSize(Handle handle) const;
+
+    // Part of the buffer of a range holding a stream, to bind it whole
+    uint64_t GetStreamOffset(Handle handle, uint32_t stream) const;
+    uint64_t GetStreamSize(Handle handle, uint32_t stream) const;
+
+    uint32_t GetElementSize() const
+    {
+        return elementSize;
+    }
+
+    Stats GetStats() const;
+    void LogStats() const;
+
+private:
+    struct Slab
+    {
+        wgpu::Buffer buffer = nullptr;
+        OffsetAllocator allocator;
+    };
+
+    struct Range
+    {
+        uint32_t slab;
+        uint32_t elementCount;
+        OffsetAllocator::Allocation allocation;
+    };
+
+    wgpu::Buffer CreateSlabBuffer(uint32_t elementCount) const;
+    // Offset of an element of a slab of the given size in a stream
+    uint64_t GetElementOffset(uint32_t slabSize, uint32_t element, uint32_t stream) const;
+    wgpu::CommandEncoder GetEncoder();
+
+    wgpu::Device device     = nullptr;
+    const char* label       = nullptr;
+    wgpu::BufferUsage usage = wgpu::BufferUsage::None;
+    uint32_t elementSize    = 0;
+    uint32_t slabElements   = 0;
+    uint64_t maxBufferSize  = 0;
+    // Size of the elements of each stream, and the sum of the sizes of the previous streams
+    std::vector<uint32_t> streamSizes;
+    std::vector<uint32_t> streamStarts;
+
+    std::vector<Slab> slabs;
+    // Indexed by handle, freed handles being reused
+    std::vector<Range> ranges;
+    std::vector<Handle> freeHandles;
+
+    // Copies recorded since the last Flush
+    wgpu::CommandEncoder encoder = nullptr;
+};
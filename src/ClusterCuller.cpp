@@ -0,0 +1,285 @@
+#include "ClusterCuller.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <glm/matrix.hpp>
+
+#include "GpuCuller.h"
+#include "ResourceManager.h"
+#include "Scene.h"
+#include "WebGPUUtils.h"
+
+namespace
+{
+    // Largest number of workgroups along a dimension of a dispatch, by default
+    constexpr uint32_t kMaxWorkgroupsPerDimension = 65535;
+}  // namespace
+
+bool ClusterCuller::Initialize(wgpu::Device device, std::span<const unsigned char> shaderSource)
+{
+    this->device = device;
+
+    wgpu::ShaderModule shaderModule = ResourceManager::LoadShaderModule(shaderSource, device);
+    if (shaderModule == nullptr)
+    {
+        SDL_Log("Could not load cluster cull shader!");
+        return false;
+    }
+
+    std::array<wgpu::BindGroupLayoutEntry, 8> bindingLayoutEntries {};
+    for (uint32_t binding = 0; binding < bindingLayoutEntries.size(); ++binding)
+    {
+        bindingLayoutEntries[binding].binding    = binding;
+        bindingLayoutEntries[binding].visibility = wgpu::ShaderStage::Compute;
+    }
+
+    bindingLayoutEntries[0].buffer.type           = wgpu::BufferBindingType::Uniform;
+    bindingLayoutEntries[0].buffer.minBindingSize = sizeof(ClusterUniforms);
+    // The instances, the meshlets and their indices, the batches and the batch of each workgroup
+    bindingLayoutEntries[1].buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    bindingLayoutEntries[1].buffer.minBindingSize = sizeof(Scene::InstanceData);
+    bindingLayoutEntries[2].buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    bindingLayoutEntries[2].buffer.minBindingSize = sizeof(MeshMeshlet);
+    bindingLayoutEntries[3].buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    bindingLayoutEntries[3].buffer.minBindingSize = sizeof(uint32_t);
+    bindingLayoutEntries[4].buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    bindingLayoutEntries[4].buffer.minBindingSize = sizeof(BatchData);
+    bindingLayoutEntries[5].buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    bindingLayoutEntries[5].buffer.minBindingSize = sizeof(uint32_t);
+    // The compacted indices and their counts
+    bindingLayoutEntries[6].buffer.type           = wgpu::BufferBindingType::Storage;
+    bindingLayoutEntries[6].buffer.minBindingSize = sizeof(uint32_t);
+    bindingLayoutEntries[7].buffer.type           = wgpu::BufferBindingType::Storage;
+    bindingLayoutEntries[7].buffer.minBindingSize = sizeof(uint32_t);
+
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
+    bindGroupLayoutDesc.label      = WebGPUUtils::GenerateString("Cluster cull bind group layout");
+    bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(bindingLayoutEntries.size());
+    bindGroupLayoutDesc.entries    = bindingLayoutEntries.data();
+    bindGroupLayout                = device.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor layoutDesc {};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts     = &bindGroupLayout;
+    pipelineLayout                  = device.CreatePipelineLayout(&layoutDesc);
+
+    wgpu::ComputePipelineDescriptor pipelineDesc = GetPipelineDesc(shaderModule);
+    pipeline                                     = device.CreateComputePipeline(&pipelineDesc);
+
+    uniformBuffer = CreateBuffer("Cluster cull uniforms",
+                                 wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+                                 sizeof(ClusterUniforms));
+    return pipeline != nullptr;
+}
+
+void ClusterCuller::ReloadShader(std::span<const unsigned char> shaderSource)
+{
+    wgpu::ShaderModule shaderModule = ResourceManager::LoadShaderModule(shaderSource, device);
+
+    wgpu::ComputePipelineDescriptor pipelineDesc = GetPipelineDesc(shaderModule);
+
+    // Only the latest reload is kept, should the shader be saved again while compiling
+    uint32_t generation = ++pipelineGeneration;
+    WebGPUUtils::CreateComputePipelinesAsync(
+        device,
+        {&pipelineDesc, 1},
+        [this, generation](std::span<const wgpu::ComputePipeline> pipelines)
+        {
+            if (generation == pipelineGeneration)
+            {
+                pipeline = pipelines[0];
+                SDL_Log("Reloaded cluster cull shader");
+            }
+        });
+}
+
+uint32_t ClusterCuller::AddMesh(std::span<const MeshMeshlet> meshlets,
+                                std::span<const uint32_t> indices)
+{
+    Mesh& mesh        = meshes.emplace_back();
+    mesh.firstMeshlet = static_cast<uint32_t>(this->meshlets.size());
+    mesh.meshletCount = static_cast<uint32_t>(meshlets.size());
+    mesh.indexCount   = static_cast<uint32_t>(indices.size());
+
+    // Meshlets refer to the indices of all meshes
+    uint32_t firstIndex = static_cast<uint32_t>(sourceIndices.size());
+    for (MeshMeshlet meshlet : meshlets)
+    {
+        meshlet.firstIndex += firstIndex;
+        this->meshlets.push_back(meshlet);
+    }
+    sourceIndices.insert(sourceIndices.end(), indices.begin(), indices.end());
+    isMeshDataChanged = true;
+
+    return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+void ClusterCuller::SetBatches(std::span<const Batch> batches, wgpu::Buffer instanceBuffer)
+{
+    wgpu::Queue queue = device.GetQueue();
+    if (isMeshDataChanged)
+    {
+        // Storage bindings may not be empty, hence at least one element in each buffer
+        uint64_t meshletSize = std::max<size_t>(meshlets.size(), 1) * sizeof(MeshMeshlet);
+        uint64_t indexSize   = std::max<size_t>(sourceIndices.size(), 1) * sizeof(uint32_t);
+
+        meshletBuffer = CreateBuffer("Meshlets",
+                                     wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst,
+                                     meshletSize);
+        queue.WriteBuffer(meshletBuffer,
+                          0,
+                          meshlets.data(),
+                          meshlets.size() * sizeof(MeshMeshlet));
+
+        sourceIndexBuffer = CreateBuffer("Meshlet indices",
+                                         wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst,
+                                         indexSize);
+        queue.WriteBuffer(sourceIndexBuffer,
+                          0,
+                          sourceIndices.data(),
+                          sourceIndices.size() * sizeof(uint32_t));
+        isMeshDataChanged = false;
+    }
+
+    // One workgroup per meshlet of each batch, and the compacted indices of the batches in turn
+    this->batches.assign(batches.begin(), batches.end());
+    this->instanceBuffer = instanceBuffer;
+    batchData.clear();
+    std::vector<uint32_t> workgroupBatches;
+    uint32_t indexCount = 0;
+    for (uint32_t batch = 0; batch < batches.size(); ++batch)
+    {
+        const Mesh& mesh = meshes[batches[batch].mesh];
+
+        BatchData& data     = batchData.emplace_back();
+        data.firstMeshlet   = mesh.firstMeshlet;
+        data.firstWorkgroup = static_cast<uint32_t>(workgroupBatches.size());
+        data.firstInstance  = batches[batch].firstInstance;
+        data.instanceCount  = std::min(batches[batch].instanceCount, kMaxInstanceCount);
+        data.firstIndex     = indexCount;
+
+        workgroupBatches.insert(workgroupBatches.end(), mesh.meshletCount, batch);
+        indexCount += mesh.indexCount;
+    }
+    workgroupCount = static_cast<uint32_t>(workgroupBatches.size());
+
+    uint64_t batchSize          = std::max<size_t>(batchData.size(), 1) * sizeof(BatchData);
+    uint64_t workgroupBatchSize = std::max<size_t>(workgroupBatches.size(), 1) * sizeof(uint32_t);
+
+    batchBuffer = CreateBuffer("Cluster batches",
+                               wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst,
+                               batchSize);
+    queue.WriteBuffer(batchBuffer, 0, batchData.data(), batchData.size() * sizeof(BatchData));
+
+    workgroupBatchBuffer = CreateBuffer("Cluster workgroup batches",
+                                        wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst,
+                                        workgroupBatchSize);
+    queue.WriteBuffer(workgroupBatchBuffer,
+                      0,
+                      workgroupBatches.data(),
+                      workgroupBatches.size() * sizeof(uint32_t));
+
+    indexBuffer      = CreateBuffer("Compacted indices",
+                                    wgpu::BufferUsage::Storage | wgpu::BufferUsage::Index,
+                                    std::max(indexCount, 1u) * sizeof(uint32_t));
+    indexCountBuffer = CreateBuffer("Compacted index counts",
+                                    wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc
+                                        | wgpu::BufferUsage::CopyDst,
+                                    std::max<size_t>(batches.size(), 1) * sizeof(uint32_t));
+
+    CreateBindGroup();
+}
+
+void ClusterCuller::Cull(wgpu::CommandEncoder encoder,
+                         const glm::mat4x4& projectionMatrix,
+                         const glm::mat4x4& viewMatrix,
+                         bool isEnabled,
+                         const GpuCuller& culler)
+{
+    if (bindGroup == nullptr || batches.empty())
+    {
+        return;
+    }
+
+    ClusterUniforms uniforms {};
+    uniforms.planes         = GpuCuller::GetFrustumPlanes(projectionMatrix * viewMatrix);
+    uniforms.cameraPosition = glm::inverse(viewMatrix)[3];
+    uniforms.workgroupCount = workgroupCount;
+    uniforms.isEnabled      = isEnabled ? 1 : 0;
+    device.GetQueue().WriteBuffer(uniformBuffer, 0, &uniforms, sizeof(ClusterUniforms));
+
+    encoder.ClearBuffer(indexCountBuffer, 0, indexCountBuffer.GetSize());
+
+    wgpu::ComputePassDescriptor computePassDesc = {};
+    computePassDesc.label                       = WebGPUUtils::GenerateString("Cluster cull pass");
+    wgpu::ComputePassEncoder computePass        = encoder.BeginComputePass(&computePassDesc);
+    computePass.SetPipeline(pipeline);
+    computePass.SetBindGroup(0, bindGroup, 0, nullptr);
+    // Meshes of more meshlets than a dispatch dimension allows wrap along y
+    computePass.DispatchWorkgroups(std::min(workgroupCount, kMaxWorkgroupsPerDimension),
+                                   (workgroupCount + kMaxWorkgroupsPerDimension - 1)
+                                       / kMaxWorkgroupsPerDimension,
+                                   1);
+    computePass.End();
+
+    // The index count leads the arguments of both draws of the finest level of each batch
+    for (uint32_t batch = 0; batch < batches.size(); ++batch)
+    {
+        for (GpuCuller::Phase phase : {GpuCuller::Phase::Early, GpuCuller::Phase::Late})
+        {
+            encoder.CopyBufferToBuffer(indexCountBuffer,
+                                       batch * sizeof(uint32_t),
+                                       culler.GetDrawArgsBuffer(),
+                                       culler.GetDrawArgsOffset(batches[batch].drawBatch, 0, phase),
+                                       sizeof(uint32_t));
+        }
+    }
+}
+
+wgpu::ComputePipelineDescriptor ClusterCuller::GetPipelineDesc(
+    wgpu::ShaderModule shaderModule) const
+{
+    wgpu::ComputePipelineDescriptor pipelineDesc {};
+    pipelineDesc.label              = WebGPUUtils::GenerateString("Cluster cull pipeline");
+    pipelineDesc.layout             = pipelineLayout;
+    pipelineDesc.compute.module     = shaderModule;
+    pipelineDesc.compute.entryPoint = WebGPUUtils::GenerateString("cs_main");
+    return pipelineDesc;
+}
+
+wgpu::Buffer ClusterCuller::CreateBuffer(const char* label,
+                                         wgpu::BufferUsage usage,
+                                         uint64_t size) const
+{
+    wgpu::BufferDescriptor bufferDesc {};
+    bufferDesc.label            = WebGPUUtils::GenerateString(label);
+    bufferDesc.size             = size;
+    bufferDesc.usage            = usage;
+    bufferDesc.mappedAtCreation = false;
+    return device.CreateBuffer(&bufferDesc);
+}
+
+void ClusterCuller::CreateBindGroup()
+{
+    std::array<wgpu::BindGroupEntry, 8> bindings {};
+    bindings[0].buffer = uniformBuffer;
+    bindings[1].buffer = instanceBuffer;
+    bindings[2].buffer = meshletBuffer;
+    bindings[3].buffer = sourceIndexBuffer;
+    bindings[4].buffer = batchBuffer;
+    bindings[5].buffer = workgroupBatchBuffer;
+    bindings[6].buffer = indexBuffer;
+    bindings[7].buffer = indexCountBuffer;
+    for (uint32_t binding = 0; binding < bindings.size(); ++binding)
+    {
+        bindings[binding].binding = binding;
+        bindings[binding].size    = bindings[binding].buffer.GetSize();
+    }
+
+    wgpu::BindGroupDescriptor bindGroupDesc {};
+    bindGroupDesc.label      = WebGPUUtils::GenerateString("Cluster cull bind group");
+    bindGroupDesc.layout     = bindGroupLayout;
+    bindGroupDesc.entryCount = static_cast<uint32_t>(bindings.size());
+    bindGroupDesc.entries    = bindings.data();
+    bindGroup                = device.CreateBindGroup(&bindGroupDesc);
+}
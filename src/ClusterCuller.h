@@ -0,0 +1,143 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <array>
+#include <cstdint>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <span>
+#include <vector>
+
+#include "MeshCache.h"
+
+class GpuCuller;
+
+/**
+ * Culling of the meshlets of batches with few instances, for large meshes seen up close where
+ * culling whole instances is too coarse. A compute pass tests each meshlet against every
+ * instance of its batch, dropping those outside the frustum or back-facing, and copies the
+ * indices of the others into a compacted index buffer. Their count replaces the index count of
+ * the draws of the batch in the GpuCuller arguments, whose first index must be GetFirstIndex.
+ * Meshlets only cover the finest level of detail, coarser ones being drawn whole.
+ *
+ * A meshlet is kept when any instance may see it, so that batches are still drawn with a
+ * single instanced draw, which is why batches of more than kMaxInstanceCount instances are not
+ * culled here. Back-facing meshlets are culled as back-facing triangles would be, which assumes
+ * closed meshes wound counter-clockwise seen from outside.
+ */
+class ClusterCuller
+{
+public:
+    // One invocation of the cull pass per instance, must match @workgroup_size in clustercull.wgsl
+    static constexpr uint32_t kMaxInstanceCount = 64;
+
+    // Draw of a batch, see Scene::Batch
+    struct Batch
+    {
+        // As returned by AddMesh
+        uint32_t mesh;
+        uint32_t firstInstance;
+        uint32_t instanceCount;
+        // Index of the batch in the draws of the GpuCuller
+        uint32_t drawBatch;
+    };
+
+    bool Initialize(wgpu::Device device, std::span<const unsigned char> shaderSource);
+
+    // Recompile the pipelines from an edited shader, keeping the current ones until the new ones
+    // are ready, and on errors
+    void ReloadShader(std::span<const unsigned char> shaderSource);
+
+    // Register the meshlets of a mesh and the indices they refer to, returning the mesh id
+    uint32_t AddMesh(std::span<const MeshMeshlet> meshlets, std::span<const uint32_t> indices);
+
+    // Describe the culled batches, to be called whenever they or the instance buffer change
+    void SetBatches(std::span<const Batch> batches, wgpu::Buffer instanceBuffer);
+
+    /**
+     * Record the cull pass and the update of the index counts of the draws of the culler, after
+     * its own cull pass. Without isEnabled every meshlet is kept.
+     */
+    void Cull(wgpu::CommandEncoder encoder,
+              const glm::mat4x4& projectionMatrix,
+              const glm::mat4x4& viewMatrix,
+              bool isEnabled,
+              const GpuCuller& culler);
+
+    // Compacted indices, to be drawn instead of those of the meshes of the culled batches
+    wgpu::Buffer GetIndexBuffer() const
+    {
+        return indexBuffer;
+    }
+
+    // First index of a batch in the compacted index buffer
+    uint32_t GetFirstIndex(uint32_t batch) const
+    {
+        return batchData[batch].firstIndex;
+    }
+
+private:
+    // Meshlets and indices of a mesh registered by AddMesh
+    struct Mesh
+    {
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+        uint32_t indexCount;
+    };
+
+    // Layout of ClusterBatch in clustercull.wgsl
+    struct BatchData
+    {
+        uint32_t firstMeshlet;
+        uint32_t firstWorkgroup;
+        uint32_t firstInstance;
+        uint32_t instanceCount;
+        uint32_t firstIndex;
+    };
+
+    struct ClusterUniforms
+    {
+        // Normalized planes, inside when dot(xyz, position) + w >= 0
+        std::array<glm::vec4, 6> planes;
+        glm::vec4 cameraPosition;
+        uint32_t workgroupCount;
+        uint32_t isEnabled;
+        uint32_t _pad[2];
+    };
+
+    static_assert(sizeof(ClusterUniforms) % 16 == 0);
+
+    wgpu::Buffer CreateBuffer(const char* label, wgpu::BufferUsage usage, uint64_t size) const;
+    wgpu::ComputePipelineDescriptor GetPipelineDesc(wgpu::ShaderModule shaderModule) const;
+    void CreateBindGroup();
+
+    wgpu::Device device                   = nullptr;
+    wgpu::BindGroupLayout bindGroupLayout = nullptr;
+    wgpu::PipelineLayout pipelineLayout   = nullptr;
+    wgpu::ComputePipeline pipeline        = nullptr;
+    wgpu::BindGroup bindGroup             = nullptr;
+    // Incremented by each reload, so that only the latest one replaces the pipelines
+    uint32_t pipelineGeneration           = 0;
+
+    wgpu::Buffer uniformBuffer        = nullptr;
+    wgpu::Buffer instanceBuffer       = nullptr;
+    // Meshlets of all meshes, and the indices they refer to
+    wgpu::Buffer meshletBuffer        = nullptr;
+    wgpu::Buffer sourceIndexBuffer    = nullptr;
+    // The batches, and the batch of each workgroup, one per meshlet of each batch
+    wgpu::Buffer batchBuffer          = nullptr;
+    wgpu::Buffer workgroupBatchBuffer = nullptr;
+    // Compacted indices, and their count for each batch, reset before each frame
+    wgpu::Buffer indexBuffer          = nullptr;
+    wgpu::Buffer indexCountBuffer     = nullptr;
+
+    // Data of the meshes added so far, uploaded by the next SetBatches after AddMesh
+    std::vector<MeshMeshlet> meshlets;
+    std::vector<uint32_t> sourceIndices;
+    bool isMeshDataChanged = false;
+
+    std::vector<Mesh> meshes;
+    std::vector<Batch> batches;
+    std::vector<BatchData> batchData;
+    uint32_t workgroupCount = 0;
+};
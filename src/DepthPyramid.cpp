@@ -0,0 +1,188 @@
+#include "DepthPyramid.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#include "ResourceManager.h"
+#include "WebGPUUtils.h"
+
+namespace
+{
+    // Must match kWorkgroupSize in depthpyramid.wgsl
+    constexpr uint32_t kWorkgroupSize = 8;
+
+    wgpu::BindGroupLayoutEntry CreateOutputLayoutEntry()
+    {
+        wgpu::BindGroupLayoutEntry outputLayout {};
+        outputLayout.binding                      = 2;
+        outputLayout.visibility                   = wgpu::ShaderStage::Compute;
+        outputLayout.storageTexture.access        = wgpu::StorageTextureAccess::WriteOnly;
+        outputLayout.storageTexture.format        = wgpu::TextureFormat::R32Float;
+        outputLayout.storageTexture.viewDimension = wgpu::TextureViewDimension::e2D;
+        return outputLayout;
+    }
+}  // namespace
+
+bool DepthPyramid::Initialize(wgpu::Device device, std::span<const unsigned char> shaderSource)
+{
+    this->device = device;
+
+    wgpu::ShaderModule shaderModule = ResourceManager::LoadShaderModule(shaderSource, device);
+    if (shaderModule == nullptr)
+    {
+        SDL_Log("Could not load depth pyramid shader!");
+        return false;
+    }
+
+    std::array<wgpu::BindGroupLayoutEntry, 2> bindingLayoutEntries {};
+
+    // The depth texture read by level 0
+    wgpu::BindGroupLayoutEntry& depthLayout = bindingLayoutEntries[0];
+    depthLayout.binding                     = 0;
+    depthLayout.visibility                  = wgpu::ShaderStage::Compute;
+    depthLayout.texture.sampleType          = wgpu::TextureSampleType::Depth;
+    depthLayout.texture.viewDimension       = wgpu::TextureViewDimension::e2D;
+    bindingLayoutEntries[1]                 = CreateOutputLayoutEntry();
+
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
+    bindGroupLayoutDesc.label      = WebGPUUtils::GenerateString("Depth pyramid bind group layout");
+    bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(bindingLayoutEntries.size());
+    bindGroupLayoutDesc.entries    = bindingLayoutEntries.data();
+    firstBindGroupLayout           = device.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    // The previous level read by the next ones
+    wgpu::BindGroupLayoutEntry& previousLevelLayout = bindingLayoutEntries[0];
+    previousLevelLayout                             = {};
+    previousLevelLayout.binding                     = 1;
+    previousLevelLayout.visibility                  = wgpu::ShaderStage::Compute;
+    previousLevelLayout.texture.sampleType          = wgpu::TextureSampleType::UnfilterableFloat;
+    previousLevelLayout.texture.viewDimension       = wgpu::TextureViewDimension::e2D;
+
+    nextBindGroupLayout = device.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor layoutDesc {};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts     = &firstBindGroupLayout;
+    firstPipelineLayout             = device.CreatePipelineLayout(&layoutDesc);
+    layoutDesc.bindGroupLayouts     = &nextBindGroupLayout;
+    nextPipelineLayout              = device.CreatePipelineLayout(&layoutDesc);
+
+    wgpu::ComputePipelineDescriptor firstPipelineDesc =
+        GetPipelineDesc(shaderModule, firstPipelineLayout, "cs_first");
+    wgpu::ComputePipelineDescriptor nextPipelineDesc =
+        GetPipelineDesc(shaderModule, nextPipelineLayout, "cs_next");
+
+    firstPipeline = device.CreateComputePipeline(&firstPipelineDesc);
+    nextPipeline  = device.CreateComputePipeline(&nextPipelineDesc);
+    return firstPipeline != nullptr && nextPipeline != nullptr;
+}
+
+void DepthPyramid::ReloadShader(std::span<const unsigned char> shaderSource)
+{
+    wgpu::ShaderModule shaderModule = ResourceManager::LoadShaderModule(shaderSource, device);
+
+    std::array<wgpu::ComputePipelineDescriptor, 2> pipelineDescs = {
+        GetPipelineDesc(shaderModule, firstPipelineLayout, "cs_first"),
+        GetPipelineDesc(shaderModule, nextPipelineLayout, "cs_next")};
+
+    // Only the latest reload is kept, should the shader be saved again while compiling
+    uint32_t generation = ++pipelineGeneration;
+    WebGPUUtils::CreateComputePipelinesAsync(
+        device,
+        pipelineDescs,
+        [this, generation](std::span<const wgpu::ComputePipeline> pipelines)
+        {
+            if (generation == pipelineGeneration)
+            {
+                firstPipeline = pipelines[0];
+                nextPipeline  = pipelines[1];
+                SDL_Log("Reloaded depth pyramid shader");
+            }
+        });
+}
+
+void DepthPyramid::SetDepthTexture(wgpu::TextureView depthTextureView,
+                                   uint32_t width,
+                                   uint32_t height)
+{
+    depthWidth  = width;
+    depthHeight = height;
+
+    // Level 0 is half the depth buffer, and a full mip chain down to 1x1
+    uint32_t levelWidth  = std::max(width / 2, 1u);
+    uint32_t levelHeight = std::max(height / 2, 1u);
+    uint32_t levelCount  = std::bit_width(std::max(levelWidth, levelHeight));
+
+    wgpu::TextureDescriptor textureDesc;
+    textureDesc.label         = WebGPUUtils::GenerateString("Depth pyramid");
+    textureDesc.dimension     = wgpu::TextureDimension::e2D;
+    textureDesc.format        = wgpu::TextureFormat::R32Float;
+    textureDesc.mipLevelCount = levelCount;
+    textureDesc.sampleCount   = 1;
+    textureDesc.size          = {levelWidth, levelHeight, 1};
+    textureDesc.usage = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::StorageBinding;
+    texture           = device.CreateTexture(&textureDesc);
+    view              = texture.CreateView();
+
+    levelViews.clear();
+    bindGroups.clear();
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        wgpu::TextureViewDescriptor textureViewDesc;
+        textureViewDesc.aspect          = wgpu::TextureAspect::All;
+        textureViewDesc.baseArrayLayer  = 0;
+        textureViewDesc.arrayLayerCount = 1;
+        textureViewDesc.baseMipLevel    = level;
+        textureViewDesc.mipLevelCount   = 1;
+        textureViewDesc.dimension       = wgpu::TextureViewDimension::e2D;
+        textureViewDesc.format          = wgpu::TextureFormat::R32Float;
+        levelViews.push_back(texture.CreateView(&textureViewDesc));
+
+        std::array<wgpu::BindGroupEntry, 2> bindings {};
+        bindings[0].binding     = level == 0 ? 0 : 1;
+        bindings[0].textureView = level == 0 ? depthTextureView : levelViews[level - 1];
+        bindings[1].binding     = 2;
+        bindings[1].textureView = levelViews[level];
+
+        wgpu::BindGroupDescriptor bindGroupDesc {};
+        bindGroupDesc.layout     = level == 0 ? firstBindGroupLayout : nextBindGroupLayout;
+        bindGroupDesc.entryCount = static_cast<uint32_t>(bindings.size());
+        bindGroupDesc.entries    = bindings.data();
+        bindGroups.push_back(device.CreateBindGroup(&bindGroupDesc));
+    }
+}
+
+void DepthPyramid::Build(wgpu::CommandEncoder encoder) const
+{
+    wgpu::ComputePassDescriptor computePassDesc = {};
+    computePassDesc.label                       = WebGPUUtils::GenerateString("Depth pyramid pass");
+    wgpu::ComputePassEncoder computePass        = encoder.BeginComputePass(&computePassDesc);
+
+    // Each dispatch reads the level written by the previous one
+    for (uint32_t level = 0; level < bindGroups.size(); ++level)
+    {
+        computePass.SetPipeline(level == 0 ? firstPipeline : nextPipeline);
+        computePass.SetBindGroup(0, bindGroups[level], 0, nullptr);
+
+        uint32_t width  = std::max(texture.GetWidth() >> level, 1u);
+        uint32_t height = std::max(texture.GetHeight() >> level, 1u);
+        computePass.DispatchWorkgroups((width + kWorkgroupSize - 1) / kWorkgroupSize,
+                                       (height + kWorkgroupSize - 1) / kWorkgroupSize,
+                                       1);
+    }
+    computePass.End();
+}
+
+wgpu::ComputePipelineDescriptor DepthPyramid::GetPipelineDesc(wgpu::ShaderModule shaderModule,
+                                                              wgpu::PipelineLayout layout,
+                                                              const char* entryPoint) const
+{
+    wgpu::ComputePipelineDescriptor pipelineDesc {};
+    pipelineDesc.label              = WebGPUUtils::GenerateString("Depth pyramid pipeline");
+    pipelineDesc.layout             = layout;
+    pipelineDesc.compute.module     = shaderModule;
+    pipelineDesc.compute.entryPoint = WebGPUUtils::GenerateString(entryPoint);
+    return pipelineDesc;
+}
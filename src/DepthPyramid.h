@@ -0,0 +1,79 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+ * Hierarchical depth (Hi-Z) of a depth buffer: a mip chain of R32Float levels, each texel
+ * holding the farthest depth of the depth texels it covers. Level 0 is half the size of the
+ * depth buffer, so that depth texel x is covered by texel min(x >> (level + 1), size - 1) of
+ * any level, and a footprint of n depth texels spans at most 2 texels at the level where
+ * 2^(level + 1) >= n.
+ */
+class DepthPyramid
+{
+public:
+    bool Initialize(wgpu::Device device, std::span<const unsigned char> shaderSource);
+
+    // Recompile the pipelines from an edited shader, keeping the current ones until the new ones
+    // are ready, and on errors
+    void ReloadShader(std::span<const unsigned char> shaderSource);
+
+    /**
+     * Create the pyramid of a depth texture, whose view must be a depth aspect view with the
+     * TextureBinding usage. To be called again when the depth texture is recreated.
+     */
+    void SetDepthTexture(wgpu::TextureView depthTextureView, uint32_t width, uint32_t height);
+
+    // Record the reduction of the depth texture, which must hold the depth to test against
+    void Build(wgpu::CommandEncoder encoder) const;
+
+    // All the levels, for textureLoad
+    wgpu::TextureView GetView() const
+    {
+        return view;
+    }
+
+    uint32_t GetLevelCount() const
+    {
+        return static_cast<uint32_t>(levelViews.size());
+    }
+
+    // Size of the depth texture the pyramid reduces
+    uint32_t GetDepthWidth() const
+    {
+        return depthWidth;
+    }
+
+    uint32_t GetDepthHeight() const
+    {
+        return depthHeight;
+    }
+
+private:
+    // The entry point must outlive the descriptor
+    wgpu::ComputePipelineDescriptor GetPipelineDesc(wgpu::ShaderModule shaderModule,
+                                                    wgpu::PipelineLayout layout,
+                                                    const char* entryPoint) const;
+
+    wgpu::Device device                        = nullptr;
+    // Level 0 reads the depth texture, the next ones the previous level
+    wgpu::BindGroupLayout firstBindGroupLayout = nullptr;
+    wgpu::BindGroupLayout nextBindGroupLayout  = nullptr;
+    wgpu::PipelineLayout firstPipelineLayout   = nullptr;
+    wgpu::PipelineLayout nextPipelineLayout    = nullptr;
+    wgpu::ComputePipeline firstPipeline        = nullptr;
+    wgpu::ComputePipeline nextPipeline         = nullptr;
+    // Incremented by each reload, so that only the latest one replaces the pipelines
+    uint32_t pipelineGeneration                = 0;
+
+    wgpu::Texture texture  = nullptr;
+    wgpu::TextureView view = nullptr;
+    uint32_t depthWidth    = 0;
+    uint32_t depthHeight   = 0;
+    std::vector<wgpu::TextureView> levelViews;
+    // One per level, writing it
+    std::vector<wgpu::BindGroup> bindGroups;
+};
@@ -0,0 +1,61 @@
+#include "FileWatcher.h"
+
+#include <system_error>
+
+void FileWatcher::Watch(const std::filesystem::path& directory,
+                        const std::string& extension,
+                        std::chrono::milliseconds interval)
+{
+    this->directory = directory;
+    this->extension = extension;
+    this->interval  = interval;
+    nextPollTime    = std::chrono::steady_clock::now() + interval;
+    writeTimes.clear();
+    Scan(nullptr);
+}
+
+std::vector<std::filesystem::path> FileWatcher::Poll()
+{
+    std::vector<std::filesystem::path> changedFiles;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (directory.empty() || now < nextPollTime)
+    {
+        return changedFiles;
+    }
+    nextPollTime = now + interval;
+    Scan(&changedFiles);
+    return changedFiles;
+}
+
+void FileWatcher::Scan(std::vector<std::filesystem::path>* changedFiles)
+{
+    // A missing directory or a file deleted while iterating is simply skipped
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator it(directory, error), end;
+         !error && it != end;
+         it.increment(error))
+    {
+        const std::filesystem::path& path = it->path();
+        if (path.extension() != extension || !it->is_regular_file(error))
+        {
+            continue;
+        }
+
+        std::filesystem::file_time_type writeTime = it->last_write_time(error);
+        if (error)
+        {
+            error.clear();
+            continue;
+        }
+        auto [writeTimeIt, inserted] = writeTimes.try_emplace(path.string(), writeTime);
+        if (!inserted && writeTimeIt->second != writeTime)
+        {
+            writeTimeIt->second = writeTime;
+            inserted            = true;
+        }
+        if (inserted && changedFiles)
+        {
+            changedFiles->push_back(path);
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Detect edits to the files of a directory tree by polling their modification time. Polling
+ * happens at most once per interval, so that Poll can be called every frame.
+ */
+class FileWatcher
+{
+public:
+    // Watch the files with the given extension, e.g. ".wgsl", under directory
+    void Watch(const std::filesystem::path& directory,
+               const std::string& extension,
+               std::chrono::milliseconds interval);
+
+    // Return the files created or modified since the last poll
+    std::vector<std::filesystem::path> Poll();
+
+private:
+    // Record the modification times, appending the files that changed to changedFiles
+    void Scan(std::vector<std::filesystem::path>* changedFiles);
+
+    std::filesystem::path directory;
+    std::string extension;
+    std::chrono::steady_clock::duration interval {};
+    std::chrono::steady_clock::time_point nextPollTime;
+    std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes;
+};
@@ -0,0 +1,79 @@
+#include "FrameBenchmark.h"
+
+#include <SDL3/SDL_log.h>
+#include <cstdio>
+#include <utility>
+
+namespace
+{
+    // Frames left to a step before it is measured, then frames it is averaged over
+    constexpr uint32_t kWarmupFrameCount   = 20;
+    constexpr uint32_t kMeasuredFrameCount = 60;
+}  // namespace
+
+void FrameBenchmark::Start(const std::string& name,
+                           std::vector<Metric> metrics,
+                           std::vector<Step> steps,
+                           std::function<void()> onFinished)
+{
+    this->name       = name;
+    this->metrics    = std::move(metrics);
+    this->steps      = std::move(steps);
+    this->onFinished = std::move(onFinished);
+    stepIndex        = 0;
+    frameIndex       = 0;
+    sums.assign(this->metrics.size(), 0.0);
+    if (IsRunning())
+    {
+        SDL_Log("%s benchmark: %zu steps of %u frames",
+                this->name.c_str(),
+                this->steps.size(),
+                kWarmupFrameCount + kMeasuredFrameCount);
+        this->steps.front().apply();
+    }
+}
+
+void FrameBenchmark::AddFrame()
+{
+    if (!IsRunning())
+    {
+        return;
+    }
+
+    if (frameIndex >= kWarmupFrameCount)
+    {
+        for (size_t i = 0; i < metrics.size(); ++i)
+        {
+            sums[i] += metrics[i].read();
+        }
+    }
+    if (++frameIndex < kWarmupFrameCount + kMeasuredFrameCount)
+    {
+        return;
+    }
+
+    std::string results;
+    for (size_t i = 0; i < metrics.size(); ++i)
+    {
+        char result[64];
+        snprintf(result,
+                 sizeof(result),
+                 "%s%s %.3f ms",
+                 i > 0 ? ", " : "",
+                 metrics[i].name.c_str(),
+                 sums[i] / kMeasuredFrameCount);
+        results += result;
+    }
+    SDL_Log("%s benchmark, %s: %s", name.c_str(), steps[stepIndex].label.c_str(), results.c_str());
+
+    frameIndex = 0;
+    sums.assign(metrics.size(), 0.0);
+    if (++stepIndex < steps.size())
+    {
+        steps[stepIndex].apply();
+    }
+    else if (onFinished)
+    {
+        onFinished();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Measure a few metrics of the frame loop over a sweep of configurations, e.g. the time spent
+ * encoding the scene for several grid sizes. Each step is applied, left to settle for a few
+ * frames, so that caches, bundles and buffers are rebuilt, then averaged over the next frames
+ * and logged. Call AddFrame once per frame.
+ */
+class FrameBenchmark
+{
+public:
+    // A value read once per frame, in milliseconds
+    struct Metric
+    {
+        std::string name;
+        std::function<double()> read;
+    };
+
+    // A configuration of the application, applied before its frames are measured
+    struct Step
+    {
+        std::string label;
+        std::function<void()> apply;
+    };
+
+    /**
+     * Apply the first step and measure each in turn. onFinished is called after the last one,
+     * e.g. to restore the configuration the benchmark started from.
+     */
+    void Start(const std::string& name,
+               std::vector<Metric> metrics,
+               std::vector<Step> steps,
+               std::function<void()> onFinished);
+
+    bool IsRunning() const
+    {
+        return stepIndex < steps.size();
+    }
+
+    // Read the metrics of the frame, and move on to the next step once the current one is done
+    void AddFrame();
+
+private:
+    std::string name;
+    std::vector<Metric> metrics;
+    std::vector<Step> steps;
+    std::function<void()> onFinished;
+
+    size_t stepIndex    = 0;
+    uint32_t frameIndex = 0;
+    // Sum of each metric over the measured frames of the current step
+    std::vector<double> sums;
+};
@@ -0,0 +1,472 @@
+#include "GpuCuller.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/geometric.hpp>
+
+#include "DepthPyramid.h"
+#include "ResourceManager.h"
+#include "WebGPUUtils.h"
+
+namespace
+{
+    // Must match @workgroup_size in cull.wgsl
+    constexpr uint32_t kWorkgroupSize = 64;
+
+    // Largest scale along the axes of a transform, which keeps bounding spheres conservative
+    float GetMaxAxisScale(const glm::mat4x4& modelMatrix)
+    {
+        float scale = 0.0f;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            glm::vec3 column = glm::vec3(modelMatrix[axis]);
+            scale            = std::max(scale, glm::dot(column, column));
+        }
+        return std::sqrt(scale);
+    }
+}  // namespace
+
+bool GpuCuller::Initialize(wgpu::Device device, std::span<const unsigned char> shaderSource)
+{
+    this->device = device;
+
+    wgpu::ShaderModule shaderModule = ResourceManager::LoadShaderModule(shaderSource, device);
+    if (shaderModule == nullptr)
+    {
+        SDL_Log("Could not load cull shader!");
+        return false;
+    }
+
+    std::array<wgpu::BindGroupLayoutEntry, 9> bindingLayoutEntries {};
+    for (uint32_t binding = 0; binding < bindingLayoutEntries.size(); ++binding)
+    {
+        bindingLayoutEntries[binding].binding    = binding;
+        bindingLayoutEntries[binding].visibility = wgpu::ShaderStage::Compute;
+    }
+
+    bindingLayoutEntries[0].buffer.type           = wgpu::BufferBindingType::Uniform;
+    bindingLayoutEntries[0].buffer.minBindingSize = sizeof(CullUniforms);
+    // The instances, their batches and the batches
+    bindingLayoutEntries[1].buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    bindingLayoutEntries[1].buffer.minBindingSize = sizeof(Scene::InstanceData);
+    bindingLayoutEntries[2].buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    bindingLayoutEntries[2].buffer.minBindingSize = sizeof(uint32_t);
+    bindingLayoutEntries[3].buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    bindingLayoutEntries[3].buffer.minBindingSize = sizeof(BatchData);
+    // The draw arguments, the visible instances, their visibility and the frustum counts
+    bindingLayoutEntries[4].buffer.type           = wgpu::BufferBindingType::Storage;
+    bindingLayoutEntries[4].buffer.minBindingSize = sizeof(DrawIndexedIndirectArgs);
+    bindingLayoutEntries[5].buffer.type           = wgpu::BufferBindingType::Storage;
+    bindingLayoutEntries[5].buffer.minBindingSize = sizeof(uint32_t);
+    bindingLayoutEntries[6].buffer.type           = wgpu::BufferBindingType::Storage;
+    bindingLayoutEntries[6].buffer.minBindingSize = sizeof(uint32_t);
+    bindingLayoutEntries[7].buffer.type           = wgpu::BufferBindingType::Storage;
+    bindingLayoutEntries[7].buffer.minBindingSize = sizeof(uint32_t);
+    // The depth pyramid, read with textureLoad
+    bindingLayoutEntries[8].texture.sampleType    = wgpu::TextureSampleType::UnfilterableFloat;
+    bindingLayoutEntries[8].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
+    bindGroupLayoutDesc.label      = WebGPUUtils::GenerateString("Cull bind group layout");
+    bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(bindingLayoutEntries.size());
+    bindGroupLayoutDesc.entries    = bindingLayoutEntries.data();
+    bindGroupLayout                = device.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor layoutDesc {};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts     = &bindGroupLayout;
+    pipelineLayout                  = device.CreatePipelineLayout(&layoutDesc);
+
+    wgpu::ComputePipelineDescriptor earlyPipelineDesc = GetPipelineDesc(shaderModule, "cs_early");
+    wgpu::ComputePipelineDescriptor latePipelineDesc  = GetPipelineDesc(shaderModule, "cs_late");
+
+    earlyPipeline = device.CreateComputePipeline(&earlyPipelineDesc);
+    latePipeline  = device.CreateComputePipeline(&latePipelineDesc);
+    uniformBuffer = CreateBuffer("Cull uniforms",
+                                 wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+                                 sizeof(CullUniforms));
+    return earlyPipeline != nullptr && latePipeline != nullptr;
+}
+
+void GpuCuller::ReloadShader(std::span<const unsigned char> shaderSource)
+{
+    wgpu::ShaderModule shaderModule = ResourceManager::LoadShaderModule(shaderSource, device);
+
+    std::array<wgpu::ComputePipelineDescriptor, 2> pipelineDescs = {
+        GetPipelineDesc(shaderModule, "cs_early"),
+        GetPipelineDesc(shaderModule, "cs_late")};
+
+    // Only the latest reload is kept, should the shader be saved again while compiling
+    uint32_t generation = ++pipelineGeneration;
+    WebGPUUtils::CreateComputePipelinesAsync(
+        device,
+        pipelineDescs,
+        [this, generation](std::span<const wgpu::ComputePipeline> pipelines)
+        {
+            if (generation == pipelineGeneration)
+            {
+                earlyPipeline = pipelines[0];
+                latePipeline  = pipelines[1];
+                SDL_Log("Reloaded cull shader");
+            }
+        });
+}
+
+void GpuCuller::SetBatches(std::span<const DrawBatch> batches, wgpu::Buffer instanceBuffer)
+{
+    this->batches.assign(batches.begin(), batches.end());
+    this->instanceBuffer = instanceBuffer;
+    instanceCount        = 0;
+    drawCount            = 0;
+    for (const DrawBatch& batch : batches)
+    {
+        instanceCount = std::max(instanceCount, batch.firstInstance + batch.instanceCount);
+        drawCount += static_cast<uint32_t>(batch.lods.size());
+    }
+
+    // Storage bindings may not be empty, hence at least one element in each buffer
+    uint32_t batchCount = std::max(static_cast<uint32_t>(batches.size()), 1u);
+    uint32_t slotCount  = std::max(instanceCount, 1u);
+    wgpu::Queue queue   = device.GetQueue();
+
+    // Each draw lists up to all the instances of its batch, the late lists following the early
+    std::vector<uint32_t> instanceBatches(slotCount, 0);
+    std::vector<DrawIndexedIndirectArgs> drawArgs;
+    batchData.assign(batchCount, BatchData {});
+    firstVisibleInstances.assign(batches.size(), 0);
+    uint32_t listSize = 0;
+    for (uint32_t batch = 0; batch < batches.size(); ++batch)
+    {
+        const DrawBatch& drawBatch = batches[batch];
+        std::fill_n(instanceBatches.begin() + drawBatch.firstInstance,
+                    drawBatch.instanceCount,
+                    batch);
+        firstVisibleInstances[batch] = listSize;
+
+        BatchData& data     = batchData[batch];
+        data.boundingSphere = drawBatch.boundingSphere;
+        data.firstDraw      = static_cast<uint32_t>(drawArgs.size());
+        data.lodCount       = static_cast<uint32_t>(drawBatch.lods.size());
+        for (uint32_t lod = 0; lod < drawBatch.lods.size(); ++lod)
+        {
+            const DrawLod& drawLod = drawBatch.lods[lod];
+            data.lodErrors[lod]    = drawLod.error;
+            drawArgs.push_back(
+                {drawLod.indexCount, 0, drawLod.firstIndex, drawBatch.baseVertex, listSize});
+            listSize += drawBatch.instanceCount;
+        }
+    }
+    drawArgs.resize(2 * std::max(drawCount, 1u), DrawIndexedIndirectArgs {});
+    for (uint32_t draw = 0; draw < drawCount; ++draw)
+    {
+        drawArgs[drawCount + draw] = drawArgs[draw];
+        drawArgs[drawCount + draw].firstInstance += listSize;
+    }
+
+    uint64_t instanceBatchSize = instanceBatches.size() * sizeof(uint32_t);
+    uint64_t batchDataSize     = batchData.size() * sizeof(BatchData);
+    uint64_t drawArgsSize      = drawArgs.size() * sizeof(DrawIndexedIndirectArgs);
+
+    instanceBatchBuffer = CreateBuffer("Cull instance batches",
+                                       wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst,
+                                       instanceBatchSize);
+    queue.WriteBuffer(instanceBatchBuffer, 0, instanceBatches.data(), instanceBatchSize);
+
+    batchBuffer = CreateBuffer("Cull batches",
+                               wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst,
+                               batchDataSize);
+    queue.WriteBuffer(batchBuffer, 0, batchData.data(), batchDataSize);
+
+    // The counts start from zero every frame, copying the template being cheaper than a pass
+    drawArgsTemplate = CreateBuffer("Draw arguments template",
+                                    wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::CopyDst,
+                                    drawArgsSize);
+    queue.WriteBuffer(drawArgsTemplate, 0, drawArgs.data(), drawArgsSize);
+
+    drawArgsBuffer = CreateBuffer("Draw arguments",
+                                  wgpu::BufferUsage::Storage | wgpu::BufferUsage::Indirect
+                                      | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::CopyDst,
+                                  drawArgsSize);
+    visibleInstanceBuffer = CreateBuffer("Visible instances",
+                                         wgpu::BufferUsage::Storage,
+                                         2 * uint64_t(std::max(listSize, 1u)) * sizeof(uint32_t));
+    // Starts with every instance hidden, so that the first frame draws them all late
+    visibilityBuffer   = CreateBuffer("Instance visibility",
+                                      wgpu::BufferUsage::Storage,
+                                      uint64_t(slotCount) * sizeof(uint32_t));
+    frustumCountBuffer = CreateBuffer("Frustum counts",
+                                      wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc
+                                          | wgpu::BufferUsage::CopyDst,
+                                      uint64_t(batchCount) * sizeof(uint32_t));
+    readbackBuffer     = nullptr;
+
+    CreateBindGroup();
+}
+
+void GpuCuller::SetDepthPyramid(const DepthPyramid& depthPyramid)
+{
+    depthPyramidView = depthPyramid.GetView();
+    depthWidth       = depthPyramid.GetDepthWidth();
+    depthHeight      = depthPyramid.GetDepthHeight();
+
+    CreateBindGroup();
+}
+
+void GpuCuller::Cull(wgpu::CommandEncoder encoder,
+                     const glm::mat4x4& projectionMatrix,
+                     const glm::mat4x4& viewMatrix,
+                     bool isEnabled,
+                     bool isOcclusionEnabled,
+                     float lodThreshold)
+{
+    if (bindGroup == nullptr)
+    {
+        return;
+    }
+
+    CullUniforms uniforms {};
+    uniforms.planes             = GetFrustumPlanes(projectionMatrix * viewMatrix);
+    uniforms.viewMatrix         = viewMatrix;
+    uniforms.projection         = glm::vec4(projectionMatrix[0][0],
+                                    projectionMatrix[1][1],
+                                    projectionMatrix[2][2],
+                                    projectionMatrix[3][2]);
+    uniforms.instanceCount      = instanceCount;
+    uniforms.drawCount          = drawCount;
+    uniforms.isEnabled          = isEnabled ? 1 : 0;
+    uniforms.isOcclusionEnabled = isEnabled && isOcclusionEnabled ? 1 : 0;
+    uniforms.depthWidth         = depthWidth;
+    uniforms.depthHeight        = depthHeight;
+    uniforms.lodThreshold       = lodThreshold;
+    device.GetQueue().WriteBuffer(uniformBuffer, 0, &uniforms, sizeof(CullUniforms));
+
+    encoder.CopyBufferToBuffer(drawArgsTemplate, 0, drawArgsBuffer, 0, drawArgsBuffer.GetSize());
+    encoder.ClearBuffer(frustumCountBuffer, 0, frustumCountBuffer.GetSize());
+    Dispatch(encoder, earlyPipeline, "Early cull pass");
+}
+
+void GpuCuller::CullLate(wgpu::CommandEncoder encoder)
+{
+    if (bindGroup == nullptr)
+    {
+        return;
+    }
+
+    Dispatch(encoder, latePipeline, "Late cull pass");
+}
+
+bool GpuCuller::ReadStats(std::function<void(const Stats&)> callback)
+{
+    if (drawArgsBuffer == nullptr
+        || (readbackBuffer != nullptr
+            && readbackBuffer.GetMapState() != wgpu::BufferMapState::Unmapped))
+    {
+        return false;
+    }
+
+    // The draw arguments followed by the frustum counts
+    uint64_t drawArgsSize = drawArgsBuffer.GetSize();
+    uint64_t size         = drawArgsSize + frustumCountBuffer.GetSize();
+    if (readbackBuffer == nullptr)
+    {
+        readbackBuffer = CreateBuffer("Cull readback",
+                                      wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst,
+                                      size);
+    }
+
+    wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
+    encoder.CopyBufferToBuffer(drawArgsBuffer, 0, readbackBuffer, 0, drawArgsSize);
+    encoder.CopyBufferToBuffer(frustumCountBuffer,
+                               0,
+                               readbackBuffer,
+                               drawArgsSize,
+                               frustumCountBuffer.GetSize());
+    wgpu::CommandBuffer commands = encoder.Finish();
+    device.GetQueue().Submit(1, &commands);
+
+    // The batches may change before the read completes, the counts matching those of now
+    auto onMapped = [buffer = readbackBuffer,
+                     batches   = batches,
+                     batchData = batchData,
+                     drawCount = drawCount,
+                     drawArgsSize,
+                     callback](
+                        wgpu::MapAsyncStatus status,
+                        wgpu::StringView message)
+    {
+        if (status != wgpu::MapAsyncStatus::Success)
+        {
+            SDL_Log("Could not read back culling results: %.*s",
+                    static_cast<int>(message.length),
+                    message.data);
+            return;
+        }
+
+        const auto* data     = static_cast<const unsigned char*>(buffer.GetConstMappedRange());
+        const auto* drawArgs = reinterpret_cast<const DrawIndexedIndirectArgs*>(data);
+        const auto* frustumCounts = reinterpret_cast<const uint32_t*>(data + drawArgsSize);
+
+        Stats stats {};
+        stats.frustumCounts.assign(frustumCounts, frustumCounts + batches.size());
+        for (uint32_t batch = 0; batch < batches.size(); ++batch)
+        {
+            const DrawBatch& drawBatch = batches[batch];
+            uint32_t count             = drawBatch.instanceCount;
+            uint32_t frustumCount      = frustumCounts[batch];
+            uint64_t triangles         = drawBatch.lods[0].indexCount / 3;
+            uint32_t drawnCount        = 0;
+            for (uint32_t lod = 0; lod < drawBatch.lods.size(); ++lod)
+            {
+                uint32_t draw          = batchData[batch].firstDraw + lod;
+                uint32_t lodDrawnCount = drawArgs[draw].instanceCount
+                                       + drawArgs[drawCount + draw].instanceCount;
+                // Fewer triangles are drawn than the level has when its meshlets are culled
+                uint64_t lodTriangles   = drawBatch.lods[lod].indexCount / 3;
+                uint64_t drawnTriangles = drawArgs[draw].indexCount / 3;
+
+                stats.lodReducedTriangleCount    += (triangles - lodTriangles) * lodDrawnCount;
+                stats.clusterCulledTriangleCount += (lodTriangles - drawnTriangles) * lodDrawnCount;
+                stats.drawnTriangleCount         += drawnTriangles * lodDrawnCount;
+                drawnCount                       += lodDrawnCount;
+            }
+
+            stats.instanceCount              += count;
+            stats.drawnInstanceCount         += drawnCount;
+            stats.triangleCount              += triangles * count;
+            stats.frustumCulledTriangleCount += triangles * (count - frustumCount);
+            stats.occludedTriangleCount      += triangles * (frustumCount - drawnCount);
+        }
+        buffer.Unmap();
+        callback(stats);
+    };
+
+    readbackBuffer.MapAsync(wgpu::MapMode::Read, 0, size, WebGPUUtils::kCallbackMode, onMapped);
+    return true;
+}
+
+std::array<glm::vec4, 6> GpuCuller::GetFrustumPlanes(const glm::mat4x4& viewProjection)
+{
+    // Rows of the matrix (Gribb and Hartmann), for clip space depths between 0 and 1
+    auto row = [&viewProjection](int i)
+    {
+        return glm::vec4(viewProjection[0][i],
+                         viewProjection[1][i],
+                         viewProjection[2][i],
+                         viewProjection[3][i]);
+    };
+
+    std::array<glm::vec4, 6> planes = {
+        row(3) + row(0),  // Left
+        row(3) - row(0),  // Right
+        row(3) + row(1),  // Bottom
+        row(3) - row(1),  // Top
+        row(2),           // Near
+        row(3) - row(2),  // Far
+    };
+    for (glm::vec4& plane : planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return planes;
+}
+
+std::vector<uint32_t> GpuCuller::CountVisible(std::span<const Scene::InstanceData> instances,
+                                              const glm::mat4x4& viewProjection) const
+{
+    std::array<glm::vec4, 6> planes = GetFrustumPlanes(viewProjection);
+
+    // Same test as isInFrustum in cull.wgsl
+    std::vector<uint32_t> counts(batches.size(), 0);
+    for (uint32_t batch = 0; batch < batches.size(); ++batch)
+    {
+        const DrawBatch& drawBatch = batches[batch];
+        const glm::vec4& sphere    = drawBatch.boundingSphere;
+        for (uint32_t i = 0; i < drawBatch.instanceCount; ++i)
+        {
+            const glm::mat4x4& modelMatrix = instances[drawBatch.firstInstance + i].modelMatrix;
+            glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(glm::vec3(sphere), 1.0f));
+            float radius     = sphere.w * GetMaxAxisScale(modelMatrix);
+
+            bool isVisible = std::all_of(planes.begin(),
+                                         planes.end(),
+                                         [&](const glm::vec4& plane)
+                                         {
+                                             return glm::dot(glm::vec3(plane), center) + plane.w
+                                                    >= -radius;
+                                         });
+            counts[batch] += isVisible ? 1 : 0;
+        }
+    }
+    return counts;
+}
+
+wgpu::Buffer GpuCuller::CreateBuffer(const char* label,
+                                     wgpu::BufferUsage usage,
+                                     uint64_t size) const
+{
+    wgpu::BufferDescriptor bufferDesc {};
+    bufferDesc.label            = WebGPUUtils::GenerateString(label);
+    bufferDesc.size             = size;
+    bufferDesc.usage            = usage;
+    bufferDesc.mappedAtCreation = false;
+    return device.CreateBuffer(&bufferDesc);
+}
+
+wgpu::ComputePipelineDescriptor GpuCuller::GetPipelineDesc(wgpu::ShaderModule shaderModule,
+                                                           const char* entryPoint) const
+{
+    wgpu::ComputePipelineDescriptor pipelineDesc {};
+    pipelineDesc.label              = WebGPUUtils::GenerateString("Cull pipeline");
+    pipelineDesc.layout             = pipelineLayout;
+    pipelineDesc.compute.module     = shaderModule;
+    pipelineDesc.compute.entryPoint = WebGPUUtils::GenerateString(entryPoint);
+    return pipelineDesc;
+}
+
+void GpuCuller::CreateBindGroup()
+{
+    // Waits for both the batches and the depth pyramid
+    if (instanceBuffer == nullptr || depthPyramidView == nullptr)
+    {
+        return;
+    }
+
+    std::array<wgpu::BindGroupEntry, 9> bindings {};
+    bindings[0].buffer = uniformBuffer;
+    bindings[1].buffer = instanceBuffer;
+    bindings[2].buffer = instanceBatchBuffer;
+    bindings[3].buffer = batchBuffer;
+    bindings[4].buffer = drawArgsBuffer;
+    bindings[5].buffer = visibleInstanceBuffer;
+    bindings[6].buffer = visibilityBuffer;
+    bindings[7].buffer = frustumCountBuffer;
+    for (uint32_t binding = 0; binding < 8; ++binding)
+    {
+        bindings[binding].binding = binding;
+        bindings[binding].size    = bindings[binding].buffer.GetSize();
+    }
+    bindings[8].binding     = 8;
+    bindings[8].textureView = depthPyramidView;
+
+    wgpu::BindGroupDescriptor bindGroupDesc {};
+    bindGroupDesc.label      = WebGPUUtils::GenerateString("Cull bind group");
+    bindGroupDesc.layout     = bindGroupLayout;
+    bindGroupDesc.entryCount = static_cast<uint32_t>(bindings.size());
+    bindGroupDesc.entries    = bindings.data();
+    bindGroup                = device.CreateBindGroup(&bindGroupDesc);
+}
+
+void GpuCuller::Dispatch(wgpu::CommandEncoder encoder,
+                         wgpu::ComputePipeline pipeline,
+                         const char* label)
+{
+    wgpu::ComputePassDescriptor computePassDesc = {};
+    computePassDesc.label                       = WebGPUUtils::GenerateString(label);
+    wgpu::ComputePassEncoder computePass        = encoder.BeginComputePass(&computePassDesc);
+    computePass.SetPipeline(pipeline);
+    computePass.SetBindGroup(0, bindGroup, 0, nullptr);
+    computePass.DispatchWorkgroups((instanceCount + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+    computePass.End();
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <span>
+#include <vector>
+
+#include "MeshCache.h"
+#include "Scene.h"
+
+class DepthPyramid;
+
+/**
+ * Frustum and occlusion culling of scene instances in compute passes. Each instance's bounding
+ * sphere is tested against the planes of the view-projection matrix, and the visible ones are
+ * appended to the range of their batch in a list of instance slots, read by the vertex shader
+ * at instance_index. The instance counts land in an argument buffer drawn with
+ * DrawIndexedIndirect, so the per-frame CPU cost only depends on the number of batches.
+ *
+ * Occlusion culling takes two phases. The early one keeps the instances visible last frame,
+ * which are drawn first. Their depth is reduced into a DepthPyramid, against which the late
+ * phase tests every instance, drawing the visible ones the early phase missed and recording
+ * the visibility of each instance for the next frame.
+ *
+ * Each visible instance is drawn at the coarsest level of detail of its mesh whose error
+ * projects to at most a threshold in pixels, measured at the nearest point of its bounding
+ * sphere. Every batch thus has one draw per level, each with its own list of instances.
+ *
+ * Indirect draws starting at a non-zero instance need the IndirectFirstInstance feature.
+ * Without it the test can be disabled, every instance being listed, and batches drawn
+ * directly with their full instance count.
+ */
+class GpuCuller
+{
+public:
+    enum class Phase
+    {
+        Early,
+        Late,
+    };
+
+    // Indices of a level of detail of the mesh of a batch, see MeshLod
+    struct DrawLod
+    {
+        uint32_t indexCount;
+        uint32_t firstIndex;
+        float error;
+    };
+
+    // Draw of a batch, see Scene::Batch, with the bounding sphere and the levels of its mesh
+    struct DrawBatch
+    {
+        int32_t baseVertex;
+        uint32_t firstInstance;
+        uint32_t instanceCount;
+        // Center in xyz and radius in w, in the space of the mesh
+        glm::vec4 boundingSphere;
+        // From the finest, at most kMaxMeshLodCount
+        std::vector<DrawLod> lods;
+    };
+
+    // Layout of the arguments of DrawIndexedIndirect
+    struct DrawIndexedIndirectArgs
+    {
+        uint32_t indexCount;
+        uint32_t instanceCount;
+        uint32_t firstIndex;
+        int32_t baseVertex;
+        uint32_t firstInstance;
+    };
+
+    // Outcome of the culling of a frame, summed over the batches
+    struct Stats
+    {
+        uint32_t instanceCount;
+        uint32_t drawnInstanceCount;
+        uint64_t triangleCount;
+        uint64_t frustumCulledTriangleCount;
+        uint64_t occludedTriangleCount;
+        // Triangles of drawn instances in the meshlets culled by a ClusterCuller
+        uint64_t clusterCulledTriangleCount;
+        // Triangles of drawn instances left out by coarser levels of detail
+        uint64_t lodReducedTriangleCount;
+        uint64_t drawnTriangleCount;
+        // Instances of each batch inside the frustum
+        std::vector<uint32_t> frustumCounts;
+    };
+
+    bool Initialize(wgpu::Device device, std::span<const unsigned char> shaderSource);
+
+    // Recompile the pipelines from an edited shader, keeping the current ones until the new ones
+    // are ready, and on errors
+    void ReloadShader(std::span<const unsigned char> shaderSource);
+
+    // Describe the batches of the scene, to be called whenever they or its buffer change
+    void SetBatches(std::span<const DrawBatch> batches, wgpu::Buffer instanceBuffer);
+
+    // Use the pyramid for occlusion culling, to be called again when it is recreated
+    void SetDepthPyramid(const DepthPyramid& depthPyramid);
+
+    /**
+     * Record the early culling pass, which must precede the render passes reading the visible
+     * instances. Without isEnabled every instance is visible, and without isOcclusionEnabled
+     * the late draws are empty and CullLate need not be recorded. Levels of detail are picked
+     * for an error of at most lodThreshold pixels, the finest being kept when it is negative.
+     */
+    void Cull(wgpu::CommandEncoder encoder,
+              const glm::mat4x4& projectionMatrix,
+              const glm::mat4x4& viewMatrix,
+              bool isEnabled,
+              bool isOcclusionEnabled,
+              float lodThreshold);
+
+    /**
+     * Record the late culling pass, after the early draws and the reduction of their depth into
+     * the depth pyramid, and before the late draws
+     */
+    void CullLate(wgpu::CommandEncoder encoder);
+
+    wgpu::Buffer GetDrawArgsBuffer() const
+    {
+        return drawArgsBuffer;
+    }
+
+    uint64_t GetDrawArgsOffset(uint32_t batch, uint32_t lod, Phase phase) const
+    {
+        uint64_t index = batchData[batch].firstDraw + lod;
+        return (phase == Phase::Late ? drawCount + index : index) * sizeof(DrawIndexedIndirectArgs);
+    }
+
+    /**
+     * First slot of the visible instances of the early draw of the finest level of a batch, for
+     * draws without indirect arguments, which must then cull with a negative lodThreshold
+     */
+    uint32_t GetFirstVisibleInstance(uint32_t batch) const
+    {
+        return firstVisibleInstances[batch];
+    }
+
+    // Slots of the visible instances, for the render bind group
+    wgpu::Buffer GetVisibleInstanceBuffer() const
+    {
+        return visibleInstanceBuffer;
+    }
+
+    /**
+     * Read back the outcome of the work submitted so far, callback being invoked from
+     * Device::Tick. Return false while the previous read is pending.
+     */
+    bool ReadStats(std::function<void(const Stats&)> callback);
+
+    // Normalized planes of the frustum of a view-projection matrix, see CullUniforms
+    static std::array<glm::vec4, 6> GetFrustumPlanes(const glm::mat4x4& viewProjection);
+
+    // Reference implementation on the CPU, returning the instances of each batch in the frustum
+    std::vector<uint32_t> CountVisible(std::span<const Scene::InstanceData> instances,
+                                       const glm::mat4x4& viewProjection) const;
+
+private:
+    // Layout of CullBatch in cull.wgsl
+    struct BatchData
+    {
+        // Center in xyz and radius in w, in the space of the mesh
+        glm::vec4 boundingSphere;
+        // Draw of the finest level, followed by the others
+        uint32_t firstDraw;
+        uint32_t lodCount;
+        float lodErrors[kMaxMeshLodCount];
+    };
+
+    static_assert(sizeof(BatchData) % 16 == 0);
+
+    struct CullUniforms
+    {
+        // Normalized planes, inside when dot(xyz, position) + w >= 0
+        std::array<glm::vec4, 6> planes;
+        glm::mat4x4 viewMatrix;
+        // Elements [0][0], [1][1], [2][2] and [3][2] of the projection matrix
+        glm::vec4 projection;
+        uint32_t instanceCount;
+        uint32_t drawCount;
+        uint32_t isEnabled;
+        uint32_t isOcclusionEnabled;
+        uint32_t depthWidth;
+        uint32_t depthHeight;
+        float lodThreshold;
+        uint32_t _pad;
+    };
+
+    static_assert(sizeof(CullUniforms) % 16 == 0);
+
+    wgpu::Buffer CreateBuffer(const char* label, wgpu::BufferUsage usage, uint64_t size) const;
+    // The entry point must outlive the descriptor
+    wgpu::ComputePipelineDescriptor GetPipelineDesc(wgpu::ShaderModule shaderModule,
+                                                    const char* entryPoint) const;
+    void CreateBindGroup();
+    void Dispatch(wgpu::CommandEncoder encoder, wgpu::ComputePipeline pipeline, const char* label);
+
+    wgpu::Device device                   = nullptr;
+    wgpu::BindGroupLayout bindGroupLayout = nullptr;
+    wgpu::PipelineLayout pipelineLayout   = nullptr;
+    wgpu::ComputePipeline earlyPipeline   = nullptr;
+    wgpu::ComputePipeline latePipeline    = nullptr;
+    wgpu::BindGroup bindGroup             = nullptr;
+    // Incremented by each reload, so that only the latest one replaces the pipelines
+    uint32_t pipelineGeneration           = 0;
+
+    wgpu::Buffer uniformBuffer         = nullptr;
+    wgpu::Buffer instanceBuffer        = nullptr;
+    // Batch of each instance, and the BatchData of each batch
+    wgpu::Buffer instanceBatchBuffer   = nullptr;
+    wgpu::Buffer batchBuffer           = nullptr;
+    // The early then the late draw arguments, reset from their template before each frame
+    wgpu::Buffer drawArgsBuffer        = nullptr;
+    wgpu::Buffer drawArgsTemplate      = nullptr;
+    // The early then the late list of each draw
+    wgpu::Buffer visibleInstanceBuffer = nullptr;
+    wgpu::Buffer visibilityBuffer      = nullptr;
+    wgpu::Buffer frustumCountBuffer    = nullptr;
+    wgpu::Buffer readbackBuffer        = nullptr;
+
+    wgpu::TextureView depthPyramidView = nullptr;
+    uint32_t depthWidth                = 0;
+    uint32_t depthHeight               = 0;
+
+    std::vector<DrawBatch> batches;
+    std::vector<BatchData> batchData;
+    std::vector<uint32_t> firstVisibleInstances;
+    uint32_t instanceCount = 0;
+    // Draws of all the levels of all the batches, in each phase
+    uint32_t drawCount = 0;
+};
@@ -0,0 +1,135 @@
+#include "GpuMipMapGenerator.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <array>
+
+#include "ResourceManager.h"
+#include "WebGPUUtils.h"
+
+namespace
+{
+    // Must match @workgroup_size in mipmap.wgsl
+    constexpr uint32_t kWorkgroupSize = 8;
+
+    wgpu::TextureView CreateMipLevelView(wgpu::Texture texture, uint32_t level)
+    {
+        wgpu::TextureViewDescriptor textureViewDesc;
+        textureViewDesc.aspect          = wgpu::TextureAspect::All;
+        textureViewDesc.baseArrayLayer  = 0;
+        textureViewDesc.arrayLayerCount = 1;
+        textureViewDesc.baseMipLevel    = level;
+        textureViewDesc.mipLevelCount   = 1;
+        textureViewDesc.dimension       = wgpu::TextureViewDimension::e2D;
+        textureViewDesc.format          = texture.GetFormat();
+        return texture.CreateView(&textureViewDesc);
+    }
+}  // namespace
+
+bool GpuMipMapGenerator::Initialize(wgpu::Device device)
+{
+    this->device = device;
+
+    wgpu::ShaderModule shaderModule =
+        ResourceManager::LoadShaderModule("resources/mipmap.wgsl", device);
+    if (shaderModule == nullptr)
+    {
+        SDL_Log("Could not load mipmap shader!");
+        return false;
+    }
+
+    std::array<wgpu::BindGroupLayoutEntry, 2> bindingLayoutEntries {};
+
+    // The level read from
+    wgpu::BindGroupLayoutEntry& previousLevelLayout = bindingLayoutEntries[0];
+    previousLevelLayout.binding                     = 0;
+    previousLevelLayout.visibility                  = wgpu::ShaderStage::Compute;
+    previousLevelLayout.texture.sampleType          = wgpu::TextureSampleType::Float;
+    previousLevelLayout.texture.viewDimension       = wgpu::TextureViewDimension::e2D;
+
+    // The level written to
+    wgpu::BindGroupLayoutEntry& nextLevelLayout  = bindingLayoutEntries[1];
+    nextLevelLayout.binding                      = 1;
+    nextLevelLayout.visibility                   = wgpu::ShaderStage::Compute;
+    nextLevelLayout.storageTexture.access        = wgpu::StorageTextureAccess::WriteOnly;
+    nextLevelLayout.storageTexture.format        = wgpu::TextureFormat::RGBA8Unorm;
+    nextLevelLayout.storageTexture.viewDimension = wgpu::TextureViewDimension::e2D;
+
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
+    bindGroupLayoutDesc.label      = WebGPUUtils::GenerateString("Mipmap bind group layout");
+    bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(bindingLayoutEntries.size());
+    bindGroupLayoutDesc.entries    = bindingLayoutEntries.data();
+    bindGroupLayout                = device.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor layoutDesc {};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts     = &bindGroupLayout;
+    pipelineLayout                  = device.CreatePipelineLayout(&layoutDesc);
+
+    linearPipeline = CreatePipeline(shaderModule, false);
+    srgbPipeline   = CreatePipeline(shaderModule, true);
+    return IsInitialized();
+}
+
+void GpuMipMapGenerator::Generate(wgpu::Texture texture, bool isSrgb) const
+{
+    wgpu::CommandEncoderDescriptor encoderDesc = {};
+    encoderDesc.label                          = WebGPUUtils::GenerateString("Mipmap encoder");
+    wgpu::CommandEncoder encoder               = device.CreateCommandEncoder(&encoderDesc);
+
+    wgpu::ComputePassDescriptor computePassDesc = {};
+    computePassDesc.label                       = WebGPUUtils::GenerateString("Mipmap pass");
+    wgpu::ComputePassEncoder computePass        = encoder.BeginComputePass(&computePassDesc);
+    computePass.SetPipeline(isSrgb ? srgbPipeline : linearPipeline);
+
+    // Each dispatch reads the level written by the previous one
+    wgpu::TextureView previousLevelView = CreateMipLevelView(texture, 0);
+    for (uint32_t level = 1; level < texture.GetMipLevelCount(); ++level)
+    {
+        wgpu::TextureView nextLevelView = CreateMipLevelView(texture, level);
+
+        std::array<wgpu::BindGroupEntry, 2> bindings {};
+        bindings[0].binding     = 0;
+        bindings[0].textureView = previousLevelView;
+        bindings[1].binding     = 1;
+        bindings[1].textureView = nextLevelView;
+
+        wgpu::BindGroupDescriptor bindGroupDesc {};
+        bindGroupDesc.layout      = bindGroupLayout;
+        bindGroupDesc.entryCount  = static_cast<uint32_t>(bindings.size());
+        bindGroupDesc.entries     = bindings.data();
+        wgpu::BindGroup bindGroup = device.CreateBindGroup(&bindGroupDesc);
+        computePass.SetBindGroup(0, bindGroup, 0, nullptr);
+
+        uint32_t width  = std::max(texture.GetWidth() >> level, 1u);
+        uint32_t height = std::max(texture.GetHeight() >> level, 1u);
+        computePass.DispatchWorkgroups((width + kWorkgroupSize - 1) / kWorkgroupSize,
+                                       (height + kWorkgroupSize - 1) / kWorkgroupSize,
+                                       1);
+
+        previousLevelView = nextLevelView;
+    }
+    computePass.End();
+
+    wgpu::CommandBufferDescriptor cmdBufferDescriptor;
+    cmdBufferDescriptor.label   = WebGPUUtils::GenerateString("Mipmap command buffer");
+    wgpu::CommandBuffer command = encoder.Finish(&cmdBufferDescriptor);
+    device.GetQueue().Submit(1, &command);
+}
+
+wgpu::ComputePipeline GpuMipMapGenerator::CreatePipeline(wgpu::ShaderModule shaderModule,
+                                                         bool isSrgb) const
+{
+    wgpu::ConstantEntry constant;
+    constant.key   = WebGPUUtils::GenerateString("isSrgb");
+    constant.value = isSrgb ? 1.0 : 0.0;
+
+    wgpu::ComputePipelineDescriptor pipelineDesc {};
+    pipelineDesc.label                 = WebGPUUtils::GenerateString("Mipmap pipeline");
+    pipelineDesc.layout                = pipelineLayout;
+    pipelineDesc.compute.module        = shaderModule;
+    pipelineDesc.compute.entryPoint    = WebGPUUtils::GenerateString("cs_main");
+    pipelineDesc.compute.constantCount = 1;
+    pipelineDesc.compute.constants     = &constant;
+    return device.CreateComputePipeline(&pipelineDesc);
+}
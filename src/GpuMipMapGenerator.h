@@ -0,0 +1,35 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+/**
+ * Compute the mip chain of RGBA8 textures on the GPU from their level 0, as an alternative
+ * to uploading every level generated by MipMapGenerator. The pipelines are created once by
+ * Initialize and reused for every texture.
+ */
+class GpuMipMapGenerator
+{
+public:
+    bool Initialize(wgpu::Device device);
+
+    bool IsInitialized() const
+    {
+        return linearPipeline != nullptr && srgbPipeline != nullptr;
+    }
+
+    /**
+     * Submit the compute passes filling levels 1 and above of texture from its level 0.
+     * The texture must be RGBA8Unorm with the TextureBinding and StorageBinding usages.
+     * With isSrgb, colors are averaged in linear space.
+     */
+    void Generate(wgpu::Texture texture, bool isSrgb) const;
+
+private:
+    wgpu::ComputePipeline CreatePipeline(wgpu::ShaderModule shaderModule, bool isSrgb) const;
+
+    wgpu::Device device                   = nullptr;
+    wgpu::BindGroupLayout bindGroupLayout = nullptr;
+    wgpu::PipelineLayout pipelineLayout   = nullptr;
+    wgpu::ComputePipeline linearPipeline  = nullptr;
+    wgpu::ComputePipeline srgbPipeline    = nullptr;
+};
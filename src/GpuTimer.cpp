@@ -0,0 +1,109 @@
+#include "GpuTimer.h"
+
+#include <SDL3/SDL_log.h>
+
+#include "WebGPUUtils.h"
+
+namespace
+{
+    // The start and end timestamps of a frame, in nanoseconds
+    constexpr uint32_t kQueryCount = 2;
+    constexpr uint64_t kQuerySize  = kQueryCount * sizeof(uint64_t);
+}  // namespace
+
+void GpuTimer::Initialize(wgpu::Device device)
+{
+    if (!device.HasFeature(wgpu::FeatureName::TimestampQuery))
+    {
+        SDL_Log("TimestampQuery is not supported, the GPU time is not measured");
+        return;
+    }
+
+    wgpu::QuerySetDescriptor querySetDesc {};
+    querySetDesc.label = WebGPUUtils::GenerateString("Frame timestamps");
+    querySetDesc.type  = wgpu::QueryType::Timestamp;
+    querySetDesc.count = kQueryCount;
+    querySet           = device.CreateQuerySet(&querySetDesc);
+
+    wgpu::BufferDescriptor bufferDesc {};
+    bufferDesc.label = WebGPUUtils::GenerateString("Frame timestamps resolve");
+    bufferDesc.size  = kQuerySize;
+    bufferDesc.usage = wgpu::BufferUsage::QueryResolve | wgpu::BufferUsage::CopySrc;
+    resolveBuffer    = device.CreateBuffer(&bufferDesc);
+
+    bufferDesc.label = WebGPUUtils::GenerateString("Frame timestamps readback");
+    bufferDesc.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+    readbackBuffer   = device.CreateBuffer(&bufferDesc);
+}
+
+void GpuTimer::Begin(wgpu::CommandEncoder encoder)
+{
+    if (IsSupported())
+    {
+        WriteTimestamp(encoder, 0);
+    }
+}
+
+void GpuTimer::End(wgpu::CommandEncoder encoder)
+{
+    if (!IsSupported())
+    {
+        return;
+    }
+
+    WriteTimestamp(encoder, 1);
+    encoder.ResolveQuerySet(querySet, 0, kQueryCount, resolveBuffer, 0);
+
+    // A buffer being mapped can't be copied to, the timestamps of this frame are then dropped
+    isCopied = readbackBuffer.GetMapState() == wgpu::BufferMapState::Unmapped;
+    if (isCopied)
+    {
+        encoder.CopyBufferToBuffer(resolveBuffer, 0, readbackBuffer, 0, kQuerySize);
+    }
+}
+
+void GpuTimer::Read()
+{
+    if (!isCopied)
+    {
+        return;
+    }
+    isCopied = false;
+
+    readbackBuffer.MapAsync(
+        wgpu::MapMode::Read,
+        0,
+        kQuerySize,
+        WebGPUUtils::kCallbackMode,
+        [this](wgpu::MapAsyncStatus status, wgpu::StringView message)
+        {
+            if (status != wgpu::MapAsyncStatus::Success)
+            {
+                SDL_Log("Could not read back timestamps: %.*s",
+                        static_cast<int>(message.length),
+                        message.data);
+                return;
+            }
+
+            const auto* timestamps =
+                static_cast<const uint64_t*>(readbackBuffer.GetConstMappedRange(0, kQuerySize));
+            // Timestamps may go backwards, e.g. when the GPU changes its clock
+            if (timestamps[1] > timestamps[0])
+            {
+                time = (timestamps[1] - timestamps[0]) / 1000000.0;
+            }
+            readbackBuffer.Unmap();
+        });
+}
+
+void GpuTimer::WriteTimestamp(wgpu::CommandEncoder encoder, uint32_t queryIndex)
+{
+    wgpu::PassTimestampWrites timestampWrites {};
+    timestampWrites.querySet                  = querySet;
+    timestampWrites.beginningOfPassWriteIndex = queryIndex;
+    timestampWrites.endOfPassWriteIndex       = WGPU_QUERY_SET_INDEX_UNDEFINED;
+
+    wgpu::ComputePassDescriptor passDesc {};
+    passDesc.timestampWrites = &timestampWrites;
+    encoder.BeginComputePass(&passDesc).End();
+}
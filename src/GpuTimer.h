@@ -0,0 +1,47 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <cstdint>
+
+/**
+ * GPU time of a frame, from timestamps written by two empty compute passes, one before the
+ * first pass of the frame and one after its last. Each frame's timestamps are resolved and
+ * read back asynchronously, no read starting while one is pending, so the time lags the frame
+ * by the read back latency.
+ *
+ * Timestamps need the TimestampQuery feature, without which the timer does nothing.
+ */
+class GpuTimer
+{
+public:
+    void Initialize(wgpu::Device device);
+
+    bool IsSupported() const
+    {
+        return querySet != nullptr;
+    }
+
+    // Write the start timestamp, before the first pass of the frame
+    void Begin(wgpu::CommandEncoder encoder);
+    // Write the end timestamp, after the last pass of the frame, and resolve both
+    void End(wgpu::CommandEncoder encoder);
+    // Read back the timestamps resolved by End, once the frame is submitted
+    void Read();
+
+    // Last time read back, in milliseconds
+    double GetTime() const
+    {
+        return time;
+    }
+
+private:
+    // An empty compute pass writing a timestamp at its beginning
+    void WriteTimestamp(wgpu::CommandEncoder encoder, uint32_t queryIndex);
+
+    wgpu::QuerySet querySet     = nullptr;
+    wgpu::Buffer resolveBuffer  = nullptr;
+    wgpu::Buffer readbackBuffer = nullptr;
+    // Whether the readback buffer received the timestamps of the frame being submitted
+    bool isCopied = false;
+    double time   = 0.0;
+};
@@ -0,0 +1,198 @@
+#include "LightClusterer.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+
+#include "ResourceManager.h"
+#include "WebGPUUtils.h"
+
+namespace
+{
+    // One invocation per cluster, must match @workgroup_size in lightcluster.wgsl
+    constexpr uint32_t kWorkgroupSize = 64;
+
+    constexpr uint32_t kClusterCount = LightClusterer::kClusterCountX
+                                       * LightClusterer::kClusterCountY
+                                       * LightClusterer::kClusterCountZ;
+
+    // Lights the buffer holds at first, it then grows to the next power of two
+    constexpr uint32_t kMinLightCapacity = 64;
+}  // namespace
+
+void LightClusterer::SetSpotCone(Light& light, float innerAngle, float outerAngle)
+{
+    float cosInner   = std::cos(innerAngle);
+    float cosOuter   = std::cos(outerAngle);
+    light.spotScale  = 1.0f / std::max(cosInner - cosOuter, 1e-4f);
+    light.spotOffset = -cosOuter * light.spotScale;
+}
+
+bool LightClusterer::Initialize(wgpu::Device device, std::span<const unsigned char> shaderSource)
+{
+    this->device = device;
+
+    wgpu::ShaderModule shaderModule = ResourceManager::LoadShaderModule(shaderSource, device);
+    if (shaderModule == nullptr)
+    {
+        SDL_Log("Could not load light cluster shader!");
+        return false;
+    }
+
+    std::array<wgpu::BindGroupLayoutEntry, 3> bindingLayoutEntries {};
+    for (uint32_t binding = 0; binding < bindingLayoutEntries.size(); ++binding)
+    {
+        bindingLayoutEntries[binding].binding    = binding;
+        bindingLayoutEntries[binding].visibility = wgpu::ShaderStage::Compute;
+    }
+
+    bindingLayoutEntries[0].buffer.type           = wgpu::BufferBindingType::Uniform;
+    bindingLayoutEntries[0].buffer.minBindingSize = sizeof(ClusterUniforms);
+    bindingLayoutEntries[1].buffer.type           = wgpu::BufferBindingType::ReadOnlyStorage;
+    bindingLayoutEntries[1].buffer.minBindingSize = sizeof(Light);
+    // The lights of each cluster
+    bindingLayoutEntries[2].buffer.type           = wgpu::BufferBindingType::Storage;
+    bindingLayoutEntries[2].buffer.minBindingSize = (kMaxLightsPerCluster + 1) * sizeof(uint32_t);
+
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
+    bindGroupLayoutDesc.label      = WebGPUUtils::GenerateString("Light cluster bind group layout");
+    bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(bindingLayoutEntries.size());
+    bindGroupLayoutDesc.entries    = bindingLayoutEntries.data();
+    bindGroupLayout                = device.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor layoutDesc {};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts     = &bindGroupLayout;
+    pipelineLayout                  = device.CreatePipelineLayout(&layoutDesc);
+
+    wgpu::ComputePipelineDescriptor pipelineDesc = GetPipelineDesc(shaderModule);
+    pipeline                                     = device.CreateComputePipeline(&pipelineDesc);
+
+    uniformBuffer      = CreateBuffer("Light cluster uniforms",
+                                      wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+                                      sizeof(ClusterUniforms));
+    clusterLightBuffer = CreateBuffer("Cluster lights",
+                                      wgpu::BufferUsage::Storage,
+                                      kClusterCount * (kMaxLightsPerCluster + 1)
+                                          * sizeof(uint32_t));
+
+    // Storage bindings may not be empty, hence room for lights before there are any
+    SetLights({});
+    return pipeline != nullptr;
+}
+
+void LightClusterer::ReloadShader(std::span<const unsigned char> shaderSource)
+{
+    wgpu::ShaderModule shaderModule = ResourceManager::LoadShaderModule(shaderSource, device);
+
+    wgpu::ComputePipelineDescriptor pipelineDesc = GetPipelineDesc(shaderModule);
+
+    // Only the latest reload is kept, should the shader be saved again while compiling
+    uint32_t generation = ++pipelineGeneration;
+    WebGPUUtils::CreateComputePipelinesAsync(
+        device,
+        {&pipelineDesc, 1},
+        [this, generation](std::span<const wgpu::ComputePipeline> pipelines)
+        {
+            if (generation == pipelineGeneration)
+            {
+                pipeline = pipelines[0];
+                SDL_Log("Reloaded light cluster shader");
+            }
+        });
+}
+
+bool LightClusterer::SetLights(std::span<const Light> lights)
+{
+    lightCount   = static_cast<uint32_t>(lights.size());
+    bool isGrown = lightBuffer == nullptr || lightCount > lightCapacity;
+    if (isGrown)
+    {
+        lightCapacity = std::max(std::bit_ceil(lightCount), kMinLightCapacity);
+        lightBuffer   = CreateBuffer("Lights",
+                                     wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst,
+                                     lightCapacity * sizeof(Light));
+        CreateBindGroup();
+    }
+    device.GetQueue().WriteBuffer(lightBuffer, 0, lights.data(), lights.size() * sizeof(Light));
+    return isGrown;
+}
+
+void LightClusterer::Build(wgpu::CommandEncoder encoder,
+                           const glm::mat4x4& projectionMatrix,
+                           const glm::mat4x4& viewMatrix,
+                           uint32_t width,
+                           uint32_t height)
+{
+    // Planes of a left-handed projection to a depth of 0 to 1, see glm::perspectiveLH_ZO
+    float nearPlane  = -projectionMatrix[3][2] / projectionMatrix[2][2];
+    float farPlane   = projectionMatrix[3][2] / (1.0f - projectionMatrix[2][2]);
+    float sliceScale = kClusterCountZ / std::log(farPlane / nearPlane);
+
+    // The pass also runs without lights, so that the counts of the clusters drop to zero
+    ClusterUniforms uniforms {};
+    uniforms.viewMatrix      = viewMatrix;
+    uniforms.clusterScale    = {static_cast<float>(kClusterCountX) / width,
+                                static_cast<float>(kClusterCountY) / height,
+                                sliceScale,
+                                -std::log(nearPlane) * sliceScale};
+    uniforms.projectionScale = {1.0f / projectionMatrix[0][0],
+                                1.0f / projectionMatrix[1][1],
+                                nearPlane,
+                                farPlane};
+    uniforms.clusterCounts   = {kClusterCountX, kClusterCountY, kClusterCountZ, lightCount};
+    device.GetQueue().WriteBuffer(uniformBuffer, 0, &uniforms, sizeof(ClusterUniforms));
+
+    wgpu::ComputePassDescriptor computePassDesc = {};
+    computePassDesc.label                       = WebGPUUtils::GenerateString("Light cluster pass");
+    wgpu::ComputePassEncoder computePass        = encoder.BeginComputePass(&computePassDesc);
+    computePass.SetPipeline(pipeline);
+    computePass.SetBindGroup(0, bindGroup, 0, nullptr);
+    computePass.DispatchWorkgroups((kClusterCount + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+    computePass.End();
+}
+
+wgpu::ComputePipelineDescriptor LightClusterer::GetPipelineDesc(
+    wgpu::ShaderModule shaderModule) const
+{
+    wgpu::ComputePipelineDescriptor pipelineDesc {};
+    pipelineDesc.label              = WebGPUUtils::GenerateString("Light cluster pipeline");
+    pipelineDesc.layout             = pipelineLayout;
+    pipelineDesc.compute.module     = shaderModule;
+    pipelineDesc.compute.entryPoint = WebGPUUtils::GenerateString("cs_main");
+    return pipelineDesc;
+}
+
+wgpu::Buffer LightClusterer::CreateBuffer(const char* label,
+                                          wgpu::BufferUsage usage,
+                                          uint64_t size) const
+{
+    wgpu::BufferDescriptor bufferDesc {};
+    bufferDesc.label            = WebGPUUtils::GenerateString(label);
+    bufferDesc.size             = size;
+    bufferDesc.usage            = usage;
+    bufferDesc.mappedAtCreation = false;
+    return device.CreateBuffer(&bufferDesc);
+}
+
+void LightClusterer::CreateBindGroup()
+{
+    std::array<wgpu::BindGroupEntry, 3> bindings {};
+    bindings[0].buffer = uniformBuffer;
+    bindings[1].buffer = lightBuffer;
+    bindings[2].buffer = clusterLightBuffer;
+    for (uint32_t binding = 0; binding < bindings.size(); ++binding)
+    {
+        bindings[binding].binding = binding;
+        bindings[binding].size    = bindings[binding].buffer.GetSize();
+    }
+
+    wgpu::BindGroupDescriptor bindGroupDesc {};
+    bindGroupDesc.label      = WebGPUUtils::GenerateString("Light cluster bind group");
+    bindGroupDesc.layout     = bindGroupLayout;
+    bindGroupDesc.entryCount = static_cast<uint32_t>(bindings.size());
+    bindGroupDesc.entries    = bindings.data();
+    bindGroup                = device.CreateBindGroup(&bindGroupDesc);
+}
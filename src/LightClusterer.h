@@ -0,0 +1,119 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <cstdint>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <span>
+
+/**
+ * Clustered forward lighting: the view frustum is divided into a grid of clusters, tiles of the
+ * screen split into slices of exponentially growing depth, and a compute pass lists the point
+ * and spot lights reaching each cluster every frame. The fragment shader then only shades the
+ * lights of its own cluster, so that its cost depends on the density of the lights around it
+ * rather than on their total number.
+ *
+ * Lights are tested as spheres of their range against the bounding box of each cluster in view
+ * space, which keeps spot lights wherever their sphere reaches. Clusters keep at most
+ * kMaxLightsPerCluster lights, further ones being dropped.
+ */
+class LightClusterer
+{
+public:
+    // Grid of clusters, the slices covering the depth range of the projection
+    static constexpr uint32_t kClusterCountX = 16;
+    static constexpr uint32_t kClusterCountY = 9;
+    static constexpr uint32_t kClusterCountZ = 24;
+    // Must match kMaxLightsPerCluster in lightcluster.wgsl and shader.wgsl
+    static constexpr uint32_t kMaxLightsPerCluster = 63;
+
+    // Layout of Light in lightcluster.wgsl and shader.wgsl
+    struct Light
+    {
+        glm::vec3 position;
+        // Distance at which the light fades out
+        float range;
+        glm::vec3 color;
+        // The cone of spot lights attenuates by saturate(cos * spotScale + spotOffset)^2, cos being
+        // that of the angle to their direction. Point lights have a scale of 0 and an offset of 1.
+        float spotScale = 0.0f;
+        glm::vec3 direction {0.0f, 0.0f, -1.0f};
+        float spotOffset = 1.0f;
+    };
+
+    // Turn a light into a spot light fading out from innerAngle to outerAngle, in radians
+    static void SetSpotCone(Light& light, float innerAngle, float outerAngle);
+
+    bool Initialize(wgpu::Device device, std::span<const unsigned char> shaderSource);
+
+    // Recompile the pipelines from an edited shader, keeping the current ones until the new ones
+    // are ready, and on errors
+    void ReloadShader(std::span<const unsigned char> shaderSource);
+
+    /**
+     * Upload the lights, to be called whenever they change. Return true when the light buffer
+     * was recreated to hold them, after which bind groups using it must be recreated.
+     */
+    bool SetLights(std::span<const Light> lights);
+
+    // Record the pass listing the lights of each cluster, for a target of the given size
+    void Build(wgpu::CommandEncoder encoder,
+               const glm::mat4x4& projectionMatrix,
+               const glm::mat4x4& viewMatrix,
+               uint32_t width,
+               uint32_t height);
+
+    // Bindings of the fragment shader: the uniforms, the lights and the lights of each cluster
+    wgpu::Buffer GetUniformBuffer() const
+    {
+        return uniformBuffer;
+    }
+
+    wgpu::Buffer GetLightBuffer() const
+    {
+        return lightBuffer;
+    }
+
+    wgpu::Buffer GetClusterLightBuffer() const
+    {
+        return clusterLightBuffer;
+    }
+
+    // Layout of ClusterUniforms in lightcluster.wgsl and shader.wgsl
+    struct ClusterUniforms
+    {
+        glm::mat4x4 viewMatrix;
+        // Clusters per pixel in xy, the slice of a view depth being log(depth) * z + w
+        glm::vec4 clusterScale;
+        // View space xy per unit of depth at the edges of the screen, and the near and far planes
+        glm::vec4 projectionScale;
+        // Clusters along each axis, and the light count in w
+        glm::uvec4 clusterCounts;
+    };
+
+    static_assert(sizeof(ClusterUniforms) % 16 == 0);
+
+private:
+    wgpu::Buffer CreateBuffer(const char* label, wgpu::BufferUsage usage, uint64_t size) const;
+    wgpu::ComputePipelineDescriptor GetPipelineDesc(wgpu::ShaderModule shaderModule) const;
+    void CreateBindGroup();
+
+    wgpu::Device device                   = nullptr;
+    wgpu::BindGroupLayout bindGroupLayout = nullptr;
+    wgpu::PipelineLayout pipelineLayout   = nullptr;
+    wgpu::ComputePipeline pipeline        = nullptr;
+    wgpu::BindGroup bindGroup             = nullptr;
+    // Incremented by each reload, so that only the latest one replaces the pipelines
+    uint32_t pipelineGeneration           = 0;
+
+    wgpu::Buffer uniformBuffer      = nullptr;
+    // Lights, with room for lightCapacity of them
+    wgpu::Buffer lightBuffer        = nullptr;
+    // Light count of each cluster followed by the indices of its lights, kMaxLightsPerCluster + 1
+    // words per cluster
+    wgpu::Buffer clusterLightBuffer = nullptr;
+
+    uint32_t lightCapacity = 0;
+    uint32_t lightCount    = 0;
+};
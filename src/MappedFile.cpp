@@ -0,0 +1,156 @@
+#include "MappedFile.h"
+
+#include <fstream>
+#include <utility>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        data     = std::exchange(other.data, nullptr);
+        size     = std::exchange(other.size, 0);
+        isOpen   = std::exchange(other.isOpen, false);
+        isMapped = std::exchange(other.isMapped, false);
+        buffer   = std::move(other.buffer);
+#ifdef _WIN32
+        fileHandle    = std::exchange(other.fileHandle, nullptr);
+        mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#endif
+    }
+    return *this;
+}
+
+bool MappedFile::Open(const std::filesystem::path& path)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(),
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER fileSize {};
+        bool hasSize = GetFileSizeEx(file, &fileSize);
+        if (hasSize && fileSize.QuadPart == 0)
+        {
+            // Empty files cannot be mapped
+            CloseHandle(file);
+            isOpen = true;
+            return true;
+        }
+
+        HANDLE mapping =
+            hasSize ? CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        void* view     = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (view)
+        {
+            fileHandle    = file;
+            mappingHandle = mapping;
+            data          = static_cast<const unsigned char*>(view);
+            size          = static_cast<size_t>(fileSize.QuadPart);
+            isOpen        = true;
+            isMapped      = true;
+            return true;
+        }
+        if (mapping)
+        {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat fileStat;
+        bool hasSize = fstat(fd, &fileStat) == 0;
+        if (hasSize && fileStat.st_size == 0)
+        {
+            // Empty files cannot be mapped
+            close(fd);
+            isOpen = true;
+            return true;
+        }
+
+        void* view =
+            hasSize ? mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        // The mapping stays valid after the descriptor is closed
+        close(fd);
+        if (view != MAP_FAILED)
+        {
+            madvise(view, fileStat.st_size, MADV_SEQUENTIAL);
+            data     = static_cast<const unsigned char*>(view);
+            size     = static_cast<size_t>(fileStat.st_size);
+            isOpen   = true;
+            isMapped = true;
+            return true;
+        }
+    }
+#endif
+
+    // Fall back to reading the whole file
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    buffer.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+
+    data   = buffer.data();
+    size   = buffer.size();
+    isOpen = true;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (isMapped)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        mappingHandle = nullptr;
+        fileHandle    = nullptr;
+#else
+        munmap(const_cast<unsigned char*>(data), size);
+#endif
+    }
+
+    buffer.clear();
+    buffer.shrink_to_fit();
+    data     = nullptr;
+    size     = 0;
+    isOpen   = false;
+    isMapped = false;
+}
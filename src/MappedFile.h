@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+/**
+ * Read-only view of a whole file, memory-mapped when the platform allows it and
+ * read into memory otherwise
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Map the file and return true if it went all right
+    bool Open(const std::filesystem::path& path);
+
+    // Unmap the file, it is safe to call this on a file that is not open
+    void Close();
+
+    bool IsOpen() const
+    {
+        return isOpen;
+    }
+
+    const unsigned char* GetData() const
+    {
+        return data;
+    }
+
+    size_t GetSize() const
+    {
+        return size;
+    }
+
+private:
+    const unsigned char* data = nullptr;
+    size_t size               = 0;
+    bool isOpen               = false;
+    bool isMapped             = false;
+
+    // Fallback storage when mapping is not available
+    std::vector<unsigned char> buffer;
+
+#ifdef _WIN32
+    void* fileHandle    = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,47 @@
+#include "MemoryUsage.h"
+
+#include <SDL3/SDL_log.h>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <psapi.h>
+#elif !defined(__EMSCRIPTEN__)
+    #include <sys/resource.h>
+#endif
+
+uint64_t MemoryUsage::GetPeakResidentSize()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#elif defined(__EMSCRIPTEN__)
+    return 0;
+#else
+    rusage usage {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+    // Reported in bytes by macOS and in kilobytes by Linux
+    #ifdef __APPLE__
+    return uint64_t(usage.ru_maxrss);
+    #else
+    return uint64_t(usage.ru_maxrss) * 1024;
+    #endif
+#endif
+}
+
+void MemoryUsage::LogPeakResidentSize(const char* stage)
+{
+    uint64_t peakSize = GetPeakResidentSize();
+    if (peakSize > 0)
+    {
+        SDL_Log("Peak resident memory after %s: %.1f MB", stage, peakSize / (1024.0 * 1024.0));
+    }
+}
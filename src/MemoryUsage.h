@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+namespace MemoryUsage
+{
+    /**
+     * Largest resident set of the process so far in bytes, e.g. to compare the peak host memory
+     * of loading paths. 0 where the platform does not report it, as on the web.
+     */
+    uint64_t GetPeakResidentSize();
+
+    // Log the peak resident set, after the given stage, when it is known
+    void LogPeakResidentSize(const char* stage);
+}  // namespace MemoryUsage
@@ -0,0 +1,270 @@
+#include "MeshCache.h"
+
+#include <SDL3/SDL_log.h>
+#include <cstring>
+
+#include "Application.h"
+#include "AssetSource.h"
+
+namespace
+{
+    constexpr uint32_t kMeshCacheMagic = 0x4853454D;  // "MESH"
+    // Bump whenever the layout or the processing of the cached geometry changes
+    constexpr uint32_t kMeshCacheVersion = 4;
+    // Alignment of every section of the file
+    constexpr uint64_t kSectionAlignment = 16;
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}  // namespace
+
+struct MeshCache::Header
+{
+    uint32_t magic;
+    uint32_t version;
+
+    // Source asset the cache was built from
+    AssetSource::Stamp source;
+
+    uint32_t vertexFormat;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t submeshCount;
+    uint32_t meshletCount;
+    uint32_t lodCount;
+    uint32_t _pad;
+
+    float boundsMin[3];
+    float boundsMax[3];
+    float positionScale[3];
+    float positionOffset[3];
+
+    // Byte offsets of the sections from the beginning of the file
+    uint64_t submeshOffset;
+    uint64_t meshletOffset;
+    uint64_t lodOffset;
+    uint64_t vertexDataOffset;
+    uint64_t indexDataOffset;
+};
+
+bool MeshCache::Open(const std::filesystem::path& cachePath,
+                     const std::filesystem::path& sourcePath,
+                     VertexFormat vertexFormat)
+{
+    return Map(cachePath, vertexFormat)
+           && CheckSource(cachePath, AssetSource::Matches(sourcePath, GetHeader()->source));
+}
+
+bool MeshCache::Open(const std::filesystem::path& cachePath,
+                     const AssetSource::Stamp& source,
+                     VertexFormat vertexFormat)
+{
+    return Map(cachePath, vertexFormat)
+           && CheckSource(cachePath, AssetSource::Matches(source, GetHeader()->source));
+}
+
+bool MeshCache::Create(const std::filesystem::path& cachePath,
+                       const AssetSource::Stamp& source,
+                       VertexFormat vertexFormat,
+                       std::span<const unsigned char> vertexData,
+                       uint32_t vertexStride,
+                       const std::vector<uint32_t>& indexData,
+                       const std::vector<MeshSubmesh>& submeshes,
+                       const std::vector<MeshMeshlet>& meshlets,
+                       const std::vector<MeshLod>& lods,
+                       const glm::vec3& positionScale,
+                       const glm::vec3& positionOffset)
+{
+    file.Close();
+
+    Header header {};
+    header.magic        = kMeshCacheMagic;
+    header.version      = kMeshCacheVersion;
+    header.vertexFormat = static_cast<uint32_t>(vertexFormat);
+    header.vertexStride = vertexStride;
+    header.vertexCount  = static_cast<uint32_t>(vertexData.size() / vertexStride);
+    header.indexCount   = static_cast<uint32_t>(indexData.size());
+    header.submeshCount = static_cast<uint32_t>(submeshes.size());
+    header.meshletCount = static_cast<uint32_t>(meshlets.size());
+    header.lodCount     = static_cast<uint32_t>(lods.size());
+    header.source       = source;
+
+    glm::vec3 boundsMin = submeshes.empty() ? glm::vec3(0.0f) : submeshes[0].boundsMin;
+    glm::vec3 boundsMax = submeshes.empty() ? glm::vec3(0.0f) : submeshes[0].boundsMax;
+    for (const MeshSubmesh& submesh : submeshes)
+    {
+        boundsMin = glm::min(boundsMin, submesh.boundsMin);
+        boundsMax = glm::max(boundsMax, submesh.boundsMax);
+    }
+    for (int k = 0; k < 3; ++k)
+    {
+        header.boundsMin[k]      = boundsMin[k];
+        header.boundsMax[k]      = boundsMax[k];
+        header.positionScale[k]  = positionScale[k];
+        header.positionOffset[k] = positionOffset[k];
+    }
+
+    uint64_t submeshSize    = submeshes.size() * sizeof(MeshSubmesh);
+    uint64_t meshletSize    = meshlets.size() * sizeof(MeshMeshlet);
+    uint64_t lodSize        = lods.size() * sizeof(MeshLod);
+    uint64_t vertexDataSize = vertexData.size();
+    uint64_t indexDataSize  = indexData.size() * sizeof(uint32_t);
+    header.submeshOffset    = AlignUp(sizeof(Header), kSectionAlignment);
+    header.meshletOffset    = AlignUp(header.submeshOffset + submeshSize, kSectionAlignment);
+    header.lodOffset        = AlignUp(header.meshletOffset + meshletSize, kSectionAlignment);
+    header.vertexDataOffset = AlignUp(header.lodOffset + lodSize, kSectionAlignment);
+    header.indexDataOffset  = AlignUp(header.vertexDataOffset + vertexDataSize, kSectionAlignment);
+    uint64_t fileSize       = header.indexDataOffset + indexDataSize;
+
+    ownedData.assign(fileSize, 0);
+    memcpy(ownedData.data(), &header, sizeof(Header));
+    memcpy(ownedData.data() + header.submeshOffset, submeshes.data(), submeshSize);
+    memcpy(ownedData.data() + header.meshletOffset, meshlets.data(), meshletSize);
+    memcpy(ownedData.data() + header.lodOffset, lods.data(), lodSize);
+    memcpy(ownedData.data() + header.vertexDataOffset, vertexData.data(), vertexDataSize);
+    memcpy(ownedData.data() + header.indexDataOffset, indexData.data(), indexDataSize);
+    data = ownedData;
+
+    // Writing is best-effort, the cache stays usable from memory
+    AssetSource::WriteCacheFile(cachePath, ownedData);
+    return true;
+}
+
+std::span<const unsigned char> MeshCache::GetVertexData() const
+{
+    const Header* header = GetHeader();
+    return data.subspan(header->vertexDataOffset,
+                        static_cast<size_t>(header->vertexCount) * header->vertexStride);
+}
+
+std::span<const uint32_t> MeshCache::GetIndexData() const
+{
+    const Header* header = GetHeader();
+    return {reinterpret_cast<const uint32_t*>(data.data() + header->indexDataOffset),
+            header->indexCount};
+}
+
+std::span<const MeshSubmesh> MeshCache::GetSubmeshes() const
+{
+    const Header* header = GetHeader();
+    return {reinterpret_cast<const MeshSubmesh*>(data.data() + header->submeshOffset),
+            header->submeshCount};
+}
+
+std::span<const MeshMeshlet> MeshCache::GetMeshlets() const
+{
+    const Header* header = GetHeader();
+    return {reinterpret_cast<const MeshMeshlet*>(data.data() + header->meshletOffset),
+            header->meshletCount};
+}
+
+std::span<const MeshLod> MeshCache::GetLods() const
+{
+    const Header* header = GetHeader();
+    return {reinterpret_cast<const MeshLod*>(data.data() + header->lodOffset), header->lodCount};
+}
+
+uint32_t MeshCache::GetVertexCount() const
+{
+    return GetHeader()->vertexCount;
+}
+
+uint32_t MeshCache::GetVertexStride() const
+{
+    return GetHeader()->vertexStride;
+}
+
+glm::vec3 MeshCache::GetBoundsMin() const
+{
+    const float* v = GetHeader()->boundsMin;
+    return {v[0], v[1], v[2]};
+}
+
+glm::vec3 MeshCache::GetBoundsMax() const
+{
+    const float* v = GetHeader()->boundsMax;
+    return {v[0], v[1], v[2]};
+}
+
+glm::vec3 MeshCache::GetPositionScale() const
+{
+    const float* v = GetHeader()->positionScale;
+    return {v[0], v[1], v[2]};
+}
+
+glm::vec3 MeshCache::GetPositionOffset() const
+{
+    const float* v = GetHeader()->positionOffset;
+    return {v[0], v[1], v[2]};
+}
+
+const MeshCache::Header* MeshCache::GetHeader() const
+{
+    return reinterpret_cast<const Header*>(data.data());
+}
+
+bool MeshCache::Map(const std::filesystem::path& cachePath, VertexFormat vertexFormat)
+{
+    ownedData.clear();
+    data = {};
+    if (!file.Open(cachePath))
+    {
+        return false;
+    }
+    data = {file.GetData(), file.GetSize()};
+
+    if (!Validate(vertexFormat))
+    {
+        SDL_Log("Ignoring invalid or incompatible mesh cache %s", cachePath.string().c_str());
+        file.Close();
+        data = {};
+        return false;
+    }
+    return true;
+}
+
+bool MeshCache::CheckSource(const std::filesystem::path& cachePath, bool isUpToDate)
+{
+    if (!isUpToDate)
+    {
+        SDL_Log("Mesh cache %s is outdated", cachePath.string().c_str());
+        file.Close();
+        data = {};
+    }
+    return isUpToDate;
+}
+
+bool MeshCache::Validate(VertexFormat vertexFormat) const
+{
+    if (data.size() < sizeof(Header))
+    {
+        return false;
+    }
+
+    const Header* header = GetHeader();
+    if (header->magic != kMeshCacheMagic || header->version != kMeshCacheVersion
+        || header->vertexFormat != static_cast<uint32_t>(vertexFormat)
+        || header->vertexStride == 0 || header->lodCount == 0
+        || header->lodCount > kMaxMeshLodCount)
+    {
+        return false;
+    }
+
+    auto isSectionValid = [this](uint64_t offset, uint64_t size)
+    {
+        return offset % kSectionAlignment == 0 && offset <= data.size()
+               && size <= data.size() - offset;
+    };
+    return isSectionValid(header->submeshOffset,
+                          uint64_t(header->submeshCount) * sizeof(MeshSubmesh))
+           && isSectionValid(header->meshletOffset,
+                             uint64_t(header->meshletCount) * sizeof(MeshMeshlet))
+           && isSectionValid(header->lodOffset, uint64_t(header->lodCount) * sizeof(MeshLod))
+           && isSectionValid(header->vertexDataOffset,
+                             uint64_t(header->vertexCount) * header->vertexStride)
+           && isSectionValid(header->indexDataOffset,
+                             uint64_t(header->indexCount) * sizeof(uint32_t));
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <span>
+#include <vector>
+
+#include "AssetSource.h"
+#include "MappedFile.h"
+
+enum class VertexFormat;
+
+// Range of the index buffer drawn with a single material
+struct MeshSubmesh
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+// Cluster of triangles culled as a whole, see ResourceManager::BuildMeshlets
+struct MeshMeshlet
+{
+    // Center in xyz and radius in w
+    glm::vec4 boundingSphere;
+    /**
+     * Axis in xyz and cutoff in w of the cone of the triangle normals. Every triangle faces
+     * away from eye when dot(center - eye, axis) >= cutoff * length(center - eye) + radius,
+     * which never holds with a cutoff of 1.
+     */
+    glm::vec4 normalCone;
+    uint32_t firstIndex;
+    uint32_t triangleCount;
+    uint32_t _pad[2];
+};
+
+// Most levels of detail of a mesh, must match kMaxLodCount in cull.wgsl
+constexpr uint32_t kMaxMeshLodCount = 6;
+
+// Range of the index buffer drawing the whole mesh at a level of detail, see SimplifyMesh
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Bound on the distance from the surface of the finest level, in the space of the mesh
+    float error;
+    uint32_t _pad;
+};
+
+/**
+ * Preprocessed geometry ready for upload: final vertex and index buffers, bounds, submesh
+ * ranges, meshlets and levels of detail. It is stored in a versioned binary file next to the
+ * source asset and memory-mapped on later runs, so that no parsing happens at startup.
+ */
+class MeshCache
+{
+public:
+    /**
+     * Map an existing cache. Return false if it is missing, corrupted, built for another
+     * vertex format or older than its source (compared by size and modification time,
+     * then by content hash when only the time differs).
+     */
+    bool Open(const std::filesystem::path& cachePath,
+              const std::filesystem::path& sourcePath,
+              VertexFormat vertexFormat);
+
+    // Map an existing cache built from a source with the given stamp, e.g. a packed asset
+    bool Open(const std::filesystem::path& cachePath,
+              const AssetSource::Stamp& source,
+              VertexFormat vertexFormat);
+
+    /**
+     * Serialize the given geometry and keep it in memory. Writing it to cachePath is
+     * best-effort: a failure is logged but the in-memory cache is still usable.
+     */
+    bool Create(const std::filesystem::path& cachePath,
+                const AssetSource::Stamp& source,
+                VertexFormat vertexFormat,
+                std::span<const unsigned char> vertexData,
+                uint32_t vertexStride,
+                const std::vector<uint32_t>& indexData,
+                const std::vector<MeshSubmesh>& submeshes,
+                const std::vector<MeshMeshlet>& meshlets,
+                const std::vector<MeshLod>& lods,
+                const glm::vec3& positionScale,
+                const glm::vec3& positionOffset);
+
+    std::span<const unsigned char> GetVertexData() const;
+    std::span<const uint32_t> GetIndexData() const;
+    std::span<const MeshSubmesh> GetSubmeshes() const;
+    std::span<const MeshMeshlet> GetMeshlets() const;
+    // From the finest, whose indices the submeshes and meshlets refer to
+    std::span<const MeshLod> GetLods() const;
+
+    uint32_t GetVertexCount() const;
+    uint32_t GetVertexStride() const;
+    glm::vec3 GetBoundsMin() const;
+    glm::vec3 GetBoundsMax() const;
+
+    // Dequantization of packed positions, see PackedVertexAttributes
+    glm::vec3 GetPositionScale() const;
+    glm::vec3 GetPositionOffset() const;
+
+private:
+    struct Header;
+
+    const Header* GetHeader() const;
+
+    bool Map(const std::filesystem::path& cachePath, VertexFormat vertexFormat);
+
+    // Unmap the cache unless it is up to date with its source
+    bool CheckSource(const std::filesystem::path& cachePath, bool isUpToDate);
+
+    // Check that the header describes ranges lying within the data
+    bool Validate(VertexFormat vertexFormat) const;
+
+    MappedFile file;
+    std::vector<unsigned char> ownedData;
+    std::span<const unsigned char> data;
+};
@@ -0,0 +1,967 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+#include <limits>
+#include <numeric>
+#include <unordered_set>
+#include <utility>
+
+namespace
+{
+    /**
+     * FIFO cache shared by the analysis and the overdraw pass. A vertex is in the cache
+     * when it has been inserted less than cacheSize insertions ago.
+     */
+    struct FifoCache
+    {
+        FifoCache(size_t vertexCount, uint32_t cacheSize) :
+            cacheSize(cacheSize),
+            timeStamp(cacheSize + 1),
+            insertionTime(vertexCount, 0)
+        {
+        }
+
+        // Return true on a cache miss
+        bool Access(uint32_t vertex)
+        {
+            if (timeStamp - insertionTime[vertex] > cacheSize)
+            {
+                insertionTime[vertex] = timeStamp++;
+                return true;
+            }
+            return false;
+        }
+
+        uint32_t AccessTriangle(const uint32_t* corners)
+        {
+            return Access(corners[0]) + Access(corners[1]) + Access(corners[2]);
+        }
+
+        void Flush()
+        {
+            timeStamp += cacheSize + 1;
+        }
+
+        uint32_t cacheSize;
+        uint32_t timeStamp;
+        std::vector<uint32_t> insertionTime;
+    };
+
+    glm::vec3 GetPosition(const float* positions, size_t vertexStride, uint32_t vertex)
+    {
+        const float* p = reinterpret_cast<const float*>(
+            reinterpret_cast<const unsigned char*>(positions) + vertex * vertexStride);
+        return {p[0], p[1], p[2]};
+    }
+
+    // Normal of a triangle, scaled by twice its area
+    glm::vec3 GetNormal(const glm::vec3* corners)
+    {
+        return glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+    }
+
+    // Weighted sum of squared distances to planes (Garland and Heckbert 1997)
+    struct Quadric
+    {
+        void AddPlane(const glm::vec3& normal, float distance, float planeWeight)
+        {
+            glm::dvec3 n = glm::dvec3(normal) * double(planeWeight);
+
+            a00    += n.x * normal.x;
+            a11    += n.y * normal.y;
+            a22    += n.z * normal.z;
+            a01    += n.x * normal.y;
+            a02    += n.x * normal.z;
+            a12    += n.y * normal.z;
+            b      += n * double(distance);
+            c      += double(planeWeight) * distance * distance;
+            weight += planeWeight;
+        }
+
+        void Add(const Quadric& other)
+        {
+            a00    += other.a00;
+            a11    += other.a11;
+            a22    += other.a22;
+            a01    += other.a01;
+            a02    += other.a02;
+            a12    += other.a12;
+            b      += other.b;
+            c      += other.c;
+            weight += other.weight;
+        }
+
+        // Root mean square distance of a point to the planes
+        float GetError(const glm::vec3& point) const
+        {
+            glm::dvec3 p(point);
+            double sum = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+                       + 2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+                       + 2.0 * glm::dot(b, p) + c;
+            return weight > 0.0 ? static_cast<float>(std::sqrt(std::max(sum, 0.0) / weight))
+                                : 0.0f;
+        }
+
+        double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+        glm::dvec3 b {0.0};
+        double c      = 0.0;
+        double weight = 0.0;
+    };
+
+    /**
+     * How a vertex may collapse in SimplifyMesh. A seam vertex shares its position with one
+     * other vertex across a single seam, a border vertex lies on a single open border, and
+     * locked vertices are on anything more complex.
+     */
+    enum class VertexKind
+    {
+        Manifold,
+        Border,
+        Seam,
+        Locked,
+    };
+
+    constexpr uint32_t kNoEdge       = UINT32_MAX;
+    constexpr uint32_t kSeveralEdges = UINT32_MAX - 1;
+
+    uint64_t GetEdgeKey(uint32_t from, uint32_t to)
+    {
+        return (uint64_t(from) << 32) | to;
+    }
+
+    // Directed edges of the triangles, between the vertices or their ids when given
+    std::unordered_set<uint64_t> GetEdges(const std::vector<uint32_t>& indexData,
+                                          const uint32_t* vertexIds = nullptr)
+    {
+        std::unordered_set<uint64_t> edges;
+        edges.reserve(indexData.size());
+        for (size_t i = 0; i < indexData.size(); i += 3)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t from = indexData[i + k];
+                uint32_t to   = indexData[i + (k + 1) % 3];
+                edges.insert(vertexIds != nullptr ? GetEdgeKey(vertexIds[from], vertexIds[to])
+                                                  : GetEdgeKey(from, to));
+            }
+        }
+        return edges;
+    }
+
+    /**
+     * Find the open edges of each vertex, those without a twin going the other way, as the
+     * other end of the only edge leaving or reaching it, kNoEdge or kSeveralEdges
+     */
+    void FindOpenEdges(const std::vector<uint32_t>& indexData,
+                       const std::unordered_set<uint64_t>& edges,
+                       std::vector<uint32_t>& openOut,
+                       std::vector<uint32_t>& openIn)
+    {
+        std::fill(openOut.begin(), openOut.end(), kNoEdge);
+        std::fill(openIn.begin(), openIn.end(), kNoEdge);
+        for (size_t i = 0; i < indexData.size(); i += 3)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t from = indexData[i + k];
+                uint32_t to   = indexData[i + (k + 1) % 3];
+                if (!edges.contains(GetEdgeKey(to, from)))
+                {
+                    openOut[from] = openOut[from] == kNoEdge ? to : kSeveralEdges;
+                    openIn[to]    = openIn[to] == kNoEdge ? from : kSeveralEdges;
+                }
+            }
+        }
+    }
+
+    bool IsSingleEdge(uint32_t edge)
+    {
+        return edge != kNoEdge && edge != kSeveralEdges;
+    }
+}  // namespace
+
+MeshOptimizer::VertexCacheStatistics MeshOptimizer::AnalyzeVertexCache(
+    const std::vector<uint32_t>& indexData,
+    size_t vertexCount,
+    uint32_t cacheSize)
+{
+    VertexCacheStatistics statistics;
+
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+    size_t uniqueVertexCount = 0;
+    for (uint32_t index : indexData)
+    {
+        statistics.vertexTransforms += cache.Access(index);
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            ++uniqueVertexCount;
+        }
+    }
+
+    size_t triangleCount = indexData.size() / 3;
+    if (triangleCount > 0)
+    {
+        statistics.acmr = static_cast<float>(statistics.vertexTransforms) / triangleCount;
+        statistics.atvr = static_cast<float>(statistics.vertexTransforms) / uniqueVertexCount;
+    }
+    return statistics;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indexData,
+                                        size_t vertexCount,
+                                        uint32_t cacheSize,
+                                        std::vector<uint32_t>* clusters)
+{
+    size_t triangleCount = indexData.size() / 3;
+
+    // Number of triangles using each vertex that are not emitted yet
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (uint32_t index : indexData)
+    {
+        ++liveTriangles[index];
+    }
+
+    // Vertex to triangle adjacency, stored as one flat array indexed by adjacencyOffsets
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+    }
+    std::vector<uint32_t> adjacency(indexData.size());
+    std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            adjacency[fillOffsets[indexData[3 * t + k]]++] = static_cast<uint32_t>(t);
+        }
+    }
+
+    std::vector<uint32_t> insertionTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEndStack;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    deadEndStack.reserve(indexData.size());
+    result.reserve(indexData.size());
+
+    uint32_t timeStamp = cacheSize + 1;
+    size_t cursor      = 0;
+
+    if (clusters)
+    {
+        clusters->clear();
+    }
+
+    auto startCluster = [&]()
+    {
+        uint32_t firstTriangle = static_cast<uint32_t>(result.size() / 3);
+        if (clusters && (clusters->empty() || clusters->back() != firstTriangle))
+        {
+            clusters->push_back(firstTriangle);
+        }
+    };
+
+    // Pick the next vertex with live triangles when the current fan is a dead-end
+    auto skipDeadEnd = [&]() -> int64_t
+    {
+        while (!deadEndStack.empty())
+        {
+            uint32_t vertex = deadEndStack.back();
+            deadEndStack.pop_back();
+            if (liveTriangles[vertex] > 0)
+            {
+                return vertex;
+            }
+        }
+        for (; cursor < vertexCount; ++cursor)
+        {
+            if (liveTriangles[cursor] > 0)
+            {
+                return static_cast<int64_t>(cursor);
+            }
+        }
+        return -1;
+    };
+
+    // An empty mesh has no cluster, not one starting past its end
+    if (triangleCount > 0)
+    {
+        startCluster();
+    }
+    int64_t fanningVertex = skipDeadEnd();
+    while (fanningVertex >= 0)
+    {
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        uint32_t adjacencyBegin = adjacencyOffsets[fanningVertex];
+        uint32_t adjacencyEnd   = adjacencyOffsets[fanningVertex + 1];
+        for (uint32_t a = adjacencyBegin; a < adjacencyEnd; ++a)
+        {
+            uint32_t t = adjacency[a];
+            if (emitted[t])
+            {
+                continue;
+            }
+
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t vertex = indexData[3 * t + k];
+                result.push_back(vertex);
+                deadEndStack.push_back(vertex);
+                candidates.push_back(vertex);
+                --liveTriangles[vertex];
+                if (timeStamp - insertionTime[vertex] > cacheSize)
+                {
+                    insertionTime[vertex] = timeStamp++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // Prefer the candidate that will still be in the cache once all its triangles are emitted
+        int64_t nextVertex   = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t vertex : candidates)
+        {
+            if (liveTriangles[vertex] == 0)
+            {
+                continue;
+            }
+            int64_t priority = 0;
+            int64_t age      = timeStamp - insertionTime[vertex];
+            if (age + 2 * liveTriangles[vertex] <= cacheSize)
+            {
+                priority = age;
+            }
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                nextVertex   = vertex;
+            }
+        }
+
+        if (nextVertex < 0)
+        {
+            startCluster();
+            nextVertex = skipDeadEnd();
+        }
+        fanningVertex = nextVertex;
+    }
+
+    indexData = std::move(result);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indexData,
+                                     const std::vector<uint32_t>& clusters,
+                                     const float* positions,
+                                     size_t vertexStride,
+                                     size_t vertexCount,
+                                     uint32_t cacheSize,
+                                     float threshold)
+{
+    uint32_t triangleCount = static_cast<uint32_t>(indexData.size() / 3);
+    if (triangleCount == 0 || clusters.empty())
+    {
+        return;
+    }
+
+    // Split hard clusters into smaller ones wherever the cache efficiency allows it
+    std::vector<uint32_t> softClusters;
+    FifoCache cache(vertexCount, cacheSize);
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        uint32_t begin = clusters[c];
+        uint32_t end   = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+        cache.Flush();
+        uint32_t clusterMisses = 0;
+        for (uint32_t t = begin; t < end; ++t)
+        {
+            clusterMisses += cache.AccessTriangle(&indexData[3 * t]);
+        }
+        float clusterThreshold = threshold * clusterMisses / (end - begin);
+
+        cache.Flush();
+        softClusters.push_back(begin);
+        uint32_t subClusterBegin = begin;
+        uint32_t misses          = 0;
+        for (uint32_t t = begin; t < end; ++t)
+        {
+            misses += cache.AccessTriangle(&indexData[3 * t]);
+            if (t + 1 < end
+                && static_cast<float>(misses) / (t + 1 - subClusterBegin) <= clusterThreshold)
+            {
+                softClusters.push_back(t + 1);
+                subClusterBegin = t + 1;
+                misses          = 0;
+                cache.Flush();
+            }
+        }
+    }
+
+    // The mesh centroid is the reference point clusters are sorted against
+    glm::vec3 meshCentroid(0.0f);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        meshCentroid += GetPosition(positions, vertexStride, static_cast<uint32_t>(v));
+    }
+    meshCentroid /= static_cast<float>(std::max<size_t>(vertexCount, 1));
+
+    // Clusters facing away from the centroid are likely to occlude the others
+    std::vector<float> sortKeys(softClusters.size());
+    for (size_t c = 0; c < softClusters.size(); ++c)
+    {
+        uint32_t begin = softClusters[c];
+        uint32_t end   = c + 1 < softClusters.size() ? softClusters[c + 1] : triangleCount;
+
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (uint32_t t = begin; t < end; ++t)
+        {
+            glm::vec3 p0 = GetPosition(positions, vertexStride, indexData[3 * t + 0]);
+            glm::vec3 p1 = GetPosition(positions, vertexStride, indexData[3 * t + 1]);
+            glm::vec3 p2 = GetPosition(positions, vertexStride, indexData[3 * t + 2]);
+
+            // Length of the cross product is twice the triangle area, weights cancel out
+            glm::vec3 n        = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(n);
+
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+
+        float normalLength = glm::length(normal);
+        if (area > 0.0f && normalLength > 0.0f)
+        {
+            sortKeys[c] = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+        }
+        else
+        {
+            sortKeys[c] = 0.0f;
+        }
+    }
+
+    std::vector<uint32_t> order(softClusters.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(),
+                     order.end(),
+                     [&sortKeys](uint32_t a, uint32_t b)
+                     {
+                         return sortKeys[a] > sortKeys[b];
+                     });
+
+    std::vector<uint32_t> result;
+    result.reserve(indexData.size());
+    for (uint32_t c : order)
+    {
+        uint32_t begin = softClusters[c];
+        uint32_t end   = c + 1 < softClusters.size() ? softClusters[c + 1] : triangleCount;
+        result.insert(result.end(), indexData.begin() + 3 * begin, indexData.begin() + 3 * end);
+    }
+    indexData = std::move(result);
+}
+
+size_t MeshOptimizer::OptimizeVertexFetch(std::vector<uint32_t>& indexData,
+                                          std::vector<uint32_t>& remap,
+                                          size_t vertexCount)
+{
+    remap.assign(vertexCount, UINT32_MAX);
+
+    uint32_t nextVertex = 0;
+    for (uint32_t& index : indexData)
+    {
+        if (remap[index] == UINT32_MAX)
+        {
+            remap[index] = nextVertex++;
+        }
+        index = remap[index];
+    }
+    return nextVertex;
+}
+
+std::vector<MeshOptimizer::MeshletRange> MeshOptimizer::BuildMeshlets(
+    std::vector<uint32_t>& indexData,
+    const float* positions,
+    size_t vertexStride,
+    size_t vertexCount,
+    uint32_t maxVertices,
+    uint32_t maxTriangles,
+    uint32_t cacheSize)
+{
+    uint32_t triangleCount = static_cast<uint32_t>(indexData.size() / 3);
+
+    // Unit normals of the triangles, zero for degenerate ones
+    std::vector<glm::vec3> normals(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        glm::vec3 p0 = GetPosition(positions, vertexStride, indexData[3 * t + 0]);
+        glm::vec3 p1 = GetPosition(positions, vertexStride, indexData[3 * t + 1]);
+        glm::vec3 p2 = GetPosition(positions, vertexStride, indexData[3 * t + 2]);
+        glm::vec3 n  = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(n);
+        normals[t]   = length > 0.0f ? n / length : glm::vec3(0.0f);
+    }
+
+    // Vertex to triangle adjacency, as in OptimizeVertexCache
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t index : indexData)
+    {
+        ++adjacencyOffsets[index + 1];
+    }
+    std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+    std::vector<uint32_t> adjacency(indexData.size());
+    std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            adjacency[fillOffsets[indexData[3 * t + k]]++] = t;
+        }
+    }
+
+    // Meshlet that last used each vertex, numbered from 1
+    std::vector<uint32_t> vertexMeshlet(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(indexData.size());
+    std::vector<MeshletRange> meshlets;
+
+    uint32_t seed = 0;
+    while (true)
+    {
+        while (seed < triangleCount && emitted[seed])
+        {
+            ++seed;
+        }
+        if (seed == triangleCount)
+        {
+            break;
+        }
+
+        uint32_t meshletId = static_cast<uint32_t>(meshlets.size() + 1);
+        MeshletRange meshlet {static_cast<uint32_t>(result.size() / 3), 0};
+        uint32_t meshletVertexCount = 0;
+        glm::vec3 normalSum(0.0f);
+        candidates.clear();
+
+        uint32_t next = seed;
+        while (next != UINT32_MAX)
+        {
+            // Emit the triangle, the triangles around its new vertices becoming candidates
+            emitted[next] = true;
+            normalSum += normals[next];
+            ++meshlet.triangleCount;
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t vertex = indexData[3 * next + k];
+                result.push_back(vertex);
+                if (vertexMeshlet[vertex] != meshletId)
+                {
+                    vertexMeshlet[vertex] = meshletId;
+                    ++meshletVertexCount;
+                    candidates.insert(candidates.end(),
+                                      adjacency.begin() + adjacencyOffsets[vertex],
+                                      adjacency.begin() + adjacencyOffsets[vertex + 1]);
+                }
+            }
+            if (meshlet.triangleCount == maxTriangles)
+            {
+                break;
+            }
+
+            // Drop the emitted candidates while looking for the best fitting one
+            next                  = UINT32_MAX;
+            uint32_t bestNewCount = 4;
+            float bestDot         = 0.0f;
+            size_t keptCount      = 0;
+            for (uint32_t candidate : candidates)
+            {
+                if (emitted[candidate])
+                {
+                    continue;
+                }
+                candidates[keptCount++] = candidate;
+
+                uint32_t newCount = 0;
+                for (int k = 0; k < 3; ++k)
+                {
+                    newCount += vertexMeshlet[indexData[3 * candidate + k]] != meshletId ? 1 : 0;
+                }
+                if (meshletVertexCount + newCount > maxVertices)
+                {
+                    continue;
+                }
+
+                float dot = glm::dot(normals[candidate], normalSum);
+                if (newCount < bestNewCount || (newCount == bestNewCount && dot > bestDot))
+                {
+                    next         = candidate;
+                    bestNewCount = newCount;
+                    bestDot      = dot;
+                }
+            }
+            candidates.resize(keptCount);
+        }
+        meshlets.push_back(meshlet);
+    }
+
+    // Growing by fewest new vertices leaves a poor order for the cache, so reorder each meshlet
+    // on its own vertices numbered locally, which keeps Tipsify from allocating for all of them
+    std::vector<uint32_t> localVertices(vertexCount, UINT32_MAX);
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint32_t> meshletIndices;
+    for (const MeshletRange& meshlet : meshlets)
+    {
+        auto first = result.begin() + 3 * meshlet.firstTriangle;
+        meshletIndices.assign(first, first + 3 * meshlet.triangleCount);
+        meshletVertices.clear();
+        for (uint32_t& index : meshletIndices)
+        {
+            if (localVertices[index] == UINT32_MAX)
+            {
+                localVertices[index] = static_cast<uint32_t>(meshletVertices.size());
+                meshletVertices.push_back(index);
+            }
+            index = localVertices[index];
+        }
+
+        OptimizeVertexCache(meshletIndices, meshletVertices.size(), cacheSize);
+        for (uint32_t index : meshletIndices)
+        {
+            *first++ = meshletVertices[index];
+        }
+        for (uint32_t vertex : meshletVertices)
+        {
+            localVertices[vertex] = UINT32_MAX;
+        }
+    }
+
+    indexData = std::move(result);
+    return meshlets;
+}
+
+std::vector<uint32_t> MeshOptimizer::SimplifyMesh(const std::vector<uint32_t>& indexData,
+                                                  const float* positions,
+                                                  size_t vertexStride,
+                                                  size_t vertexCount,
+                                                  size_t targetIndexCount,
+                                                  float targetError,
+                                                  float* resultError)
+{
+    // Border and seam edges also keep their distance to planes through them, weighted by this
+    // much more than the triangles so that they stay in place
+    constexpr float kBorderWeight = 10.0f;
+
+    std::vector<glm::vec3> vertexPositions(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        vertexPositions[v] = GetPosition(positions, vertexStride, v);
+    }
+
+    // Vertices sharing a position are numbered by the first of them, and linked in a ring
+    std::vector<uint32_t> positionIds(vertexCount);
+    std::vector<uint32_t> wedges(vertexCount);
+    std::vector<uint32_t> sortedVertices(vertexCount);
+    std::iota(sortedVertices.begin(), sortedVertices.end(), 0);
+    auto isPositionLess = [&vertexPositions](uint32_t a, uint32_t b)
+    {
+        const glm::vec3& p = vertexPositions[a];
+        const glm::vec3& q = vertexPositions[b];
+        return p.x < q.x || (p.x == q.x && (p.y < q.y || (p.y == q.y && p.z < q.z)));
+    };
+    std::stable_sort(sortedVertices.begin(), sortedVertices.end(), isPositionLess);
+    for (size_t first = 0; first < vertexCount;)
+    {
+        size_t last = first + 1;
+        while (last < vertexCount && vertexPositions[sortedVertices[last]]
+                                         == vertexPositions[sortedVertices[first]])
+        {
+            ++last;
+        }
+        for (size_t i = first; i < last; ++i)
+        {
+            positionIds[sortedVertices[i]] = sortedVertices[first];
+            wedges[sortedVertices[i]]      = sortedVertices[i + 1 < last ? i + 1 : first];
+        }
+        first = last;
+    }
+
+    // Kinds are found once on the original mesh, edges crossing a seam having a twin between
+    // the same positions but not the same vertices
+    std::vector<uint32_t> openOut(vertexCount);
+    std::vector<uint32_t> openIn(vertexCount);
+    std::unordered_set<uint64_t> edges         = GetEdges(indexData);
+    std::unordered_set<uint64_t> positionEdges = GetEdges(indexData, positionIds.data());
+    FindOpenEdges(indexData, edges, openOut, openIn);
+    auto isSeamEdge = [&](uint32_t from, uint32_t to)
+    {
+        return positionEdges.contains(GetEdgeKey(positionIds[to], positionIds[from]));
+    };
+    auto hasSingleOpenEdges = [&](uint32_t v, bool isSeam)
+    {
+        return IsSingleEdge(openOut[v]) && IsSingleEdge(openIn[v])
+               && isSeamEdge(v, openOut[v]) == isSeam && isSeamEdge(openIn[v], v) == isSeam;
+    };
+
+    std::vector<VertexKind> kinds(vertexCount, VertexKind::Locked);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        uint32_t wedge = wedges[v];
+        if (wedge == v)
+        {
+            if (openOut[v] == kNoEdge && openIn[v] == kNoEdge)
+            {
+                kinds[v] = VertexKind::Manifold;
+            }
+            else if (hasSingleOpenEdges(v, false))
+            {
+                kinds[v] = VertexKind::Border;
+            }
+        }
+        else if (wedges[wedge] == v && hasSingleOpenEdges(v, true)
+                 && hasSingleOpenEdges(wedge, true))
+        {
+            kinds[v] = VertexKind::Seam;
+        }
+    }
+
+    // Quadrics of the triangles around each position, and of the open edges through it
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indexData.size(); i += 3)
+    {
+        glm::vec3 p0 = vertexPositions[indexData[i + 0]];
+        glm::vec3 p1 = vertexPositions[indexData[i + 1]];
+        glm::vec3 p2 = vertexPositions[indexData[i + 2]];
+        glm::vec3 n  = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(n);
+        if (length == 0.0f)
+        {
+            continue;
+        }
+        n /= length;
+
+        for (int k = 0; k < 3; ++k)
+        {
+            uint32_t from = indexData[i + k];
+            uint32_t to   = indexData[i + (k + 1) % 3];
+            quadrics[positionIds[from]].AddPlane(n, -glm::dot(n, p0), 0.5f * length);
+
+            if (!edges.contains(GetEdgeKey(to, from)))
+            {
+                glm::vec3 edge       = vertexPositions[to] - vertexPositions[from];
+                glm::vec3 edgeNormal = glm::cross(edge, n);
+                float edgeLength     = glm::length(edgeNormal);
+                if (edgeLength > 0.0f)
+                {
+                    edgeNormal /= edgeLength;
+                    float distance = -glm::dot(edgeNormal, vertexPositions[from]);
+                    float weight   = kBorderWeight * glm::dot(edge, edge);
+                    quadrics[positionIds[from]].AddPlane(edgeNormal, distance, weight);
+                    quadrics[positionIds[to]].AddPlane(edgeNormal, distance, weight);
+                }
+            }
+        }
+    }
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        float error;
+    };
+
+    std::vector<uint32_t> result = indexData;
+    std::vector<uint32_t> collapseTargets(vertexCount);
+    std::iota(collapseTargets.begin(), collapseTargets.end(), 0);
+    std::vector<bool> isLocked(vertexCount);
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> adjacencyOffsets;
+    std::vector<uint32_t> adjacency;
+    float maxError = 0.0f;
+
+    // Vertex collapsing with a seam vertex, onto the other end of the seam edge on its side
+    auto getSeamCollapse = [&](uint32_t from, uint32_t to) -> std::pair<uint32_t, uint32_t>
+    {
+        uint32_t wedge = wedges[from];
+        uint32_t other = to == openOut[from] ? openIn[wedge] : openOut[wedge];
+        if (!IsSingleEdge(other) || positionIds[other] != positionIds[to] || other == to)
+        {
+            return {kNoEdge, kNoEdge};
+        }
+        return {wedge, other};
+    };
+
+    auto canCollapse = [&](uint32_t from, uint32_t to)
+    {
+        bool isOpenEdge = to == openOut[from] || to == openIn[from];
+        switch (kinds[from])
+        {
+            case VertexKind::Manifold:
+                return true;
+            case VertexKind::Border:
+                return isOpenEdge && kinds[to] == VertexKind::Border;
+            case VertexKind::Seam:
+                return isOpenEdge && kinds[to] == VertexKind::Seam
+                       && getSeamCollapse(from, to).first != kNoEdge;
+            default:
+                return false;
+        }
+    };
+
+    // Whether moving a position onto another turns over a triangle around it that remains
+    auto hasFlip = [&](uint32_t fromId, uint32_t toId)
+    {
+        const glm::vec3& target = vertexPositions[toId];
+        for (uint32_t a = adjacencyOffsets[fromId]; a < adjacencyOffsets[fromId + 1]; ++a)
+        {
+            const uint32_t* triangle = &result[3 * adjacency[a]];
+            glm::vec3 corners[3];
+            glm::vec3 movedCorners[3];
+            bool isRemoved = false;
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t id     = positionIds[triangle[k]];
+                corners[k]      = vertexPositions[triangle[k]];
+                movedCorners[k] = id == fromId ? target : corners[k];
+                isRemoved       = isRemoved || id == toId;
+            }
+            if (isRemoved)
+            {
+                continue;
+            }
+            if (glm::dot(GetNormal(corners), GetNormal(movedCorners)) <= 0.0f)
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Each pass collapses the cheapest edges whose surroundings no other collapse touched
+    while (result.size() > targetIndexCount)
+    {
+        size_t triangleCount = result.size() / 3;
+        adjacencyOffsets.assign(vertexCount + 1, 0);
+        for (uint32_t index : result)
+        {
+            ++adjacencyOffsets[positionIds[index] + 1];
+        }
+        std::partial_sum(adjacencyOffsets.begin(),
+                         adjacencyOffsets.end(),
+                         adjacencyOffsets.begin());
+        adjacency.resize(result.size());
+        std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (uint32_t t = 0; t < triangleCount; ++t)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                adjacency[fillOffsets[positionIds[result[3 * t + k]]]++] = t;
+            }
+        }
+
+        // The cheaper direction of each edge, edges between two triangles being seen twice
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t a      = result[i + k];
+                uint32_t b      = result[i + (k + 1) % 3];
+                float errorAtoB = canCollapse(a, b)
+                                      ? quadrics[positionIds[a]].GetError(vertexPositions[b])
+                                      : std::numeric_limits<float>::max();
+                float errorBtoA = canCollapse(b, a)
+                                      ? quadrics[positionIds[b]].GetError(vertexPositions[a])
+                                      : std::numeric_limits<float>::max();
+                if (std::min(errorAtoB, errorBtoA) <= targetError)
+                {
+                    collapses.push_back(errorAtoB <= errorBtoA ? Collapse {a, b, errorAtoB}
+                                                               : Collapse {b, a, errorBtoA});
+                }
+            }
+        }
+        std::sort(collapses.begin(),
+                  collapses.end(),
+                  [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        size_t removeGoal    = (result.size() - targetIndexCount + 2) / 3;
+        size_t removedCount  = 0;
+        size_t collapseCount = 0;
+        std::fill(isLocked.begin(), isLocked.end(), false);
+        for (const Collapse& collapse : collapses)
+        {
+            if (removedCount >= removeGoal)
+            {
+                break;
+            }
+            uint32_t fromId = positionIds[collapse.from];
+            uint32_t toId   = positionIds[collapse.to];
+            if (isLocked[fromId] || isLocked[toId] || hasFlip(fromId, toId))
+            {
+                continue;
+            }
+
+            collapseTargets[collapse.from] = collapse.to;
+            if (kinds[collapse.from] == VertexKind::Seam)
+            {
+                auto [wedge, other]    = getSeamCollapse(collapse.from, collapse.to);
+                collapseTargets[wedge] = other;
+            }
+            quadrics[toId].Add(quadrics[fromId]);
+            maxError = std::max(maxError, collapse.error);
+            ++collapseCount;
+
+            // The triangles around the collapsed position change, so their corners wait
+            for (uint32_t a = adjacencyOffsets[fromId]; a < adjacencyOffsets[fromId + 1]; ++a)
+            {
+                const uint32_t* triangle = &result[3 * adjacency[a]];
+                bool isRemoved           = false;
+                for (int k = 0; k < 3; ++k)
+                {
+                    uint32_t id  = positionIds[triangle[k]];
+                    isLocked[id] = true;
+                    isRemoved    = isRemoved || id == toId;
+                }
+                removedCount += isRemoved ? 1 : 0;
+            }
+        }
+        if (collapseCount == 0)
+        {
+            break;
+        }
+
+        // Drop the triangles left with two corners at the same position
+        size_t keptCount = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            uint32_t a = collapseTargets[result[i + 0]];
+            uint32_t b = collapseTargets[result[i + 1]];
+            uint32_t c = collapseTargets[result[i + 2]];
+            if (positionIds[a] != positionIds[b] && positionIds[b] != positionIds[c]
+                && positionIds[c] != positionIds[a])
+            {
+                result[keptCount++] = a;
+                result[keptCount++] = b;
+                result[keptCount++] = c;
+            }
+        }
+        result.resize(keptCount);
+        std::iota(collapseTargets.begin(), collapseTargets.end(), 0);
+        FindOpenEdges(result, GetEdges(result), openOut, openIn);
+    }
+
+    if (resultError != nullptr)
+    {
+        *resultError = maxError;
+    }
+    return result;
+}
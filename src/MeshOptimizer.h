@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace MeshOptimizer
+{
+    struct VertexCacheStatistics
+    {
+        // Number of vertex shader invocations with a FIFO post-transform cache
+        uint32_t vertexTransforms = 0;
+        // Average cache miss ratio: transformed vertices per triangle (0.5 is the best case)
+        float acmr = 0.0f;
+        // Average transform to vertex ratio: transformed vertices per unique vertex (1.0 is optimal)
+        float atvr = 0.0f;
+    };
+
+    /**
+     * Simulate a FIFO post-transform vertex cache of the given size over an indexed triangle list
+     */
+    VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indexData,
+                                             size_t vertexCount,
+                                             uint32_t cacheSize);
+
+    /**
+     * Reorder triangles for vertex cache locality using Tipsify (Sander et al. 2007).
+     * If clusters is not null, it receives the first triangle of every run that starts
+     * after a dead-end, which are the hard boundaries used by OptimizeOverdraw.
+     */
+    void OptimizeVertexCache(std::vector<uint32_t>& indexData,
+                             size_t vertexCount,
+                             uint32_t cacheSize,
+                             std::vector<uint32_t>* clusters = nullptr);
+
+    /**
+     * Reorder the clusters produced by OptimizeVertexCache so that outward facing ones are
+     * drawn first. Clusters are split further as long as their ACMR stays within threshold
+     * times the ACMR of the cache-optimized order.
+     */
+    void OptimizeOverdraw(std::vector<uint32_t>& indexData,
+                          const std::vector<uint32_t>& clusters,
+                          const float* positions,
+                          size_t vertexStride,
+                          size_t vertexCount,
+                          uint32_t cacheSize,
+                          float threshold);
+
+    /**
+     * Renumber vertices in order of first use so the vertex buffer is fetched linearly.
+     * remap[oldIndex] receives the new index, or UINT32_MAX for unreferenced vertices.
+     * Return the number of referenced vertices.
+     */
+    size_t OptimizeVertexFetch(std::vector<uint32_t>& indexData,
+                               std::vector<uint32_t>& remap,
+                               size_t vertexCount);
+
+    // Triangles of a meshlet, a contiguous range of the index buffer
+    struct MeshletRange
+    {
+        uint32_t firstTriangle;
+        uint32_t triangleCount;
+    };
+
+    /**
+     * Group triangles into meshlets of at most maxVertices unique vertices and maxTriangles
+     * triangles, reordering indexData so that each meshlet is a contiguous range. A meshlet
+     * grows from the first triangle left in the current order through the triangles sharing
+     * its vertices, taking those adding the fewest vertices first, then those whose normal is
+     * closest to its own so that its normal cone stays narrow. The triangles of each meshlet
+     * are then reordered for a vertex cache of cacheSize entries.
+     */
+    std::vector<MeshletRange> BuildMeshlets(std::vector<uint32_t>& indexData,
+                                            const float* positions,
+                                            size_t vertexStride,
+                                            size_t vertexCount,
+                                            uint32_t maxVertices,
+                                            uint32_t maxTriangles,
+                                            uint32_t cacheSize);
+
+    /**
+     * Simplify a mesh by edge collapses in order of quadric error (Garland and Heckbert 1997)
+     * until at most targetIndexCount indices remain, or no collapse keeps the error within
+     * targetError. Vertices stay in place, so the result indexes the same vertex buffer.
+     * Vertices sharing a position with different attributes form seams, which like open
+     * borders only collapse along themselves so that both sides stay joined. resultError
+     * receives the largest error, the root mean square distance from the collapsed positions
+     * to the planes of the triangles they had.
+     */
+    std::vector<uint32_t> SimplifyMesh(const std::vector<uint32_t>& indexData,
+                                       const float* positions,
+                                       size_t vertexStride,
+                                       size_t vertexCount,
+                                       size_t targetIndexCount,
+                                       float targetError,
+                                       float* resultError);
+
+}  // namespace MeshOptimizer
@@ -0,0 +1,354 @@
+#include "MipMapGenerator.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define MIP_MAP_GENERATOR_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define MIP_MAP_GENERATOR_NEON
+#endif
+
+namespace
+{
+    // Destination texels handled by one task of the thread pool
+    constexpr size_t kTexelsPerTask = 16 * 1024;
+    // Resolution of the table converting linear values back to sRGB
+    constexpr int kLinearToSrgbSize = 4096;
+
+    uint32_t NextLevelSize(uint32_t size)
+    {
+        return std::max(size / 2, 1u);
+    }
+
+    // Source texels contributing to a destination texel along one axis, and their weights
+    struct FilterTaps
+    {
+        uint32_t index[3];
+        float weight[3];
+        uint32_t count;
+    };
+
+    /**
+     * A destination texel covers 2 source texels when the source size is even. When it is
+     * odd (2n + 1), it covers (2n + 1) / n texels spread over 3 of them, weighted so that
+     * every source texel contributes equally to the level.
+     */
+    FilterTaps ComputeFilterTaps(uint32_t sourceSize, uint32_t i)
+    {
+        if (sourceSize == 1)
+        {
+            return {{0, 0, 0}, {1.0f, 0.0f, 0.0f}, 1};
+        }
+        if (sourceSize % 2 == 0)
+        {
+            return {{2 * i, 2 * i + 1, 0}, {0.5f, 0.5f, 0.0f}, 2};
+        }
+        uint32_t n  = sourceSize / 2;
+        float scale = 1.0f / static_cast<float>(sourceSize);
+        FilterTaps taps;
+        taps.index[0]  = 2 * i;
+        taps.index[1]  = 2 * i + 1;
+        taps.index[2]  = 2 * i + 2;
+        taps.weight[0] = static_cast<float>(n - i) * scale;
+        taps.weight[1] = static_cast<float>(n) * scale;
+        taps.weight[2] = static_cast<float>(i + 1) * scale;
+        taps.count     = 3;
+        return taps;
+    }
+
+    const std::array<float, 256>& GetSrgbToLinearTable()
+    {
+        static const std::array<float, 256> table = []
+        {
+            std::array<float, 256> values;
+            for (int i = 0; i < 256; ++i)
+            {
+                float c   = static_cast<float>(i) / 255.0f;
+                values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+        return table;
+    }
+
+    const std::array<unsigned char, kLinearToSrgbSize>& GetLinearToSrgbTable()
+    {
+        static const std::array<unsigned char, kLinearToSrgbSize> table = []
+        {
+            std::array<unsigned char, kLinearToSrgbSize> values;
+            for (int i = 0; i < kLinearToSrgbSize; ++i)
+            {
+                float c   = static_cast<float>(i) / (kLinearToSrgbSize - 1);
+                float s   = c <= 0.0031308f ? c * 12.92f
+                                            : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+                values[i] = static_cast<unsigned char>(std::lround(std::min(s, 1.0f) * 255.0f));
+            }
+            return values;
+        }();
+        return table;
+    }
+
+    /**
+     * Average 2x2 blocks of two source rows into one destination row, with rounding.
+     * Four destination texels are produced per iteration with SIMD.
+     */
+    void BoxFilterRow(const unsigned char* row0,
+                      const unsigned char* row1,
+                      unsigned char* destination,
+                      uint32_t destinationWidth)
+    {
+        uint32_t i = 0;
+#if defined(MIP_MAP_GENERATOR_SSE2)
+        const __m128i zero  = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(2);
+        for (; i + 4 <= destinationWidth; i += 4)
+        {
+            // 8 source texels per row
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * i + 16));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * i));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * i + 16));
+
+            // Vertical sums in 16 bits, two texels per register
+            __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(c, zero));
+            __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(c, zero));
+            __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(d, zero));
+            __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(d, zero));
+
+            // Horizontal sums of neighbouring texels land in the low half of each register
+            s0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+            s1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+            s2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+            s3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+
+            __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s0, s1), round), 2);
+            __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s2, s3), round), 2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + 4 * i),
+                             _mm_packus_epi16(lo, hi));
+        }
+#elif defined(MIP_MAP_GENERATOR_NEON)
+        for (; i + 4 <= destinationWidth; i += 4)
+        {
+            // De-interleave even and odd source texels of each row
+            uint32x4x2_t a = vld2q_u32(reinterpret_cast<const uint32_t*>(row0 + 8 * i));
+            uint32x4x2_t b = vld2q_u32(reinterpret_cast<const uint32_t*>(row1 + 8 * i));
+            uint8x16_t a0  = vreinterpretq_u8_u32(a.val[0]);
+            uint8x16_t a1  = vreinterpretq_u8_u32(a.val[1]);
+            uint8x16_t b0  = vreinterpretq_u8_u32(b.val[0]);
+            uint8x16_t b1  = vreinterpretq_u8_u32(b.val[1]);
+
+            uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a0), vget_low_u8(a1)),
+                                      vaddl_u8(vget_low_u8(b0), vget_low_u8(b1)));
+            uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a0), vget_high_u8(a1)),
+                                      vaddl_u8(vget_high_u8(b0), vget_high_u8(b1)));
+            vst1q_u8(destination + 4 * i, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+        }
+#endif
+        for (; i < destinationWidth; ++i)
+        {
+            const unsigned char* p0 = row0 + 8 * i;
+            const unsigned char* p1 = row1 + 8 * i;
+            for (int k = 0; k < 4; ++k)
+            {
+                destination[4 * i + k] =
+                    static_cast<unsigned char>((p0[k] + p0[k + 4] + p1[k] + p1[k + 4] + 2) / 4);
+            }
+        }
+    }
+
+    unsigned char LinearToSrgb(float value)
+    {
+        const std::array<unsigned char, kLinearToSrgbSize>& table = GetLinearToSrgbTable();
+        int index = static_cast<int>(value * (kLinearToSrgbSize - 1) + 0.5f);
+        return table[std::clamp(index, 0, kLinearToSrgbSize - 1)];
+    }
+
+    // BoxFilterRow for sRGB colors, averaged in linear space
+    void BoxFilterRowSrgb(const unsigned char* row0,
+                          const unsigned char* row1,
+                          unsigned char* destination,
+                          uint32_t destinationWidth)
+    {
+        const std::array<float, 256>& srgbToLinear = GetSrgbToLinearTable();
+        for (uint32_t i = 0; i < destinationWidth; ++i)
+        {
+            const unsigned char* p0 = row0 + 8 * i;
+            const unsigned char* p1 = row1 + 8 * i;
+            for (int k = 0; k < 3; ++k)
+            {
+                float sum = srgbToLinear[p0[k]] + srgbToLinear[p0[k + 4]] + srgbToLinear[p1[k]]
+                            + srgbToLinear[p1[k + 4]];
+                destination[4 * i + k] = LinearToSrgb(0.25f * sum);
+            }
+            destination[4 * i + 3] =
+                static_cast<unsigned char>((p0[3] + p0[7] + p1[3] + p1[7] + 2) / 4);
+        }
+    }
+
+    /**
+     * Weighted filter used for odd sizes and for the sRGB path, accumulating in floats.
+     * accumulator must hold 4 floats per destination texel.
+     */
+    void FilterRow(const unsigned char* source,
+                   uint32_t sourceWidth,
+                   const FilterTaps& rowTaps,
+                   const std::vector<FilterTaps>& columnTaps,
+                   bool isSrgb,
+                   unsigned char* destination,
+                   float* accumulator)
+    {
+        const std::array<float, 256>& srgbToLinear = GetSrgbToLinearTable();
+        uint32_t destinationWidth                  = static_cast<uint32_t>(columnTaps.size());
+        std::fill(accumulator, accumulator + 4 * destinationWidth, 0.0f);
+
+        for (uint32_t r = 0; r < rowTaps.count; ++r)
+        {
+            const unsigned char* row = source + 4 * size_t(rowTaps.index[r]) * sourceWidth;
+            for (uint32_t i = 0; i < destinationWidth; ++i)
+            {
+                const FilterTaps& taps = columnTaps[i];
+                float* texel           = accumulator + 4 * i;
+                for (uint32_t c = 0; c < taps.count; ++c)
+                {
+                    const unsigned char* p = row + 4 * taps.index[c];
+                    float weight           = rowTaps.weight[r] * taps.weight[c];
+                    if (isSrgb)
+                    {
+                        texel[0] += weight * srgbToLinear[p[0]];
+                        texel[1] += weight * srgbToLinear[p[1]];
+                        texel[2] += weight * srgbToLinear[p[2]];
+                    }
+                    else
+                    {
+                        texel[0] += weight * p[0];
+                        texel[1] += weight * p[1];
+                        texel[2] += weight * p[2];
+                    }
+                    texel[3] += weight * p[3];
+                }
+            }
+        }
+
+        for (uint32_t i = 0; i < 4 * destinationWidth; ++i)
+        {
+            float value = accumulator[i];
+            if (isSrgb && i % 4 != 3)
+            {
+                destination[i] = LinearToSrgb(value);
+            }
+            else
+            {
+                destination[i] = static_cast<unsigned char>(std::min(value + 0.5f, 255.0f));
+            }
+        }
+    }
+}  // namespace
+
+namespace MipMapGenerator
+{
+    std::vector<MipLevel> Generate(const unsigned char* pixels,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   uint32_t levelCount,
+                                   bool isSrgb,
+                                   std::vector<unsigned char>& arena)
+    {
+        std::vector<MipLevel> levels;
+        if (levelCount == 0)
+        {
+            return levels;
+        }
+        levels.reserve(levelCount);
+        levels.push_back({width, height, pixels});
+
+        // Size the arena once so that the level pointers stay valid
+        size_t arenaSize = 0;
+        for (uint32_t level = 1; level < levelCount; ++level)
+        {
+            width      = NextLevelSize(width);
+            height     = NextLevelSize(height);
+            arenaSize += 4 * size_t(width) * height;
+        }
+        arena.resize(arenaSize);
+
+        unsigned char* data = arena.data();
+        for (uint32_t level = 1; level < levelCount; ++level)
+        {
+            const MipLevel& previous = levels.back();
+            MipLevel current         = {NextLevelSize(previous.width),
+                                        NextLevelSize(previous.height),
+                                        data};
+            Downsample(previous.data, previous.width, previous.height, data, isSrgb);
+            data += 4 * size_t(current.width) * current.height;
+            levels.push_back(current);
+        }
+        return levels;
+    }
+
+    void Downsample(const unsigned char* source,
+                    uint32_t sourceWidth,
+                    uint32_t sourceHeight,
+                    unsigned char* destination,
+                    bool isSrgb)
+    {
+        uint32_t destinationWidth  = NextLevelSize(sourceWidth);
+        uint32_t destinationHeight = NextLevelSize(sourceHeight);
+        size_t rowsPerTask         = std::max<size_t>(1, kTexelsPerTask / destinationWidth);
+        size_t sourcePitch         = 4 * size_t(sourceWidth);
+        size_t destinationPitch    = 4 * size_t(destinationWidth);
+
+        if (sourceWidth % 2 == 0 && sourceHeight % 2 == 0)
+        {
+            ThreadPool::GetInstance().ParallelFor(
+                destinationHeight,
+                rowsPerTask,
+                [&](size_t first, size_t last)
+                {
+                    for (size_t j = first; j < last; ++j)
+                    {
+                        const unsigned char* row0 = source + 2 * j * sourcePitch;
+                        unsigned char* row = destination + j * destinationPitch;
+                        if (isSrgb)
+                        {
+                            BoxFilterRowSrgb(row0, row0 + sourcePitch, row, destinationWidth);
+                        }
+                        else
+                        {
+                            BoxFilterRow(row0, row0 + sourcePitch, row, destinationWidth);
+                        }
+                    }
+                });
+            return;
+        }
+
+        std::vector<FilterTaps> columnTaps(destinationWidth);
+        for (uint32_t i = 0; i < destinationWidth; ++i)
+        {
+            columnTaps[i] = ComputeFilterTaps(sourceWidth, i);
+        }
+        ThreadPool::GetInstance().ParallelFor(
+            destinationHeight,
+            rowsPerTask,
+            [&](size_t first, size_t last)
+            {
+                std::vector<float> accumulator(4 * size_t(destinationWidth));
+                for (size_t j = first; j < last; ++j)
+                {
+                    FilterRow(source,
+                              sourceWidth,
+                              ComputeFilterTaps(sourceHeight, static_cast<uint32_t>(j)),
+                              columnTaps,
+                              isSrgb,
+                              destination + j * destinationPitch,
+                              accumulator.data());
+                }
+            });
+    }
+
+}  // namespace MipMapGenerator
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace MipMapGenerator
+{
+    struct MipLevel
+    {
+        uint32_t width;
+        uint32_t height;
+        // RGBA8 pixels, tightly packed
+        const unsigned char* data;
+    };
+
+    /**
+     * Build the RGBA8 mip chain of an image. Level 0 points at the given pixels, and the
+     * other levels are written one after the other into arena, allocated once for the
+     * whole chain. Each level halves the previous one, rounding down and never below 1.
+     * With isSrgb, pixels are averaged in linear space (alpha is always linear).
+     */
+    std::vector<MipLevel> Generate(const unsigned char* pixels,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   uint32_t levelCount,
+                                   bool isSrgb,
+                                   std::vector<unsigned char>& arena);
+
+    /**
+     * Downsample one RGBA8 level into the next one, of size max(1, size / 2). Even sizes
+     * use a 2x2 box filter (with SIMD outside of the sRGB path), odd sizes weight 3 source
+     * texels so that every source texel contributes equally. Rows are spread over the
+     * shared thread pool.
+     */
+    void Downsample(const unsigned char* source,
+                    uint32_t sourceWidth,
+                    uint32_t sourceHeight,
+                    unsigned char* destination,
+                    bool isSrgb);
+
+}  // namespace MipMapGenerator
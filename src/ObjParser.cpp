@@ -0,0 +1,475 @@
+#include "ObjParser.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "VertexFormat.h"
+
+namespace
+{
+    // Below this size per chunk, threading costs more than it saves
+    constexpr size_t kMinChunkSize = 256 * 1024;
+
+    enum class LineType
+    {
+        Other,
+        Position,
+        Normal,
+        TexCoord,
+        Face,
+    };
+
+    // Number of elements of each kind found in a chunk, or preceding it once summed up
+    struct ElementCounts
+    {
+        size_t positions      = 0;
+        size_t normals        = 0;
+        size_t texCoords      = 0;
+        size_t outputVertices = 0;
+    };
+
+    // OBJ indices as written in the file: 1-based, negative when relative, 0 when absent
+    struct FaceCorner
+    {
+        int position = 0;
+        int texCoord = 0;
+        int normal   = 0;
+    };
+
+    bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    const char* SkipSpaces(const char* p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+        {
+            ++p;
+        }
+        return p;
+    }
+
+    const char* FindLineEnd(const char* p, const char* end)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        return lineEnd ? lineEnd : end;
+    }
+
+    // Identify the line and move p past its keyword
+    LineType ReadLineType(const char*& p, const char* end)
+    {
+        p = SkipSpaces(p, end);
+        if (end - p < 2)
+        {
+            return LineType::Other;
+        }
+
+        if (p[0] == 'f' && IsSpace(p[1]))
+        {
+            p += 2;
+            return LineType::Face;
+        }
+        if (p[0] != 'v')
+        {
+            return LineType::Other;
+        }
+        if (IsSpace(p[1]))
+        {
+            p += 2;
+            return LineType::Position;
+        }
+        if (end - p >= 3 && IsSpace(p[2]))
+        {
+            if (p[1] == 'n')
+            {
+                p += 3;
+                return LineType::Normal;
+            }
+            if (p[1] == 't')
+            {
+                p += 3;
+                return LineType::TexCoord;
+            }
+        }
+        return LineType::Other;
+    }
+
+    bool ParseFloat(const char*& p, const char* end, float& value)
+    {
+        p = SkipSpaces(p, end);
+        if (p < end && *p == '+')
+        {
+            ++p;
+        }
+#if defined(__cpp_lib_to_chars)
+        auto [ptr, ec] = std::from_chars(p, end, value);
+        if (ec != std::errc())
+        {
+            return false;
+        }
+        p = ptr;
+#else
+        // Standard libraries without floating point from_chars
+        char buffer[64];
+        size_t length = 0;
+        while (p + length < end && length < sizeof(buffer) - 1 && !IsSpace(p[length]))
+        {
+            buffer[length] = p[length];
+            ++length;
+        }
+        buffer[length] = '\0';
+        char* parsedEnd = nullptr;
+        value           = strtof(buffer, &parsedEnd);
+        if (parsedEnd == buffer)
+        {
+            return false;
+        }
+        p += parsedEnd - buffer;
+#endif
+        return true;
+    }
+
+    int ParseFloats(const char* p, const char* end, float* values, int maxCount)
+    {
+        int count = 0;
+        while (count < maxCount && ParseFloat(p, end, values[count]))
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    bool ParseIndex(const char*& p, const char* end, int& index)
+    {
+        auto [ptr, ec] = std::from_chars(p, end, index);
+        if (ec != std::errc())
+        {
+            return false;
+        }
+        p = ptr;
+        return true;
+    }
+
+    // Parse v, v/vt, v//vn or v/vt/vn
+    bool ParseFaceCorner(const char*& p, const char* end, FaceCorner& corner)
+    {
+        corner = {};
+        p      = SkipSpaces(p, end);
+        if (p == end || !ParseIndex(p, end, corner.position))
+        {
+            return false;
+        }
+        if (p < end && *p == '/')
+        {
+            ++p;
+            if (p < end && *p != '/' && !ParseIndex(p, end, corner.texCoord))
+            {
+                return false;
+            }
+            if (p < end && *p == '/')
+            {
+                ++p;
+                if (!ParseIndex(p, end, corner.normal))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    size_t CountFaceCorners(const char* p, const char* end)
+    {
+        size_t count = 0;
+        while ((p = SkipSpaces(p, end)) < end)
+        {
+            ++count;
+            while (p < end && !IsSpace(*p))
+            {
+                ++p;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Turn an OBJ index into a 0-based one. Relative indices are resolved against the
+     * number of elements defined before the current line. Return -1 when out of range.
+     */
+    int64_t ResolveIndex(int index, size_t definedBefore, size_t total)
+    {
+        int64_t resolved = index > 0 ? static_cast<int64_t>(index) - 1
+                                     : static_cast<int64_t>(definedBefore) + index;
+        return index != 0 && resolved >= 0 && resolved < static_cast<int64_t>(total) ? resolved
+                                                                                     : -1;
+    }
+
+    ElementCounts CountElements(const char* begin, const char* end)
+    {
+        ElementCounts counts;
+        for (const char* p = begin; p < end;)
+        {
+            const char* lineEnd = FindLineEnd(p, end);
+            switch (ReadLineType(p, lineEnd))
+            {
+                case LineType::Position:
+                    ++counts.positions;
+                    break;
+                case LineType::Normal:
+                    ++counts.normals;
+                    break;
+                case LineType::TexCoord:
+                    ++counts.texCoords;
+                    break;
+                case LineType::Face:
+                {
+                    size_t cornerCount = CountFaceCorners(p, lineEnd);
+                    if (cornerCount >= 3)
+                    {
+                        counts.outputVertices += 3 * (cornerCount - 2);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+            p = lineEnd + 1;
+        }
+        return counts;
+    }
+
+    struct Attributes
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> colors;
+        std::vector<glm::vec3> normals;
+        std::vector<glm::vec2> texCoords;
+    };
+
+    // Store attributes already converted to the application conventions
+    void ParseAttributes(const char* begin,
+                         const char* end,
+                         const ElementCounts& offsets,
+                         Attributes& attributes)
+    {
+        size_t positionIndex = offsets.positions;
+        size_t normalIndex   = offsets.normals;
+        size_t texCoordIndex = offsets.texCoords;
+        float values[6];
+        for (const char* p = begin; p < end;)
+        {
+            const char* lineEnd = FindLineEnd(p, end);
+            switch (ReadLineType(p, lineEnd))
+            {
+                case LineType::Position:
+                {
+                    std::fill(std::begin(values), std::end(values), 0.0f);
+                    // A vertex has either x y z [w] or x y z r g b
+                    int count = ParseFloats(p, lineEnd, values, 6);
+                    attributes.positions[positionIndex] = {values[0], -values[2], values[1]};
+                    attributes.colors[positionIndex] =
+                        count >= 6 ? glm::vec3(values[3], values[4], values[5]) : glm::vec3(1.0f);
+                    ++positionIndex;
+                    break;
+                }
+                case LineType::Normal:
+                    std::fill(std::begin(values), std::end(values), 0.0f);
+                    ParseFloats(p, lineEnd, values, 3);
+                    attributes.normals[normalIndex++] = {values[0], -values[2], values[1]};
+                    break;
+                case LineType::TexCoord:
+                    std::fill(std::begin(values), std::end(values), 0.0f);
+                    ParseFloats(p, lineEnd, values, 2);
+                    attributes.texCoords[texCoordIndex++] = {values[0], 1 - values[1]};
+                    break;
+                default:
+                    break;
+            }
+            p = lineEnd + 1;
+        }
+    }
+
+    // Write the fan-triangulated faces of a chunk straight into their final location
+    bool ParseFaces(const char* begin,
+                    const char* end,
+                    const ElementCounts& offsets,
+                    const ElementCounts& totals,
+                    const Attributes& attributes,
+                    VertexAttributes* output)
+    {
+        ElementCounts definedBefore = offsets;
+        std::vector<VertexAttributes> corners;
+        for (const char* p = begin; p < end;)
+        {
+            const char* lineEnd = FindLineEnd(p, end);
+            switch (ReadLineType(p, lineEnd))
+            {
+                case LineType::Position:
+                    ++definedBefore.positions;
+                    break;
+                case LineType::Normal:
+                    ++definedBefore.normals;
+                    break;
+                case LineType::TexCoord:
+                    ++definedBefore.texCoords;
+                    break;
+                case LineType::Face:
+                {
+                    corners.clear();
+                    FaceCorner corner;
+                    while (SkipSpaces(p, lineEnd) < lineEnd)
+                    {
+                        if (!ParseFaceCorner(p, lineEnd, corner))
+                        {
+                            return false;
+                        }
+
+                        int64_t position =
+                            ResolveIndex(corner.position, definedBefore.positions, totals.positions);
+                        int64_t texCoord =
+                            ResolveIndex(corner.texCoord, definedBefore.texCoords, totals.texCoords);
+                        int64_t normal =
+                            ResolveIndex(corner.normal, definedBefore.normals, totals.normals);
+                        if (position < 0 || (corner.texCoord != 0 && texCoord < 0)
+                            || (corner.normal != 0 && normal < 0))
+                        {
+                            return false;
+                        }
+
+                        VertexAttributes& vertex = corners.emplace_back();
+                        vertex.position          = attributes.positions[position];
+                        vertex.color             = attributes.colors[position];
+                        vertex.normal = normal >= 0 ? attributes.normals[normal] : glm::vec3(0.0f);
+                        vertex.uv =
+                            texCoord >= 0 ? attributes.texCoords[texCoord] : glm::vec2(0.0f);
+                    }
+
+                    for (size_t k = 2; k < corners.size(); ++k)
+                    {
+                        *output++ = corners[0];
+                        *output++ = corners[k - 1];
+                        *output++ = corners[k];
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+            p = lineEnd + 1;
+        }
+        return true;
+    }
+}  // namespace
+
+bool ObjParser::LoadObj(const std::filesystem::path& path,
+                        std::vector<VertexAttributes>& vertexData)
+{
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        SDL_Log("Could not open %s", path.string().c_str());
+        return false;
+    }
+    return ParseObj(reinterpret_cast<const char*>(file.GetData()), file.GetSize(), vertexData);
+}
+
+bool ObjParser::ParseObj(const char* data, size_t size, std::vector<VertexAttributes>& vertexData)
+{
+    ThreadPool& threadPool = ThreadPool::GetInstance();
+    const char* dataEnd    = data + size;
+
+    // Split the data into chunks that start at the beginning of a line
+    size_t maxChunkCount = 4 * (threadPool.GetThreadCount() + 1);
+    size_t chunkCount    = std::clamp<size_t>(size / kMinChunkSize, 1, maxChunkCount);
+    std::vector<const char*> chunkBounds(chunkCount + 1);
+    chunkBounds[0]          = data;
+    chunkBounds[chunkCount] = dataEnd;
+    for (size_t c = 1; c < chunkCount; ++c)
+    {
+        const char* p       = std::max(data + size * c / chunkCount, chunkBounds[c - 1]);
+        const char* lineEnd = p < dataEnd ? FindLineEnd(p, dataEnd) : dataEnd;
+        chunkBounds[c]      = lineEnd < dataEnd ? lineEnd + 1 : dataEnd;
+    }
+
+    // First pass: count elements to know where each chunk writes its output
+    std::vector<ElementCounts> chunkCounts(chunkCount);
+    threadPool.ParallelFor(chunkCount,
+                           1,
+                           [&](size_t first, size_t last)
+                           {
+                               for (size_t c = first; c < last; ++c)
+                               {
+                                   chunkCounts[c] =
+                                       CountElements(chunkBounds[c], chunkBounds[c + 1]);
+                               }
+                           });
+
+    std::vector<ElementCounts> chunkOffsets(chunkCount);
+    ElementCounts totals;
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        chunkOffsets[c] = totals;
+        totals.positions += chunkCounts[c].positions;
+        totals.normals += chunkCounts[c].normals;
+        totals.texCoords += chunkCounts[c].texCoords;
+        totals.outputVertices += chunkCounts[c].outputVertices;
+    }
+
+    // Second pass: attributes, which faces of any chunk may refer to
+    Attributes attributes;
+    attributes.positions.resize(totals.positions);
+    attributes.colors.resize(totals.positions);
+    attributes.normals.resize(totals.normals);
+    attributes.texCoords.resize(totals.texCoords);
+    threadPool.ParallelFor(chunkCount,
+                           1,
+                           [&](size_t first, size_t last)
+                           {
+                               for (size_t c = first; c < last; ++c)
+                               {
+                                   ParseAttributes(chunkBounds[c],
+                                                   chunkBounds[c + 1],
+                                                   chunkOffsets[c],
+                                                   attributes);
+                               }
+                           });
+
+    // Third pass: faces
+    vertexData.resize(totals.outputVertices);
+    std::atomic<bool> failed = false;
+    threadPool.ParallelFor(chunkCount,
+                           1,
+                           [&](size_t first, size_t last)
+                           {
+                               for (size_t c = first; c < last; ++c)
+                               {
+                                   if (!ParseFaces(chunkBounds[c],
+                                                   chunkBounds[c + 1],
+                                                   chunkOffsets[c],
+                                                   totals,
+                                                   attributes,
+                                                   vertexData.data()
+                                                       + chunkOffsets[c].outputVertices))
+                                   {
+                                       failed = true;
+                                   }
+                               }
+                           });
+
+    if (failed)
+    {
+        SDL_Log("Invalid face in OBJ data");
+        vertexData.clear();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+struct VertexAttributes;
+
+namespace ObjParser
+{
+    /**
+     * Memory-map a Wavefront OBJ file and parse it with ParseObj
+     */
+    bool LoadObj(const std::filesystem::path& path, std::vector<VertexAttributes>& vertexData);
+
+    /**
+     * Parse OBJ data into a non-indexed triangle list, in parallel over line-aligned chunks.
+     * Positions and normals are converted to the Z-up frame of the application, V texture
+     * coordinates are flipped and polygons are triangulated as fans. Only positions, colors,
+     * normals and texture coordinates are filled in.
+     */
+    bool ParseObj(const char* data, size_t size, std::vector<VertexAttributes>& vertexData);
+
+}  // namespace ObjParser
@@ -0,0 +1,253 @@
+#include "OffsetAllocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+namespace
+{
+    constexpr uint32_t kMantissaBits  = 3;
+    constexpr uint32_t kMantissaValue = 1 << kMantissaBits;
+    constexpr uint32_t kMantissaMask  = kMantissaValue - 1;
+
+    /**
+     * Bin of a size, as a tiny float with kMantissaBits of mantissa. Sizes below
+     * kMantissaValue have a bin of their own.
+     */
+    uint32_t GetBin(uint32_t size, bool isRoundedUp)
+    {
+        if (size < kMantissaValue)
+        {
+            return size;
+        }
+
+        uint32_t mantissaStart = std::bit_width(size) - 1 - kMantissaBits;
+        uint32_t exponent      = mantissaStart + 1;
+        uint32_t mantissa      = (size >> mantissaStart) & kMantissaMask;
+        // Adding rather than or-ing lets the mantissa carry into the exponent
+        uint32_t bin = (exponent << kMantissaBits) + mantissa;
+        if (isRoundedUp && (size & ((1u << mantissaStart) - 1)) != 0)
+        {
+            ++bin;
+        }
+        return bin;
+    }
+}  // namespace
+
+OffsetAllocator::OffsetAllocator(uint32_t size)
+{
+    Reset(size);
+}
+
+void OffsetAllocator::Reset(uint32_t size)
+{
+    this->size     = size;
+    freeSize       = 0;
+    freeRangeCount = 0;
+    usedTopBins    = 0;
+    usedLeafBins.fill(0);
+    binHeads.fill(kInvalid);
+    nodes.clear();
+    unusedNodes.clear();
+
+    if (size > 0)
+    {
+        InsertFree(CreateNode(0, size));
+    }
+}
+
+OffsetAllocator::Allocation OffsetAllocator::Allocate(uint32_t size)
+{
+    // Rounding the request up means that any range in the bin found is large enough
+    uint32_t bin = size > 0 ? FindFreeBin(GetBin(size, true)) : kInvalid;
+    if (bin == kInvalid)
+    {
+        return {};
+    }
+
+    uint32_t index = binHeads[bin];
+    RemoveFree(index);
+
+    // Give the remainder back as a free range right after the allocation
+    uint32_t remainder  = nodes[index].size - size;
+    nodes[index].size   = size;
+    nodes[index].isUsed = true;
+    if (remainder > 0)
+    {
+        uint32_t remainderIndex        = CreateNode(nodes[index].offset + size, remainder);
+        Node& remainderNode            = nodes[remainderIndex];
+        remainderNode.neighborPrevious = index;
+        remainderNode.neighborNext     = nodes[index].neighborNext;
+        if (remainderNode.neighborNext != kInvalid)
+        {
+            nodes[remainderNode.neighborNext].neighborPrevious = remainderIndex;
+        }
+        nodes[index].neighborNext = remainderIndex;
+        InsertFree(remainderIndex);
+    }
+
+    return {nodes[index].offset, index};
+}
+
+void OffsetAllocator::Free(const Allocation& allocation)
+{
+    if (allocation.node == kInvalid)
+    {
+        return;
+    }
+
+    uint32_t index = allocation.node;
+    Node& node     = nodes[index];
+    assert(node.isUsed);
+    node.isUsed = false;
+
+    // Merge with the free neighbors, the node taking over their ranges
+    uint32_t previous = node.neighborPrevious;
+    if (previous != kInvalid && !nodes[previous].isUsed)
+    {
+        RemoveFree(previous);
+        node.offset            = nodes[previous].offset;
+        node.size             += nodes[previous].size;
+        node.neighborPrevious  = nodes[previous].neighborPrevious;
+        if (node.neighborPrevious != kInvalid)
+        {
+            nodes[node.neighborPrevious].neighborNext = index;
+        }
+        ReleaseNode(previous);
+    }
+
+    uint32_t next = node.neighborNext;
+    if (next != kInvalid && !nodes[next].isUsed)
+    {
+        RemoveFree(next);
+        node.size         += nodes[next].size;
+        node.neighborNext  = nodes[next].neighborNext;
+        if (node.neighborNext != kInvalid)
+        {
+            nodes[node.neighborNext].neighborPrevious = index;
+        }
+        ReleaseNode(next);
+    }
+
+    InsertFree(index);
+}
+
+uint32_t OffsetAllocator::GetAllocationSize(const Allocation& allocation) const
+{
+    return allocation.node != kInvalid ? nodes[allocation.node].size : 0;
+}
+
+OffsetAllocator::Stats OffsetAllocator::GetStats() const
+{
+    Stats stats {freeSize, 0, freeRangeCount};
+
+    // The largest range is in the highest non-empty bin, whose ranges differ in size
+    if (usedTopBins != 0)
+    {
+        uint32_t topBin = std::bit_width(usedTopBins) - 1;
+        uint32_t bin    = topBin * kBinsPerLeaf + std::bit_width(usedLeafBins[topBin]) - 1;
+        for (uint32_t index = binHeads[bin]; index != kInvalid; index = nodes[index].binNext)
+        {
+            stats.largestFreeRange = std::max(stats.largestFreeRange, nodes[index].size);
+        }
+    }
+    return stats;
+}
+
+uint32_t OffsetAllocator::CreateNode(uint32_t offset, uint32_t size)
+{
+    uint32_t index;
+    if (unusedNodes.empty())
+    {
+        index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+    else
+    {
+        index = unusedNodes.back();
+        unusedNodes.pop_back();
+    }
+    nodes[index] = {offset, size, false, kInvalid, kInvalid, kInvalid, kInvalid};
+    return index;
+}
+
+void OffsetAllocator::ReleaseNode(uint32_t index)
+{
+    unusedNodes.push_back(index);
+}
+
+void OffsetAllocator::InsertFree(uint32_t index)
+{
+    // Rounding down means that a range never sits in a bin promising more than it holds
+    Node& node   = nodes[index];
+    uint32_t bin = GetBin(node.size, false);
+
+    node.binPrevious = kInvalid;
+    node.binNext     = binHeads[bin];
+    if (node.binNext != kInvalid)
+    {
+        nodes[node.binNext].binPrevious = index;
+    }
+    binHeads[bin] = index;
+
+    usedTopBins |= 1u << (bin / kBinsPerLeaf);
+    usedLeafBins[bin / kBinsPerLeaf] |= 1u << (bin % kBinsPerLeaf);
+    freeSize += node.size;
+    ++freeRangeCount;
+}
+
+void OffsetAllocator::RemoveFree(uint32_t index)
+{
+    Node& node   = nodes[index];
+    uint32_t bin = GetBin(node.size, false);
+
+    if (node.binPrevious != kInvalid)
+    {
+        nodes[node.binPrevious].binNext = node.binNext;
+    }
+    else
+    {
+        binHeads[bin] = node.binNext;
+    }
+    if (node.binNext != kInvalid)
+    {
+        nodes[node.binNext].binPrevious = node.binPrevious;
+    }
+
+    if (binHeads[bin] == kInvalid)
+    {
+        uint32_t topBin = bin / kBinsPerLeaf;
+        usedLeafBins[topBin] &= ~(1u << (bin % kBinsPerLeaf));
+        if (usedLeafBins[topBin] == 0)
+        {
+            usedTopBins &= ~(1u << topBin);
+        }
+    }
+    freeSize -= node.size;
+    --freeRangeCount;
+}
+
+uint32_t OffsetAllocator::FindFreeBin(uint32_t minBin) const
+{
+    uint32_t topBin = minBin / kBinsPerLeaf;
+    if (topBin >= kTopBinCount)
+    {
+        return kInvalid;
+    }
+
+    // Larger bins of the same power of two
+    uint32_t leafMask = usedLeafBins[topBin] & (0xFFu << (minBin % kBinsPerLeaf)) & 0xFFu;
+    if (leafMask != 0)
+    {
+        return topBin * kBinsPerLeaf + std::countr_zero(leafMask);
+    }
+
+    // Otherwise the smallest bin of the next non-empty power of two
+    uint32_t topMask = topBin + 1 < kTopBinCount ? usedTopBins & (~0u << (topBin + 1)) : 0;
+    if (topMask == 0)
+    {
+        return kInvalid;
+    }
+    topBin = std::countr_zero(topMask);
+    return topBin * kBinsPerLeaf + std::countr_zero(static_cast<uint32_t>(usedLeafBins[topBin]));
+}
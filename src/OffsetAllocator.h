@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Two-level segregated fit (TLSF) allocator of ranges within [0, size), in abstract units.
+ * It manages offsets only, the memory itself belonging to the caller, e.g. a GPU buffer.
+ *
+ * Free ranges are binned by size with a floating point like encoding, 3 bits of mantissa
+ * giving 8 bins per power of two. Two levels of bitmasks find the smallest non-empty bin
+ * able to hold a request in constant time. Freed ranges are merged with their free
+ * neighbors, so fragmentation only comes from the interleaving of live allocations.
+ */
+class OffsetAllocator
+{
+public:
+    static constexpr uint32_t kInvalid = UINT32_MAX;
+
+    struct Allocation
+    {
+        uint32_t offset = kInvalid;
+        // Internal node, needed to free the allocation
+        uint32_t node = kInvalid;
+    };
+
+    struct Stats
+    {
+        uint32_t freeSize;
+        uint32_t largestFreeRange;
+        uint32_t freeRangeCount;
+    };
+
+    explicit OffsetAllocator(uint32_t size = 0);
+
+    // Forget all allocations and manage [0, size)
+    void Reset(uint32_t size);
+
+    // Return an allocation with an offset of kInvalid when no free range is large enough
+    Allocation Allocate(uint32_t size);
+    void Free(const Allocation& allocation);
+
+    uint32_t GetSize() const
+    {
+        return size;
+    }
+
+    uint32_t GetAllocationSize(const Allocation& allocation) const;
+
+    Stats GetStats() const;
+
+private:
+    static constexpr uint32_t kTopBinCount  = 32;
+    static constexpr uint32_t kBinsPerLeaf  = 8;
+    static constexpr uint32_t kLeafBinCount = kTopBinCount * kBinsPerLeaf;
+
+    struct Node
+    {
+        uint32_t offset;
+        uint32_t size;
+        bool isUsed;
+        // Free ranges of the same bin
+        uint32_t binPrevious;
+        uint32_t binNext;
+        // Adjacent ranges, free or used, in address order
+        uint32_t neighborPrevious;
+        uint32_t neighborNext;
+    };
+
+    uint32_t CreateNode(uint32_t offset, uint32_t size);
+    void ReleaseNode(uint32_t index);
+
+    // Link a free node into the bin of its size
+    void InsertFree(uint32_t index);
+    void RemoveFree(uint32_t index);
+
+    // Smallest non-empty bin at or above minBin, kInvalid if none
+    uint32_t FindFreeBin(uint32_t minBin) const;
+
+    uint32_t size           = 0;
+    uint32_t freeSize       = 0;
+    uint32_t freeRangeCount = 0;
+
+    // Bit i of usedTopBins is set when usedLeafBins[i] is non-zero
+    uint32_t usedTopBins = 0;
+    std::array<uint8_t, kTopBinCount> usedLeafBins {};
+    std::array<uint32_t, kLeafBinCount> binHeads {};
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> unusedNodes;
+};
@@ -0,0 +1,249 @@
+#include "PipelineCache.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <system_error>
+#include <vector>
+
+#include "AssetSource.h"
+#include "MappedFile.h"
+
+namespace
+{
+    constexpr uint32_t kPipelineCacheMagic = 0x424C4244;  // "DBLB"
+    // Bump whenever the layout of the blob files changes
+    constexpr uint32_t kPipelineCacheVersion = 1;
+    constexpr const char* kBlobExtension     = ".blob";
+}  // namespace
+
+// Followed by the key, then by the value
+struct PipelineCache::Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t keySize;
+    uint64_t valueSize;
+    // Hash of the value, so that a corrupted blob never reaches the driver
+    uint64_t valueHash;
+};
+
+bool PipelineCache::Initialize(const std::filesystem::path& directory, uint64_t maxSize)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->directory = directory;
+    this->maxSize   = maxSize;
+    entries.clear();
+    statistics = {};
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        SDL_Log("Could not create pipeline cache %s: %s",
+                directory.string().c_str(),
+                error.message().c_str());
+        return false;
+    }
+
+    // Blobs are ranked by modification time, which is refreshed whenever one is used
+    struct Blob
+    {
+        uint64_t keyHash;
+        uint64_t size;
+        std::filesystem::file_time_type writeTime;
+    };
+    std::vector<Blob> blobs;
+    for (const std::filesystem::directory_entry& directoryEntry :
+         std::filesystem::directory_iterator(directory, error))
+    {
+        const std::filesystem::path& path = directoryEntry.path();
+        uint64_t keyHash                  = 0;
+
+        bool isValid = path.extension() == kBlobExtension
+                       && sscanf(path.stem().string().c_str(), "%" SCNx64, &keyHash) == 1;
+        if (isValid)
+        {
+            MappedFile file;
+            isValid = file.Open(path) && file.GetSize() >= sizeof(Header);
+            if (isValid)
+            {
+                const Header* header = reinterpret_cast<const Header*>(file.GetData());
+                isValid              = header->magic == kPipelineCacheMagic
+                                       && header->version == kPipelineCacheVersion;
+            }
+        }
+        if (!isValid)
+        {
+            std::filesystem::remove(path, error);
+            continue;
+        }
+        blobs.push_back({keyHash, directoryEntry.file_size(), directoryEntry.last_write_time()});
+    }
+
+    std::sort(blobs.begin(),
+              blobs.end(),
+              [](const Blob& a, const Blob& b) { return a.writeTime < b.writeTime; });
+    for (const Blob& blob : blobs)
+    {
+        entries[blob.keyHash] = {blob.size, ++useCounter};
+        statistics.size      += blob.size;
+    }
+    Evict();
+
+    SDL_Log("Pipeline cache %s: %zu blobs, %.1f MB",
+            directory.string().c_str(),
+            entries.size(),
+            statistics.size / (1024.0 * 1024.0));
+    return true;
+}
+
+#ifndef __EMSCRIPTEN__
+void PipelineCache::Attach(wgpu::DawnCacheDeviceDescriptor& cacheDesc)
+{
+    cacheDesc.loadDataFunction  = &PipelineCache::LoadData;
+    cacheDesc.storeDataFunction = &PipelineCache::StoreData;
+    cacheDesc.functionUserdata  = this;
+}
+#endif
+
+PipelineCache::Statistics PipelineCache::GetStatistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return statistics;
+}
+
+size_t PipelineCache::LoadData(const void* key,
+                               size_t keySize,
+                               void* value,
+                               size_t valueSize,
+                               void* userdata)
+{
+    return static_cast<PipelineCache*>(userdata)->Load(key, keySize, value, valueSize);
+}
+
+void PipelineCache::StoreData(const void* key,
+                              size_t keySize,
+                              const void* value,
+                              size_t valueSize,
+                              void* userdata)
+{
+    static_cast<PipelineCache*>(userdata)->Store(key, keySize, value, valueSize);
+}
+
+size_t PipelineCache::Load(const void* key, size_t keySize, void* value, size_t valueSize)
+{
+    uint64_t keyHash = AssetSource::HashBytes(static_cast<const unsigned char*>(key), keySize);
+    bool isQuery     = value == nullptr || valueSize == 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(keyHash);
+    if (it == entries.end())
+    {
+        ++statistics.misses;
+        return 0;
+    }
+
+    std::filesystem::path path = GetBlobPath(keyHash);
+    std::span<const unsigned char> keyBytes(static_cast<const unsigned char*>(key), keySize);
+    MappedFile file;
+    std::span<const unsigned char> storedValue;
+    if (!ReadBlob(path, keyBytes, !isQuery, file, storedValue))
+    {
+        ++statistics.misses;
+        return 0;
+    }
+
+    if (isQuery)
+    {
+        return storedValue.size();
+    }
+    size_t copySize = std::min(valueSize, storedValue.size());
+    memcpy(value, storedValue.data(), copySize);
+
+    ++statistics.hits;
+    it->second.lastUse = ++useCounter;
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    return copySize;
+}
+
+void PipelineCache::Store(const void* key, size_t keySize, const void* value, size_t valueSize)
+{
+    uint64_t keyHash = AssetSource::HashBytes(static_cast<const unsigned char*>(key), keySize);
+
+    Header header {};
+    header.magic     = kPipelineCacheMagic;
+    header.version   = kPipelineCacheVersion;
+    header.keySize   = keySize;
+    header.valueSize = valueSize;
+    header.valueHash = AssetSource::HashBytes(static_cast<const unsigned char*>(value), valueSize);
+
+    std::vector<unsigned char> blob(sizeof(Header) + keySize + valueSize);
+    memcpy(blob.data(), &header, sizeof(Header));
+    memcpy(blob.data() + sizeof(Header), key, keySize);
+    memcpy(blob.data() + sizeof(Header) + keySize, value, valueSize);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!AssetSource::WriteCacheFile(GetBlobPath(keyHash), blob))
+    {
+        return;
+    }
+
+    ++statistics.stores;
+    auto [it, inserted] = entries.try_emplace(keyHash, Entry {0, 0});
+    statistics.size    += blob.size() - it->second.size;
+    it->second          = {blob.size(), ++useCounter};
+    Evict();
+}
+
+bool PipelineCache::ReadBlob(const std::filesystem::path& path,
+                             std::span<const unsigned char> key,
+                             bool checkValue,
+                             MappedFile& file,
+                             std::span<const unsigned char>& value) const
+{
+    if (!file.Open(path) || file.GetSize() < sizeof(Header))
+    {
+        return false;
+    }
+
+    // A hash collision or a corrupted file reads as a miss
+    const Header* header = reinterpret_cast<const Header*>(file.GetData());
+    size_t payloadSize   = file.GetSize() - sizeof(Header);
+    if (header->keySize != key.size() || key.size() > payloadSize
+        || header->valueSize != payloadSize - key.size()
+        || memcmp(file.GetData() + sizeof(Header), key.data(), key.size()) != 0)
+    {
+        return false;
+    }
+
+    value = {file.GetData() + sizeof(Header) + key.size(), header->valueSize};
+    return !checkValue || AssetSource::HashBytes(value.data(), value.size()) == header->valueHash;
+}
+
+std::filesystem::path PipelineCache::GetBlobPath(uint64_t keyHash) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 "%s", keyHash, kBlobExtension);
+    return directory / name;
+}
+
+void PipelineCache::Evict()
+{
+    while (statistics.size > maxSize && !entries.empty())
+    {
+        auto leastRecentlyUsed = std::min_element(entries.begin(),
+                                                  entries.end(),
+                                                  [](const auto& a, const auto& b)
+                                                  { return a.second.lastUse < b.second.lastUse; });
+        std::error_code error;
+        std::filesystem::remove(GetBlobPath(leastRecentlyUsed->first), error);
+        statistics.size -= leastRecentlyUsed->second.size;
+        ++statistics.evictions;
+        entries.erase(leastRecentlyUsed);
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+
+#include "MappedFile.h"
+
+/**
+ * On-disk key-value store backing the blob cache of Dawn, in which it keeps compiled shaders
+ * and backend pipeline caches. Each blob is a versioned file of a cache directory whose total
+ * size is bounded, the least recently used blobs being evicted first. Later launches then
+ * skip the backend shader compilation. Dawn may call the cache from any thread.
+ */
+class PipelineCache
+{
+public:
+    struct Statistics
+    {
+        uint32_t hits      = 0;
+        uint32_t misses    = 0;
+        uint32_t stores    = 0;
+        uint32_t evictions = 0;
+        // Bytes of all the blobs in the directory
+        uint64_t size = 0;
+    };
+
+    /**
+     * Use directory for the cache, creating it if needed. Blobs that are invalid or written
+     * by another version are removed, and the least recently used ones are evicted until
+     * the cache fits in maxSize bytes.
+     */
+    bool Initialize(const std::filesystem::path& directory, uint64_t maxSize);
+
+#ifndef __EMSCRIPTEN__
+    // Route the blob cache of the device created with cacheDesc to this cache
+    void Attach(wgpu::DawnCacheDeviceDescriptor& cacheDesc);
+#endif
+
+    Statistics GetStatistics() const;
+
+private:
+    struct Header;
+
+    struct Entry
+    {
+        uint64_t size;
+        // Order of the last use, higher is more recent
+        uint64_t lastUse;
+    };
+
+    static size_t LoadData(const void* key,
+                           size_t keySize,
+                           void* value,
+                           size_t valueSize,
+                           void* userdata);
+    static void StoreData(const void* key,
+                          size_t keySize,
+                          const void* value,
+                          size_t valueSize,
+                          void* userdata);
+
+    /**
+     * Dawn first asks for the size of a blob with a null value, then for its content.
+     * Return the size of the blob, or 0 when it is missing.
+     */
+    size_t Load(const void* key, size_t keySize, void* value, size_t valueSize);
+    void Store(const void* key, size_t keySize, const void* value, size_t valueSize);
+
+    /**
+     * Map the blob at path and get its value if it was stored for key. The value is only
+     * checked against its hash when checkValue is set.
+     */
+    bool ReadBlob(const std::filesystem::path& path,
+                  std::span<const unsigned char> key,
+                  bool checkValue,
+                  MappedFile& file,
+                  std::span<const unsigned char>& value) const;
+
+    std::filesystem::path GetBlobPath(uint64_t keyHash) const;
+
+    // Remove the least recently used blobs until the cache fits, the mutex must be held
+    void Evict();
+
+    std::filesystem::path directory;
+    uint64_t maxSize = 0;
+
+    mutable std::mutex mutex;
+    // Blobs in the directory, by hash of their key
+    std::unordered_map<uint64_t, Entry> entries;
+    uint64_t useCounter = 0;
+    Statistics statistics;
+};
@@ -2,19 +2,133 @@
 
 #include <algorithm>
 #include <bit>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <limits>
+#include <span>
 #include <sstream>
 #include <string>
-
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
+#include <unordered_map>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #include "Application.h"
+#include "GpuMipMapGenerator.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MipMapGenerator.h"
+#include "ObjParser.h"
+#include "TangentSpace.h"
 #include "WebGPUUtils.h"
 
+// Size of the FIFO post-transform cache the optimizer targets
+constexpr uint32_t kVertexCacheSize = 16;
+// How much ACMR the overdraw optimizer may trade for a better triangle order
+constexpr float kOverdrawThreshold = 1.05f;
+// Limits of a meshlet, those of common mesh shader hardware. Small meshlets have narrow normal
+// cones and tight bounds, at the cost of more of them to cull.
+constexpr uint32_t kMeshletMaxVertices  = 64;
+constexpr uint32_t kMeshletMaxTriangles = 124;
+// Meshlets whose normals spread wider than this dot product with their axis are never back-facing
+constexpr float kMeshletMinConeDot = 0.1f;
+// Each level of detail targets half the triangles of the previous one, the chain ending when
+// simplification keeps more than this fraction of them, held back by seams and borders
+constexpr float kLodMaxKeptRatio = 0.85f;
+// Accumulate tangent frames over the triangles sharing each welded vertex, rather than
+// using one frame per triangle corner which keeps most corners from being welded
+constexpr bool kSmoothTangentFrames = true;
+
+namespace
+{
+    // Rows of a buffer copied into a texture are aligned to this many bytes
+    constexpr uint32_t kBytesPerRowAlignment = 256;
+
+    uint32_t AlignUp(uint32_t value, uint32_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    uint16_t FloatToHalf(float value)
+    {
+        uint32_t bits     = std::bit_cast<uint32_t>(value);
+        uint32_t sign     = (bits >> 16) & 0x8000;
+        uint32_t mantissa = bits & 0x7FFFFF;
+        int32_t exponent  = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+
+        if (((bits >> 23) & 0xFF) == 0xFF)
+        {
+            // Infinity or NaN
+            return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+        }
+        if (exponent >= 31)
+        {
+            // Overflow to infinity
+            return static_cast<uint16_t>(sign | 0x7C00);
+        }
+        if (exponent <= 0)
+        {
+            // Subnormal half, or zero when too small
+            if (exponent < -10)
+            {
+                return static_cast<uint16_t>(sign);
+            }
+            mantissa |= 0x800000;
+            uint32_t shift     = 14 - exponent;
+            uint32_t half      = mantissa >> shift;
+            uint32_t remainder = mantissa & ((1u << shift) - 1);
+            uint32_t halfway   = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half & 1)))
+            {
+                ++half;
+            }
+            return static_cast<uint16_t>(sign | half);
+        }
+
+        // Round to nearest even, a carry into the exponent is still correct
+        uint32_t half      = sign | (exponent << 10) | (mantissa >> 13);
+        uint32_t remainder = mantissa & 0x1FFF;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        {
+            ++half;
+        }
+        return static_cast<uint16_t>(half);
+    }
+
+    int16_t FloatToSnorm16(float value)
+    {
+        return static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    uint16_t FloatToUnorm16(float value)
+    {
+        return static_cast<uint16_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+    }
+
+    uint8_t FloatToUnorm8(float value)
+    {
+        return static_cast<uint8_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+    }
+
+    /**
+     * Map a unit vector onto the [-1, 1] square by projecting it on an octahedron
+     */
+    glm::vec2 EncodeOctahedral(glm::vec3 n)
+    {
+        n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (n.z >= 0.0f)
+        {
+            return {n.x, n.y};
+        }
+        return {
+            (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f),
+        };
+    }
+}  // namespace
+
 bool ResourceManager::LoadGeometry(const std::filesystem::path& path,
                                    std::vector<float>& pointData,
                                    std::vector<uint16_t>& indexData,
@@ -86,71 +200,439 @@ bool ResourceManager::LoadGeometry(const std::filesystem::path& path,
     return true;
 }
 
-bool ResourceManager::LoadGeometryFromObj(const std::filesystem::path& path,
-                                          std::vector<VertexAttributes>& vertexData)
+bool ResourceManager::LoadMesh(const std::filesystem::path& path,
+                               VertexFormat vertexFormat,
+                               MeshCache& mesh)
 {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
+    std::filesystem::path cachePath = path;
+    cachePath.replace_extension(".meshcache");
+    if (mesh.Open(cachePath, path, vertexFormat))
+    {
+        return true;
+    }
 
-    std::string warn;
-    std::string err;
+    MappedFile file;
+    AssetSource::Stamp source;
+    if (!file.Open(path) || !AssetSource::GetStamp(path, source))
+    {
+        return false;
+    }
+    return BuildMesh({file.GetData(), file.GetSize()}, source, cachePath, vertexFormat, mesh);
+}
 
-    bool result =
-        tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.string().c_str());
+bool ResourceManager::LoadMesh(std::span<const unsigned char> objData,
+                               const AssetSource::Stamp& source,
+                               const std::filesystem::path& cachePath,
+                               VertexFormat vertexFormat,
+                               MeshCache& mesh)
+{
+    if (mesh.Open(cachePath, source, vertexFormat))
+    {
+        return true;
+    }
+    return BuildMesh(objData, source, cachePath, vertexFormat, mesh);
+}
 
-    if (!warn.empty())
+bool ResourceManager::BuildMesh(std::span<const unsigned char> objData,
+                                const AssetSource::Stamp& source,
+                                const std::filesystem::path& cachePath,
+                                VertexFormat vertexFormat,
+                                MeshCache& mesh)
+{
+    std::vector<VertexAttributes> vertexData;
+    std::vector<uint32_t> indexData;
+    if (!LoadGeometryFromObj(objData, vertexData, indexData))
     {
-        SDL_Log("%s", warn.c_str());
+        return false;
     }
-    if (!err.empty())
+
+    // All shapes are merged and reordered together, so the mesh has a single submesh
+    MeshSubmesh submesh;
+    submesh.firstIndex = 0;
+    submesh.indexCount = static_cast<uint32_t>(indexData.size());
+    submesh.boundsMin  = glm::vec3(std::numeric_limits<float>::max());
+    submesh.boundsMax  = glm::vec3(std::numeric_limits<float>::lowest());
+    for (const VertexAttributes& vertex : vertexData)
     {
-        SDL_Log("%s", err.c_str());
+        submesh.boundsMin = glm::min(submesh.boundsMin, vertex.position);
+        submesh.boundsMax = glm::max(submesh.boundsMax, vertex.position);
     }
 
-    if (!result)
+    glm::vec3 positionScale(1.0f);
+    glm::vec3 positionOffset(0.0f);
+    std::span<const unsigned char> vertexBytes(
+        reinterpret_cast<const unsigned char*>(vertexData.data()),
+        vertexData.size() * sizeof(VertexAttributes));
+    uint32_t vertexStride = sizeof(VertexAttributes);
+
+    // Meshlets are bounded with the positions the mesh is drawn with, quantized or not
+    std::vector<glm::vec3> positions(vertexData.size());
+    std::vector<PackedVertexAttributes> packedVertexData;
+    if (vertexFormat == VertexFormat::Packed)
+    {
+        PackVertexAttributes(vertexData, packedVertexData, positionScale, positionOffset);
+        vertexBytes  = {reinterpret_cast<const unsigned char*>(packedVertexData.data()),
+                        packedVertexData.size() * sizeof(PackedVertexAttributes)};
+        vertexStride = sizeof(PackedVertexAttributes);
+        for (size_t i = 0; i < packedVertexData.size(); ++i)
+        {
+            const uint16_t* position = packedVertexData[i].position;
+            positions[i] = glm::vec3(position[0], position[1], position[2]) / 65535.0f
+                               * positionScale
+                           + positionOffset;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < vertexData.size(); ++i)
+        {
+            positions[i] = vertexData[i].position;
+        }
+    }
+
+    std::vector<MeshMeshlet> meshlets;
+    BuildMeshlets(positions, indexData, meshlets);
+    std::vector<MeshLod> lods;
+    BuildLods(positions, indexData, lods);
+
+    return mesh.Create(cachePath,
+                       source,
+                       vertexFormat,
+                       vertexBytes,
+                       vertexStride,
+                       indexData,
+                       {submesh},
+                       meshlets,
+                       lods,
+                       positionScale,
+                       positionOffset);
+}
+
+bool ResourceManager::LoadGeometryFromObj(const std::filesystem::path& path,
+                                          std::vector<VertexAttributes>& vertexData,
+                                          std::vector<uint32_t>& indexData)
+{
+    MappedFile file;
+    if (!file.Open(path))
     {
         return false;
     }
+    return LoadGeometryFromObj({file.GetData(), file.GetSize()}, vertexData, indexData);
+}
+
+bool ResourceManager::LoadGeometryFromObj(std::span<const unsigned char> objData,
+                                          std::vector<VertexAttributes>& vertexData,
+                                          std::vector<uint32_t>& indexData)
+{
+    Uint64 startTime = SDL_GetTicksNS();
+
+    if (!ObjParser::ParseObj(reinterpret_cast<const char*>(objData.data()),
+                             objData.size(),
+                             vertexData))
+    {
+        return false;
+    }
+
+    SDL_Log("Parsed %zu bytes of OBJ in %.1f ms",
+            objData.size(),
+            (SDL_GetTicksNS() - startTime) / 1000000.0);
+
+    Uint64 tangentStartTime = SDL_GetTicksNS();
+    if (kSmoothTangentFrames)
+    {
+        WeldVertices(vertexData, indexData);
+        PopulateTextureFrameAttributes(vertexData, indexData);
+    }
+    else
+    {
+        // The tangent frame is computed per triangle, so corners can only be merged afterwards
+        PopulateTextureFrameAttributes(vertexData);
+        WeldVertices(vertexData, indexData);
+    }
+
+    SDL_Log("Welded vertices and computed tangent frames in %.1f ms",
+            (SDL_GetTicksNS() - tangentStartTime) / 1000000.0);
+
+    OptimizeGeometry(vertexData, indexData);
+    return true;
+}
+
+void ResourceManager::WeldVertices(std::vector<VertexAttributes>& vertexData,
+                                   std::vector<uint32_t>& indexData)
+{
+    static_assert(sizeof(VertexAttributes) == 17 * sizeof(float),
+                  "VertexAttributes must not contain padding to be hashed bytewise");
 
-    // Filling in vertexData
-    vertexData.clear();
-    for (const auto& shape : shapes)
+    struct VertexHash
     {
-        size_t offset = vertexData.size();
-        vertexData.resize(offset + shape.mesh.indices.size());
+        size_t operator()(const VertexAttributes& vertex) const
+        {
+            // FNV-1a over the raw bytes of the vertex
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+            uint64_t hash              = 14695981039346656037ull;
+            for (size_t i = 0; i < sizeof(VertexAttributes); ++i)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+            return static_cast<size_t>(hash);
+        }
+    };
 
-        for (size_t i = 0; i < shape.mesh.indices.size(); ++i)
+    struct VertexEqual
+    {
+        bool operator()(const VertexAttributes& a, const VertexAttributes& b) const
         {
-            const tinyobj::index_t& index = shape.mesh.indices[i];
-
-            vertexData[offset + i].position = {
-                attrib.vertices[3 * index.vertex_index + 0],
-                -attrib.vertices[3 * index.vertex_index + 2],  // Add a minus to avoid mirroring
-                attrib.vertices[3 * index.vertex_index + 1],
-            };
-
-            vertexData[offset + i].normal = {
-                attrib.normals[3 * index.normal_index + 0],
-                -attrib.normals[3 * index.normal_index + 2],
-                attrib.normals[3 * index.normal_index + 1],
-            };
-
-            vertexData[offset + i].uv = {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1 - attrib.texcoords[2 * index.texcoord_index + 1],
-            };
-
-            vertexData[offset + i].color = {
-                attrib.colors[3 * index.vertex_index + 0],
-                attrib.colors[3 * index.vertex_index + 1],
-                attrib.colors[3 * index.vertex_index + 2],
-            };
+            return memcmp(&a, &b, sizeof(VertexAttributes)) == 0;
         }
+    };
+
+    std::unordered_map<VertexAttributes, uint32_t, VertexHash, VertexEqual> uniqueVertices;
+    uniqueVertices.reserve(vertexData.size());
+
+    indexData.clear();
+    indexData.reserve(vertexData.size());
+
+    // Compact unique vertices in place, they are always written at or before the read position
+    size_t uniqueCount = 0;
+    for (size_t i = 0; i < vertexData.size(); ++i)
+    {
+        auto [it, inserted] =
+            uniqueVertices.try_emplace(vertexData[i], static_cast<uint32_t>(uniqueCount));
+        if (inserted)
+        {
+            vertexData[uniqueCount++] = vertexData[i];
+        }
+        indexData.push_back(it->second);
     }
 
-    PopulateTextureFrameAttributes(vertexData);
-    return true;
+    vertexData.resize(uniqueCount);
+    vertexData.shrink_to_fit();
+}
+
+void ResourceManager::OptimizeGeometry(std::vector<VertexAttributes>& vertexData,
+                                       std::vector<uint32_t>& indexData)
+{
+    if (vertexData.empty())
+    {
+        return;
+    }
+
+    MeshOptimizer::VertexCacheStatistics before =
+        MeshOptimizer::AnalyzeVertexCache(indexData, vertexData.size(), kVertexCacheSize);
+
+    std::vector<uint32_t> clusters;
+    MeshOptimizer::OptimizeVertexCache(indexData, vertexData.size(), kVertexCacheSize, &clusters);
+    MeshOptimizer::OptimizeOverdraw(indexData,
+                                    clusters,
+                                    &vertexData[0].position.x,
+                                    sizeof(VertexAttributes),
+                                    vertexData.size(),
+                                    kVertexCacheSize,
+                                    kOverdrawThreshold);
+
+    // Lay out vertices in the order they are first referenced
+    std::vector<uint32_t> remap;
+    size_t vertexCount = MeshOptimizer::OptimizeVertexFetch(indexData, remap, vertexData.size());
+    std::vector<VertexAttributes> remappedVertexData(vertexCount);
+    for (size_t i = 0; i < vertexData.size(); ++i)
+    {
+        if (remap[i] != UINT32_MAX)
+        {
+            remappedVertexData[remap[i]] = vertexData[i];
+        }
+    }
+    vertexData = std::move(remappedVertexData);
+
+    MeshOptimizer::VertexCacheStatistics after =
+        MeshOptimizer::AnalyzeVertexCache(indexData, vertexData.size(), kVertexCacheSize);
+
+    SDL_Log("Vertex cache optimization (FIFO %u):", kVertexCacheSize);
+    SDL_Log(" - ACMR: %.3f -> %.3f", before.acmr, after.acmr);
+    SDL_Log(" - ATVR: %.3f -> %.3f", before.atvr, after.atvr);
+}
+
+void ResourceManager::BuildMeshlets(std::span<const glm::vec3> positions,
+                                    std::vector<uint32_t>& indexData,
+                                    std::vector<MeshMeshlet>& meshlets)
+{
+    meshlets.clear();
+    if (positions.empty())
+    {
+        return;
+    }
+
+    Uint64 startTime = SDL_GetTicksNS();
+
+    std::vector<MeshOptimizer::MeshletRange> ranges =
+        MeshOptimizer::BuildMeshlets(indexData,
+                                     &positions[0].x,
+                                     sizeof(glm::vec3),
+                                     positions.size(),
+                                     kMeshletMaxVertices,
+                                     kMeshletMaxTriangles,
+                                     kVertexCacheSize);
+
+    uint32_t conelessCount = 0;
+    for (const MeshOptimizer::MeshletRange& range : ranges)
+    {
+        std::span<const uint32_t> indices(indexData.data() + 3 * range.firstTriangle,
+                                          3 * range.triangleCount);
+
+        // Sphere around the bounding box of the vertices
+        glm::vec3 boundsMin(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+        for (uint32_t index : indices)
+        {
+            boundsMin = glm::min(boundsMin, positions[index]);
+            boundsMax = glm::max(boundsMax, positions[index]);
+        }
+        glm::vec3 center = 0.5f * (boundsMin + boundsMax);
+        float radius     = 0.0f;
+        for (uint32_t index : indices)
+        {
+            radius = std::max(radius, glm::length(positions[index] - center));
+        }
+
+        // Cone around the average normal, as wide as the farthest normal from it
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis(0.0f);
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            glm::vec3 p0 = positions[indices[i + 0]];
+            glm::vec3 p1 = positions[indices[i + 1]];
+            glm::vec3 p2 = positions[indices[i + 2]];
+            glm::vec3 n  = glm::cross(p1 - p0, p2 - p0);
+            if (glm::length(n) > 0.0f)
+            {
+                normals.push_back(glm::normalize(n));
+                axis += normals.back();
+            }
+        }
+        float minDot = -1.0f;
+        if (glm::length(axis) > 0.0f)
+        {
+            axis   = glm::normalize(axis);
+            minDot = 1.0f;
+            for (const glm::vec3& normal : normals)
+            {
+                minDot = std::min(minDot, glm::dot(normal, axis));
+            }
+        }
+        float cutoff = 1.0f;
+        if (minDot > kMeshletMinConeDot)
+        {
+            cutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+        else
+        {
+            ++conelessCount;
+        }
+
+        MeshMeshlet& meshlet   = meshlets.emplace_back();
+        meshlet.boundingSphere = glm::vec4(center, radius);
+        meshlet.normalCone     = glm::vec4(axis, cutoff);
+        meshlet.firstIndex     = 3 * range.firstTriangle;
+        meshlet.triangleCount  = range.triangleCount;
+    }
+
+    SDL_Log("Built %zu meshlets in %.1f ms, %u of them too curved to be back-facing",
+            meshlets.size(),
+            (SDL_GetTicksNS() - startTime) / 1000000.0,
+            conelessCount);
+}
+
+void ResourceManager::BuildLods(std::span<const glm::vec3> positions,
+                                std::vector<uint32_t>& indexData,
+                                std::vector<MeshLod>& lods)
+{
+    Uint64 startTime = SDL_GetTicksNS();
+
+    lods.assign(1, {0, static_cast<uint32_t>(indexData.size()), 0.0f, 0});
+    std::vector<uint32_t> lodIndices(indexData);
+    while (lods.size() < kMaxMeshLodCount && !positions.empty())
+    {
+        // Each level simplifies the previous one, so their errors add up
+        float error = 0.0f;
+        std::vector<uint32_t> simplified =
+            MeshOptimizer::SimplifyMesh(lodIndices,
+                                        &positions[0].x,
+                                        sizeof(glm::vec3),
+                                        positions.size(),
+                                        lodIndices.size() / 6 * 3,
+                                        std::numeric_limits<float>::max(),
+                                        &error);
+        if (simplified.empty() || simplified.size() > kLodMaxKeptRatio * lodIndices.size())
+        {
+            break;
+        }
+
+        MeshOptimizer::OptimizeVertexCache(simplified, positions.size(), kVertexCacheSize);
+        lods.push_back({static_cast<uint32_t>(indexData.size()),
+                        static_cast<uint32_t>(simplified.size()),
+                        lods.back().error + error,
+                        0});
+        indexData.insert(indexData.end(), simplified.begin(), simplified.end());
+        lodIndices = std::move(simplified);
+    }
+
+    SDL_Log("Built %zu levels of detail in %.1f ms, down to %u triangles with an error of %g",
+            lods.size(),
+            (SDL_GetTicksNS() - startTime) / 1000000.0,
+            lods.back().indexCount / 3,
+            lods.back().error);
+}
+
+void ResourceManager::PackVertexAttributes(const std::vector<VertexAttributes>& vertexData,
+                                           std::vector<PackedVertexAttributes>& packedVertexData,
+                                           glm::vec3& positionScale,
+                                           glm::vec3& positionOffset)
+{
+    // Quantize positions within the bounding box of the mesh
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+    for (const VertexAttributes& vertex : vertexData)
+    {
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+    positionOffset = vertexData.empty() ? glm::vec3(0.0f) : boundsMin;
+    positionScale  = vertexData.empty() ? glm::vec3(1.0f) : boundsMax - boundsMin;
+    for (int k = 0; k < 3; ++k)
+    {
+        if (positionScale[k] <= 0.0f)
+        {
+            positionScale[k] = 1.0f;
+        }
+    }
+
+    packedVertexData.resize(vertexData.size());
+    for (size_t i = 0; i < vertexData.size(); ++i)
+    {
+        const VertexAttributes& vertex = vertexData[i];
+        PackedVertexAttributes& packed = packedVertexData[i];
+
+        glm::vec3 position = (vertex.position - positionOffset) / positionScale;
+        packed.position[0] = FloatToUnorm16(position.x);
+        packed.position[1] = FloatToUnorm16(position.y);
+        packed.position[2] = FloatToUnorm16(position.z);
+        packed.position[3] = 0;
+
+        glm::vec2 normal  = EncodeOctahedral(vertex.normal);
+        glm::vec2 tangent = EncodeOctahedral(vertex.tangent);
+        packed.normal[0]  = FloatToSnorm16(normal.x);
+        packed.normal[1]  = FloatToSnorm16(normal.y);
+        packed.tangent[0] = FloatToSnorm16(tangent.x);
+        packed.tangent[1] = FloatToSnorm16(tangent.y);
+
+        packed.color[0] = FloatToUnorm8(vertex.color.r);
+        packed.color[1] = FloatToUnorm8(vertex.color.g);
+        packed.color[2] = FloatToUnorm8(vertex.color.b);
+        packed.color[3] = 255;
+
+        packed.uv[0] = FloatToHalf(vertex.uv.x);
+        packed.uv[1] = FloatToHalf(vertex.uv.y);
+    }
 }
 
 wgpu::ShaderModule ResourceManager::LoadShaderModule(const std::filesystem::path& path,
@@ -167,10 +649,20 @@ wgpu::ShaderModule ResourceManager::LoadShaderModule(const std::filesystem::path
     file.seekg(0);
     file.read(shaderSource.data(), size);
 
+    std::span<const unsigned char> shaderBytes(
+        reinterpret_cast<const unsigned char*>(shaderSource.data()),
+        size);
+    return LoadShaderModule(shaderBytes, device);
+}
+
+wgpu::ShaderModule ResourceManager::LoadShaderModule(std::span<const unsigned char> shaderSource,
+                                                     wgpu::Device device)
+{
     wgpu::ShaderSourceWGSL shaderCodeDesc {};
     shaderCodeDesc.nextInChain = nullptr;
     shaderCodeDesc.sType       = wgpu::SType::ShaderSourceWGSL;
-    shaderCodeDesc.code        = WebGPUUtils::GenerateString(shaderSource.c_str());
+    shaderCodeDesc.code        = {reinterpret_cast<const char*>(shaderSource.data()),
+                                  shaderSource.size()};
 
     wgpu::ShaderModuleDescriptor shaderDesc {};
     shaderDesc.nextInChain = &shaderCodeDesc;
@@ -182,7 +674,9 @@ wgpu::ShaderModule ResourceManager::LoadShaderModule(const std::filesystem::path
 
 wgpu::Texture ResourceManager::LoadTexture(const std::filesystem::path& path,
                                            wgpu::Device device,
-                                           wgpu::TextureView* pTextureView)
+                                           wgpu::TextureView* pTextureView,
+                                           bool isSrgb,
+                                           const GpuMipMapGenerator* gpuMipMapGenerator)
 {
     int width, height, channels;
     unsigned char* pixelData =
@@ -193,24 +687,88 @@ wgpu::Texture ResourceManager::LoadTexture(const std::filesystem::path& path,
         return nullptr;
     }
 
+    wgpu::Texture texture = CreateTexture(pixelData,
+                                          width,
+                                          height,
+                                          device,
+                                          pTextureView,
+                                          isSrgb,
+                                          gpuMipMapGenerator);
+    stbi_image_free(pixelData);
+    return texture;
+}
+
+wgpu::Texture ResourceManager::LoadTexture(std::span<const unsigned char> imageData,
+                                           wgpu::Device device,
+                                           wgpu::TextureView* pTextureView,
+                                           bool isSrgb,
+                                           const GpuMipMapGenerator* gpuMipMapGenerator)
+{
+    int width, height, channels;
+    unsigned char* pixelData = stbi_load_from_memory(imageData.data(),
+                                                     static_cast<int>(imageData.size()),
+                                                     &width,
+                                                     &height,
+                                                     &channels,
+                                                     4 /* force 4 channels */);
+
+    if (pixelData == nullptr)
+    {
+        return nullptr;
+    }
+
+    wgpu::Texture texture = CreateTexture(pixelData,
+                                          width,
+                                          height,
+                                          device,
+                                          pTextureView,
+                                          isSrgb,
+                                          gpuMipMapGenerator);
+    stbi_image_free(pixelData);
+    return texture;
+}
+
+wgpu::Texture ResourceManager::CreateTexture(const unsigned char* pixelData,
+                                             uint32_t width,
+                                             uint32_t height,
+                                             wgpu::Device device,
+                                             wgpu::TextureView* pTextureView,
+                                             bool isSrgb,
+                                             const GpuMipMapGenerator* gpuMipMapGenerator)
+{
     wgpu::TextureDescriptor textureDesc;
     textureDesc.nextInChain = nullptr;
     textureDesc.label       = WebGPUUtils::GenerateString("Texture");
     textureDesc.dimension   = wgpu::TextureDimension::e2D;
     textureDesc.format      = wgpu::TextureFormat::RGBA8Unorm;
-    textureDesc.size        = {(unsigned int)width, (unsigned int)height, 1};
+    textureDesc.size        = {width, height, 1};
     textureDesc.mipLevelCount =
         std::bit_width(std::max(textureDesc.size.width, textureDesc.size.height));
     textureDesc.sampleCount     = 1;
     textureDesc.usage           = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopyDst;
     textureDesc.viewFormatCount = 0;
     textureDesc.viewFormats     = nullptr;
-    wgpu::Texture texture       = device.CreateTexture(&textureDesc);
-
-    // Upload data to the GPU texture (to be implemented!)
-    WriteMipMaps(device, texture, textureDesc.size, textureDesc.mipLevelCount, pixelData);
+    if (gpuMipMapGenerator)
+    {
+        textureDesc.usage |= wgpu::TextureUsage::StorageBinding;
+    }
+    wgpu::Texture texture = device.CreateTexture(&textureDesc);
 
-    stbi_image_free(pixelData);
+    // Upload data to the GPU texture
+    if (gpuMipMapGenerator)
+    {
+        WriteMipMaps(device, texture, textureDesc.size, 1, pixelData, isSrgb);
+        gpuMipMapGenerator->Generate(texture, isSrgb);
+    }
+    else
+    {
+        WriteMipMaps(device,
+                     texture,
+                     textureDesc.size,
+                     textureDesc.mipLevelCount,
+                     pixelData,
+                     isSrgb);
+    }
 
     if (pTextureView)
     {
@@ -233,130 +791,81 @@ wgpu::Texture ResourceManager::LoadTexture(const std::filesystem::path& path,
 
 void ResourceManager::PopulateTextureFrameAttributes(std::vector<VertexAttributes>& vertexData)
 {
-    size_t triangleCount = vertexData.size() / 3;
-    // We compute the local texture frame per triangle
-    for (int t = 0; t < triangleCount; ++t)
-    {
-        VertexAttributes* v = &vertexData[3 * t];
-
-        // We assign these to the 3 corners of the triangle
-        for (int k = 0; k < 3; ++k)
-        {
-            glm::mat3x3 TBN = ComputeTBN(v, v[k].normal);
-            v[k].tangent    = TBN[0];
-            v[k].bitangent  = TBN[1];
-        }
-    }
+    TangentSpace::ComputePerTriangle(vertexData);
 }
 
-glm::mat3x3 ResourceManager::ComputeTBN(const VertexAttributes corners[3],
-                                        const glm::vec3& expectedN)
+void ResourceManager::PopulateTextureFrameAttributes(std::vector<VertexAttributes>& vertexData,
+                                                     const std::vector<uint32_t>& indexData)
 {
-    // What we call e in the figure
-    glm::vec3 ePos1 = corners[1].position - corners[0].position;
-    glm::vec3 ePos2 = corners[2].position - corners[0].position;
-
-    // What we call \bar e in the figure
-    glm::vec2 eUV1 = corners[1].uv - corners[0].uv;
-    glm::vec2 eUV2 = corners[2].uv - corners[0].uv;
-
-    glm::vec3 T = normalize(ePos1 * eUV2.y - ePos2 * eUV1.y);
-    glm::vec3 B = normalize(ePos2 * eUV1.x - ePos1 * eUV2.x);
-    glm::vec3 N = glm::cross(T, B);
-
-    // Fix overall orientation
-    if (glm::dot(N, expectedN) < 0.0)
-    {
-        T = -T;
-        B = -B;
-        N = -N;
-    }
-
-    // Ortho-normalize the (T, B, expectedN) frame
-    // a. "Remove" the part of T that is along expected N
-    N = expectedN;
-    T = glm::normalize(T - glm::dot(T, N) * N);
-    // b. Recompute B from N and T
-    B = glm::cross(N, T);
-
-    return glm::mat3x3(T, B, N);
+    TangentSpace::ComputePerVertex(vertexData, indexData);
 }
 
 void ResourceManager::WriteMipMaps(wgpu::Device device,
                                    wgpu::Texture texture,
                                    wgpu::Extent3D textureSize,
                                    uint32_t mipLevelCount,
-                                   const unsigned char* pixelData)
+                                   const unsigned char* pixelData,
+                                   bool isSrgb)
 {
-    wgpu::Queue queue = device.GetQueue();
+    // Level 0 is uploaded from pixelData, the others all live in a single arena
+    std::vector<unsigned char> arena;
+    std::vector<MipMapGenerator::MipLevel> levels = MipMapGenerator::Generate(pixelData,
+                                                                              textureSize.width,
+                                                                              textureSize.height,
+                                                                              mipLevelCount,
+                                                                              isSrgb,
+                                                                              arena);
+
+    // Lay out the levels in a single staging buffer, their rows padded to the copy alignment
+    std::vector<uint64_t> levelOffsets;
+    uint64_t stagingSize = 0;
+    for (const MipMapGenerator::MipLevel& mipLevel : levels)
+    {
+        uint32_t bytesPerRow = AlignUp(4 * mipLevel.width, kBytesPerRowAlignment);
+        levelOffsets.push_back(stagingSize);
+        stagingSize += uint64_t(bytesPerRow) * mipLevel.height;
+    }
+
+    // The levels are written into the mapped buffer, then copied into the texture by the GPU,
+    // instead of going through the staging memory of Queue::WriteTexture
+    wgpu::Buffer stagingBuffer =
+        WebGPUUtils::CreateMappedBuffer(device,
+                                        "Texture staging buffer",
+                                        wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::CopySrc,
+                                        stagingSize);
+    auto* stagingData = static_cast<unsigned char*>(stagingBuffer.GetMappedRange());
+
+    wgpu::TexelCopyBufferInfo source;
+    source.buffer = stagingBuffer;
 
-    // Arguments telling which part of the texture we upload to
     wgpu::TexelCopyTextureInfo destination;
     destination.texture = texture;
     destination.origin  = {0, 0, 0};
     destination.aspect  = wgpu::TextureAspect::All;
 
-    // Arguments telling how the C++ side pixel memory is laid out
-    wgpu::TexelCopyBufferLayout source;
-    source.offset = 0;
-
-    // Create image data
-    wgpu::Extent3D mipLevelSize = textureSize;
-    std::vector<unsigned char> previousLevelPixels;
-    wgpu::Extent3D previousMipLevelSize;
-    for (uint32_t level = 0; level < mipLevelCount; ++level)
+    wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
+    for (uint32_t level = 0; level < levels.size(); ++level)
     {
-        // Pixel data for the current level
-        std::vector<unsigned char> pixels(4 * mipLevelSize.width * mipLevelSize.height);
-        if (level == 0)
+        const MipMapGenerator::MipLevel& mipLevel = levels[level];
+        uint32_t rowSize                          = 4 * mipLevel.width;
+        uint32_t bytesPerRow                      = AlignUp(rowSize, kBytesPerRowAlignment);
+        unsigned char* stagedData                 = stagingData + levelOffsets[level];
+        for (uint32_t row = 0; row < mipLevel.height; ++row)
         {
-            // We cannot really avoid this copy since we need this
-            // in previousLevelPixels at the next iteration
-            memcpy(pixels.data(), pixelData, pixels.size());
+            memcpy(stagedData + size_t(row) * bytesPerRow,
+                   mipLevel.data + size_t(row) * rowSize,
+                   rowSize);
         }
-        else
-        {
-            // Create mip level data
-            for (uint32_t i = 0; i < mipLevelSize.width; ++i)
-            {
-                for (uint32_t j = 0; j < mipLevelSize.height; ++j)
-                {
-                    unsigned char* p = &pixels[4 * (j * mipLevelSize.width + i)];
-                    // Get the corresponding 4 pixels from the previous level
-                    unsigned char* p00 =
-                        &previousLevelPixels[4
-                                             * ((2 * j + 0) * previousMipLevelSize.width
-                                                + (2 * i + 0))];
-                    unsigned char* p01 =
-                        &previousLevelPixels[4
-                                             * ((2 * j + 0) * previousMipLevelSize.width
-                                                + (2 * i + 1))];
-                    unsigned char* p10 =
-                        &previousLevelPixels[4
-                                             * ((2 * j + 1) * previousMipLevelSize.width
-                                                + (2 * i + 0))];
-                    unsigned char* p11 =
-                        &previousLevelPixels[4
-                                             * ((2 * j + 1) * previousMipLevelSize.width
-                                                + (2 * i + 1))];
-                    // Average
-                    p[0] = (p00[0] + p01[0] + p10[0] + p11[0]) / 4;
-                    p[1] = (p00[1] + p01[1] + p10[1] + p11[1]) / 4;
-                    p[2] = (p00[2] + p01[2] + p10[2] + p11[2]) / 4;
-                    p[3] = (p00[3] + p01[3] + p10[3] + p11[3]) / 4;
-                }
-            }
-        }
-
-        // Upload data to the GPU texture
-        destination.mipLevel = level;
-        source.bytesPerRow   = 4 * mipLevelSize.width;
-        source.rowsPerImage  = mipLevelSize.height;
-        queue.WriteTexture(&destination, pixels.data(), pixels.size(), &source, &mipLevelSize);
 
-        previousLevelPixels  = std::move(pixels);
-        previousMipLevelSize = mipLevelSize;
-        mipLevelSize.width /= 2;
-        mipLevelSize.height /= 2;
+        wgpu::Extent3D mipLevelSize = {mipLevel.width, mipLevel.height, 1};
+        source.layout.offset        = levelOffsets[level];
+        source.layout.bytesPerRow   = bytesPerRow;
+        source.layout.rowsPerImage  = mipLevel.height;
+        destination.mipLevel        = level;
+        encoder.CopyBufferToTexture(&source, &destination, &mipLevelSize);
     }
+    stagingBuffer.Unmap();
+
+    wgpu::CommandBuffer commands = encoder.Finish();
+    device.GetQueue().Submit(1, &commands);
 }
@@ -2,11 +2,19 @@
 
 #include <webgpu/webgpu_cpp.h>
 #include <filesystem>
-#include <glm/mat3x3.hpp>
 #include <glm/vec3.hpp>
+#include <span>
 #include <vector>
 
+#include "AssetSource.h"
+
 struct VertexAttributes;
+struct PackedVertexAttributes;
+struct MeshLod;
+struct MeshMeshlet;
+enum class VertexFormat;
+class MeshCache;
+class GpuMipMapGenerator;
 
 class ResourceManager
 {
@@ -16,28 +24,129 @@ public:
                              std::vector<uint16_t>& indexData,
                              int dimensions);
 
+    /**
+     * Load a mesh ready for upload in the given vertex format, from its binary cache when
+     * it is up to date, or else from the OBJ file, in which case the cache is rebuilt
+     */
+    static bool LoadMesh(const std::filesystem::path& path,
+                         VertexFormat vertexFormat,
+                         MeshCache& mesh);
+
+    /**
+     * Same as above for OBJ data already in memory, e.g. a packed asset, whose content is
+     * identified by source. The OBJ data is only read when the cache at cachePath is outdated.
+     */
+    static bool LoadMesh(std::span<const unsigned char> objData,
+                         const AssetSource::Stamp& source,
+                         const std::filesystem::path& cachePath,
+                         VertexFormat vertexFormat,
+                         MeshCache& mesh);
+
     static bool LoadGeometryFromObj(const std::filesystem::path& path,
-                                    std::vector<VertexAttributes>& vertexData);
+                                    std::vector<VertexAttributes>& vertexData,
+                                    std::vector<uint32_t>& indexData);
+
+    static bool LoadGeometryFromObj(std::span<const unsigned char> objData,
+                                    std::vector<VertexAttributes>& vertexData,
+                                    std::vector<uint32_t>& indexData);
 
     static wgpu::ShaderModule LoadShaderModule(const std::filesystem::path& path,
                                                wgpu::Device device);
 
+    static wgpu::ShaderModule LoadShaderModule(std::span<const unsigned char> shaderSource,
+                                               wgpu::Device device);
+
+    /**
+     * Load an image as an RGBA8 texture with its full mip chain. Set isSrgb for color
+     * textures so that mip levels are averaged in linear space. With a gpuMipMapGenerator,
+     * only level 0 is uploaded and the other levels are computed on the GPU.
+     */
     static wgpu::Texture LoadTexture(const std::filesystem::path& path,
                                      wgpu::Device device,
-                                     wgpu::TextureView* pTextureView = nullptr);
+                                     wgpu::TextureView* pTextureView               = nullptr,
+                                     bool isSrgb                                   = false,
+                                     const GpuMipMapGenerator* gpuMipMapGenerator = nullptr);
 
-private:
-    static void PopulateTextureFrameAttributes(std::vector<VertexAttributes>& vertexData);
+    // Same as above for an encoded image already in memory, e.g. a packed asset
+    static wgpu::Texture LoadTexture(std::span<const unsigned char> imageData,
+                                     wgpu::Device device,
+                                     wgpu::TextureView* pTextureView               = nullptr,
+                                     bool isSrgb                                   = false,
+                                     const GpuMipMapGenerator* gpuMipMapGenerator = nullptr);
+
+    /**
+     * Merge vertices whose attributes are bitwise identical into a unique vertex table
+     * and emit the index buffer that references it
+     */
+    static void WeldVertices(std::vector<VertexAttributes>& vertexData,
+                             std::vector<uint32_t>& indexData);
 
     /**
-	 * Compute the TBN local to a triangle face from its corners and return it as
-	 * a matrix whose columns are the T, B and N vectors
-	 */
-    static glm::mat3x3 ComputeTBN(const VertexAttributes corners[3], const glm::vec3& expectedN);
+     * Reorder triangles for post-transform vertex cache locality, then for overdraw,
+     * and finally reorder vertices so that the vertex buffer is fetched linearly
+     */
+    static void OptimizeGeometry(std::vector<VertexAttributes>& vertexData,
+                                 std::vector<uint32_t>& indexData);
 
+    /**
+     * Split indexed geometry into meshlets of at most 64 vertices and 124 triangles, reordering
+     * the triangles so that each meshlet is a contiguous range of indexData. Their bounding
+     * spheres and normal cones are computed from positions, those the mesh is drawn with.
+     */
+    static void BuildMeshlets(std::span<const glm::vec3> positions,
+                              std::vector<uint32_t>& indexData,
+                              std::vector<MeshMeshlet>& meshlets);
+
+    /**
+     * Append coarser levels of detail of indexed geometry to indexData, each with about half
+     * the triangles of the previous one, simplified on positions while keeping the vertices
+     * and the seams between their attributes. lods receives the finest level, the whole of
+     * indexData on entry, followed by the others.
+     */
+    static void BuildLods(std::span<const glm::vec3> positions,
+                          std::vector<uint32_t>& indexData,
+                          std::vector<MeshLod>& lods);
+
+    /**
+     * Convert vertices to the compact PackedVertexAttributes layout. Positions are quantized
+     * within the mesh bounds, and are recovered as position * positionScale + positionOffset.
+     */
+    static void PackVertexAttributes(const std::vector<VertexAttributes>& vertexData,
+                                     std::vector<PackedVertexAttributes>& packedVertexData,
+                                     glm::vec3& positionScale,
+                                     glm::vec3& positionOffset);
+
+    /**
+     * Compute the first mipLevelCount levels of RGBA8 pixels on the CPU and upload them to a
+     * texture with the CopyDst usage, through a single staging buffer
+     */
     static void WriteMipMaps(wgpu::Device device,
                              wgpu::Texture texture,
                              wgpu::Extent3D textureSize,
                              uint32_t mipLevelCount,
-                             const unsigned char* pixelData);
+                             const unsigned char* pixelData,
+                             bool isSrgb);
+
+private:
+    // Process OBJ data and store the result in a new cache
+    static bool BuildMesh(std::span<const unsigned char> objData,
+                          const AssetSource::Stamp& source,
+                          const std::filesystem::path& cachePath,
+                          VertexFormat vertexFormat,
+                          MeshCache& mesh);
+
+    // Create a texture from decoded RGBA8 pixels and upload its mip chain
+    static wgpu::Texture CreateTexture(const unsigned char* pixelData,
+                                       uint32_t width,
+                                       uint32_t height,
+                                       wgpu::Device device,
+                                       wgpu::TextureView* pTextureView,
+                                       bool isSrgb,
+                                       const GpuMipMapGenerator* gpuMipMapGenerator);
+
+    static void PopulateTextureFrameAttributes(std::vector<VertexAttributes>& vertexData);
+
+    static void PopulateTextureFrameAttributes(std::vector<VertexAttributes>& vertexData,
+                                               const std::vector<uint32_t>& indexData);
+
 };
@@ -0,0 +1,140 @@
+#include "Scene.h"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+
+#include "WebGPUUtils.h"
+
+namespace
+{
+    constexpr uint32_t kInitialCapacity = 1024;
+}  // namespace
+
+void Scene::Initialize(wgpu::Device device)
+{
+    this->device = device;
+    CreateInstanceBuffer(kInitialCapacity);
+}
+
+Scene::InstanceId Scene::AddInstance(MeshId mesh, MaterialId material, const glm::mat4x4& transform)
+{
+    InstanceId instance = static_cast<InstanceId>(instances.size());
+    instances.push_back({mesh, material, static_cast<uint32_t>(instanceData.size())});
+    instanceData.push_back({transform});
+    isSorted = false;
+    return instance;
+}
+
+void Scene::SetTransform(InstanceId instance, const glm::mat4x4& transform)
+{
+    uint32_t slot                  = instances[instance].slot;
+    instanceData[slot].modelMatrix = transform;
+    if (dirtyBegin >= dirtyEnd)
+    {
+        dirtyBegin = slot;
+        dirtyEnd   = slot + 1;
+    }
+    else
+    {
+        dirtyBegin = std::min(dirtyBegin, slot);
+        dirtyEnd   = std::max(dirtyEnd, slot + 1);
+    }
+}
+
+void Scene::Clear()
+{
+    instances.clear();
+    instanceData.clear();
+    batches.clear();
+    // So that the next Update reports the batches as changed
+    isSorted   = false;
+    dirtyBegin = 0;
+    dirtyEnd   = 0;
+}
+
+void Scene::SetMaxBatchSize(uint32_t instanceCount)
+{
+    if (instanceCount != maxBatchSize)
+    {
+        maxBatchSize = instanceCount;
+        isSorted     = false;
+    }
+}
+
+bool Scene::Update(wgpu::Queue queue)
+{
+    bool isChanged = !isSorted;
+    if (!isSorted)
+    {
+        SortInstances();
+    }
+
+    if (instanceData.size() * sizeof(InstanceData) > instanceBuffer.GetSize())
+    {
+        CreateInstanceBuffer(std::bit_ceil(static_cast<uint32_t>(instanceData.size())));
+        dirtyBegin = 0;
+        dirtyEnd   = static_cast<uint32_t>(instanceData.size());
+        isChanged  = true;
+    }
+
+    if (dirtyBegin < dirtyEnd)
+    {
+        queue.WriteBuffer(instanceBuffer,
+                          dirtyBegin * sizeof(InstanceData),
+                          &instanceData[dirtyBegin],
+                          (dirtyEnd - dirtyBegin) * sizeof(InstanceData));
+        dirtyBegin = 0;
+        dirtyEnd   = 0;
+    }
+    return isChanged;
+}
+
+void Scene::SortInstances()
+{
+    // Instances sharing a mesh and a material end up contiguous, in the order they were added
+    std::vector<InstanceId> order(instances.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(),
+                     order.end(),
+                     [this](InstanceId a, InstanceId b)
+                     {
+                         const Instance& instanceA = instances[a];
+                         const Instance& instanceB = instances[b];
+                         return instanceA.mesh != instanceB.mesh
+                                    ? instanceA.mesh < instanceB.mesh
+                                    : instanceA.material < instanceB.material;
+                     });
+
+    std::vector<InstanceData> sortedData(instanceData.size());
+    batches.clear();
+    for (uint32_t slot = 0; slot < order.size(); ++slot)
+    {
+        Instance& instance = instances[order[slot]];
+        sortedData[slot]   = instanceData[instance.slot];
+        instance.slot      = slot;
+
+        if (batches.empty() || batches.back().mesh != instance.mesh
+            || batches.back().material != instance.material
+            || batches.back().instanceCount == maxBatchSize)
+        {
+            batches.push_back({instance.mesh, instance.material, slot, 0});
+        }
+        ++batches.back().instanceCount;
+    }
+
+    instanceData.swap(sortedData);
+    isSorted   = true;
+    dirtyBegin = 0;
+    dirtyEnd   = static_cast<uint32_t>(instanceData.size());
+}
+
+void Scene::CreateInstanceBuffer(uint32_t capacity)
+{
+    wgpu::BufferDescriptor bufferDesc {};
+    bufferDesc.label            = WebGPUUtils::GenerateString("Instance buffer");
+    bufferDesc.size             = uint64_t(capacity) * sizeof(InstanceData);
+    bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage;
+    bufferDesc.mappedAtCreation = false;
+    instanceBuffer              = device.CreateBuffer(&bufferDesc);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <cstdint>
+#include <glm/mat4x4.hpp>
+#include <span>
+#include <vector>
+
+/**
+ * Instances of meshes drawn with a material and a transform. Their per-instance data lives in
+ * a storage buffer, sorted so that the instances sharing a mesh and a material are contiguous
+ * and drawn by a single instanced call, the vertex shader reading its data at instance_index.
+ *
+ * Meshes and materials are identified by indices into lists owned by the renderer.
+ */
+class Scene
+{
+public:
+    using MeshId     = uint32_t;
+    using MaterialId = uint32_t;
+    using InstanceId = uint32_t;
+
+    // Layout of InstanceData in the shader
+    struct InstanceData
+    {
+        glm::mat4x4 modelMatrix;
+    };
+
+    static_assert(sizeof(InstanceData) % 16 == 0);
+
+    // Instances drawn by one call, firstInstance being the index of their data in the buffer
+    struct Batch
+    {
+        MeshId mesh;
+        MaterialId material;
+        uint32_t firstInstance;
+        uint32_t instanceCount;
+    };
+
+    void Initialize(wgpu::Device device);
+
+    InstanceId AddInstance(MeshId mesh, MaterialId material, const glm::mat4x4& transform);
+    void SetTransform(InstanceId instance, const glm::mat4x4& transform);
+    void Clear();
+
+    // Split batches past the given number of instances, mostly to benchmark many draws
+    void SetMaxBatchSize(uint32_t instanceCount);
+
+    /**
+     * Sort the instances into batches after instances were added, and upload the instance data
+     * that changed. Return true when the batches changed or the instance buffer was recreated
+     * to grow, in which case the draws and bind groups using them must be rebuilt.
+     */
+    bool Update(wgpu::Queue queue);
+
+    std::span<const Batch> GetBatches() const
+    {
+        return batches;
+    }
+
+    wgpu::Buffer GetInstanceBuffer() const
+    {
+        return instanceBuffer;
+    }
+
+    // Instance data in the order of the buffer, valid after Update
+    std::span<const InstanceData> GetInstanceData() const
+    {
+        return instanceData;
+    }
+
+    uint32_t GetInstanceCount() const
+    {
+        return static_cast<uint32_t>(instances.size());
+    }
+
+private:
+    struct Instance
+    {
+        MeshId mesh;
+        MaterialId material;
+        // Index of the instance data in the buffer
+        uint32_t slot;
+    };
+
+    void SortInstances();
+    void CreateInstanceBuffer(uint32_t capacity);
+
+    wgpu::Device device         = nullptr;
+    wgpu::Buffer instanceBuffer = nullptr;
+    std::vector<Instance> instances;
+    std::vector<InstanceData> instanceData;
+    std::vector<Batch> batches;
+
+    uint32_t maxBatchSize = UINT32_MAX;
+    bool isSorted         = true;
+    // Range of slots to upload, empty when dirtyBegin >= dirtyEnd
+    uint32_t dirtyBegin = 0;
+    uint32_t dirtyEnd   = 0;
+};
@@ -0,0 +1,314 @@
+#include "ShaderVariants.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+    constexpr const char* kManifestVersion = "shadervariants 1";
+    constexpr const char* kHalfPrecision   = "F16";
+
+    std::string_view Trim(std::string_view text)
+    {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string_view::npos)
+        {
+            return {};
+        }
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    // Split at whitespace
+    std::vector<std::string_view> Tokenize(std::string_view line)
+    {
+        std::vector<std::string_view> tokens;
+        while (!(line = Trim(line)).empty())
+        {
+            size_t end = std::min(line.find_first_of(" \t"), line.size());
+            tokens.push_back(line.substr(0, end));
+            line.remove_prefix(end);
+        }
+        return tokens;
+    }
+
+    bool ParseUnsigned(std::string_view text, uint32_t& value)
+    {
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return error == std::errc() && end == text.data() + text.size();
+    }
+
+    // Cost of shading with a variant, lights dominating texture fetches and precision
+    uint32_t GetCost(const ShaderVariants::Features& features)
+    {
+        return features.lightCount * 4 + (features.normalMapping ? 2 : 0) + (features.f16 ? 0 : 1);
+    }
+}  // namespace
+
+bool ShaderVariants::Preprocess(std::string_view source,
+                                const std::vector<std::string>& defines,
+                                std::string& output)
+{
+    struct Block
+    {
+        bool isActive;
+        bool hasElse;
+    };
+    std::vector<Block> blocks;
+    bool isActive = true;
+
+    output.clear();
+    output.reserve(source.size());
+    size_t lineNumber = 0;
+    while (!source.empty())
+    {
+        size_t lineEnd        = source.find('\n');
+        std::string_view line = source.substr(0, lineEnd);
+        source.remove_prefix(lineEnd == std::string_view::npos ? source.size() : lineEnd + 1);
+        ++lineNumber;
+
+        std::vector<std::string_view> tokens = Tokenize(line);
+        if (tokens.empty() || tokens[0][0] != '#')
+        {
+            if (isActive)
+            {
+                output.append(line);
+            }
+            output.push_back('\n');
+            continue;
+        }
+        output.push_back('\n');
+
+        if (tokens[0] == "#if" && tokens.size() == 2)
+        {
+            std::string_view name = tokens[1];
+            bool isNegated        = name.starts_with('!');
+            if (isNegated)
+            {
+                name.remove_prefix(1);
+            }
+            bool isDefined = std::find(defines.begin(), defines.end(), name) != defines.end();
+            blocks.push_back({isActive, false});
+            isActive = isActive && isDefined != isNegated;
+        }
+        else if (tokens[0] == "#else" && tokens.size() == 1 && !blocks.empty()
+                 && !blocks.back().hasElse)
+        {
+            blocks.back().hasElse = true;
+            isActive              = blocks.back().isActive && !isActive;
+        }
+        else if (tokens[0] == "#endif" && tokens.size() == 1 && !blocks.empty())
+        {
+            isActive = blocks.back().isActive;
+            blocks.pop_back();
+        }
+        else
+        {
+            SDL_Log("Invalid shader directive at line %zu: %.*s",
+                    lineNumber,
+                    static_cast<int>(line.size()),
+                    line.data());
+            return false;
+        }
+    }
+
+    if (!blocks.empty())
+    {
+        SDL_Log("Missing #endif in shader");
+        return false;
+    }
+    return true;
+}
+
+std::vector<ShaderVariants::Variant> ShaderVariants::Enumerate(std::string_view baseName)
+{
+    std::vector<Variant> variants;
+    for (bool f16 : {false, true})
+    {
+        for (VertexFormat vertexFormat : {VertexFormat::Full, VertexFormat::Packed})
+        {
+            for (bool normalMapping : {false, true})
+            {
+                for (uint32_t lightCount = 1; lightCount <= kMaxLightCount; ++lightCount)
+                {
+                    Variant& variant = variants.emplace_back();
+
+                    variant.features.lightCount    = lightCount;
+                    variant.features.normalMapping = normalMapping;
+                    variant.features.vertexFormat  = vertexFormat;
+                    variant.features.f16           = f16;
+
+                    variant.sourceName = std::string(baseName) + (f16 ? ".f16.wgsl" : ".f32.wgsl");
+                    if (f16)
+                    {
+                        variant.defines.push_back(kHalfPrecision);
+                    }
+                    variant.vertexEntryPoint =
+                        vertexFormat == VertexFormat::Packed ? "vs_main_packed" : "vs_main";
+                    variant.fragmentEntryPoint = "fs_main";
+                    variant.constants          = {{"kLightCount", lightCount},
+                                                  {"kNormalMapping", normalMapping ? 1.0 : 0.0}};
+                }
+            }
+        }
+    }
+    return variants;
+}
+
+std::string ShaderVariants::GetManifestName(std::string_view baseName)
+{
+    return std::string(baseName) + ".manifest";
+}
+
+const char* ShaderVariants::GetDepthEntryPoint(VertexFormat vertexFormat)
+{
+    return vertexFormat == VertexFormat::Packed ? "vs_depth_packed" : "vs_depth";
+}
+
+/**
+ * One line per variant:
+ *
+ *     <source> <vertex entry point> <fragment entry point> lights=<n> normalMapping=<0|1>
+ *         vertexFormat=<full|packed> f16=<0|1> [define=<name>...] [constant=<name>:<value>...]
+ */
+std::string ShaderVariants::WriteManifest(const std::vector<Variant>& variants)
+{
+    std::string manifest = std::string(kManifestVersion) + "\n";
+    for (const Variant& variant : variants)
+    {
+        char features[128];
+        snprintf(features,
+                 sizeof(features),
+                 " lights=%u normalMapping=%d vertexFormat=%s f16=%d",
+                 variant.features.lightCount,
+                 variant.features.normalMapping ? 1 : 0,
+                 variant.features.vertexFormat == VertexFormat::Packed ? "packed" : "full",
+                 variant.features.f16 ? 1 : 0);
+
+        manifest += variant.sourceName + " " + variant.vertexEntryPoint + " "
+                    + variant.fragmentEntryPoint + features;
+        for (const std::string& define : variant.defines)
+        {
+            manifest += " define=" + define;
+        }
+        for (const auto& [name, value] : variant.constants)
+        {
+            char constant[32];
+            snprintf(constant, sizeof(constant), ":%.17g", value);
+            manifest += " constant=" + name + constant;
+        }
+        manifest += "\n";
+    }
+    return manifest;
+}
+
+bool ShaderVariants::ReadManifest(std::string_view manifest, std::vector<Variant>& variants)
+{
+    variants.clear();
+    size_t lineEnd = manifest.find('\n');
+    if (Trim(manifest.substr(0, lineEnd)) != kManifestVersion)
+    {
+        SDL_Log("Unsupported shader manifest version");
+        return false;
+    }
+
+    while (lineEnd != std::string_view::npos)
+    {
+        manifest.remove_prefix(lineEnd + 1);
+        lineEnd = manifest.find('\n');
+
+        std::vector<std::string_view> tokens = Tokenize(manifest.substr(0, lineEnd));
+        if (tokens.empty())
+        {
+            continue;
+        }
+
+        if (tokens.size() < 3)
+        {
+            SDL_Log("Invalid shader manifest entry");
+            return false;
+        }
+
+        Variant variant;
+        variant.sourceName         = tokens[0];
+        variant.vertexEntryPoint   = tokens[1];
+        variant.fragmentEntryPoint = tokens[2];
+
+        bool isValid           = true;
+        uint32_t normalMapping = 0;
+        uint32_t f16           = 0;
+        for (size_t i = 3; isValid && i < tokens.size(); ++i)
+        {
+            size_t separator       = tokens[i].find('=');
+            std::string_view key   = tokens[i].substr(0, separator);
+            std::string_view value = tokens[i].substr(std::min(separator + 1, tokens[i].size()));
+            size_t colon           = value.find(':');
+            if (key == "lights")
+            {
+                isValid = ParseUnsigned(value, variant.features.lightCount)
+                          && variant.features.lightCount <= kMaxLightCount;
+            }
+            else if (key == "normalMapping")
+            {
+                isValid = ParseUnsigned(value, normalMapping);
+            }
+            else if (key == "vertexFormat" && (value == "packed" || value == "full"))
+            {
+                variant.features.vertexFormat =
+                    value == "packed" ? VertexFormat::Packed : VertexFormat::Full;
+            }
+            else if (key == "f16")
+            {
+                isValid = ParseUnsigned(value, f16);
+            }
+            else if (key == "define")
+            {
+                variant.defines.emplace_back(value);
+            }
+            else if (key == "constant" && colon != std::string_view::npos)
+            {
+                std::string number(value.substr(colon + 1));
+                char* end = nullptr;
+                variant.constants.emplace_back(value.substr(0, colon),
+                                               strtod(number.c_str(), &end));
+                isValid = !number.empty() && *end == '\0';
+            }
+            else
+            {
+                isValid = false;
+            }
+        }
+        variant.features.normalMapping = normalMapping != 0;
+        variant.features.f16           = f16 != 0;
+
+        if (!isValid)
+        {
+            SDL_Log("Invalid shader manifest entry for %s", variant.sourceName.c_str());
+            return false;
+        }
+        variants.push_back(std::move(variant));
+    }
+    return true;
+}
+
+const ShaderVariants::Variant* ShaderVariants::Select(const std::vector<Variant>& variants,
+                                                      const Features& required)
+{
+    const Variant* cheapest = nullptr;
+    for (const Variant& variant : variants)
+    {
+        const Features& features = variant.features;
+        bool isSuitable          = features.vertexFormat == required.vertexFormat
+                                   && features.lightCount >= required.lightCount
+                                   && (features.normalMapping || !required.normalMapping)
+                                   && (!features.f16 || required.f16);
+        if (isSuitable && (!cheapest || GetCost(features) < GetCost(cheapest->features)))
+        {
+            cheapest = &variant;
+        }
+    }
+    return cheapest;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "VertexFormat.h"
+
+/**
+ * Specialization of the render shader for the features a material needs. Features that WGSL
+ * can express as pipeline-overridable constants (light count, normal mapping) share a source,
+ * and the compiler drops the code they disable when the pipeline is created. The others
+ * select an entry point (vertex format) or a preprocessed source (half precision). Variants
+ * are expanded and validated at build time by the shadercompiler tool, which lists them in
+ * a manifest, or else expanded at runtime from the same source.
+ */
+namespace ShaderVariants
+{
+    // Size of the light arrays of LightingUniforms
+    constexpr uint32_t kMaxLightCount = 2;
+
+    struct Features
+    {
+        // Number of lights shaded, the first ones of LightingUniforms
+        uint32_t lightCount = kMaxLightCount;
+        bool normalMapping  = true;
+        // Selects the vertex entry point
+        VertexFormat vertexFormat = VertexFormat::Packed;
+        // Shade in half precision, which needs wgpu::FeatureName::ShaderF16
+        bool f16 = false;
+    };
+
+    struct Variant
+    {
+        Features features;
+        // Preprocessed WGSL source, shared by the variants with the same defines
+        std::string sourceName;
+        std::vector<std::string> defines;
+        std::string vertexEntryPoint;
+        std::string fragmentEntryPoint;
+        // Values of the pipeline-overridable constants
+        std::vector<std::pair<std::string, double>> constants;
+    };
+
+    /**
+     * Keep the lines of source according to the `#if NAME`, `#if !NAME`, `#else` and `#endif`
+     * directives and the defined names. Directives and removed lines are left empty, so that
+     * compilation messages keep the line numbers of the source.
+     */
+    bool Preprocess(std::string_view source,
+                    const std::vector<std::string>& defines,
+                    std::string& output);
+
+    // Every variant of the shader named baseName, e.g. "shader" for shader.wgsl
+    std::vector<Variant> Enumerate(std::string_view baseName);
+
+    std::string GetManifestName(std::string_view baseName);
+
+    // Vertex entry point of the depth-only pipelines, which only read positions
+    const char* GetDepthEntryPoint(VertexFormat vertexFormat);
+
+    std::string WriteManifest(const std::vector<Variant>& variants);
+
+    bool ReadManifest(std::string_view manifest, std::vector<Variant>& variants);
+
+    /**
+     * Get the cheapest variant providing the required features: the fewest lights, then
+     * no normal map fetch, then half precision if required.f16 allows it. Return null when
+     * no variant fits.
+     */
+    const Variant* Select(const std::vector<Variant>& variants, const Features& required);
+
+}  // namespace ShaderVariants
@@ -0,0 +1,413 @@
+#include "TangentSpace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <glm/geometric.hpp>
+
+#include "ThreadPool.h"
+#include "VertexFormat.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define TANGENT_SPACE_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define TANGENT_SPACE_NEON
+#endif
+
+namespace
+{
+    // Triangles handled by one task of the thread pool
+    constexpr size_t kTrianglesPerTask = 16 * 1024;
+    // Below this length a vector is considered degenerate
+    constexpr float kEpsilon = 1e-12f;
+
+    /**
+     * Four floats processed together, one lane per triangle. Only the operations needed
+     * here are provided, with a scalar fallback for targets without SSE2 or NEON.
+     */
+    struct Float4
+    {
+#if defined(TANGENT_SPACE_SSE2)
+        __m128 v;
+#elif defined(TANGENT_SPACE_NEON)
+        float32x4_t v;
+#else
+        float v[4];
+#endif
+
+        static Float4 Load(const float values[4])
+        {
+#if defined(TANGENT_SPACE_SSE2)
+            return {_mm_loadu_ps(values)};
+#elif defined(TANGENT_SPACE_NEON)
+            return {vld1q_f32(values)};
+#else
+            return {{values[0], values[1], values[2], values[3]}};
+#endif
+        }
+
+        void Store(float values[4]) const
+        {
+#if defined(TANGENT_SPACE_SSE2)
+            _mm_storeu_ps(values, v);
+#elif defined(TANGENT_SPACE_NEON)
+            vst1q_f32(values, v);
+#else
+            std::copy(v, v + 4, values);
+#endif
+        }
+    };
+
+#if defined(TANGENT_SPACE_SSE2)
+    Float4 operator+(Float4 a, Float4 b)
+    {
+        return {_mm_add_ps(a.v, b.v)};
+    }
+
+    Float4 operator-(Float4 a, Float4 b)
+    {
+        return {_mm_sub_ps(a.v, b.v)};
+    }
+
+    Float4 operator*(Float4 a, Float4 b)
+    {
+        return {_mm_mul_ps(a.v, b.v)};
+    }
+
+    // 1 / sqrt(x) where x > kEpsilon, 0 elsewhere
+    Float4 SafeInverseSqrt(Float4 x)
+    {
+        __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(x.v));
+        __m128 valid   = _mm_cmpgt_ps(x.v, _mm_set1_ps(kEpsilon));
+        return {_mm_and_ps(valid, inverse)};
+    }
+
+    // -a where s < 0, a elsewhere
+    Float4 FlipSign(Float4 a, Float4 s)
+    {
+        __m128 signBit = _mm_and_ps(s.v, _mm_set1_ps(-0.0f));
+        return {_mm_xor_ps(a.v, signBit)};
+    }
+#elif defined(TANGENT_SPACE_NEON)
+    Float4 operator+(Float4 a, Float4 b)
+    {
+        return {vaddq_f32(a.v, b.v)};
+    }
+
+    Float4 operator-(Float4 a, Float4 b)
+    {
+        return {vsubq_f32(a.v, b.v)};
+    }
+
+    Float4 operator*(Float4 a, Float4 b)
+    {
+        return {vmulq_f32(a.v, b.v)};
+    }
+
+    Float4 SafeInverseSqrt(Float4 x)
+    {
+        float32x4_t inverse = vdivq_f32(vdupq_n_f32(1.0f), vsqrtq_f32(x.v));
+        uint32x4_t valid    = vcgtq_f32(x.v, vdupq_n_f32(kEpsilon));
+        return {vreinterpretq_f32_u32(vandq_u32(valid, vreinterpretq_u32_f32(inverse)))};
+    }
+
+    Float4 FlipSign(Float4 a, Float4 s)
+    {
+        uint32x4_t signBit = vandq_u32(vreinterpretq_u32_f32(s.v), vdupq_n_u32(0x80000000u));
+        return {vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a.v), signBit))};
+    }
+#else
+    template <typename Op>
+    Float4 Map(Float4 a, Float4 b, Op op)
+    {
+        Float4 result;
+        for (int i = 0; i < 4; ++i)
+        {
+            result.v[i] = op(a.v[i], b.v[i]);
+        }
+        return result;
+    }
+
+    Float4 operator+(Float4 a, Float4 b)
+    {
+        return Map(a, b, std::plus<float>());
+    }
+
+    Float4 operator-(Float4 a, Float4 b)
+    {
+        return Map(a, b, std::minus<float>());
+    }
+
+    Float4 operator*(Float4 a, Float4 b)
+    {
+        return Map(a, b, std::multiplies<float>());
+    }
+
+    Float4 SafeInverseSqrt(Float4 x)
+    {
+        return Map(x,
+                   x,
+                   [](float y, float)
+                   {
+                       return y > kEpsilon ? 1.0f / std::sqrt(y) : 0.0f;
+                   });
+    }
+
+    Float4 FlipSign(Float4 a, Float4 s)
+    {
+        return Map(a,
+                   s,
+                   [](float x, float y)
+                   {
+                       return std::signbit(y) ? -x : x;
+                   });
+    }
+#endif
+
+    // Four 3D vectors in SoA layout
+    struct Vec3x4
+    {
+        Float4 x, y, z;
+    };
+
+    Vec3x4 operator-(const Vec3x4& a, const Vec3x4& b)
+    {
+        return {a.x - b.x, a.y - b.y, a.z - b.z};
+    }
+
+    Vec3x4 operator*(const Vec3x4& a, Float4 s)
+    {
+        return {a.x * s, a.y * s, a.z * s};
+    }
+
+    Float4 Dot(const Vec3x4& a, const Vec3x4& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    Vec3x4 Cross(const Vec3x4& a, const Vec3x4& b)
+    {
+        return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+    }
+
+    Vec3x4 Normalize(const Vec3x4& a)
+    {
+        return a * SafeInverseSqrt(Dot(a, a));
+    }
+
+    Vec3x4 FlipSign(const Vec3x4& a, Float4 s)
+    {
+        return {FlipSign(a.x, s), FlipSign(a.y, s), FlipSign(a.z, s)};
+    }
+
+    // Transpose one attribute of 4 vertices from AoS to SoA
+    template <typename T>
+    Float4 GatherComponent(const VertexAttributes* const vertices[4],
+                           T VertexAttributes::*member,
+                           int c)
+    {
+        float values[4] = {
+            (vertices[0]->*member)[c],
+            (vertices[1]->*member)[c],
+            (vertices[2]->*member)[c],
+            (vertices[3]->*member)[c],
+        };
+        return Float4::Load(values);
+    }
+
+    Vec3x4 Gather(const VertexAttributes* const vertices[4], glm::vec3 VertexAttributes::*member)
+    {
+        return {GatherComponent(vertices, member, 0),
+                GatherComponent(vertices, member, 1),
+                GatherComponent(vertices, member, 2)};
+    }
+
+    void Scatter(const Vec3x4& a,
+                 VertexAttributes* const vertices[4],
+                 glm::vec3 VertexAttributes::*member,
+                 int laneCount)
+    {
+        float x[4], y[4], z[4];
+        a.x.Store(x);
+        a.y.Store(y);
+        a.z.Store(z);
+        for (int i = 0; i < laneCount; ++i)
+        {
+            vertices[i]->*member = {x[i], y[i], z[i]};
+        }
+    }
+
+    /**
+     * Raw frame of 4 triangles: the tangent T and the normal C = T x B of the UV mapping,
+     * which tells on which side of the surface the frame lies. Both are unnormalized.
+     */
+    void ComputeTriangleFrames(const VertexAttributes* const corners[3][4],
+                               Vec3x4& T,
+                               Vec3x4& C)
+    {
+        Vec3x4 p0 = Gather(corners[0], &VertexAttributes::position);
+        Vec3x4 p1 = Gather(corners[1], &VertexAttributes::position);
+        Vec3x4 p2 = Gather(corners[2], &VertexAttributes::position);
+
+        Float4 u0  = GatherComponent(corners[0], &VertexAttributes::uv, 0);
+        Float4 v0  = GatherComponent(corners[0], &VertexAttributes::uv, 1);
+        Float4 eU1 = GatherComponent(corners[1], &VertexAttributes::uv, 0) - u0;
+        Float4 eV1 = GatherComponent(corners[1], &VertexAttributes::uv, 1) - v0;
+        Float4 eU2 = GatherComponent(corners[2], &VertexAttributes::uv, 0) - u0;
+        Float4 eV2 = GatherComponent(corners[2], &VertexAttributes::uv, 1) - v0;
+
+        Vec3x4 ePos1 = p1 - p0;
+        Vec3x4 ePos2 = p2 - p0;
+
+        T        = ePos1 * eV2 - ePos2 * eV1;
+        Vec3x4 B = ePos2 * eU1 - ePos1 * eU2;
+        C        = Cross(T, B);
+    }
+
+    // Any unit vector orthogonal to n, used when a vertex has no usable UV mapping
+    glm::vec3 AnyPerpendicular(const glm::vec3& n)
+    {
+        glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+        return glm::normalize(glm::cross(n, axis));
+    }
+}  // namespace
+
+void TangentSpace::ComputePerTriangle(std::vector<VertexAttributes>& vertexData)
+{
+    size_t triangleCount = vertexData.size() / 3;
+    ThreadPool::GetInstance().ParallelFor(
+        triangleCount,
+        kTrianglesPerTask,
+        [&vertexData](size_t first, size_t last)
+        {
+            for (size_t base = first; base < last; base += 4)
+            {
+                // Unused lanes repeat the last triangle and are not written back
+                int laneCount = static_cast<int>(std::min<size_t>(4, last - base));
+                VertexAttributes* corners[3][4];
+                for (int i = 0; i < 4; ++i)
+                {
+                    size_t t = base + std::min(i, laneCount - 1);
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        corners[k][i] = &vertexData[3 * t + k];
+                    }
+                }
+
+                Vec3x4 T, C;
+                ComputeTriangleFrames(corners, T, C);
+
+                // Ortho-normalize the frame against the normal of each corner
+                for (int k = 0; k < 3; ++k)
+                {
+                    Vec3x4 N         = Gather(corners[k], &VertexAttributes::normal);
+                    Vec3x4 orientedT = FlipSign(T, Dot(C, N));
+                    Vec3x4 cornerT   = Normalize(orientedT - N * Dot(orientedT, N));
+                    Vec3x4 cornerB   = Cross(N, cornerT);
+                    Scatter(cornerT, corners[k], &VertexAttributes::tangent, laneCount);
+                    Scatter(cornerB, corners[k], &VertexAttributes::bitangent, laneCount);
+                }
+            }
+        });
+}
+
+void TangentSpace::ComputePerVertex(std::vector<VertexAttributes>& vertexData,
+                                    const std::vector<uint32_t>& indexData)
+{
+    ThreadPool& threadPool = ThreadPool::GetInstance();
+    size_t triangleCount   = indexData.size() / 3;
+    size_t vertexCount     = vertexData.size();
+
+    // Unit tangent and UV mapping normal of every triangle
+    std::vector<glm::vec3> triangleTangents(triangleCount);
+    std::vector<glm::vec3> triangleNormals(triangleCount);
+    threadPool.ParallelFor(
+        triangleCount,
+        kTrianglesPerTask,
+        [&](size_t first, size_t last)
+        {
+            for (size_t base = first; base < last; base += 4)
+            {
+                int laneCount = static_cast<int>(std::min<size_t>(4, last - base));
+                const VertexAttributes* corners[3][4];
+                for (int i = 0; i < 4; ++i)
+                {
+                    size_t t = base + std::min(i, laneCount - 1);
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        corners[k][i] = &vertexData[indexData[3 * t + k]];
+                    }
+                }
+
+                Vec3x4 T, C;
+                ComputeTriangleFrames(corners, T, C);
+                T = Normalize(T);
+
+                float tx[4], ty[4], tz[4], cx[4], cy[4], cz[4];
+                T.x.Store(tx);
+                T.y.Store(ty);
+                T.z.Store(tz);
+                C.x.Store(cx);
+                C.y.Store(cy);
+                C.z.Store(cz);
+                for (int i = 0; i < laneCount; ++i)
+                {
+                    triangleTangents[base + i] = {tx[i], ty[i], tz[i]};
+                    triangleNormals[base + i]  = {cx[i], cy[i], cz[i]};
+                }
+            }
+        });
+
+    // Vertex to triangle adjacency, stored as one flat array indexed by adjacencyOffsets
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t index : indexData)
+    {
+        ++adjacencyOffsets[index + 1];
+    }
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+    std::vector<uint32_t> adjacency(indexData.size());
+    std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indexData.size(); ++i)
+    {
+        adjacency[fillOffsets[indexData[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // Each vertex gathers the frames of its triangles, so no two tasks write the same data
+    threadPool.ParallelFor(
+        vertexCount,
+        kTrianglesPerTask,
+        [&](size_t first, size_t last)
+        {
+            for (size_t v = first; v < last; ++v)
+            {
+                VertexAttributes& vertex = vertexData[v];
+                const glm::vec3& N       = vertex.normal;
+
+                glm::vec3 T(0.0f);
+                for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a)
+                {
+                    // Orient each triangle frame like in the per triangle case
+                    uint32_t t = adjacency[a];
+                    bool flip  = glm::dot(triangleNormals[t], N) < 0.0f;
+                    T += flip ? -triangleTangents[t] : triangleTangents[t];
+                }
+
+                T = T - glm::dot(T, N) * N;
+                if (glm::dot(T, T) > kEpsilon)
+                {
+                    T = glm::normalize(T);
+                }
+                else
+                {
+                    T = AnyPerpendicular(N);
+                }
+                vertex.tangent   = T;
+                vertex.bitangent = glm::cross(N, T);
+            }
+        });
+}
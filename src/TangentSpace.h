@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct VertexAttributes;
+
+namespace TangentSpace
+{
+    /**
+     * Compute the tangent and bitangent of every corner of a non-indexed triangle list from
+     * the frame of its triangle, ortho-normalized against the corner normal. Triangles are
+     * processed 4 at a time with SIMD and spread over the shared thread pool.
+     */
+    void ComputePerTriangle(std::vector<VertexAttributes>& vertexData);
+
+    /**
+     * Compute the tangent frame of every vertex of an indexed mesh by accumulating the frames
+     * of the triangles sharing it, then ortho-normalizing against the vertex normal
+     */
+    void ComputePerVertex(std::vector<VertexAttributes>& vertexData,
+                          const std::vector<uint32_t>& indexData);
+
+}  // namespace TangentSpace
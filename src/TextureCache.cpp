@@ -0,0 +1,192 @@
+#include "TextureCache.h"
+
+#include <SDL3/SDL_log.h>
+#include <cstring>
+
+#include "AssetSource.h"
+
+namespace
+{
+    constexpr uint32_t kTextureCacheMagic = 0x58455454;  // "TTEX"
+    // Bump whenever the layout or the encoding of the cached levels changes
+    constexpr uint32_t kTextureCacheVersion = 1;
+    // Alignment of every level in the file
+    constexpr uint64_t kSectionAlignment = 16;
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}  // namespace
+
+struct TextureCache::Header
+{
+    uint32_t magic;
+    uint32_t version;
+
+    // Source image the cache was built from
+    AssetSource::Stamp source;
+
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+};
+
+// Location of a mip level, the level entries directly follow the header
+struct TextureCache::LevelEntry
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+bool TextureCache::Open(const std::filesystem::path& cachePath,
+                        const std::filesystem::path& sourcePath,
+                        wgpu::TextureFormat format)
+{
+    return Map(cachePath, format)
+           && CheckSource(cachePath, AssetSource::Matches(sourcePath, GetHeader()->source));
+}
+
+bool TextureCache::Open(const std::filesystem::path& cachePath,
+                        const AssetSource::Stamp& source,
+                        wgpu::TextureFormat format)
+{
+    return Map(cachePath, format)
+           && CheckSource(cachePath, AssetSource::Matches(source, GetHeader()->source));
+}
+
+bool TextureCache::Create(const std::filesystem::path& cachePath,
+                          const AssetSource::Stamp& source,
+                          wgpu::TextureFormat format,
+                          uint32_t width,
+                          uint32_t height,
+                          const std::vector<std::span<const unsigned char>>& levels)
+{
+    file.Close();
+
+    Header header {};
+    header.magic      = kTextureCacheMagic;
+    header.version    = kTextureCacheVersion;
+    header.format     = static_cast<uint32_t>(format);
+    header.width      = width;
+    header.height     = height;
+    header.levelCount = static_cast<uint32_t>(levels.size());
+    header.source     = source;
+
+    std::vector<LevelEntry> levelEntries(levels.size());
+    uint64_t offset = AlignUp(sizeof(Header) + levels.size() * sizeof(LevelEntry),
+                              kSectionAlignment);
+    for (size_t level = 0; level < levels.size(); ++level)
+    {
+        levelEntries[level] = {offset, levels[level].size()};
+        offset              = AlignUp(offset + levels[level].size(), kSectionAlignment);
+    }
+
+    ownedData.assign(offset, 0);
+    memcpy(ownedData.data(), &header, sizeof(Header));
+    memcpy(ownedData.data() + sizeof(Header),
+           levelEntries.data(),
+           levelEntries.size() * sizeof(LevelEntry));
+    for (size_t level = 0; level < levels.size(); ++level)
+    {
+        memcpy(ownedData.data() + levelEntries[level].offset,
+               levels[level].data(),
+               levels[level].size());
+    }
+    data = ownedData;
+
+    // Writing is best-effort, the cache stays usable from memory
+    AssetSource::WriteCacheFile(cachePath, ownedData);
+    return true;
+}
+
+uint32_t TextureCache::GetWidth() const
+{
+    return GetHeader()->width;
+}
+
+uint32_t TextureCache::GetHeight() const
+{
+    return GetHeader()->height;
+}
+
+uint32_t TextureCache::GetLevelCount() const
+{
+    return GetHeader()->levelCount;
+}
+
+std::span<const unsigned char> TextureCache::GetLevelData(uint32_t level) const
+{
+    const LevelEntry& entry = GetLevelEntries()[level];
+    return data.subspan(entry.offset, entry.size);
+}
+
+const TextureCache::Header* TextureCache::GetHeader() const
+{
+    return reinterpret_cast<const Header*>(data.data());
+}
+
+const TextureCache::LevelEntry* TextureCache::GetLevelEntries() const
+{
+    return reinterpret_cast<const LevelEntry*>(data.data() + sizeof(Header));
+}
+
+bool TextureCache::Map(const std::filesystem::path& cachePath, wgpu::TextureFormat format)
+{
+    ownedData.clear();
+    data = {};
+    if (!file.Open(cachePath))
+    {
+        return false;
+    }
+    data = {file.GetData(), file.GetSize()};
+
+    if (!Validate(format))
+    {
+        SDL_Log("Ignoring invalid or incompatible texture cache %s", cachePath.string().c_str());
+        file.Close();
+        data = {};
+        return false;
+    }
+    return true;
+}
+
+bool TextureCache::CheckSource(const std::filesystem::path& cachePath, bool isUpToDate)
+{
+    if (!isUpToDate)
+    {
+        SDL_Log("Texture cache %s is outdated", cachePath.string().c_str());
+        file.Close();
+        data = {};
+    }
+    return isUpToDate;
+}
+
+bool TextureCache::Validate(wgpu::TextureFormat format) const
+{
+    if (data.size() < sizeof(Header))
+    {
+        return false;
+    }
+
+    const Header* header = GetHeader();
+    if (header->magic != kTextureCacheMagic || header->version != kTextureCacheVersion
+        || header->format != static_cast<uint32_t>(format) || header->levelCount == 0
+        || header->levelCount > (data.size() - sizeof(Header)) / sizeof(LevelEntry))
+    {
+        return false;
+    }
+
+    const LevelEntry* levelEntries = GetLevelEntries();
+    for (uint32_t level = 0; level < header->levelCount; ++level)
+    {
+        const LevelEntry& entry = levelEntries[level];
+        if (entry.offset % kSectionAlignment != 0 || entry.offset > data.size()
+            || entry.size > data.size() - entry.offset)
+        {
+            return false;
+        }
+    }
+    return true;
+}
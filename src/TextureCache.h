@@ -0,0 +1,68 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include "AssetSource.h"
+#include "MappedFile.h"
+
+/**
+ * Texture ready for upload in its GPU format, with all its mip levels. It is stored in a
+ * versioned binary file next to the source image and memory-mapped on later runs, so that
+ * neither decoding nor mip generation nor compression happens at runtime.
+ */
+class TextureCache
+{
+public:
+    /**
+     * Map an existing cache. Return false if it is missing, corrupted, stored in another
+     * format or older than its source image.
+     */
+    bool Open(const std::filesystem::path& cachePath,
+              const std::filesystem::path& sourcePath,
+              wgpu::TextureFormat format);
+
+    // Map an existing cache built from a source with the given stamp, e.g. a packed asset
+    bool Open(const std::filesystem::path& cachePath,
+              const AssetSource::Stamp& source,
+              wgpu::TextureFormat format);
+
+    /**
+     * Serialize the given mip levels, finest first, and keep them in memory. Writing them
+     * to cachePath is best-effort: a failure is logged but the in-memory cache is usable.
+     */
+    bool Create(const std::filesystem::path& cachePath,
+                const AssetSource::Stamp& source,
+                wgpu::TextureFormat format,
+                uint32_t width,
+                uint32_t height,
+                const std::vector<std::span<const unsigned char>>& levels);
+
+    uint32_t GetWidth() const;
+    uint32_t GetHeight() const;
+    uint32_t GetLevelCount() const;
+    std::span<const unsigned char> GetLevelData(uint32_t level) const;
+
+private:
+    struct Header;
+    struct LevelEntry;
+
+    const Header* GetHeader() const;
+    const LevelEntry* GetLevelEntries() const;
+
+    bool Map(const std::filesystem::path& cachePath, wgpu::TextureFormat format);
+
+    // Unmap the cache unless it is up to date with its source
+    bool CheckSource(const std::filesystem::path& cachePath, bool isUpToDate);
+
+    // Check that the header describes ranges lying within the data
+    bool Validate(wgpu::TextureFormat format) const;
+
+    MappedFile file;
+    std::vector<unsigned char> ownedData;
+    std::span<const unsigned char> data;
+};
@@ -0,0 +1,492 @@
+#include "TextureStreamer.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <mutex>
+
+#include <stb_image.h>
+
+#include "BlockCompression.h"
+#include "MemoryUsage.h"
+#include "MipMapGenerator.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+#include "WebGPUUtils.h"
+
+namespace
+{
+    // Bytes uploaded per Update. A level larger than this is still uploaded on its own.
+    constexpr size_t kUploadBudget = 4 * 1024 * 1024;
+
+    const wgpu::TextureUsage kTextureUsage =
+        wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopyDst;
+
+    bool IsBlockCompressed(wgpu::TextureFormat format)
+    {
+        return format == wgpu::TextureFormat::BC7RGBAUnorm
+               || format == wgpu::TextureFormat::BC5RGUnorm;
+    }
+
+    // Rows of a buffer copied into a texture are aligned to this many bytes
+    constexpr uint32_t kBytesPerRowAlignment = 256;
+
+    uint32_t AlignUp(uint32_t value, uint32_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Tightly packed layout of a mip level
+    struct LevelLayout
+    {
+        uint32_t bytesPerRow;
+        uint32_t rowsPerImage;
+        // Block compressed levels are copied in whole blocks
+        wgpu::Extent3D copySize;
+    };
+
+    LevelLayout GetLevelLayout(wgpu::TextureFormat format, uint32_t width, uint32_t height)
+    {
+        if (!IsBlockCompressed(format))
+        {
+            return {4 * width, height, {width, height, 1}};
+        }
+        constexpr uint32_t kDimension = BlockCompression::kBlockDimension;
+        uint32_t blocksWide           = (width + kDimension - 1) / kDimension;
+        uint32_t blocksHigh           = (height + kDimension - 1) / kDimension;
+        return {blocksWide * BlockCompression::kBytesPerBlock,
+                blocksHigh,
+                {blocksWide * kDimension, blocksHigh * kDimension, 1}};
+    }
+
+    std::filesystem::path GetCachePath(const std::filesystem::path& path)
+    {
+        std::filesystem::path cachePath = path;
+        cachePath += ".texcache";
+        return cachePath;
+    }
+}  // namespace
+
+// Encoded image, read from path unless its data is in memory
+struct TextureStreamer::ImageSource
+{
+    std::filesystem::path path;
+    std::span<const unsigned char> data;
+    // Identity of the in-memory data
+    AssetSource::Stamp stamp;
+};
+
+struct TextureStreamer::DecodedImage
+{
+    struct Level
+    {
+        uint32_t width;
+        uint32_t height;
+        std::span<const unsigned char> data;
+    };
+
+    Handle handle;
+    wgpu::TextureFormat format;
+    // Finest first, empty when the image could not be loaded
+    std::vector<Level> levels;
+
+    // Storage the levels point to, either the decoded image and its mip chain or a cache
+    std::unique_ptr<unsigned char, decltype(&stbi_image_free)> pixels {nullptr, stbi_image_free};
+    std::vector<unsigned char> arena;
+    TextureCache cache;
+};
+
+struct TextureStreamer::StreamedTexture
+{
+    std::filesystem::path path;
+    wgpu::Texture texture  = nullptr;
+    wgpu::TextureView view = nullptr;
+    // Levels waiting for upload, released once the whole chain is resident
+    std::unique_ptr<DecodedImage> image;
+    // Finest level uploaded so far, equal to the level count when none is
+    uint32_t residentLevel = 0;
+};
+
+struct TextureStreamer::Mailbox
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<DecodedImage>> decodedImages;
+};
+
+TextureStreamer::TextureStreamer() : mailbox(std::make_shared<Mailbox>()) {}
+
+TextureStreamer::~TextureStreamer() = default;
+
+void TextureStreamer::Initialize(wgpu::Device device)
+{
+    this->device = device;
+
+    supportsBlockCompression = device.HasFeature(wgpu::FeatureName::TextureCompressionBC);
+    if (!supportsBlockCompression)
+    {
+        SDL_Log("BC texture compression is not supported, textures are uploaded as RGBA8");
+    }
+}
+
+TextureStreamer::Handle TextureStreamer::Load(const std::filesystem::path& path,
+                                              TextureType type,
+                                              const std::array<uint8_t, 4>& placeholderColor)
+{
+    return Load(ImageSource {path}, type, placeholderColor);
+}
+
+TextureStreamer::Handle TextureStreamer::Load(const std::filesystem::path& path,
+                                              std::span<const unsigned char> imageData,
+                                              const AssetSource::Stamp& source,
+                                              TextureType type,
+                                              const std::array<uint8_t, 4>& placeholderColor)
+{
+    return Load(ImageSource {path, imageData, source}, type, placeholderColor);
+}
+
+TextureStreamer::Handle TextureStreamer::CreateSolid(const std::array<uint8_t, 4>& color)
+{
+    Handle handle = static_cast<Handle>(textures.size());
+
+    wgpu::TextureDescriptor textureDesc;
+    textureDesc.label         = WebGPUUtils::GenerateString("Solid texture");
+    textureDesc.dimension     = wgpu::TextureDimension::e2D;
+    textureDesc.format        = wgpu::TextureFormat::RGBA8Unorm;
+    textureDesc.size          = {1, 1, 1};
+    textureDesc.mipLevelCount = 1;
+    textureDesc.sampleCount   = 1;
+    textureDesc.usage         = kTextureUsage;
+
+    StreamedTexture& streamedTexture = textures.emplace_back();
+    streamedTexture.texture          = device.CreateTexture(&textureDesc);
+    streamedTexture.view             = CreateView(streamedTexture.texture, 0);
+
+    wgpu::TexelCopyTextureInfo destination;
+    destination.texture = streamedTexture.texture;
+    wgpu::TexelCopyBufferLayout layout;
+    layout.bytesPerRow  = 4;
+    layout.rowsPerImage = 1;
+    device.GetQueue().WriteTexture(&destination,
+                                   color.data(),
+                                   color.size(),
+                                   &layout,
+                                   &textureDesc.size);
+    return handle;
+}
+
+TextureStreamer::Handle TextureStreamer::Load(const ImageSource& source,
+                                              TextureType type,
+                                              const std::array<uint8_t, 4>& placeholderColor)
+{
+    // Placeholder bound until the first level lands
+    Handle handle         = CreateSolid(placeholderColor);
+    textures[handle].path = source.path;
+
+    wgpu::TextureFormat format = wgpu::TextureFormat::RGBA8Unorm;
+    if (supportsBlockCompression)
+    {
+        format = type == TextureType::Color ? wgpu::TextureFormat::BC7RGBAUnorm
+                                            : wgpu::TextureFormat::BC5RGUnorm;
+    }
+
+    ThreadPool::GetInstance().Submit(
+        [mailbox = mailbox, source, type, format, handle]()
+        {
+            auto image    = std::make_unique<DecodedImage>();
+            image->handle = handle;
+            image->format = format;
+
+            if (!IsBlockCompressed(format) || !LoadFromCache(source, *image))
+            {
+                LoadFromImage(source, type, *image);
+                if (IsBlockCompressed(image->format))
+                {
+                    Compress(source, *image);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mailbox->mutex);
+            mailbox->decodedImages.push_back(std::move(image));
+        });
+    return handle;
+}
+
+bool TextureStreamer::Update()
+{
+    std::vector<std::unique_ptr<DecodedImage>> decodedImages;
+    {
+        std::lock_guard<std::mutex> lock(mailbox->mutex);
+        decodedImages.swap(mailbox->decodedImages);
+    }
+
+    for (std::unique_ptr<DecodedImage>& image : decodedImages)
+    {
+        StreamedTexture& streamedTexture = textures[image->handle];
+        if (image->levels.empty())
+        {
+            SDL_Log("Could not load texture %s", streamedTexture.path.string().c_str());
+            continue;
+        }
+
+        // The placeholder stays bound until a level of the new texture is uploaded
+        const DecodedImage::Level& level0 = image->levels.front();
+        wgpu::TextureDescriptor textureDesc;
+        textureDesc.label         = WebGPUUtils::GenerateString("Texture");
+        textureDesc.dimension     = wgpu::TextureDimension::e2D;
+        textureDesc.format        = image->format;
+        textureDesc.size          = {level0.width, level0.height, 1};
+        textureDesc.mipLevelCount = static_cast<uint32_t>(image->levels.size());
+        textureDesc.sampleCount   = 1;
+        textureDesc.usage         = kTextureUsage;
+
+        streamedTexture.texture       = device.CreateTexture(&textureDesc);
+        streamedTexture.residentLevel = textureDesc.mipLevelCount;
+        streamedTexture.image         = std::move(image);
+    }
+
+    size_t uploadedBytes = 0;
+    bool viewChanged     = false;
+    for (StreamedTexture& streamedTexture : textures)
+    {
+        if (streamedTexture.image && uploadedBytes < kUploadBudget)
+        {
+            viewChanged |= UploadLevels(streamedTexture, uploadedBytes);
+        }
+    }
+    return viewChanged;
+}
+
+wgpu::TextureView TextureStreamer::GetTextureView(Handle handle) const
+{
+    return textures[handle].view;
+}
+
+bool TextureStreamer::LoadFromCache(const ImageSource& source, DecodedImage& image)
+{
+    bool isCached = source.data.empty()
+                        ? image.cache.Open(GetCachePath(source.path), source.path, image.format)
+                        : image.cache.Open(GetCachePath(source.path), source.stamp, image.format);
+    if (!isCached)
+    {
+        return false;
+    }
+
+    uint32_t width  = image.cache.GetWidth();
+    uint32_t height = image.cache.GetHeight();
+    for (uint32_t level = 0; level < image.cache.GetLevelCount(); ++level)
+    {
+        image.levels.push_back({width, height, image.cache.GetLevelData(level)});
+        width  = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+    return true;
+}
+
+void TextureStreamer::LoadFromImage(const ImageSource& source,
+                                    TextureType type,
+                                    DecodedImage& image)
+{
+    int width, height, channels;
+    if (source.data.empty())
+    {
+        image.pixels.reset(stbi_load(source.path.string().c_str(), &width, &height, &channels, 4));
+    }
+    else
+    {
+        image.pixels.reset(stbi_load_from_memory(source.data.data(),
+                                                 static_cast<int>(source.data.size()),
+                                                 &width,
+                                                 &height,
+                                                 &channels,
+                                                 4));
+    }
+    if (!image.pixels)
+    {
+        return;
+    }
+
+    uint32_t levelCount = std::bit_width(static_cast<uint32_t>(std::max(width, height)));
+    std::vector<MipMapGenerator::MipLevel> levels =
+        MipMapGenerator::Generate(image.pixels.get(),
+                                  width,
+                                  height,
+                                  levelCount,
+                                  type == TextureType::Color,
+                                  image.arena);
+    for (const MipMapGenerator::MipLevel& level : levels)
+    {
+        size_t dataSize = 4 * size_t(level.width) * level.height;
+        image.levels.push_back({level.width, level.height, {level.data, dataSize}});
+    }
+
+    // The base level of a block compressed texture must be a whole number of blocks
+    if (width % BlockCompression::kBlockDimension != 0
+        || height % BlockCompression::kBlockDimension != 0)
+    {
+        image.format = wgpu::TextureFormat::RGBA8Unorm;
+    }
+}
+
+void TextureStreamer::Compress(const ImageSource& source, DecodedImage& image)
+{
+    if (image.levels.empty())
+    {
+        return;
+    }
+
+    std::vector<std::vector<unsigned char>> compressedLevels(image.levels.size());
+    std::vector<std::span<const unsigned char>> levelData;
+    for (size_t level = 0; level < image.levels.size(); ++level)
+    {
+        const DecodedImage::Level& source  = image.levels[level];
+        std::vector<unsigned char>& blocks = compressedLevels[level];
+        blocks.resize(BlockCompression::GetCompressedSize(source.width, source.height));
+        if (image.format == wgpu::TextureFormat::BC7RGBAUnorm)
+        {
+            BlockCompression::CompressBC7(source.data.data(),
+                                          source.width,
+                                          source.height,
+                                          blocks.data());
+        }
+        else
+        {
+            BlockCompression::CompressBC5(source.data.data(),
+                                          source.width,
+                                          source.height,
+                                          blocks.data());
+        }
+        levelData.push_back(blocks);
+    }
+
+    AssetSource::Stamp stamp = source.stamp;
+    if (source.data.empty())
+    {
+        AssetSource::GetStamp(source.path, stamp);
+    }
+    const DecodedImage::Level& level0 = image.levels.front();
+    image.cache.Create(GetCachePath(source.path),
+                       stamp,
+                       image.format,
+                       level0.width,
+                       level0.height,
+                       levelData);
+
+    // Upload from the cache, the uncompressed levels are no longer needed
+    for (uint32_t level = 0; level < image.levels.size(); ++level)
+    {
+        image.levels[level].data = image.cache.GetLevelData(level);
+    }
+    image.pixels.reset();
+    image.arena = {};
+}
+
+bool TextureStreamer::UploadLevels(StreamedTexture& streamedTexture, size_t& uploadedBytes)
+{
+    // Lay out the levels fitting in the budget, coarsest first, in a single staging buffer
+    struct StagedLevel
+    {
+        uint32_t level;
+        LevelLayout layout;
+        uint64_t offset;
+        uint32_t bytesPerRow;
+    };
+    std::vector<StagedLevel> stagedLevels;
+    uint64_t stagingSize = 0;
+
+    const DecodedImage& image = *streamedTexture.image;
+    for (uint32_t level = streamedTexture.residentLevel; level-- > 0;)
+    {
+        const DecodedImage::Level& data = image.levels[level];
+        if (uploadedBytes > 0 && uploadedBytes + data.data.size() > kUploadBudget)
+        {
+            break;
+        }
+
+        StagedLevel& stagedLevel = stagedLevels.emplace_back();
+        stagedLevel.level        = level;
+        stagedLevel.layout       = GetLevelLayout(image.format, data.width, data.height);
+        stagedLevel.offset       = stagingSize;
+        stagedLevel.bytesPerRow  = AlignUp(stagedLevel.layout.bytesPerRow, kBytesPerRowAlignment);
+        stagingSize += uint64_t(stagedLevel.bytesPerRow) * stagedLevel.layout.rowsPerImage;
+        uploadedBytes += data.data.size();
+    }
+
+    if (stagedLevels.empty())
+    {
+        return false;
+    }
+
+    // The levels are written in place into the mapped buffer, then copied by the GPU
+    wgpu::Buffer stagingBuffer =
+        WebGPUUtils::CreateMappedBuffer(device,
+                                        "Texture staging buffer",
+                                        wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::CopySrc,
+                                        stagingSize);
+    auto* stagingData = static_cast<unsigned char*>(stagingBuffer.GetMappedRange());
+
+    wgpu::TexelCopyBufferInfo source;
+    source.buffer = stagingBuffer;
+
+    wgpu::TexelCopyTextureInfo destination;
+    destination.texture = streamedTexture.texture;
+    destination.origin  = {0, 0, 0};
+    destination.aspect  = wgpu::TextureAspect::All;
+
+    wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
+    for (const StagedLevel& stagedLevel : stagedLevels)
+    {
+        const unsigned char* levelData = image.levels[stagedLevel.level].data.data();
+        const LevelLayout& layout      = stagedLevel.layout;
+        unsigned char* stagedData      = stagingData + stagedLevel.offset;
+        if (layout.bytesPerRow == stagedLevel.bytesPerRow)
+        {
+            memcpy(stagedData, levelData, size_t(layout.bytesPerRow) * layout.rowsPerImage);
+        }
+        else
+        {
+            for (uint32_t row = 0; row < layout.rowsPerImage; ++row)
+            {
+                memcpy(stagedData + size_t(row) * stagedLevel.bytesPerRow,
+                       levelData + size_t(row) * layout.bytesPerRow,
+                       layout.bytesPerRow);
+            }
+        }
+
+        source.layout.offset       = stagedLevel.offset;
+        source.layout.bytesPerRow  = stagedLevel.bytesPerRow;
+        source.layout.rowsPerImage = layout.rowsPerImage;
+        destination.mipLevel       = stagedLevel.level;
+        encoder.CopyBufferToTexture(&source, &destination, &layout.copySize);
+    }
+    stagingBuffer.Unmap();
+
+    wgpu::CommandBuffer commands = encoder.Finish();
+    device.GetQueue().Submit(1, &commands);
+
+    streamedTexture.residentLevel = stagedLevels.back().level;
+    if (streamedTexture.residentLevel == 0)
+    {
+        streamedTexture.image.reset();
+        std::string stage = "streaming " + streamedTexture.path.string();
+        MemoryUsage::LogPeakResidentSize(stage.c_str());
+    }
+    streamedTexture.view = CreateView(streamedTexture.texture, streamedTexture.residentLevel);
+    return true;
+}
+
+wgpu::TextureView TextureStreamer::CreateView(wgpu::Texture texture, uint32_t baseMipLevel) const
+{
+    wgpu::TextureViewDescriptor textureViewDesc;
+    textureViewDesc.aspect          = wgpu::TextureAspect::All;
+    textureViewDesc.baseArrayLayer  = 0;
+    textureViewDesc.arrayLayerCount = 1;
+    textureViewDesc.baseMipLevel    = baseMipLevel;
+    textureViewDesc.mipLevelCount   = texture.GetMipLevelCount() - baseMipLevel;
+    textureViewDesc.dimension       = wgpu::TextureViewDimension::e2D;
+    textureViewDesc.format          = texture.GetFormat();
+#ifndef __EMSCRIPTEN__
+    textureViewDesc.usage = wgpu::TextureUsage::None;
+#endif
+    return texture.CreateView(&textureViewDesc);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "AssetSource.h"
+
+/**
+ * Load textures in the background without ever blocking the frame loop. Images are decoded
+ * and their mip chain generated on the shared thread pool. Until then a 1x1 placeholder is
+ * bound, and the levels are then uploaded coarsest first within a per-frame budget, the
+ * texture view exposing the finest level uploaded so far. Levels are written in place into a
+ * buffer mapped at creation and copied into the texture by the GPU.
+ *
+ * When the device supports BC compression, color textures are stored as BC7 and normal maps
+ * as BC5. Encoding happens once, the result being cached next to the source image.
+ */
+class TextureStreamer
+{
+public:
+    using Handle = uint32_t;
+
+    // Handle of no texture, e.g. of a material without a normal map
+    static constexpr Handle kInvalidHandle = UINT32_MAX;
+
+    enum class TextureType
+    {
+        // sRGB encoded color, mip levels are averaged in linear space
+        Color,
+        // Tangent space normal map, only X and Y are kept and Z is rebuilt by the shader
+        NormalMap,
+    };
+
+    TextureStreamer();
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer&)            = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    void Initialize(wgpu::Device device);
+
+    /**
+     * Start loading a texture and return its handle right away. placeholderColor is shown
+     * until the first level is uploaded.
+     */
+    Handle Load(const std::filesystem::path& path,
+                TextureType type,
+                const std::array<uint8_t, 4>& placeholderColor);
+
+    /**
+     * Same as above for an encoded image already in memory, e.g. a packed asset whose content
+     * is identified by source. path only names the texture and its cache. imageData must stay
+     * valid until the texture is resident.
+     */
+    Handle Load(const std::filesystem::path& path,
+                std::span<const unsigned char> imageData,
+                const AssetSource::Stamp& source,
+                TextureType type,
+                const std::array<uint8_t, 4>& placeholderColor);
+
+    // Create a 1x1 texture of a color, resident right away
+    Handle CreateSolid(const std::array<uint8_t, 4>& color);
+
+    /**
+     * Upload the levels decoded since the last call, coarsest first and up to a budget of
+     * bytes per call. Call once per frame before recording commands. Return true when a
+     * texture view changed, in which case the bind groups using it must be rebuilt.
+     */
+    bool Update();
+
+    wgpu::TextureView GetTextureView(Handle handle) const;
+
+private:
+    struct ImageSource;
+    struct DecodedImage;
+    struct StreamedTexture;
+    struct Mailbox;
+
+    Handle Load(const ImageSource& source,
+                TextureType type,
+                const std::array<uint8_t, 4>& placeholderColor);
+
+    // Fill the levels from an up-to-date cache in the format of the image
+    static bool LoadFromCache(const ImageSource& source, DecodedImage& image);
+    // Decode the image and generate its mip chain, falling back to RGBA8 if it can't be compressed
+    static void LoadFromImage(const ImageSource& source, TextureType type, DecodedImage& image);
+    // Encode the levels in the format of the image and cache them
+    static void Compress(const ImageSource& source, DecodedImage& image);
+
+    bool UploadLevels(StreamedTexture& streamedTexture, size_t& uploadedBytes);
+
+    wgpu::TextureView CreateView(wgpu::Texture texture, uint32_t baseMipLevel) const;
+
+    wgpu::Device device           = nullptr;
+    bool supportsBlockCompression = false;
+    std::vector<StreamedTexture> textures;
+    // Shared with the loading tasks, which may outlive the streamer
+    std::shared_ptr<Mailbox> mailbox;
+};
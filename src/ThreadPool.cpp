@@ -0,0 +1,135 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+#ifndef __EMSCRIPTEN__
+    workers.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+#endif
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::GetInstance()
+{
+    // Keep one hardware thread for the calling thread, which also takes part in ParallelFor
+    static ThreadPool instance(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+    return instance;
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> task)
+{
+    std::packaged_task<void()> packagedTask(std::move(task));
+    std::future<void> future = packagedTask.get_future();
+
+    if (workers.empty())
+    {
+        packagedTask();
+        return future;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(packagedTask));
+    }
+    condition.notify_one();
+    return future;
+}
+
+void ThreadPool::ParallelFor(size_t count,
+                             size_t grainSize,
+                             const std::function<void(size_t, size_t)>& func)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    grainSize         = std::max<size_t>(grainSize, 1);
+    size_t rangeCount = (count + grainSize - 1) / grainSize;
+    if (rangeCount == 1 || workers.empty())
+    {
+        func(0, count);
+        return;
+    }
+
+    // Helpers may start after the loop is over, so they only share ref-counted state
+    struct SharedState
+    {
+        std::atomic<size_t> nextRange {0};
+        std::atomic<size_t> completedRanges {0};
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+    auto state = std::make_shared<SharedState>();
+
+    auto runRanges = [state, count, grainSize, rangeCount, &func]()
+    {
+        size_t range;
+        while ((range = state->nextRange.fetch_add(1)) < rangeCount)
+        {
+            size_t begin = range * grainSize;
+            func(begin, std::min(begin + grainSize, count));
+            if (state->completedRanges.fetch_add(1) + 1 == rangeCount)
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->condition.notify_all();
+            }
+        }
+    };
+
+    size_t helperCount = std::min<size_t>(workers.size(), rangeCount - 1);
+    for (size_t i = 0; i < helperCount; ++i)
+    {
+        Submit(runRanges);
+    }
+    runRanges();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock,
+                          [&state, rangeCount]()
+                          {
+                              return state->completedRanges.load() == rangeCount;
+                          });
+}
+
+void ThreadPool::WorkerLoop()
+{
+    while (true)
+    {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock,
+                           [this]()
+                           {
+                               return stopping || !tasks.empty();
+                           });
+            if (stopping && tasks.empty())
+            {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads consuming a FIFO task queue. When built without thread
+ * support (Emscripten without pthreads) tasks run inline on the calling thread.
+ */
+class ThreadPool
+{
+public:
+    explicit ThreadPool(uint32_t threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&)            = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Pool shared by the resource loaders, sized after the hardware concurrency
+    static ThreadPool& GetInstance();
+
+    std::future<void> Submit(std::function<void()> task);
+
+    /**
+     * Call func(begin, end) over ranges of at most grainSize items covering [0, count)
+     * and return once all of them are done. The calling thread takes part in the work,
+     * so this is safe to call from a worker thread.
+     */
+    void ParallelFor(size_t count,
+                     size_t grainSize,
+                     const std::function<void(size_t, size_t)>& func);
+
+    uint32_t GetThreadCount() const
+    {
+        return static_cast<uint32_t>(workers.size());
+    }
+
+private:
+    void WorkerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::packaged_task<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+};
@@ -0,0 +1,76 @@
+#include "UniformRing.h"
+
+#include <SDL3/SDL_log.h>
+#include <cassert>
+#include <cstring>
+
+#include "WebGPUUtils.h"
+
+namespace
+{
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}  // namespace
+
+bool UniformRing::Initialize(wgpu::Device device,
+                             std::span<const uint64_t> blockSizes,
+                             uint32_t frameCount)
+{
+    wgpu::Limits limits {};
+    device.GetLimits(&limits);
+    uint64_t alignment = limits.minUniformBufferOffsetAlignment;
+
+    this->blockSizes.assign(blockSizes.begin(), blockSizes.end());
+    this->frameCount = frameCount;
+    blockOffsets.clear();
+    sliceSize = 0;
+    for (uint64_t blockSize : blockSizes)
+    {
+        blockOffsets.push_back(sliceSize);
+        sliceSize = AlignUp(sliceSize + blockSize, alignment);
+    }
+
+    wgpu::BufferDescriptor bufferDesc {};
+    bufferDesc.label            = WebGPUUtils::GenerateString("Uniform ring");
+    bufferDesc.size             = sliceSize * frameCount;
+    bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
+    bufferDesc.mappedAtCreation = false;
+    buffer                      = device.CreateBuffer(&bufferDesc);
+
+    slice.assign(sliceSize, 0);
+    dynamicOffsets.assign(blockOffsets.begin(), blockOffsets.end());
+    frameIndex = 0;
+    isDirty    = true;
+
+    SDL_Log("Uniform ring: %u slices of %llu bytes",
+            frameCount,
+            static_cast<unsigned long long>(sliceSize));
+    return buffer != nullptr;
+}
+
+void UniformRing::Write(Block block, const void* data, uint64_t size)
+{
+    assert(size <= blockSizes[block]);
+    memcpy(slice.data() + blockOffsets[block], data, size);
+    isDirty = true;
+}
+
+void UniformRing::Flush(wgpu::Queue queue)
+{
+    if (!isDirty)
+    {
+        return;
+    }
+
+    frameIndex          = (frameIndex + 1) % frameCount;
+    uint64_t sliceStart = sliceSize * frameIndex;
+    queue.WriteBuffer(buffer, sliceStart, slice.data(), sliceSize);
+    for (size_t i = 0; i < dynamicOffsets.size(); ++i)
+    {
+        dynamicOffsets[i] = static_cast<uint32_t>(sliceStart + blockOffsets[i]);
+    }
+
+    isDirty = false;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+ * Uniform buffer holding every uniform block in one allocation, bound once with dynamic
+ * offsets so that bind groups need not be rebuilt when uniforms change. Updates go to a CPU
+ * copy, and Flush uploads all the blocks changed during a frame with a single write instead of
+ * one per change. Nothing is uploaded in frames where no block changed.
+ *
+ * The buffer is split into slices of the same blocks at offsets aligned to
+ * minUniformBufferOffsetAlignment, each flush writing the next one. Queue writes are already
+ * ordered after the work submitted before them, so the slices are not needed to keep the GPU
+ * from reading data being written, and a single slice would be just as correct.
+ */
+class UniformRing
+{
+public:
+    using Block = uint32_t;
+
+    /**
+     * Create the buffer for blocks of the given sizes, in binding order, with frameCount
+     * slices
+     */
+    bool Initialize(wgpu::Device device,
+                    std::span<const uint64_t> blockSizes,
+                    uint32_t frameCount);
+
+    // Copy data into a block, to be uploaded by the next Flush
+    void Write(Block block, const void* data, uint64_t size);
+
+    // Upload the blocks written since the last flush, if any
+    void Flush(wgpu::Queue queue);
+
+    wgpu::Buffer GetBuffer() const
+    {
+        return buffer;
+    }
+
+    uint64_t GetBlockSize(Block block) const
+    {
+        return blockSizes[block];
+    }
+
+    // Dynamic offsets of the blocks in the current slice, for SetBindGroup
+    std::span<const uint32_t> GetDynamicOffsets() const
+    {
+        return dynamicOffsets;
+    }
+
+    // Slice holding the blocks of the current frame, the dynamic offsets only depend on it
+    uint32_t GetSliceIndex() const
+    {
+        return frameIndex;
+    }
+
+    uint32_t GetSliceCount() const
+    {
+        return frameCount;
+    }
+
+private:
+    wgpu::Buffer buffer = nullptr;
+    std::vector<uint64_t> blockSizes;
+    // Offsets of the blocks within a slice
+    std::vector<uint64_t> blockOffsets;
+    uint64_t sliceSize  = 0;
+    uint32_t frameCount = 0;
+    uint32_t frameIndex = 0;
+
+    std::vector<unsigned char> slice;
+    std::vector<uint32_t> dynamicOffsets;
+    bool isDirty = false;
+};
@@ -0,0 +1,30 @@
+#include "VertexFormat.h"
+
+#include <cstddef>
+#include <cstring>
+
+uint32_t GetPositionSize(VertexFormat vertexFormat)
+{
+    return vertexFormat == VertexFormat::Packed ? sizeof(PackedVertexAttributes::position)
+                                                : sizeof(VertexAttributes::position);
+}
+
+std::vector<unsigned char> SplitVertexStreams(VertexFormat vertexFormat,
+                                              std::span<const unsigned char> vertexData)
+{
+    size_t vertexSize    = vertexFormat == VertexFormat::Packed ? sizeof(PackedVertexAttributes)
+                                                                : sizeof(VertexAttributes);
+    size_t positionSize  = GetPositionSize(vertexFormat);
+    size_t attributeSize = vertexSize - positionSize;
+    size_t vertexCount   = vertexData.size() / vertexSize;
+
+    std::vector<unsigned char> streamData(vertexData.size());
+    unsigned char* attributes = streamData.data() + vertexCount * positionSize;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        const unsigned char* vertex = vertexData.data() + i * vertexSize;
+        memcpy(streamData.data() + i * positionSize, vertex, positionSize);
+        memcpy(attributes + i * attributeSize, vertex + positionSize, attributeSize);
+    }
+    return streamData;
+}
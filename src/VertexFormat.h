@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <span>
+#include <vector>
+
+struct VertexAttributes
+{
+    glm::vec3 position;
+    // Texture mapping attributes represent the local frame in which
+    // normals sampled from the normal map are expressed.
+    glm::vec3 tangent;    // T = local X axis
+    glm::vec3 bitangent;  // B = local Y axis
+    glm::vec3 normal;     // N = local Z axis
+
+    glm::vec3 color;
+    glm::vec2 uv;
+};
+
+// Compact alternative to VertexAttributes (24 bytes instead of 68)
+struct PackedVertexAttributes
+{
+    // unorm16 within the mesh bounds, see Application::MyUniforms::positionScale/positionOffset
+    uint16_t position[4];
+    // Octahedral encoded snorm16, the bitangent is reconstructed as cross(normal, tangent)
+    int16_t normal[2];
+    int16_t tangent[2];
+
+    uint8_t color[4];  // unorm8
+    uint16_t uv[2];    // float16
+};
+
+static_assert(sizeof(PackedVertexAttributes) == 24);
+
+enum class VertexFormat
+{
+    // Full precision VertexAttributes
+    Full,
+    // Quantized PackedVertexAttributes
+    Packed,
+};
+
+// Size of the position of a vertex, which comes first in both formats
+uint32_t GetPositionSize(VertexFormat vertexFormat);
+
+// Split interleaved vertices into the positions of all vertices followed by their attributes
+std::vector<unsigned char> SplitVertexStreams(VertexFormat vertexFormat,
+                                              std::span<const unsigned char> vertexData);
@@ -0,0 +1,74 @@
+#include "VertexLayout.h"
+
+#include <cstddef>
+
+std::array<wgpu::VertexBufferLayout, 2>
+GetVertexBufferLayouts(VertexFormat vertexFormat, std::vector<wgpu::VertexAttribute>& attributes)
+{
+    uint32_t vertexSize;
+    if (vertexFormat == VertexFormat::Packed)
+    {
+        attributes.resize(5);
+        attributes[0].shaderLocation = 0;  // @location(0) quantized position attribute
+        attributes[0].format         = wgpu::VertexFormat::Unorm16x4;
+        attributes[0].offset         = offsetof(PackedVertexAttributes, position);
+        attributes[1].shaderLocation = 1;  // @location(1) octahedral normal attribute
+        attributes[1].format         = wgpu::VertexFormat::Snorm16x2;
+        attributes[1].offset         = offsetof(PackedVertexAttributes, normal);
+        attributes[2].shaderLocation = 2;  // @location(2) octahedral tangent attribute
+        attributes[2].format         = wgpu::VertexFormat::Snorm16x2;
+        attributes[2].offset         = offsetof(PackedVertexAttributes, tangent);
+        attributes[3].shaderLocation = 3;  // @location(3) color attribute
+        attributes[3].format         = wgpu::VertexFormat::Unorm8x4;
+        attributes[3].offset         = offsetof(PackedVertexAttributes, color);
+        attributes[4].shaderLocation = 4;  // @location(4) uv attribute
+        attributes[4].format         = wgpu::VertexFormat::Float16x2;
+        attributes[4].offset         = offsetof(PackedVertexAttributes, uv);
+
+        vertexSize = sizeof(PackedVertexAttributes);
+    }
+    else
+    {
+        attributes.resize(6);
+        attributes[0].shaderLocation = 0;  // @location(0) position attribute
+        attributes[0].format         = wgpu::VertexFormat::Float32x3;
+        attributes[0].offset         = offsetof(VertexAttributes, position);
+        attributes[1].shaderLocation = 1;  // @location(1) tangent attribute
+        attributes[1].format         = wgpu::VertexFormat::Float32x3;
+        attributes[1].offset         = offsetof(VertexAttributes, tangent);
+        attributes[2].shaderLocation = 2;  // @location(2) bitangent attribute
+        attributes[2].format         = wgpu::VertexFormat::Float32x3;
+        attributes[2].offset         = offsetof(VertexAttributes, bitangent);
+        attributes[3].shaderLocation = 3;  // @location(3) normal attribute
+        attributes[3].format         = wgpu::VertexFormat::Float32x3;
+        attributes[3].offset         = offsetof(VertexAttributes, normal);
+        attributes[4].shaderLocation = 4;  // @location(4) color attribute
+        attributes[4].format         = wgpu::VertexFormat::Float32x3;
+        attributes[4].offset         = offsetof(VertexAttributes, color);
+        attributes[5].shaderLocation = 5;  // @location(5) uv attribute
+        attributes[5].format         = wgpu::VertexFormat::Float32x2;
+        attributes[5].offset         = offsetof(VertexAttributes, uv);
+
+        vertexSize = sizeof(VertexAttributes);
+    }
+
+    // The other attributes are offset within their stream by the size of the position
+    uint32_t positionSize = GetPositionSize(vertexFormat);
+    for (size_t i = 1; i < attributes.size(); ++i)
+    {
+        attributes[i].offset -= positionSize;
+    }
+
+    std::array<wgpu::VertexBufferLayout, 2> vertexBufferLayouts {};
+    vertexBufferLayouts[0].arrayStride    = positionSize;
+    vertexBufferLayouts[0].attributeCount = 1;
+    vertexBufferLayouts[0].attributes     = attributes.data();
+    vertexBufferLayouts[1].arrayStride    = vertexSize - positionSize;
+    vertexBufferLayouts[1].attributeCount = static_cast<uint32_t>(attributes.size() - 1);
+    vertexBufferLayouts[1].attributes     = attributes.data() + 1;
+    for (wgpu::VertexBufferLayout& vertexBufferLayout : vertexBufferLayouts)
+    {
+        vertexBufferLayout.stepMode = wgpu::VertexStepMode::Vertex;
+    }
+    return vertexBufferLayouts;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <array>
+#include <vector>
+
+#include "VertexFormat.h"
+
+/**
+ * Describe the two vertex buffers holding vertices of the given format: the positions, on
+ * their own so that depth-only passes fetch nothing else, then the other attributes. Their
+ * descriptions are stored in attributes, which must outlive the layouts.
+ */
+std::array<wgpu::VertexBufferLayout, 2>
+GetVertexBufferLayouts(VertexFormat vertexFormat, std::vector<wgpu::VertexAttribute>& attributes);
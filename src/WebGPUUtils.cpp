@@ -2,6 +2,7 @@
 
 #include <SDL3/SDL_log.h>
 #include <cassert>
+#include <memory>
 #include <vector>
 
 /**
@@ -152,3 +153,92 @@ wgpu::TextureFormat WebGPUUtils::GetTextureFormat(wgpu::Surface surface, wgpu::A
 
     return surfaceFormat;
 }
+
+void WebGPUUtils::LogCompilationMessages(wgpu::ShaderModule shaderModule, const char* label)
+{
+    auto callback = [name = std::string(label)](wgpu::CompilationInfoRequestStatus status,
+                                                const wgpu::CompilationInfo* compilationInfo)
+    {
+        if (status != wgpu::CompilationInfoRequestStatus::Success || compilationInfo == nullptr)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < compilationInfo->messageCount; ++i)
+        {
+            const wgpu::CompilationMessage& message = compilationInfo->messages[i];
+            if (message.type == wgpu::CompilationMessageType::Info)
+            {
+                continue;
+            }
+            SDL_Log("%s:%llu:%llu: %s: %.*s",
+                    name.c_str(),
+                    static_cast<unsigned long long>(message.lineNum),
+                    static_cast<unsigned long long>(message.linePos),
+                    message.type == wgpu::CompilationMessageType::Error ? "error" : "warning",
+                    static_cast<int>(message.message.length),
+                    message.message.data);
+        }
+    };
+
+    shaderModule.GetCompilationInfo(kCallbackMode, callback);
+}
+
+void WebGPUUtils::CreateComputePipelinesAsync(
+    wgpu::Device device,
+    std::span<const wgpu::ComputePipelineDescriptor> pipelineDescs,
+    std::function<void(std::span<const wgpu::ComputePipeline>)> onCreated)
+{
+    // Shared by the callbacks, the last one to complete handing over the pipelines
+    struct Creation
+    {
+        std::vector<wgpu::ComputePipeline> pipelines;
+        size_t pendingCount = 0;
+        bool isFailed       = false;
+        std::function<void(std::span<const wgpu::ComputePipeline>)> onCreated;
+    };
+
+    auto creation          = std::make_shared<Creation>();
+    creation->pendingCount = pipelineDescs.size();
+    creation->onCreated    = std::move(onCreated);
+    creation->pipelines.resize(pipelineDescs.size());
+    for (size_t i = 0; i < pipelineDescs.size(); ++i)
+    {
+        auto callback = [creation, i](wgpu::CreatePipelineAsyncStatus status,
+                                      wgpu::ComputePipeline pipeline,
+                                      wgpu::StringView message)
+        {
+            if (status == wgpu::CreatePipelineAsyncStatus::Success)
+            {
+                creation->pipelines[i] = std::move(pipeline);
+            }
+            else
+            {
+                SDL_Log("Could not create compute pipeline: %.*s",
+                        static_cast<int>(message.length),
+                        message.data);
+                creation->isFailed = true;
+            }
+
+            if (--creation->pendingCount == 0 && !creation->isFailed)
+            {
+                creation->onCreated(creation->pipelines);
+            }
+        };
+
+        device.CreateComputePipelineAsync(&pipelineDescs[i], kCallbackMode, callback);
+    }
+}
+
+wgpu::Buffer WebGPUUtils::CreateMappedBuffer(wgpu::Device device,
+                                             const char* label,
+                                             wgpu::BufferUsage usage,
+                                             uint64_t size)
+{
+    wgpu::BufferDescriptor bufferDesc {};
+    bufferDesc.label            = GenerateString(label);
+    bufferDesc.size             = (size + 3) & ~uint64_t(3);
+    bufferDesc.usage            = usage;
+    bufferDesc.mappedAtCreation = true;
+    return device.CreateBuffer(&bufferDesc);
+}
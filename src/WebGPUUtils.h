@@ -1,10 +1,22 @@
 #pragma once
 
 #include <webgpu/webgpu_cpp.h>
+#include <functional>
+#include <span>
 #include <string>
 
 namespace WebGPUUtils
 {
+    /**
+     * Mode of the asynchronous callbacks that touch the state of the main loop. On native they
+     * only run during Device::Tick, which the main loop calls once per frame.
+     */
+#ifdef __EMSCRIPTEN__
+    constexpr wgpu::CallbackMode kCallbackMode = wgpu::CallbackMode::AllowSpontaneous;
+#else
+    constexpr wgpu::CallbackMode kCallbackMode = wgpu::CallbackMode::AllowProcessEvents;
+#endif
+
     /**
      * Utility function to get a WebGPU adapter
      */
@@ -34,6 +46,32 @@ namespace WebGPUUtils
      */
     wgpu::TextureFormat GetTextureFormat(wgpu::Surface surface, wgpu::Adapter adapter);
 
+    /**
+     * Log the errors and warnings of a shader module once its compilation completes, label
+     * being the name of its source
+     */
+    void LogCompilationMessages(wgpu::ShaderModule shaderModule, const char* label);
+
+    /**
+     * Create compute pipelines asynchronously, calling onCreated with all of them, in the order
+     * of their descriptors, once every one is ready. Errors are logged and onCreated is not
+     * called then, so that the caller keeps its current pipelines.
+     */
+    void CreateComputePipelinesAsync(
+        wgpu::Device device,
+        std::span<const wgpu::ComputePipelineDescriptor> pipelineDescs,
+        std::function<void(std::span<const wgpu::ComputePipeline>)> onCreated);
+
+    /**
+     * Create a buffer mapped at creation, its size rounded up to a multiple of 4. The caller
+     * fills GetMappedRange() in place and calls Unmap(), which saves the copy into the staging
+     * memory of Queue::WriteBuffer.
+     */
+    wgpu::Buffer CreateMappedBuffer(wgpu::Device device,
+                                    const char* label,
+                                    wgpu::BufferUsage usage,
+                                    uint64_t size);
+
     inline wgpu::StringView GenerateString(const char* str)
     {
         return {str, strlen(str)};
@@ -0,0 +1,271 @@
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "BufferPool.h"
+#include "TestDevice.h"
+#include "TestUtils.h"
+
+namespace
+{
+    // Two streams of one word each, in slabs of 64 elements
+    constexpr uint32_t kElementSize = 8;
+    constexpr uint64_t kSlabSize    = 64 * kElementSize;
+
+    // Words of a range, those of the first stream followed by those of the second
+    std::vector<uint32_t> CreateData(uint32_t elementCount, uint32_t seed)
+    {
+        std::vector<uint32_t> data(2 * elementCount);
+        for (uint32_t i = 0; i < data.size(); ++i)
+        {
+            data[i] = seed * 1000 + i;
+        }
+        return data;
+    }
+
+    // Whether both streams of a range hold the data written to it
+    bool HoldsData(TestDevice& testDevice,
+                   const BufferPool& pool,
+                   BufferPool::Handle handle,
+                   const std::vector<uint32_t>& data)
+    {
+        uint32_t elementCount = static_cast<uint32_t>(data.size() / 2);
+        for (uint32_t stream = 0; stream < 2; ++stream)
+        {
+            uint64_t offset = pool.GetStreamOffset(handle, stream)
+                            + uint64_t(pool.GetFirstElement(handle)) * sizeof(uint32_t);
+            std::vector<unsigned char> bytes =
+                testDevice.ReadBuffer(pool.GetBuffer(handle),
+                                      offset,
+                                      elementCount * sizeof(uint32_t));
+            if (bytes.size() != elementCount * sizeof(uint32_t)
+                || memcmp(bytes.data(),
+                          data.data() + stream * elementCount,
+                          bytes.size()) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Ranges of a mesh in the vertex and index pools, and the data written to them
+    struct TestMesh
+    {
+        BufferPool::Handle vertices;
+        BufferPool::Handle indices;
+        std::vector<uint32_t> vertexData;
+        std::vector<uint32_t> indexData;
+    };
+
+    // Arguments of the indexed draw of a mesh, as Application::UpdateDrawBatches fills them
+    struct Draw
+    {
+        int32_t baseVertex;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+    };
+
+    Draw GetDraw(const BufferPool& vertexPool, const BufferPool& indexPool, const TestMesh& mesh)
+    {
+        return {static_cast<int32_t>(vertexPool.GetFirstElement(mesh.vertices)),
+                indexPool.GetFirstElement(mesh.indices),
+                static_cast<uint32_t>(mesh.indexData.size())};
+    }
+
+    /**
+     * Whether a draw fetches the vertices of a mesh, with the bindings of
+     * Application::EncodeScene: the whole index buffer of its slab, and each stream of its
+     * vertex slab from GetStreamOffset, the indices being relative to the base vertex
+     */
+    bool DrawsMesh(TestDevice& testDevice,
+                   const BufferPool& vertexPool,
+                   const BufferPool& indexPool,
+                   const TestMesh& mesh,
+                   const Draw& draw)
+    {
+        std::vector<unsigned char> indexBytes =
+            testDevice.ReadBuffer(indexPool.GetBuffer(mesh.indices),
+                                  uint64_t(draw.firstIndex) * sizeof(uint32_t),
+                                  draw.indexCount * sizeof(uint32_t));
+        if (indexBytes.size() != draw.indexCount * sizeof(uint32_t))
+        {
+            return false;
+        }
+        std::vector<uint32_t> indices(draw.indexCount);
+        memcpy(indices.data(), indexBytes.data(), indexBytes.size());
+
+        uint32_t vertexCount = static_cast<uint32_t>(mesh.vertexData.size() / 2);
+        for (uint32_t stream = 0; stream < 2; ++stream)
+        {
+            std::vector<unsigned char> streamBytes =
+                testDevice.ReadBuffer(vertexPool.GetBuffer(mesh.vertices),
+                                      vertexPool.GetStreamOffset(mesh.vertices, stream),
+                                      vertexPool.GetStreamSize(mesh.vertices, stream));
+            for (uint32_t index : indices)
+            {
+                uint64_t offset = (uint64_t(draw.baseVertex) + index) * sizeof(uint32_t);
+                uint32_t word   = 0;
+                if (index >= vertexCount || offset + sizeof(word) > streamBytes.size())
+                {
+                    return false;
+                }
+                memcpy(&word, streamBytes.data() + offset, sizeof(word));
+                if (word != mesh.vertexData[stream * vertexCount + index])
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Free every other mesh of a vertex pool and an index pool, defragment both, and check that
+     * the draws rebuilt from the handles of the remaining meshes still fetch their vertices
+     */
+    void CheckRebuiltDraws(TestDevice& testDevice, std::span<const uint32_t> streamSizes)
+    {
+        BufferPool vertexPool;
+        vertexPool.Initialize(testDevice.GetDevice(),
+                              "Test vertex pool",
+                              wgpu::BufferUsage::Vertex,
+                              kElementSize,
+                              kSlabSize,
+                              streamSizes);
+        BufferPool indexPool;
+        indexPool.Initialize(testDevice.GetDevice(),
+                             "Test index pool",
+                             wgpu::BufferUsage::Index,
+                             sizeof(uint32_t),
+                             kSlabSize);
+
+        // Fans of triangles around the first vertex, the indices being local to each mesh
+        std::vector<TestMesh> meshes(8);
+        for (uint32_t i = 0; i < meshes.size(); ++i)
+        {
+            TestMesh& mesh       = meshes[i];
+            uint32_t vertexCount = 12 + i;
+            mesh.vertexData      = CreateData(vertexCount, 10 + i);
+            for (uint32_t v = 1; v + 1 < vertexCount; ++v)
+            {
+                mesh.indexData.insert(mesh.indexData.end(), {0, v, v + 1});
+            }
+
+            mesh.vertices = vertexPool.Allocate(vertexCount);
+            mesh.indices  = indexPool.Allocate(static_cast<uint32_t>(mesh.indexData.size()));
+            CHECK(mesh.vertices != BufferPool::kInvalidHandle);
+            CHECK(mesh.indices != BufferPool::kInvalidHandle);
+            vertexPool.Write(mesh.vertices,
+                             mesh.vertexData.data(),
+                             mesh.vertexData.size() * sizeof(uint32_t));
+            indexPool.Write(mesh.indices,
+                            mesh.indexData.data(),
+                            mesh.indexData.size() * sizeof(uint32_t));
+        }
+        vertexPool.Flush();
+        indexPool.Flush();
+        for (uint32_t i = 0; i < meshes.size(); i += 2)
+        {
+            vertexPool.Free(meshes[i].vertices);
+            indexPool.Free(meshes[i].indices);
+        }
+
+        std::vector<Draw> draws;
+        for (const TestMesh& mesh : meshes)
+        {
+            draws.push_back(GetDraw(vertexPool, indexPool, mesh));
+        }
+
+        for (BufferPool* pool : {&vertexPool, &indexPool})
+        {
+            CHECK(pool->GetStats().fragmentation > 0.0f);
+            pool->Defragment();
+            pool->Flush();
+        }
+
+        bool isMoved = false;
+        for (uint32_t i = 1; i < meshes.size(); i += 2)
+        {
+            Draw draw = GetDraw(vertexPool, indexPool, meshes[i]);
+            if (draw.baseVertex != draws[i].baseVertex || draw.firstIndex != draws[i].firstIndex)
+            {
+                isMoved = true;
+            }
+            if (!CHECK(DrawsMesh(testDevice, vertexPool, indexPool, meshes[i], draw)))
+            {
+                SDL_Log("Mesh %u is not drawn from its moved ranges", i);
+            }
+        }
+        CHECK(isMoved);
+    }
+}  // namespace
+
+/**
+ * Scatter the free space of a pool by freeing every other range, defragment it, and check that
+ * the handles of the remaining ranges resolve to their data in the repacked slabs, then that the
+ * draws of meshes rebuilt from their handles after a defragmentation fetch their vertices
+ */
+int main()
+{
+    TestDevice testDevice;
+    if (!testDevice.Initialize())
+    {
+        return TestUtils::kSkipped;
+    }
+
+    std::array<uint32_t, 2> streamSizes = {sizeof(uint32_t), sizeof(uint32_t)};
+    BufferPool pool;
+    pool.Initialize(testDevice.GetDevice(),
+                    "Test pool",
+                    wgpu::BufferUsage::Vertex,
+                    kElementSize,
+                    kSlabSize,
+                    streamSizes);
+
+    std::vector<BufferPool::Handle> handles;
+    std::vector<std::vector<uint32_t>> data;
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        data.push_back(CreateData(12 + i, i));
+        handles.push_back(pool.Allocate(12 + i));
+        CHECK(handles.back() != BufferPool::kInvalidHandle);
+        pool.Write(handles.back(), data.back().data(), data.back().size() * sizeof(uint32_t));
+    }
+    pool.Flush();
+    for (uint32_t i = 0; i < handles.size(); i += 2)
+    {
+        pool.Free(handles[i]);
+    }
+
+    BufferPool::Stats stats = pool.GetStats();
+    CHECK(stats.fragmentation > 0.0f);
+
+    uint64_t movedSize = pool.Defragment();
+    pool.Flush();
+
+    BufferPool::Stats packedStats = pool.GetStats();
+    CHECK(movedSize == packedStats.usedSize);
+    CHECK(packedStats.usedSize == stats.usedSize);
+    CHECK(packedStats.slabCount <= stats.slabCount);
+    CHECK(packedStats.fragmentation == 0.0f);
+    for (uint32_t i = 1; i < handles.size(); i += 2)
+    {
+        CHECK(pool.GetSize(handles[i]) == data[i].size() * sizeof(uint32_t));
+        CHECK(HoldsData(testDevice, pool, handles[i], data[i]));
+    }
+
+    // Freed handles are reused, and ranges allocated after a defragmentation are written alike
+    std::vector<uint32_t> newData = CreateData(20, 8);
+    BufferPool::Handle handle     = pool.Allocate(20);
+    CHECK(handle == handles[6]);
+    pool.Write(handle, newData.data(), newData.size() * sizeof(uint32_t));
+    pool.Flush();
+    CHECK(HoldsData(testDevice, pool, handle, newData));
+
+    CheckRebuiltDraws(testDevice, streamSizes);
+
+    return TestUtils::Finish();
+}
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "GpuMipMapGenerator.h"
+#include "MipMapGenerator.h"
+#include "TestDevice.h"
+#include "TestUtils.h"
+
+namespace
+{
+    // Largest difference of a channel between the levels of both generators. The GPU filters in
+    // floating point and rounds each level to the nearest, the CPU in integers for even sizes,
+    // and both chains then downsample their own rounding. The shader emulated on the CPU is
+    // within 2 of MipMapGenerator in sRGB space, with some margin left for pow on GPUs.
+    constexpr int kTolerance = 3;
+
+    // The usages GpuMipMapGenerator requires, plus the upload and the read back of the levels
+    const wgpu::TextureUsage kTextureUsage =
+        wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::StorageBinding
+        | wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::CopySrc;
+
+    std::vector<unsigned char> CreateImage(uint32_t width, uint32_t height, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_int_distribution<int> byte(0, 255);
+        std::vector<unsigned char> pixels(4 * size_t(width) * height);
+        for (unsigned char& value : pixels)
+        {
+            value = static_cast<unsigned char>(byte(random));
+        }
+        return pixels;
+    }
+
+    // Texture with its level 0 uploaded, ready for GpuMipMapGenerator::Generate
+    wgpu::Texture CreateTexture(wgpu::Device device,
+                                const std::vector<unsigned char>& pixels,
+                                uint32_t width,
+                                uint32_t height)
+    {
+        wgpu::TextureDescriptor textureDesc {};
+        textureDesc.dimension     = wgpu::TextureDimension::e2D;
+        textureDesc.format        = wgpu::TextureFormat::RGBA8Unorm;
+        textureDesc.size          = {width, height, 1};
+        textureDesc.mipLevelCount = std::bit_width(std::max(width, height));
+        textureDesc.sampleCount   = 1;
+        textureDesc.usage         = kTextureUsage;
+        wgpu::Texture texture     = device.CreateTexture(&textureDesc);
+
+        wgpu::TexelCopyTextureInfo destination;
+        destination.texture = texture;
+        wgpu::TexelCopyBufferLayout layout;
+        layout.bytesPerRow  = 4 * width;
+        layout.rowsPerImage = height;
+        device.GetQueue().WriteTexture(&destination,
+                                       pixels.data(),
+                                       pixels.size(),
+                                       &layout,
+                                       &textureDesc.size);
+        return texture;
+    }
+
+    // Largest difference of a channel between two levels, or INT_MAX when their sizes differ
+    int GetMaxDifference(const std::vector<unsigned char>& gpuLevel,
+                         const MipMapGenerator::MipLevel& cpuLevel)
+    {
+        if (gpuLevel.size() != 4 * size_t(cpuLevel.width) * cpuLevel.height)
+        {
+            return INT_MAX;
+        }
+        int maxDifference = 0;
+        for (size_t i = 0; i < gpuLevel.size(); ++i)
+        {
+            maxDifference = std::max(maxDifference, std::abs(gpuLevel[i] - cpuLevel.data[i]));
+        }
+        return maxDifference;
+    }
+}  // namespace
+
+/**
+ * Compute the mip chains of images of even, odd and one-texel sizes with the compute shader of
+ * GpuMipMapGenerator, in linear and sRGB space, and check every level against the chain of
+ * MipMapGenerator on the CPU
+ */
+int main()
+{
+    // Runs on SwiftShader without a GPU, so a missing adapter fails rather than skips the test
+    TestDevice testDevice;
+    if (!CHECK(testDevice.Initialize()))
+    {
+        return TestUtils::Finish();
+    }
+
+    // Loads resources/mipmap.wgsl, the test running from the root of the repository
+    GpuMipMapGenerator gpuMipMapGenerator;
+    if (!CHECK(gpuMipMapGenerator.Initialize(testDevice.GetDevice())))
+    {
+        return TestUtils::Finish();
+    }
+
+    const uint32_t sizes[][2] = {{64, 64}, {256, 32}, {37, 20}, {45, 45}, {1, 9}};
+    for (const auto& size : sizes)
+    {
+        std::vector<unsigned char> image = CreateImage(size[0], size[1], size[0] * size[1]);
+        for (bool isSrgb : {false, true})
+        {
+            wgpu::Texture texture = CreateTexture(testDevice.GetDevice(), image, size[0], size[1]);
+            gpuMipMapGenerator.Generate(texture, isSrgb);
+
+            std::vector<unsigned char> arena;
+            std::vector<MipMapGenerator::MipLevel> levels =
+                MipMapGenerator::Generate(image.data(),
+                                          size[0],
+                                          size[1],
+                                          texture.GetMipLevelCount(),
+                                          isSrgb,
+                                          arena);
+            CHECK(levels.size() == texture.GetMipLevelCount());
+
+            int maxDifference = 0;
+            for (uint32_t level = 1; level < levels.size(); ++level)
+            {
+                maxDifference = std::max(
+                    maxDifference,
+                    GetMaxDifference(testDevice.ReadTexture(texture, level), levels[level]));
+            }
+            SDL_Log("%ux%u %s mip chain: GPU within %d of the CPU",
+                    size[0],
+                    size[1],
+                    isSrgb ? "sRGB" : "linear",
+                    maxDifference);
+            CHECK(maxDifference <= kTolerance);
+        }
+    }
+
+    return TestUtils::Finish();
+}
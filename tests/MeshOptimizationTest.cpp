@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <glm/ext.hpp>
+#include <glm/glm.hpp>
+
+#include "ObjParser.h"
+#include "ResourceManager.h"
+#include "TestDevice.h"
+#include "TestUtils.h"
+#include "VertexFormat.h"
+#include "VertexLayout.h"
+#include "WebGPUUtils.h"
+
+namespace
+{
+    // Quads around and along the tube of the torus
+    constexpr uint32_t kSegmentCount = 96;
+    constexpr uint32_t kRingCount    = 48;
+
+    constexpr uint32_t kImageSize = 256;
+
+    // Largest difference of a color channel between the images, for rounding in the
+    // interpolation of triangles whose corners the optimizer may have rotated
+    constexpr int kTolerance = 1;
+
+    constexpr wgpu::TextureFormat kColorFormat = wgpu::TextureFormat::RGBA8Unorm;
+    constexpr wgpu::TextureFormat kDepthFormat = wgpu::TextureFormat::Depth32Float;
+
+    // Shading with the normals and UVs, so that welding a vertex with the wrong one shows
+    const char kShaderSource[] = R"(
+        @group(0) @binding(0) var<uniform> uViewProjection: mat4x4f;
+
+        struct VertexOutput {
+            @builtin(position) position: vec4f,
+            @location(0) normal: vec3f,
+            @location(1) color: vec3f,
+            @location(2) uv: vec2f,
+        };
+
+        @vertex
+        fn vs_main(@location(0) position: vec3f,
+                   @location(3) normal: vec3f,
+                   @location(4) color: vec3f,
+                   @location(5) uv: vec2f) -> VertexOutput {
+            var out: VertexOutput;
+            out.position = uViewProjection * vec4f(position, 1.0);
+            out.normal = normal;
+            out.color = color;
+            out.uv = uv;
+            return out;
+        }
+
+        @fragment
+        fn fs_main(in: VertexOutput) -> @location(0) vec4f {
+            return vec4f(mix(in.normal * 0.5 + 0.5, vec3f(in.uv, 0.0), 0.5) * in.color, 1.0);
+        }
+    )";
+
+    // Vertex streams as split by SplitVertexStreams, and the indices if any
+    struct GpuMesh
+    {
+        wgpu::Buffer vertexBuffer = nullptr;
+        uint64_t positionSize     = 0;
+        wgpu::Buffer indexBuffer  = nullptr;
+        uint32_t drawCount        = 0;
+    };
+
+    /**
+     * OBJ text of a torus around the Y axis, made of quads, whose seams repeat the positions of
+     * the first vertices with other UVs so that welding must keep them apart
+     */
+    std::string CreateTorusObj()
+    {
+        std::string text;
+        char line[128];
+        std::vector<glm::vec3> normals;
+        std::vector<glm::vec2> texCoords;
+        for (uint32_t j = 0; j <= kRingCount; ++j)
+        {
+            for (uint32_t i = 0; i <= kSegmentCount; ++i)
+            {
+                glm::vec2 uv       = {static_cast<float>(i) / kSegmentCount,
+                                      static_cast<float>(j) / kRingCount};
+                float theta        = 2.0f * glm::pi<float>() * uv.x;
+                float phi          = 2.0f * glm::pi<float>() * uv.y;
+                glm::vec3 center   = {std::cos(theta), 0.0f, std::sin(theta)};
+                glm::vec3 normal   = {std::cos(theta) * std::cos(phi),
+                                      std::sin(phi),
+                                      std::sin(theta) * std::cos(phi)};
+                glm::vec3 position = center + 0.4f * normal;
+                snprintf(line,
+                         sizeof(line),
+                         "v %.9g %.9g %.9g\n",
+                         position.x,
+                         position.y,
+                         position.z);
+                text += line;
+                normals.push_back(normal);
+                texCoords.push_back(uv);
+            }
+        }
+        for (const glm::vec3& normal : normals)
+        {
+            snprintf(line, sizeof(line), "vn %.9g %.9g %.9g\n", normal.x, normal.y, normal.z);
+            text += line;
+        }
+        for (const glm::vec2& uv : texCoords)
+        {
+            snprintf(line, sizeof(line), "vt %.9g %.9g\n", uv.x, uv.y);
+            text += line;
+        }
+
+        for (uint32_t j = 0; j < kRingCount; ++j)
+        {
+            for (uint32_t i = 0; i < kSegmentCount; ++i)
+            {
+                uint32_t a = j * (kSegmentCount + 1) + i + 1;
+                uint32_t b = a + 1;
+                uint32_t c = b + kSegmentCount + 1;
+                uint32_t d = a + kSegmentCount + 1;
+                snprintf(line,
+                         sizeof(line),
+                         "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n",
+                         a,
+                         a,
+                         a,
+                         d,
+                         d,
+                         d,
+                         c,
+                         c,
+                         c,
+                         b,
+                         b,
+                         b);
+                text += line;
+            }
+        }
+        return text;
+    }
+
+    wgpu::Buffer CreateBuffer(wgpu::Device device,
+                              const char* label,
+                              wgpu::BufferUsage usage,
+                              std::span<const unsigned char> data)
+    {
+        wgpu::Buffer buffer = WebGPUUtils::CreateMappedBuffer(device, label, usage, data.size());
+        memcpy(buffer.GetMappedRange(), data.data(), data.size());
+        buffer.Unmap();
+        return buffer;
+    }
+
+    GpuMesh CreateGpuMesh(wgpu::Device device,
+                          const std::vector<VertexAttributes>& vertexData,
+                          const std::vector<uint32_t>& indexData)
+    {
+        std::vector<unsigned char> streamData = SplitVertexStreams(
+            VertexFormat::Full,
+            {reinterpret_cast<const unsigned char*>(vertexData.data()),
+             vertexData.size() * sizeof(VertexAttributes)});
+
+        GpuMesh mesh;
+        mesh.vertexBuffer =
+            CreateBuffer(device, "Test vertex buffer", wgpu::BufferUsage::Vertex, streamData);
+        mesh.positionSize = vertexData.size() * GetPositionSize(VertexFormat::Full);
+        mesh.drawCount    = static_cast<uint32_t>(vertexData.size());
+        if (!indexData.empty())
+        {
+            std::span<const unsigned char> indexBytes = {
+                reinterpret_cast<const unsigned char*>(indexData.data()),
+                indexData.size() * sizeof(uint32_t)};
+            mesh.indexBuffer =
+                CreateBuffer(device, "Test index buffer", wgpu::BufferUsage::Index, indexBytes);
+            mesh.drawCount = static_cast<uint32_t>(indexData.size());
+        }
+        return mesh;
+    }
+
+    // Pipeline drawing the meshes with the vertex layout of the application, depth tested
+    wgpu::RenderPipeline CreatePipeline(wgpu::Device device, wgpu::BindGroupLayout bindGroupLayout)
+    {
+        std::span<const unsigned char> shaderSource(
+            reinterpret_cast<const unsigned char*>(kShaderSource),
+            strlen(kShaderSource));
+        wgpu::ShaderModule shaderModule = ResourceManager::LoadShaderModule(shaderSource, device);
+
+        wgpu::PipelineLayoutDescriptor layoutDesc {};
+        layoutDesc.bindGroupLayoutCount = 1;
+        layoutDesc.bindGroupLayouts     = &bindGroupLayout;
+
+        std::vector<wgpu::VertexAttribute> vertexAttribs;
+        std::array<wgpu::VertexBufferLayout, 2> vertexBufferLayouts =
+            GetVertexBufferLayouts(VertexFormat::Full, vertexAttribs);
+
+        wgpu::RenderPipelineDescriptor pipelineDesc = {};
+        pipelineDesc.layout                         = device.CreatePipelineLayout(&layoutDesc);
+        pipelineDesc.vertex.module                  = shaderModule;
+        pipelineDesc.vertex.entryPoint              = WebGPUUtils::GenerateString("vs_main");
+        pipelineDesc.vertex.bufferCount             = vertexBufferLayouts.size();
+        pipelineDesc.vertex.buffers                 = vertexBufferLayouts.data();
+        pipelineDesc.primitive.topology             = wgpu::PrimitiveTopology::TriangleList;
+        pipelineDesc.primitive.frontFace            = wgpu::FrontFace::CCW;
+        pipelineDesc.primitive.cullMode             = wgpu::CullMode::None;
+
+        wgpu::ColorTargetState colorTarget {};
+        colorTarget.format    = kColorFormat;
+        colorTarget.writeMask = wgpu::ColorWriteMask::All;
+
+        wgpu::FragmentState fragmentState {};
+        fragmentState.module      = shaderModule;
+        fragmentState.entryPoint  = WebGPUUtils::GenerateString("fs_main");
+        fragmentState.targetCount = 1;
+        fragmentState.targets     = &colorTarget;
+        pipelineDesc.fragment     = &fragmentState;
+
+        wgpu::DepthStencilState depthStencilState {};
+        depthStencilState.format            = kDepthFormat;
+        depthStencilState.depthWriteEnabled = true;
+        depthStencilState.depthCompare      = wgpu::CompareFunction::Less;
+        pipelineDesc.depthStencil           = &depthStencilState;
+
+        return device.CreateRenderPipeline(&pipelineDesc);
+    }
+
+    wgpu::Texture CreateTarget(wgpu::Device device, wgpu::TextureFormat format)
+    {
+        wgpu::TextureDescriptor textureDesc {};
+        textureDesc.dimension     = wgpu::TextureDimension::e2D;
+        textureDesc.format        = format;
+        textureDesc.size          = {kImageSize, kImageSize, 1};
+        textureDesc.mipLevelCount = 1;
+        textureDesc.sampleCount   = 1;
+
+        // Color targets are read back, depth targets are only ever attached
+        textureDesc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::CopySrc;
+        return device.CreateTexture(&textureDesc);
+    }
+
+    // Draw a mesh over a transparent background and read the image back
+    std::vector<unsigned char> Render(TestDevice& testDevice,
+                                      wgpu::RenderPipeline pipeline,
+                                      wgpu::BindGroup bindGroup,
+                                      const GpuMesh& mesh)
+    {
+        wgpu::Device device        = testDevice.GetDevice();
+        wgpu::Texture colorTexture = CreateTarget(device, kColorFormat);
+        wgpu::Texture depthTexture = CreateTarget(device, kDepthFormat);
+
+        wgpu::RenderPassColorAttachment colorAttachment = {};
+        colorAttachment.view                            = colorTexture.CreateView();
+        colorAttachment.loadOp                          = wgpu::LoadOp::Clear;
+        colorAttachment.storeOp                         = wgpu::StoreOp::Store;
+        colorAttachment.clearValue                      = {0.0, 0.0, 0.0, 0.0};
+        colorAttachment.depthSlice                      = WGPU_DEPTH_SLICE_UNDEFINED;
+
+        wgpu::RenderPassDepthStencilAttachment depthStencilAttachment;
+        depthStencilAttachment.view            = depthTexture.CreateView();
+        depthStencilAttachment.depthClearValue = 1.0f;
+        depthStencilAttachment.depthLoadOp     = wgpu::LoadOp::Clear;
+        depthStencilAttachment.depthStoreOp    = wgpu::StoreOp::Discard;
+
+        wgpu::RenderPassDescriptor renderPassDesc = {};
+        renderPassDesc.colorAttachmentCount       = 1;
+        renderPassDesc.colorAttachments           = &colorAttachment;
+        renderPassDesc.depthStencilAttachment     = &depthStencilAttachment;
+
+        wgpu::CommandEncoder encoder       = device.CreateCommandEncoder();
+        wgpu::RenderPassEncoder renderPass = encoder.BeginRenderPass(&renderPassDesc);
+        renderPass.SetPipeline(pipeline);
+        renderPass.SetBindGroup(0, bindGroup);
+        renderPass.SetVertexBuffer(0, mesh.vertexBuffer, 0, mesh.positionSize);
+        renderPass.SetVertexBuffer(1, mesh.vertexBuffer, mesh.positionSize);
+        if (mesh.indexBuffer)
+        {
+            renderPass.SetIndexBuffer(mesh.indexBuffer, wgpu::IndexFormat::Uint32);
+            renderPass.DrawIndexed(mesh.drawCount);
+        }
+        else
+        {
+            renderPass.Draw(mesh.drawCount);
+        }
+        renderPass.End();
+        testDevice.Submit(encoder);
+
+        return testDevice.ReadTexture(colorTexture, 0);
+    }
+}  // namespace
+
+/**
+ * Render a torus from the corners parsed out of its OBJ data, the golden image, then from the
+ * vertices and indices of LoadGeometryFromObj, welded and reordered for the vertex cache,
+ * overdraw and vertex fetch, and check that the images match
+ */
+int main()
+{
+    TestDevice testDevice;
+    if (!testDevice.Initialize())
+    {
+        return TestUtils::kSkipped;
+    }
+    wgpu::Device device = testDevice.GetDevice();
+
+    std::string text = CreateTorusObj();
+    std::vector<VertexAttributes> corners;
+    CHECK(ObjParser::ParseObj(text.data(), text.size(), corners));
+
+    std::span<const unsigned char> objData(reinterpret_cast<const unsigned char*>(text.data()),
+                                           text.size());
+    std::vector<VertexAttributes> vertexData;
+    std::vector<uint32_t> indexData;
+    CHECK(ResourceManager::LoadGeometryFromObj(objData, vertexData, indexData));
+
+    // Corners sharing a grid vertex are welded, those of the seams are not
+    CHECK(indexData.size() == corners.size());
+    CHECK(vertexData.size() == (kSegmentCount + 1) * (kRingCount + 1));
+    if (corners.empty() || indexData.size() != corners.size())
+    {
+        return TestUtils::Finish();
+    }
+
+    // Camera above the torus, looking down at it from the side so that its near half hides
+    // parts of the far half and of its own back faces
+    glm::mat4 viewProjection =
+        glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 10.0f)
+        * glm::lookAt(glm::vec3(0.0f, -3.0f, 2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    wgpu::Buffer uniformBuffer =
+        CreateBuffer(device,
+                     "Test uniform buffer",
+                     wgpu::BufferUsage::Uniform,
+                     {reinterpret_cast<const unsigned char*>(&viewProjection), sizeof(glm::mat4)});
+
+    wgpu::BindGroupLayoutEntry bindingLayout {};
+    bindingLayout.binding               = 0;
+    bindingLayout.visibility            = wgpu::ShaderStage::Vertex;
+    bindingLayout.buffer.type           = wgpu::BufferBindingType::Uniform;
+    bindingLayout.buffer.minBindingSize = sizeof(glm::mat4);
+
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
+    bindGroupLayoutDesc.entryCount        = 1;
+    bindGroupLayoutDesc.entries           = &bindingLayout;
+    wgpu::BindGroupLayout bindGroupLayout = device.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    wgpu::BindGroupEntry binding {};
+    binding.binding = 0;
+    binding.buffer  = uniformBuffer;
+    binding.size    = sizeof(glm::mat4);
+
+    wgpu::BindGroupDescriptor bindGroupDesc {};
+    bindGroupDesc.layout      = bindGroupLayout;
+    bindGroupDesc.entryCount  = 1;
+    bindGroupDesc.entries     = &binding;
+    wgpu::BindGroup bindGroup = device.CreateBindGroup(&bindGroupDesc);
+
+    wgpu::RenderPipeline pipeline = CreatePipeline(device, bindGroupLayout);
+
+    std::vector<unsigned char> golden =
+        Render(testDevice, pipeline, bindGroup, CreateGpuMesh(device, corners, {}));
+    std::vector<unsigned char> optimized =
+        Render(testDevice, pipeline, bindGroup, CreateGpuMesh(device, vertexData, indexData));
+    CHECK(golden.size() == 4 * kImageSize * kImageSize);
+    CHECK(optimized.size() == golden.size());
+    if (optimized.size() != golden.size())
+    {
+        return TestUtils::Finish();
+    }
+
+    // The torus must cover a good part of the image for the comparison to mean anything
+    uint32_t coveredCount   = 0;
+    uint32_t differentCount = 0;
+    int maxDifference       = 0;
+    for (size_t i = 0; i < golden.size(); i += 4)
+    {
+        coveredCount += golden[i + 3] != 0;
+        int difference = 0;
+        for (size_t c = 0; c < 4; ++c)
+        {
+            difference = std::max(difference, std::abs(golden[i + c] - optimized[i + c]));
+        }
+        differentCount += difference > kTolerance;
+        maxDifference = std::max(maxDifference, difference);
+    }
+    SDL_Log("%u of %u covered pixels differ by more than %d, by %d at most",
+            differentCount,
+            coveredCount,
+            kTolerance,
+            maxDifference);
+    CHECK(coveredCount > kImageSize * kImageSize / 8);
+    CHECK(differentCount == 0);
+
+    return TestUtils::Finish();
+}
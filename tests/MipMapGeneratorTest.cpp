@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "MipMapGenerator.h"
+#include "TestUtils.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    // Destination texels handled by one task of the thread pool, as in MipMapGenerator.cpp
+    constexpr size_t kTexelsPerTask = 16 * 1024;
+
+    constexpr uint32_t kBenchSize = 4096;
+
+    std::vector<unsigned char> CreateImage(uint32_t width, uint32_t height, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_int_distribution<int> byte(0, 255);
+        std::vector<unsigned char> pixels(4 * size_t(width) * height);
+        for (unsigned char& value : pixels)
+        {
+            value = static_cast<unsigned char>(byte(random));
+        }
+        return pixels;
+    }
+
+    /**
+     * Scalar 2x2 box filter of an image of even size, rounding like BoxFilterRow, over the same
+     * thread pool as Downsample
+     */
+    void DownsampleScalar(const unsigned char* source,
+                          uint32_t sourceWidth,
+                          uint32_t sourceHeight,
+                          unsigned char* destination)
+    {
+        uint32_t destinationWidth = sourceWidth / 2;
+        size_t sourcePitch        = 4 * size_t(sourceWidth);
+        size_t rowsPerTask        = std::max<size_t>(1, kTexelsPerTask / destinationWidth);
+        ThreadPool::GetInstance().ParallelFor(
+            sourceHeight / 2,
+            rowsPerTask,
+            [&](size_t first, size_t last)
+            {
+                for (size_t j = first; j < last; ++j)
+                {
+                    const unsigned char* p0 = source + 2 * j * sourcePitch;
+                    const unsigned char* p1 = p0 + sourcePitch;
+                    unsigned char* row      = destination + 4 * j * destinationWidth;
+                    for (uint32_t i = 0; i < 4 * destinationWidth; ++i)
+                    {
+                        uint32_t k = 8 * (i / 4) + i % 4;
+                        row[i]     = static_cast<unsigned char>(
+                            (p0[k] + p0[k + 4] + p1[k] + p1[k + 4] + 2) / 4);
+                    }
+                }
+            });
+    }
+}  // namespace
+
+/**
+ * Check the SIMD box filter of even sizes bit for bit against the scalar one, including the
+ * texels left over after the SIMD batches, then time both
+ */
+int main()
+{
+    const uint32_t sizes[][2] = {{2, 2}, {8, 8}, {10, 6}, {14, 2}, {256, 128}, {1030, 18}};
+    for (const auto& size : sizes)
+    {
+        std::vector<unsigned char> image = CreateImage(size[0], size[1], size[0] * size[1]);
+        std::vector<unsigned char> simd(image.size() / 4);
+        std::vector<unsigned char> scalar(image.size() / 4);
+        MipMapGenerator::Downsample(image.data(), size[0], size[1], simd.data(), false);
+        DownsampleScalar(image.data(), size[0], size[1], scalar.data());
+        if (!CHECK(simd == scalar))
+        {
+            SDL_Log("Box filter of %ux%u differs from the scalar one", size[0], size[1]);
+        }
+    }
+
+    // Odd sizes weight 3 texels each way, so that a constant image stays constant
+    std::vector<unsigned char> constant(4 * 7 * 5, 200);
+    std::vector<unsigned char> reduced(4 * 3 * 2);
+    MipMapGenerator::Downsample(constant.data(), 7, 5, reduced.data(), false);
+    CHECK(std::all_of(reduced.begin(),
+                      reduced.end(),
+                      [](unsigned char value)
+                      {
+                          return value == 200;
+                      }));
+
+    std::vector<unsigned char> image = CreateImage(kBenchSize, kBenchSize, 0);
+    std::vector<unsigned char> level(image.size() / 4);
+    double scalarTime = TestUtils::Benchmark(5,
+                                             [&]()
+                                             {
+                                                 DownsampleScalar(image.data(),
+                                                                  kBenchSize,
+                                                                  kBenchSize,
+                                                                  level.data());
+                                             });
+    double simdTime   = TestUtils::Benchmark(5,
+                                           [&]()
+                                           {
+                                               MipMapGenerator::Downsample(image.data(),
+                                                                           kBenchSize,
+                                                                           kBenchSize,
+                                                                           level.data(),
+                                                                           false);
+                                           });
+    double srgbTime   = TestUtils::Benchmark(5,
+                                           [&]()
+                                           {
+                                               MipMapGenerator::Downsample(image.data(),
+                                                                           kBenchSize,
+                                                                           kBenchSize,
+                                                                           level.data(),
+                                                                           true);
+                                           });
+    SDL_Log("%ux%u level on %u threads: scalar %.2f ms, SIMD %.2f ms (%.1fx), sRGB %.2f ms",
+            kBenchSize,
+            kBenchSize,
+            ThreadPool::GetInstance().GetThreadCount() + 1,
+            scalarTime,
+            simdTime,
+            scalarTime / simdTime,
+            srgbTime);
+
+    return TestUtils::Finish();
+}
@@ -0,0 +1,374 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#if defined(HAS_TINYOBJLOADER)
+#include <tiny_obj_loader.h>
+#endif
+
+#include "ObjParser.h"
+#include "TestUtils.h"
+#include "ThreadPool.h"
+#include "VertexFormat.h"
+
+namespace
+{
+    // Smallest chunk parsed by one task of the thread pool, as in ObjParser.cpp
+    constexpr size_t kMinChunkSize = 256 * 1024;
+
+    // Quads along each side of the generated grid, whose OBJ text spans several chunks
+    constexpr uint32_t kGridSize = 256;
+    // Quads along each side of the grid timed against tinyobjloader, about 350 MB of OBJ text
+    constexpr uint32_t kLargeGridSize = 1440;
+
+    bool Parse(const std::string& text, std::vector<VertexAttributes>& vertexData)
+    {
+        return ObjParser::ParseObj(text.data(), text.size(), vertexData);
+    }
+
+    // Corner as written by the parser for OBJ coordinates, missing attributes being zero
+    VertexAttributes CreateCorner(const glm::vec3& position,
+                                  const glm::vec3& normal,
+                                  const glm::vec2& uv,
+                                  const glm::vec3& color = glm::vec3(1.0f))
+    {
+        VertexAttributes vertex {};
+        vertex.position = {position.x, -position.z, position.y};
+        vertex.normal   = {normal.x, -normal.z, normal.y};
+        vertex.uv       = {uv.x, 1.0f - uv.y};
+        vertex.color    = color;
+        return vertex;
+    }
+
+    bool SameCorners(const std::vector<VertexAttributes>& a, const std::vector<VertexAttributes>& b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if (!(a[i].position == b[i].position) || !(a[i].normal == b[i].normal)
+                || !(a[i].uv == b[i].uv) || !(a[i].color == b[i].color))
+            {
+                SDL_Log("Corner %zu differs", i);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * OBJ text of a grid whose rows of v, vn and vt lines are each followed by the triangles
+     * joining them to the previous row, and unless null the corners the parser should output
+     * for it. Corners cycle through absolute v/vt/vn, relative v/vt/vn reaching back into
+     * earlier chunks, and v//vn. Coordinates are written with enough digits to round-trip
+     * exactly.
+     */
+    void CreateGridObj(uint32_t size, std::string& text, std::vector<VertexAttributes>* corners)
+    {
+        std::vector<VertexAttributes> vertices;
+        std::vector<glm::vec3> positions(size + 1);
+        std::vector<glm::vec3> normals(size + 1);
+        std::vector<glm::vec2> texCoords(size + 1);
+        char line[128];
+        for (uint32_t j = 0; j <= size; ++j)
+        {
+            for (uint32_t i = 0; i <= size; ++i)
+            {
+                positions[i] = {i / 4.0f, j / 8.0f, ((i * 7 + j) % 16) / 16.0f};
+                normals[i]   = {(i % 4) / 4.0f, 1.0f, (j % 4) / -4.0f};
+                texCoords[i] = {static_cast<float>(i) / size, static_cast<float>(j) / size};
+                vertices.push_back(CreateCorner(positions[i], normals[i], texCoords[i]));
+            }
+            for (const glm::vec3& position : positions)
+            {
+                snprintf(line,
+                         sizeof(line),
+                         "v %.9g %.9g %.9g\n",
+                         position.x,
+                         position.y,
+                         position.z);
+                text += line;
+            }
+            for (const glm::vec3& normal : normals)
+            {
+                snprintf(line, sizeof(line), "vn %.9g %.9g %.9g\n", normal.x, normal.y, normal.z);
+                text += line;
+            }
+            for (const glm::vec2& uv : texCoords)
+            {
+                snprintf(line, sizeof(line), "vt %.9g %.9g\n", uv.x, uv.y);
+                text += line;
+            }
+            if (j == 0)
+            {
+                continue;
+            }
+
+            // Elements of every kind defined so far, which relative indices count back from
+            int64_t definedCount = static_cast<int64_t>(vertices.size());
+            for (uint32_t i = 0; i < size; ++i)
+            {
+                uint32_t corner             = (j - 1) * (size + 1) + i;
+                const uint32_t triangles[6] = {corner,
+                                               corner + 1,
+                                               corner + size + 2,
+                                               corner,
+                                               corner + size + 2,
+                                               corner + size + 1};
+                for (uint32_t t = 0; t < 2; ++t)
+                {
+                    text += 'f';
+                    for (uint32_t k = 0; k < 3; ++k)
+                    {
+                        uint32_t index     = triangles[3 * t + k];
+                        long long absolute = index + 1;
+                        long long relative = index - definedCount;
+                        if (corners)
+                        {
+                            corners->push_back(vertices[index]);
+                        }
+                        switch ((i + t + k) % 3)
+                        {
+                            case 0:
+                                snprintf(line,
+                                         sizeof(line),
+                                         " %lld/%lld/%lld",
+                                         absolute,
+                                         absolute,
+                                         absolute);
+                                break;
+                            case 1:
+                                snprintf(line,
+                                         sizeof(line),
+                                         " %lld/%lld/%lld",
+                                         relative,
+                                         relative,
+                                         relative);
+                                break;
+                            default:
+                                snprintf(line, sizeof(line), " %lld//%lld", absolute, absolute);
+                                if (corners)
+                                {
+                                    corners->back().uv = {0.0f, 0.0f};
+                                }
+                                break;
+                        }
+                        text += line;
+                    }
+                    text += '\n';
+                }
+            }
+        }
+    }
+
+#if defined(HAS_TINYOBJLOADER)
+    /**
+     * Corners of the former tinyobjloader path of ResourceManager::LoadGeometryFromObj, with
+     * missing texture coordinates and colors defaulting like those of ObjParser
+     */
+    bool ParseWithTinyObj(const std::string& text, std::vector<VertexAttributes>& vertexData)
+    {
+        tinyobj::ObjReader reader;
+        if (!reader.ParseFromString(text, ""))
+        {
+            SDL_Log("%s", reader.Error().c_str());
+            return false;
+        }
+
+        const tinyobj::attrib_t& attrib = reader.GetAttrib();
+        bool hasColors                  = attrib.colors.size() == attrib.vertices.size();
+        vertexData.clear();
+        for (const tinyobj::shape_t& shape : reader.GetShapes())
+        {
+            for (const tinyobj::index_t& index : shape.mesh.indices)
+            {
+                const float* position    = &attrib.vertices[3 * index.vertex_index];
+                const float* normal      = &attrib.normals[3 * index.normal_index];
+                VertexAttributes& vertex = vertexData.emplace_back();
+                vertex.position          = {position[0], -position[2], position[1]};
+                vertex.normal            = {normal[0], -normal[2], normal[1]};
+                vertex.uv                = {0.0f, 0.0f};
+                vertex.color             = {1.0f, 1.0f, 1.0f};
+                if (index.texcoord_index >= 0)
+                {
+                    const float* uv = &attrib.texcoords[2 * index.texcoord_index];
+                    vertex.uv       = {uv[0], 1 - uv[1]};
+                }
+                if (hasColors)
+                {
+                    const float* color = &attrib.colors[3 * index.vertex_index];
+                    vertex.color       = {color[0], color[1], color[2]};
+                }
+            }
+        }
+        return true;
+    }
+#endif
+
+    /**
+     * Compare the corners of ParseObj to those of tinyobjloader on the chunked grid, then time
+     * both on a grid of hundreds of MB. Return kSkipped when the test was built without it.
+     */
+    int CompareWithTinyObj()
+    {
+#if defined(HAS_TINYOBJLOADER)
+        // Triangles only, since tinyobjloader splits larger polygons differently from the fans
+        std::string text;
+        std::vector<VertexAttributes> vertexData;
+        std::vector<VertexAttributes> tinyObjData;
+        CreateGridObj(kGridSize, text, nullptr);
+        CHECK(Parse(text, vertexData));
+        CHECK(ParseWithTinyObj(text, tinyObjData));
+        CHECK(SameCorners(vertexData, tinyObjData));
+
+        text.clear();
+        CreateGridObj(kLargeGridSize, text, nullptr);
+        double parseTime = TestUtils::Benchmark(2,
+                                                [&]()
+                                                {
+                                                    Parse(text, vertexData);
+                                                });
+
+        double tinyObjTime = TestUtils::Benchmark(2,
+                                                  [&]()
+                                                  {
+                                                      ParseWithTinyObj(text, tinyObjData);
+                                                  });
+        CHECK(SameCorners(vertexData, tinyObjData));
+        SDL_Log("%.1f MB of OBJ data on %u threads: ObjParser %.0f ms, tinyobjloader %.0f ms "
+                "(%.1fx)",
+                text.size() / (1024.0 * 1024.0),
+                ThreadPool::GetInstance().GetThreadCount() + 1,
+                parseTime,
+                tinyObjTime,
+                tinyObjTime / parseTime);
+        return TestUtils::Finish();
+#else
+        SDL_Log("Built without tinyobjloader, install it e.g. with the \"tests\" feature of "
+                "vcpkg.json");
+        return TestUtils::kSkipped;
+#endif
+    }
+}  // namespace
+
+/**
+ * Check ParseObj on hand-written OBJ snippets covering the index forms, polygon fans and invalid
+ * faces, then on a generated grid large enough to be split into chunks in the middle of lines,
+ * against the corners it was generated from. With --tinyobj, compare it to tinyobjloader
+ * instead.
+ */
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--tinyobj") == 0)
+    {
+        return CompareWithTinyObj();
+    }
+
+    std::vector<VertexAttributes> vertexData;
+
+    // Absolute v/vt/vn corners, converted to Z-up with V flipped, and per-vertex colors
+    CHECK(Parse("# triangle\n"
+                "v 1 2 3\n"
+                "v 4 5 6 0.5 0.25 0.125\n"
+                "v 7 8 9\n"
+                "vt 0.25 0.75\n"
+                "vn 0 0 1\n"
+                "\n"
+                "f 1/1/1 2/1/1 3/1/1\n",
+                vertexData));
+    CHECK(SameCorners(vertexData,
+                      {CreateCorner({1, 2, 3}, {0, 0, 1}, {0.25f, 0.75f}),
+                       CreateCorner({4, 5, 6}, {0, 0, 1}, {0.25f, 0.75f}, {0.5f, 0.25f, 0.125f}),
+                       CreateCorner({7, 8, 9}, {0, 0, 1}, {0.25f, 0.75f})}));
+
+    // Relative indices count back from the elements defined before the face, not from the total
+    CHECK(Parse("v 1 0 0\nv 0 1 0\nv 0 0 1\n"
+                "vt 0 0\nvt 1 0\n"
+                "vn 1 0 0\n"
+                "f -3/-2/-1 -2/-1/-1 -1/-1/-1\n"
+                "v 2 0 0\n"
+                "vn 0 1 0\n"
+                "f -1/1/-1 -3/2/1 2/-2/-2\n",
+                vertexData));
+    CHECK(SameCorners(vertexData,
+                      {CreateCorner({1, 0, 0}, {1, 0, 0}, {0, 0}),
+                       CreateCorner({0, 1, 0}, {1, 0, 0}, {1, 0}),
+                       CreateCorner({0, 0, 1}, {1, 0, 0}, {1, 0}),
+                       CreateCorner({2, 0, 0}, {0, 1, 0}, {0, 0}),
+                       CreateCorner({0, 1, 0}, {1, 0, 0}, {1, 0}),
+                       CreateCorner({0, 1, 0}, {1, 0, 0}, {0, 0})}));
+
+    // v//vn and bare v corners leave the missing attributes at zero, CRLF and tabs are spaces
+    CHECK(Parse("v 1 0 0\r\nv 0 1 0\r\nv 0 0 1\r\nvn 0 1 0\r\n"
+                "f\t1//1 2//1\t3//1\r\n"
+                "f 3 2 1",
+                vertexData));
+    // A V coordinate of 1 flips to 0
+    CHECK(SameCorners(vertexData,
+                      {CreateCorner({1, 0, 0}, {0, 1, 0}, {0, 1}),
+                       CreateCorner({0, 1, 0}, {0, 1, 0}, {0, 1}),
+                       CreateCorner({0, 0, 1}, {0, 1, 0}, {0, 1}),
+                       CreateCorner({0, 0, 1}, {0, 0, 0}, {0, 1}),
+                       CreateCorner({0, 1, 0}, {0, 0, 0}, {0, 1}),
+                       CreateCorner({1, 0, 0}, {0, 0, 0}, {0, 1})}));
+
+    // Polygons are split into fans around their first corner
+    CHECK(Parse("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv -1 0.5 0\n"
+                "f 1 2 3 4\n"
+                "f 1 2 3 4 5\n",
+                vertexData));
+    const uint32_t fans[]       = {0, 1, 2, 0, 2, 3, 0, 1, 2, 0, 2, 3, 0, 3, 4};
+    const glm::vec3 positions[] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}, {-1, 0.5f, 0}};
+    CHECK(vertexData.size() == std::size(fans));
+    for (size_t i = 0; i < vertexData.size() && i < std::size(fans); ++i)
+    {
+        const glm::vec3& position = positions[fans[i]];
+        CHECK(vertexData[i].position == glm::vec3(position.x, -position.z, position.y));
+    }
+
+    // Out-of-range, zero and malformed indices fail and leave no vertices behind
+    const char* invalidFaces[] = {"v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 4\n",
+                                  "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 0 1 2\n",
+                                  "v 0 0 0\nv 1 0 0\nv 1 1 0\nf -4 -2 -1\n",
+                                  "f -1 -2 -3\nv 0 0 0\nv 1 0 0\nv 1 1 0\n",
+                                  "v 0 0 0\nv 1 0 0\nv 1 1 0\nvt 0 0\nf 1/2 2/1 3/1\n",
+                                  "v 0 0 0\nv 1 0 0\nv 1 1 0\nvn 0 0 1\nf 1//1 2//1 3//2\n",
+                                  "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 x\n"};
+    for (const char* text : invalidFaces)
+    {
+        vertexData.assign(3, VertexAttributes {});
+        if (!CHECK(!Parse(text, vertexData) && vertexData.empty()))
+        {
+            SDL_Log("Accepted invalid OBJ data:\n%s", text);
+        }
+    }
+
+    // Chunk boundaries fall at arbitrary bytes and are moved to the next line end, so any line
+    // may straddle one, while relative indices reach back across them
+    std::string text;
+    std::vector<VertexAttributes> gridCorners;
+    CreateGridObj(kGridSize, text, &gridCorners);
+    CHECK(text.size() >= 8 * kMinChunkSize);
+    CHECK(Parse(text, vertexData));
+    CHECK(SameCorners(vertexData, gridCorners));
+
+    double parseTime = TestUtils::Benchmark(5,
+                                            [&]()
+                                            {
+                                                Parse(text, vertexData);
+                                            });
+    SDL_Log("%.1f MB of OBJ data on %u threads: ObjParser %.2f ms",
+            text.size() / (1024.0 * 1024.0),
+            ThreadPool::GetInstance().GetThreadCount() + 1,
+            parseTime);
+
+    return TestUtils::Finish();
+}
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/geometric.hpp>
+
+#include "TangentSpace.h"
+#include "TestUtils.h"
+#include "ThreadPool.h"
+#include "VertexFormat.h"
+
+namespace
+{
+    // Triangles handled by one task of the thread pool, as in TangentSpace.cpp
+    constexpr size_t kTrianglesPerTask = 16 * 1024;
+
+    // Quads along each side of the test surfaces
+    constexpr uint32_t kGridSize      = 64;
+    constexpr uint32_t kBenchGridSize = 512;
+
+    /**
+     * Indexed grid over a gently curved height field, its UVs following x and y and its
+     * normals being those of the surface, so that neighboring triangles have close frames
+     */
+    void CreateGrid(uint32_t size,
+                    std::vector<VertexAttributes>& vertexData,
+                    std::vector<uint32_t>& indexData)
+    {
+        for (uint32_t j = 0; j <= size; ++j)
+        {
+            for (uint32_t i = 0; i <= size; ++i)
+            {
+                float x = static_cast<float>(i) / size;
+                float y = static_cast<float>(j) / size;
+
+                // z = 0.1 * sin(3x) * cos(2y)
+                float dzdx = 0.3f * std::cos(3.0f * x) * std::cos(2.0f * y);
+                float dzdy = -0.2f * std::sin(3.0f * x) * std::sin(2.0f * y);
+
+                VertexAttributes& vertex = vertexData.emplace_back();
+
+                vertex.position  = {x, y, 0.1f * std::sin(3.0f * x) * std::cos(2.0f * y)};
+                vertex.normal    = glm::normalize(glm::vec3(-dzdx, -dzdy, 1.0f));
+                vertex.color     = {1.0f, 1.0f, 1.0f};
+                vertex.uv        = {x, y};
+                vertex.tangent   = {};
+                vertex.bitangent = {};
+            }
+        }
+
+        for (uint32_t j = 0; j < size; ++j)
+        {
+            for (uint32_t i = 0; i < size; ++i)
+            {
+                uint32_t corner = j * (size + 1) + i;
+                indexData.insert(indexData.end(), {corner, corner + 1, corner + size + 2});
+                indexData.insert(indexData.end(), {corner, corner + size + 2, corner + size + 1});
+            }
+        }
+    }
+
+    std::vector<VertexAttributes> Unindex(const std::vector<VertexAttributes>& vertexData,
+                                          const std::vector<uint32_t>& indexData)
+    {
+        std::vector<VertexAttributes> corners;
+        corners.reserve(indexData.size());
+        for (uint32_t index : indexData)
+        {
+            corners.push_back(vertexData[index]);
+        }
+        return corners;
+    }
+
+    /**
+     * Frame of a triangle ortho-normalized against the normal of one of its corners, the
+     * scalar per-corner computation ComputePerTriangle replaced
+     */
+    void ComputeTBN(const VertexAttributes corners[3],
+                    const glm::vec3& expectedN,
+                    glm::vec3& tangent,
+                    glm::vec3& bitangent)
+    {
+        glm::vec3 ePos1 = corners[1].position - corners[0].position;
+        glm::vec3 ePos2 = corners[2].position - corners[0].position;
+        glm::vec2 eUV1  = corners[1].uv - corners[0].uv;
+        glm::vec2 eUV2  = corners[2].uv - corners[0].uv;
+
+        glm::vec3 T = glm::normalize(ePos1 * eUV2.y - ePos2 * eUV1.y);
+        glm::vec3 B = glm::normalize(ePos2 * eUV1.x - ePos1 * eUV2.x);
+        glm::vec3 N = glm::cross(T, B);
+
+        // Fix overall orientation
+        if (glm::dot(N, expectedN) < 0.0f)
+        {
+            T = -T;
+        }
+
+        N         = expectedN;
+        tangent   = glm::normalize(T - glm::dot(T, N) * N);
+        bitangent = glm::cross(N, tangent);
+    }
+
+    // Scalar counterpart of ComputePerTriangle, over the same thread pool
+    void ComputePerCorner(std::vector<VertexAttributes>& vertexData)
+    {
+        ThreadPool::GetInstance().ParallelFor(
+            vertexData.size() / 3,
+            kTrianglesPerTask,
+            [&vertexData](size_t first, size_t last)
+            {
+                for (size_t t = first; t < last; ++t)
+                {
+                    VertexAttributes* corners = &vertexData[3 * t];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        ComputeTBN(corners,
+                                   corners[k].normal,
+                                   corners[k].tangent,
+                                   corners[k].bitangent);
+                    }
+                }
+            });
+    }
+
+    // Smallest cosine of the angle between the frames of matching corners
+    float GetMinFrameCosine(const std::vector<VertexAttributes>& a,
+                            const std::vector<VertexAttributes>& b)
+    {
+        float minCosine = 1.0f;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            minCosine = std::min(minCosine, glm::dot(a[i].tangent, b[i].tangent));
+            minCosine = std::min(minCosine, glm::dot(a[i].bitangent, b[i].bitangent));
+        }
+        return minCosine;
+    }
+}  // namespace
+
+/**
+ * Check the SIMD and per-vertex tangent frames against the scalar per-corner computation, then
+ * time the SIMD batches against it
+ */
+int main()
+{
+    std::vector<VertexAttributes> vertexData;
+    std::vector<uint32_t> indexData;
+    CreateGrid(kGridSize, vertexData, indexData);
+
+    std::vector<VertexAttributes> reference = Unindex(vertexData, indexData);
+    ComputePerCorner(reference);
+
+    // The SIMD batches compute the same frames, up to rounding
+    std::vector<VertexAttributes> perTriangle = Unindex(vertexData, indexData);
+    TangentSpace::ComputePerTriangle(perTriangle);
+    CHECK(GetMinFrameCosine(perTriangle, reference) > 0.99999f);
+
+    // Frames averaged over the triangles of each vertex stay close to those of its corners
+    std::vector<VertexAttributes> perVertex = vertexData;
+    TangentSpace::ComputePerVertex(perVertex, indexData);
+    float minCosine = GetMinFrameCosine(Unindex(perVertex, indexData), reference);
+    SDL_Log("Per-vertex frames within %.2f degrees of the per-corner ones",
+            std::acos(std::min(minCosine, 1.0f)) * 180.0f / 3.14159265f);
+    CHECK(minCosine > std::cos(2.0f * 3.14159265f / 180.0f));
+    for (const VertexAttributes& vertex : perVertex)
+    {
+        CHECK(std::abs(glm::length(vertex.tangent) - 1.0f) < 1e-4f);
+        CHECK(std::abs(glm::dot(vertex.tangent, vertex.normal)) < 1e-4f);
+    }
+
+    // Degenerate UVs fall back to any frame orthogonal to the normal
+    std::vector<VertexAttributes> flat = vertexData;
+    for (VertexAttributes& vertex : flat)
+    {
+        vertex.uv = {0.5f, 0.5f};
+    }
+    TangentSpace::ComputePerVertex(flat, indexData);
+    CHECK(std::abs(glm::dot(flat[0].tangent, flat[0].normal)) < 1e-4f);
+    CHECK(std::abs(glm::length(flat[0].tangent) - 1.0f) < 1e-4f);
+
+    std::vector<VertexAttributes> benchVertices;
+    std::vector<uint32_t> benchIndices;
+    CreateGrid(kBenchGridSize, benchVertices, benchIndices);
+    std::vector<VertexAttributes> benchCorners = Unindex(benchVertices, benchIndices);
+    double scalarTime = TestUtils::Benchmark(5,
+                                             [&]()
+                                             {
+                                                 ComputePerCorner(benchCorners);
+                                             });
+    double simdTime   = TestUtils::Benchmark(5,
+                                           [&]()
+                                           {
+                                               TangentSpace::ComputePerTriangle(benchCorners);
+                                           });
+    double vertexTime = TestUtils::Benchmark(5,
+                                             [&]()
+                                             {
+                                                 TangentSpace::ComputePerVertex(benchVertices,
+                                                                                benchIndices);
+                                             });
+    SDL_Log("%zu triangles on %u threads: scalar per corner %.2f ms, SIMD per triangle %.2f ms "
+            "(%.1fx), per vertex %.2f ms",
+            benchIndices.size() / 3,
+            ThreadPool::GetInstance().GetThreadCount() + 1,
+            scalarTime,
+            simdTime,
+            scalarTime / simdTime,
+            vertexTime);
+
+    return TestUtils::Finish();
+}
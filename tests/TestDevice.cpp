@@ -0,0 +1,172 @@
+#include "TestDevice.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "WebGPUUtils.h"
+
+bool TestDevice::Initialize()
+{
+    static const auto kTimeoutWaitAny = wgpu::InstanceFeatureName::TimedWaitAny;
+    wgpu::InstanceDescriptor instanceDesc = {};
+    instanceDesc.requiredFeatureCount     = 1;
+    instanceDesc.requiredFeatures         = &kTimeoutWaitAny;
+    instance                              = wgpu::CreateInstance(&instanceDesc);
+    if (instance == nullptr)
+    {
+        return false;
+    }
+
+    // The fallback adapter, SwiftShader with Dawn, gives the same results on every machine and
+    // runs without a GPU. Unlike WebGPUUtils::RequestAdapterSync, a missing adapter is not
+    // fatal, the default one being tried next.
+    wgpu::Adapter adapter = nullptr;
+    for (bool forceFallbackAdapter : {true, false})
+    {
+        wgpu::RequestAdapterOptions adapterOptions = {};
+        adapterOptions.forceFallbackAdapter        = forceFallbackAdapter;
+
+        wgpu::Future future = instance.RequestAdapter(
+            &adapterOptions,
+            wgpu::CallbackMode::WaitAnyOnly,
+            [&adapter](wgpu::RequestAdapterStatus status,
+                       wgpu::Adapter result,
+                       wgpu::StringView message)
+            {
+                if (status != wgpu::RequestAdapterStatus::Success)
+                {
+                    SDL_Log("No adapter: %.*s", static_cast<int>(message.length), message.data);
+                    return;
+                }
+                adapter = std::move(result);
+            });
+        instance.WaitAny(future, UINT64_MAX);
+        if (adapter != nullptr)
+        {
+            break;
+        }
+    }
+    if (adapter == nullptr)
+    {
+        return false;
+    }
+
+    wgpu::AdapterInfo info;
+    adapter.GetInfo(&info);
+    SDL_Log("Test adapter: %.*s (%.*s), backend 0x%08X",
+            static_cast<int>(info.device.length),
+            info.device.data,
+            static_cast<int>(info.description.length),
+            info.description.data,
+            static_cast<uint32_t>(info.backendType));
+
+    wgpu::DeviceDescriptor deviceDesc = {};
+    deviceDesc.SetUncapturedErrorCallback(
+        [](const wgpu::Device&, wgpu::ErrorType, wgpu::StringView message)
+        {
+            SDL_Log("Device error: %.*s", static_cast<int>(message.length), message.data);
+            std::abort();
+        });
+    device = WebGPUUtils::RequestDeviceSync(instance, adapter, &deviceDesc);
+    return device != nullptr;
+}
+
+void TestDevice::Submit(wgpu::CommandEncoder encoder)
+{
+    wgpu::CommandBuffer commands = encoder.Finish();
+    device.GetQueue().Submit(1, &commands);
+
+    wgpu::Future future = device.GetQueue().OnSubmittedWorkDone(
+        wgpu::CallbackMode::WaitAnyOnly,
+        [](wgpu::QueueWorkDoneStatus, wgpu::StringView) {});
+    instance.WaitAny(future, UINT64_MAX);
+}
+
+std::vector<unsigned char> TestDevice::ReadBuffer(wgpu::Buffer buffer,
+                                                  uint64_t offset,
+                                                  uint64_t size)
+{
+    wgpu::BufferDescriptor readbackDesc {};
+    readbackDesc.label            = WebGPUUtils::GenerateString("Test readback buffer");
+    readbackDesc.size             = size;
+    readbackDesc.usage            = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+    readbackDesc.mappedAtCreation = false;
+    wgpu::Buffer readbackBuffer   = device.CreateBuffer(&readbackDesc);
+
+    wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
+    encoder.CopyBufferToBuffer(buffer, offset, readbackBuffer, 0, size);
+    Submit(encoder);
+
+    std::vector<unsigned char> data;
+    wgpu::Future future = readbackBuffer.MapAsync(
+        wgpu::MapMode::Read,
+        0,
+        size,
+        wgpu::CallbackMode::WaitAnyOnly,
+        [&](wgpu::MapAsyncStatus status, wgpu::StringView message)
+        {
+            if (status != wgpu::MapAsyncStatus::Success)
+            {
+                SDL_Log("Could not read back: %.*s",
+                        static_cast<int>(message.length),
+                        message.data);
+                return;
+            }
+            const auto* mapped = static_cast<const unsigned char*>(
+                readbackBuffer.GetConstMappedRange(0, size));
+            data.assign(mapped, mapped + size);
+            readbackBuffer.Unmap();
+        });
+    instance.WaitAny(future, UINT64_MAX);
+    return data;
+}
+
+std::vector<unsigned char> TestDevice::ReadTexture(wgpu::Texture texture, uint32_t mipLevel)
+{
+    // Rows of a texture copy are aligned to 256 bytes in the buffer
+    uint32_t width       = std::max(texture.GetWidth() >> mipLevel, 1u);
+    uint32_t height      = std::max(texture.GetHeight() >> mipLevel, 1u);
+    uint32_t rowSize     = 4 * width;
+    uint32_t bytesPerRow = (rowSize + 255) & ~255u;
+
+    wgpu::BufferDescriptor bufferDesc {};
+    bufferDesc.label            = WebGPUUtils::GenerateString("Test texture readback buffer");
+    bufferDesc.size             = uint64_t(bytesPerRow) * height;
+    bufferDesc.usage            = wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::CopyDst;
+    bufferDesc.mappedAtCreation = false;
+    wgpu::Buffer buffer         = device.CreateBuffer(&bufferDesc);
+
+    wgpu::TexelCopyTextureInfo source;
+    source.texture  = texture;
+    source.mipLevel = mipLevel;
+    source.origin   = {0, 0, 0};
+    source.aspect   = wgpu::TextureAspect::All;
+
+    wgpu::TexelCopyBufferInfo destination;
+    destination.buffer              = buffer;
+    destination.layout.offset       = 0;
+    destination.layout.bytesPerRow  = bytesPerRow;
+    destination.layout.rowsPerImage = height;
+
+    wgpu::Extent3D copySize      = {width, height, 1};
+    wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
+    encoder.CopyTextureToBuffer(&source, &destination, &copySize);
+    Submit(encoder);
+
+    std::vector<unsigned char> paddedData = ReadBuffer(buffer, 0, bufferDesc.size);
+    if (paddedData.size() != bufferDesc.size)
+    {
+        return {};
+    }
+
+    std::vector<unsigned char> data(size_t(rowSize) * height);
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        memcpy(data.data() + size_t(row) * rowSize,
+               paddedData.data() + size_t(row) * bytesPerRow,
+               rowSize);
+    }
+    return data;
+}
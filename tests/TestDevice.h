@@ -0,0 +1,37 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Headless device for the tests, on the fallback adapter when there is one, e.g. SwiftShader,
+ * and on the default adapter otherwise. Reads wait for the GPU, which is fine for tests but never
+ * done by the application.
+ */
+class TestDevice
+{
+public:
+    // Return false when there is no adapter at all
+    bool Initialize();
+
+    wgpu::Device GetDevice() const
+    {
+        return device;
+    }
+
+    // Submit the commands and wait for them to complete
+    void Submit(wgpu::CommandEncoder encoder);
+
+    // Copy part of a buffer with the CopySrc usage back to the CPU, offset and size being
+    // multiples of 4
+    std::vector<unsigned char> ReadBuffer(wgpu::Buffer buffer, uint64_t offset, uint64_t size);
+
+    // Copy a mip level of a texture with the CopySrc usage and 4 bytes per texel, e.g.
+    // RGBA8Unorm, back to the CPU, its rows tightly packed
+    std::vector<unsigned char> ReadTexture(wgpu::Texture texture, uint32_t mipLevel);
+
+private:
+    wgpu::Instance instance = nullptr;
+    wgpu::Device device     = nullptr;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <SDL3/SDL_log.h>
+#include <chrono>
+#include <cstdlib>
+
+/**
+ * Minimal helpers shared by the tests, each of which is a plain executable run by CTest. Checks
+ * log their failures and keep going, the test then exiting with the result of Finish.
+ */
+namespace TestUtils
+{
+    // Exit code of a test which could not run, e.g. for lack of an adapter, see SKIP_RETURN_CODE
+    constexpr int kSkipped = 77;
+
+    inline int failureCount = 0;
+
+    inline bool Check(bool condition, const char* expression, const char* file, int line)
+    {
+        if (!condition)
+        {
+            SDL_Log("%s:%d: check failed: %s", file, line, expression);
+            ++failureCount;
+        }
+        return condition;
+    }
+
+    inline int Finish()
+    {
+        if (failureCount > 0)
+        {
+            SDL_Log("%d checks failed", failureCount);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // Best time in milliseconds of a few runs of a function, the first one warming up caches
+    template <typename Function>
+    double Benchmark(int runCount, Function&& function)
+    {
+        double bestTime = 0.0;
+        for (int run = 0; run <= runCount; ++run)
+        {
+            auto start = std::chrono::steady_clock::now();
+            function();
+            std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now()
+                                                             - start;
+            if (run == 1 || (run > 1 && time.count() < bestTime))
+            {
+                bestTime = time.count();
+            }
+        }
+        return bestTime;
+    }
+}  // namespace TestUtils
+
+#define CHECK(condition) TestUtils::Check((condition), #condition, __FILE__, __LINE__)
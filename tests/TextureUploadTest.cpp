@@ -0,0 +1,153 @@
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "MemoryUsage.h"
+#include "MipMapGenerator.h"
+#include "ResourceManager.h"
+#include "TestDevice.h"
+#include "TestUtils.h"
+
+namespace
+{
+    // Size of the uploaded image, 64 MB for level 0 and about 85 MB for the whole chain
+    constexpr uint32_t kImageSize = 4096;
+
+    std::vector<unsigned char> CreateImage(uint32_t width, uint32_t height)
+    {
+        std::mt19937 random(width * height);
+        std::uniform_int_distribution<int> byte(0, 255);
+        std::vector<unsigned char> pixels(4 * size_t(width) * height);
+        for (unsigned char& value : pixels)
+        {
+            value = static_cast<unsigned char>(byte(random));
+        }
+        return pixels;
+    }
+
+    /**
+     * The upload of ResourceManager::WriteMipMaps before it went through a staging buffer, each
+     * level written by the queue, for a comparison of their peak memory
+     */
+    void WriteMipMapsPerLevel(wgpu::Device device,
+                              wgpu::Texture texture,
+                              wgpu::Extent3D textureSize,
+                              uint32_t mipLevelCount,
+                              const unsigned char* pixelData,
+                              bool isSrgb)
+    {
+        wgpu::TexelCopyTextureInfo destination;
+        destination.texture = texture;
+        destination.origin  = {0, 0, 0};
+        destination.aspect  = wgpu::TextureAspect::All;
+
+        wgpu::TexelCopyBufferLayout source;
+        source.offset = 0;
+
+        std::vector<unsigned char> arena;
+        std::vector<MipMapGenerator::MipLevel> levels =
+            MipMapGenerator::Generate(pixelData,
+                                      textureSize.width,
+                                      textureSize.height,
+                                      mipLevelCount,
+                                      isSrgb,
+                                      arena);
+        for (uint32_t level = 0; level < levels.size(); ++level)
+        {
+            const MipMapGenerator::MipLevel& mipLevel = levels[level];
+            wgpu::Extent3D mipLevelSize               = {mipLevel.width, mipLevel.height, 1};
+
+            destination.mipLevel = level;
+            source.bytesPerRow   = 4 * mipLevel.width;
+            source.rowsPerImage  = mipLevel.height;
+            device.GetQueue().WriteTexture(&destination,
+                                           mipLevel.data,
+                                           4 * size_t(mipLevel.width) * mipLevel.height,
+                                           &source,
+                                           &mipLevelSize);
+        }
+    }
+}  // namespace
+
+/**
+ * Upload the mip chain of a large image with ResourceManager::WriteMipMaps, or with --per-level
+ * as it was before the staging buffer, log the growth of the peak resident memory during the
+ * upload, and check every level against MipMapGenerator. The peak only ever grows, so each path
+ * runs in a process of its own.
+ */
+int main(int argc, char** argv)
+{
+    bool isPerLevel = argc > 1 && strcmp(argv[1], "--per-level") == 0;
+
+    // Runs on SwiftShader without a GPU, so a missing adapter fails rather than skips the test
+    TestDevice testDevice;
+    if (!CHECK(testDevice.Initialize()))
+    {
+        return TestUtils::Finish();
+    }
+    wgpu::Device device = testDevice.GetDevice();
+
+    std::vector<unsigned char> image = CreateImage(kImageSize, kImageSize);
+
+    wgpu::TextureDescriptor textureDesc {};
+    textureDesc.dimension     = wgpu::TextureDimension::e2D;
+    textureDesc.format        = wgpu::TextureFormat::RGBA8Unorm;
+    textureDesc.size          = {kImageSize, kImageSize, 1};
+    textureDesc.mipLevelCount = std::bit_width(kImageSize);
+    textureDesc.sampleCount   = 1;
+    textureDesc.usage         = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::CopySrc;
+    wgpu::Texture texture     = device.CreateTexture(&textureDesc);
+
+    // Submitting nothing waits for the texture to be allocated before the first measure
+    testDevice.Submit(device.CreateCommandEncoder());
+    uint64_t peakBefore = MemoryUsage::GetPeakResidentSize();
+    if (isPerLevel)
+    {
+        WriteMipMapsPerLevel(device,
+                             texture,
+                             textureDesc.size,
+                             textureDesc.mipLevelCount,
+                             image.data(),
+                             false);
+    }
+    else
+    {
+        ResourceManager::WriteMipMaps(device,
+                                      texture,
+                                      textureDesc.size,
+                                      textureDesc.mipLevelCount,
+                                      image.data(),
+                                      false);
+    }
+    testDevice.Submit(device.CreateCommandEncoder());
+    uint64_t peakAfter = MemoryUsage::GetPeakResidentSize();
+
+    SDL_Log("%ux%u mip chain %s: peak resident memory %.1f MB -> %.1f MB (+%.1f MB)",
+            kImageSize,
+            kImageSize,
+            isPerLevel ? "written per level" : "staged",
+            peakBefore / (1024.0 * 1024.0),
+            peakAfter / (1024.0 * 1024.0),
+            (peakAfter - peakBefore) / (1024.0 * 1024.0));
+
+    std::vector<unsigned char> arena;
+    std::vector<MipMapGenerator::MipLevel> levels =
+        MipMapGenerator::Generate(image.data(),
+                                  kImageSize,
+                                  kImageSize,
+                                  textureDesc.mipLevelCount,
+                                  false,
+                                  arena);
+    bool isUploaded = levels.size() == textureDesc.mipLevelCount;
+    for (uint32_t level = 0; level < levels.size() && isUploaded; ++level)
+    {
+        std::vector<unsigned char> gpuLevel = testDevice.ReadTexture(texture, level);
+        isUploaded = gpuLevel.size() == 4 * size_t(levels[level].width) * levels[level].height
+                     && memcmp(gpuLevel.data(), levels[level].data, gpuLevel.size()) == 0;
+    }
+    CHECK(isUploaded);
+
+    return TestUtils::Finish();
+}
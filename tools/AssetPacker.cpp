@@ -0,0 +1,133 @@
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// AssetPack inflates compressed entries with the zlib decoder of stb_image
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "AssetPack.h"
+#include "MappedFile.h"
+
+namespace
+{
+    // Files written at runtime next to the assets, which are never packed
+    const std::vector<std::string> kSkippedExtensions = {".meshcache", ".texcache", ".tmp"};
+
+    bool Contains(const std::vector<std::string>& extensions, const std::filesystem::path& path)
+    {
+        return std::find(extensions.begin(), extensions.end(), path.extension().string())
+               != extensions.end();
+    }
+
+    // Read the pack back and compare every entry with its source file
+    bool VerifyPack(const std::filesystem::path& packPath,
+                    const std::vector<AssetPack::SourceEntry>& entries)
+    {
+        AssetPack pack;
+        if (!pack.Open(packPath, {}))
+        {
+            return false;
+        }
+        for (const AssetPack::SourceEntry& entry : entries)
+        {
+            AssetPack::Asset asset;
+            if (!pack.Load(entry.name, asset)
+                || !std::equal(asset.data.begin(),
+                               asset.data.end(),
+                               entry.data.begin(),
+                               entry.data.end()))
+            {
+                SDL_Log("Asset %s does not match its source", entry.name.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+}  // namespace
+
+/**
+ * Pack every file of the input directories into a single asset pack, with their path
+ * relative to their directory as name. Files with one of the given extensions are compressed.
+ *
+ *     assetpacker <output pack> <input directory>... [--compress <extension>...]
+ */
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> arguments(argv + 1, argv + argc);
+    auto compressOption = std::find(arguments.begin(), arguments.end(), "--compress");
+    if (argc < 3 || compressOption - arguments.begin() < 2)
+    {
+        SDL_Log("Usage: %s <output pack> <input directory>... [--compress <extension>...]",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path packPath = arguments[0];
+    std::vector<std::filesystem::path> inputDirectories(arguments.begin() + 1, compressOption);
+    std::vector<std::string> compressedExtensions(
+        compressOption == arguments.end() ? arguments.end() : compressOption + 1,
+        arguments.end());
+
+    std::vector<AssetPack::SourceEntry> entries;
+    size_t totalSize = 0;
+    for (const std::filesystem::path& inputDirectory : inputDirectories)
+    {
+        for (const std::filesystem::directory_entry& directoryEntry :
+             std::filesystem::recursive_directory_iterator(inputDirectory))
+        {
+            const std::filesystem::path& path = directoryEntry.path();
+            if (!directoryEntry.is_regular_file() || Contains(kSkippedExtensions, path))
+            {
+                continue;
+            }
+
+            MappedFile file;
+            if (!file.Open(path))
+            {
+                SDL_Log("Could not read %s", path.string().c_str());
+                return EXIT_FAILURE;
+            }
+
+            AssetPack::SourceEntry& entry = entries.emplace_back();
+            entry.name = std::filesystem::relative(path, inputDirectory).generic_string();
+            entry.data.assign(file.GetData(), file.GetData() + file.GetSize());
+            entry.compression = Contains(compressedExtensions, path)
+                                    ? AssetPack::Compression::Deflate
+                                    : AssetPack::Compression::None;
+            totalSize += file.GetSize();
+        }
+    }
+
+    // Names must be unique, although they may come from different directories
+    std::sort(entries.begin(),
+              entries.end(),
+              [](const AssetPack::SourceEntry& a, const AssetPack::SourceEntry& b)
+              { return a.name < b.name; });
+    auto duplicate = std::adjacent_find(entries.begin(),
+                                        entries.end(),
+                                        [](const AssetPack::SourceEntry& a,
+                                           const AssetPack::SourceEntry& b)
+                                        { return a.name == b.name; });
+    if (duplicate != entries.end())
+    {
+        SDL_Log("Asset %s is found in several input directories", duplicate->name.c_str());
+        return EXIT_FAILURE;
+    }
+
+    if (!AssetPack::Write(packPath, entries) || !VerifyPack(packPath, entries))
+    {
+        SDL_Log("Could not write asset pack %s", packPath.string().c_str());
+        return EXIT_FAILURE;
+    }
+
+    SDL_Log("Packed %zu assets (%zu bytes) into %s (%ju bytes)",
+            entries.size(),
+            totalSize,
+            packPath.string().c_str(),
+            static_cast<uintmax_t>(std::filesystem::file_size(packPath)));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,286 @@
+#include <SDL3/SDL_log.h>
+#include <webgpu/webgpu_cpp.h>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AssetSource.h"
+#include "MappedFile.h"
+#include "ShaderVariants.h"
+#include "VertexLayout.h"
+#include "WebGPUUtils.h"
+
+namespace
+{
+    std::span<const unsigned char> AsBytes(const std::string& text)
+    {
+        return {reinterpret_cast<const unsigned char*>(text.data()), text.size()};
+    }
+
+    wgpu::StringView AsStringView(const std::string& text)
+    {
+        return {text.data(), text.size()};
+    }
+
+    /**
+     * Compiles the variants with Dawn, the same way the application creates its pipeline,
+     * except for the layout which is deduced from the shader
+     */
+    class Validator
+    {
+    public:
+        bool Initialize()
+        {
+            static const auto kTimeoutWaitAny = wgpu::InstanceFeatureName::TimedWaitAny;
+            wgpu::InstanceDescriptor instanceDesc = {};
+            instanceDesc.requiredFeatureCount     = 1;
+            instanceDesc.requiredFeatures         = &kTimeoutWaitAny;
+            instance                              = wgpu::CreateInstance(&instanceDesc);
+            if (instance == nullptr)
+            {
+                return false;
+            }
+
+            wgpu::RequestAdapterOptions adapterOptions = {};
+            wgpu::Adapter adapter = WebGPUUtils::RequestAdapterSync(instance, &adapterOptions);
+
+            std::vector<wgpu::FeatureName> requiredFeatures;
+            if (adapter.HasFeature(wgpu::FeatureName::ShaderF16))
+            {
+                requiredFeatures.push_back(wgpu::FeatureName::ShaderF16);
+            }
+            wgpu::DeviceDescriptor deviceDesc = {};
+            deviceDesc.requiredFeatureCount   = requiredFeatures.size();
+            deviceDesc.requiredFeatures       = requiredFeatures.data();
+            device = WebGPUUtils::RequestDeviceSync(instance, adapter, &deviceDesc);
+            return device != nullptr;
+        }
+
+        bool HasShaderF16() const
+        {
+            return device.HasFeature(wgpu::FeatureName::ShaderF16);
+        }
+
+        // Compile a preprocessed source, logging its errors and warnings
+        wgpu::ShaderModule CompileSource(const std::string& name, const std::string& source)
+        {
+            wgpu::ShaderModule shaderModule = CreateShaderModule(source);
+
+            bool hasErrors = false;
+            auto callback  = [&name, &hasErrors](wgpu::CompilationInfoRequestStatus status,
+                                                const wgpu::CompilationInfo* compilationInfo)
+            {
+                hasErrors = status != wgpu::CompilationInfoRequestStatus::Success;
+                for (size_t i = 0; compilationInfo && i < compilationInfo->messageCount; ++i)
+                {
+                    const wgpu::CompilationMessage& message = compilationInfo->messages[i];
+                    if (message.type == wgpu::CompilationMessageType::Info)
+                    {
+                        continue;
+                    }
+                    hasErrors = hasErrors || message.type == wgpu::CompilationMessageType::Error;
+                    SDL_Log("%s:%llu:%llu: %s: %.*s",
+                            name.c_str(),
+                            static_cast<unsigned long long>(message.lineNum),
+                            static_cast<unsigned long long>(message.linePos),
+                            message.type == wgpu::CompilationMessageType::Error ? "error"
+                                                                                : "warning",
+                            static_cast<int>(message.message.length),
+                            message.message.data);
+                }
+            };
+            instance.WaitAny(
+                shaderModule.GetCompilationInfo(wgpu::CallbackMode::WaitAnyOnly, callback),
+                UINT64_MAX);
+            return hasErrors ? nullptr : shaderModule;
+        }
+
+        /**
+         * Create the render pipeline of a variant, which resolves its override constants, and
+         * its depth-only pipeline
+         */
+        bool CreatePipeline(const ShaderVariants::Variant& variant,
+                            wgpu::ShaderModule shaderModule)
+        {
+            std::vector<wgpu::VertexAttribute> vertexAttribs;
+            std::array<wgpu::VertexBufferLayout, 2> vertexBufferLayouts =
+                GetVertexBufferLayouts(variant.features.vertexFormat, vertexAttribs);
+
+            std::vector<wgpu::ConstantEntry> constants(variant.constants.size());
+            for (size_t i = 0; i < constants.size(); ++i)
+            {
+                constants[i].key   = AsStringView(variant.constants[i].first);
+                constants[i].value = variant.constants[i].second;
+            }
+
+            wgpu::ColorTargetState colorTarget {};
+            colorTarget.format = wgpu::TextureFormat::BGRA8Unorm;
+
+            wgpu::FragmentState fragmentState {};
+            fragmentState.module        = shaderModule;
+            fragmentState.entryPoint    = AsStringView(variant.fragmentEntryPoint);
+            fragmentState.constantCount = constants.size();
+            fragmentState.constants     = constants.data();
+            fragmentState.targetCount   = 1;
+            fragmentState.targets       = &colorTarget;
+
+            wgpu::DepthStencilState depthStencilState {};
+            depthStencilState.format            = wgpu::TextureFormat::Depth24Plus;
+            depthStencilState.depthWriteEnabled = true;
+            depthStencilState.depthCompare      = wgpu::CompareFunction::Less;
+
+            wgpu::RenderPipelineDescriptor pipelineDesc = {};
+            pipelineDesc.vertex.module                  = shaderModule;
+            pipelineDesc.vertex.entryPoint              = AsStringView(variant.vertexEntryPoint);
+            pipelineDesc.vertex.bufferCount             = vertexBufferLayouts.size();
+            pipelineDesc.vertex.buffers                 = vertexBufferLayouts.data();
+            pipelineDesc.fragment                       = &fragmentState;
+            pipelineDesc.depthStencil                   = &depthStencilState;
+            if (!WaitForPipeline(variant, pipelineDesc))
+            {
+                return false;
+            }
+
+            const char* depthEntryPoint =
+                ShaderVariants::GetDepthEntryPoint(variant.features.vertexFormat);
+            pipelineDesc.vertex.entryPoint  = WebGPUUtils::GenerateString(depthEntryPoint);
+            pipelineDesc.vertex.bufferCount = 1;
+            pipelineDesc.fragment           = nullptr;
+            return WaitForPipeline(variant, pipelineDesc);
+        }
+
+    private:
+        bool WaitForPipeline(const ShaderVariants::Variant& variant,
+                             const wgpu::RenderPipelineDescriptor& pipelineDesc)
+        {
+            bool isValid  = false;
+            auto callback = [&variant, &isValid](wgpu::CreatePipelineAsyncStatus status,
+                                                 wgpu::RenderPipeline,
+                                                 wgpu::StringView message)
+            {
+                isValid = status == wgpu::CreatePipelineAsyncStatus::Success;
+                if (!isValid)
+                {
+                    SDL_Log("%s: %.*s",
+                            variant.sourceName.c_str(),
+                            static_cast<int>(message.length),
+                            message.data);
+                }
+            };
+            instance.WaitAny(device.CreateRenderPipelineAsync(&pipelineDesc,
+                                                              wgpu::CallbackMode::WaitAnyOnly,
+                                                              callback),
+                             UINT64_MAX);
+            return isValid;
+        }
+
+        wgpu::ShaderModule CreateShaderModule(const std::string& source)
+        {
+            wgpu::ShaderSourceWGSL shaderCodeDesc {};
+            shaderCodeDesc.code = AsStringView(source);
+
+            wgpu::ShaderModuleDescriptor shaderDesc {};
+            shaderDesc.nextInChain = &shaderCodeDesc;
+            return device.CreateShaderModule(&shaderDesc);
+        }
+
+        wgpu::Instance instance = nullptr;
+        wgpu::Device device     = nullptr;
+    };
+}  // namespace
+
+/**
+ * Expand the variants of a shader, see ShaderVariants.h, into preprocessed WGSL sources and a
+ * manifest listing the variants along with their entry points and override constants. Unless
+ * validation is skipped, every variant is compiled into a render pipeline with Dawn, and the
+ * build fails on the first invalid one. Half precision variants are left out of the manifest
+ * when the adapter cannot validate them.
+ *
+ *     shadercompiler <shader> <output directory> [--skip-validation]
+ */
+int main(int argc, char* argv[])
+{
+    if (argc < 3 || (argc == 4 && std::string_view(argv[3]) != "--skip-validation") || argc > 4)
+    {
+        SDL_Log("Usage: %s <shader> <output directory> [--skip-validation]", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path shaderPath      = argv[1];
+    std::filesystem::path outputDirectory = argv[2];
+    bool isValidated                      = argc == 3;
+
+    MappedFile file;
+    if (!file.Open(shaderPath))
+    {
+        SDL_Log("Could not read %s", shaderPath.string().c_str());
+        return EXIT_FAILURE;
+    }
+    std::string_view source(reinterpret_cast<const char*>(file.GetData()), file.GetSize());
+    std::string baseName = shaderPath.stem().string();
+
+    Validator validator;
+    if (isValidated && !validator.Initialize())
+    {
+        SDL_Log("Could not create a device to validate the shaders");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<ShaderVariants::Variant> variants;
+    std::map<std::string, wgpu::ShaderModule> shaderModules;
+    for (const ShaderVariants::Variant& variant : ShaderVariants::Enumerate(baseName))
+    {
+        if (isValidated && variant.features.f16 && !validator.HasShaderF16())
+        {
+            continue;
+        }
+
+        // Variants sharing defines share their preprocessed source
+        auto [it, isNewSource] = shaderModules.try_emplace(variant.sourceName, nullptr);
+        if (isNewSource)
+        {
+            std::string preprocessedSource;
+            if (!ShaderVariants::Preprocess(source, variant.defines, preprocessedSource)
+                || !AssetSource::WriteCacheFile(outputDirectory / variant.sourceName,
+                                                AsBytes(preprocessedSource)))
+            {
+                return EXIT_FAILURE;
+            }
+            if (isValidated)
+            {
+                it->second = validator.CompileSource(variant.sourceName, preprocessedSource);
+                if (it->second == nullptr)
+                {
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+
+        if (isValidated && !validator.CreatePipeline(variant, it->second))
+        {
+            return EXIT_FAILURE;
+        }
+        variants.push_back(variant);
+    }
+
+    std::string manifestName = ShaderVariants::GetManifestName(baseName);
+    if (!AssetSource::WriteCacheFile(outputDirectory / manifestName,
+                                     AsBytes(ShaderVariants::WriteManifest(variants))))
+    {
+        return EXIT_FAILURE;
+    }
+
+    SDL_Log("Compiled %zu variants of %s from %zu sources into %s%s",
+            variants.size(),
+            shaderPath.filename().string().c_str(),
+            shaderModules.size(),
+            outputDirectory.string().c_str(),
+            isValidated ? "" : " without validation");
+    return EXIT_SUCCESS;
+}